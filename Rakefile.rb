@@ -345,7 +345,15 @@ namespace 'build' do
 
   directory "code/compute_ch/build"
 
-  file "code/compute_ch/build/compute_ch" => ["code/compute_ch/build", "code/compute_ch/src/bin/compute_contraction_hierarchy_and_order.cpp"] do
+  file "code/compute_ch/build/compute_ch" => ["code/compute_ch/build", "code/compute_ch/src/bin/compute_contraction_hierarchy_and_order.cpp", "code/compute_ch/src/parallel_contraction_hierarchy.cpp"] do
+    Dir.chdir "code/compute_ch/build/" do
+      sh "cmake -DCMAKE_BUILD_TYPE=Release .. && make"
+    end
+  end
+
+  task :customize_ch => "code/compute_ch/build/customize_ch"
+
+  file "code/compute_ch/build/customize_ch" => ["code/compute_ch/build", "code/compute_ch/src/bin/customize_contraction_hierarchy.cpp", "code/compute_ch/src/customization.cpp"] do
     Dir.chdir "code/compute_ch/build/" do
       sh "cmake -DCMAKE_BUILD_TYPE=Release .. && make"
     end
@@ -4,6 +4,8 @@
 #include <routingkit/min_max.h>
 #include <routingkit/inverse_vector.h>
 
+#include "parallel_contraction_hierarchy.h"
+
 #include <iostream>
 #include <stdexcept>
 #include <vector>
@@ -26,30 +28,48 @@ int main(int argc, char*argv[]){
     string ch_backward_head;
     string ch_backward_weight;
 
-    if(argc != 11){
-      cerr << argv[0] << " graph_first_out graph_head graph_weight ch_order ch_forward_first_out ch_forward_head ch_forward_weight ch_backward_first_out ch_backward_head ch_backward_weight" << endl;
+    unsigned thread_count = 0;
+    bool use_witness_search = true;
+
+    vector<string>args;
+    for(int i=1; i<argc; ++i){
+      if(string(argv[i]) == "--threads" && i+1 < argc)
+        thread_count = stoul(argv[++i]);
+      else if(string(argv[i]) == "--no-witness")
+        use_witness_search = false;
+      else
+        args.push_back(argv[i]);
+    }
+
+    if(args.size() != 10){
+      cerr << argv[0] << " [--threads N] [--no-witness] graph_first_out graph_head graph_weight ch_order ch_forward_first_out ch_forward_head ch_forward_weight ch_backward_first_out ch_backward_head ch_backward_weight" << endl;
+      cerr << "Without --threads, the CH is built sequentially. With --threads N, the CH is built using N threads." << endl;
+      cerr << "With --no-witness, no shortcut is omitted because of a witness path. Only such a CH can be passed to customize_ch." << endl;
       return 1;
     }else{
-      graph_first_out = argv[1];
-      graph_head = argv[2];
-      graph_weight = argv[3];
-      ch_order = argv[4];
-      ch_forward_first_out = argv[5];
-      ch_forward_head = argv[6];
-      ch_forward_weight = argv[7];
-      ch_backward_first_out = argv[8];
-      ch_backward_head = argv[9];
-      ch_backward_weight = argv[10];
+      graph_first_out = args[0];
+      graph_head = args[1];
+      graph_weight = args[2];
+      ch_order = args[3];
+      ch_forward_first_out = args[4];
+      ch_forward_head = args[5];
+      ch_forward_weight = args[6];
+      ch_backward_first_out = args[7];
+      ch_backward_head = args[8];
+      ch_backward_weight = args[9];
     }
 
+    long long timer;
 
     cout << "Loading graph ... " << flush;
+    timer = -get_micro_time();
 
     vector<unsigned>first_out = load_vector<unsigned>(graph_first_out);
     vector<unsigned>head = load_vector<unsigned>(graph_head);
     vector<unsigned>weight = load_vector<unsigned>(graph_weight);
 
-    cout << "done" << endl;
+    timer += get_micro_time();
+    cout << "done in " << timer << "musec" << endl;
 
     const unsigned node_count = first_out.size()-1;
     const unsigned arc_count = head.size();
@@ -66,15 +86,55 @@ int main(int argc, char*argv[]){
       throw runtime_error("The weight vector must be as long as the number of arcs");
 
 
-    auto ch = ContractionHierarchy::build(node_count, invert_inverse_vector(first_out), head, weight, [](string msg){cout << msg << endl;});
-    check_contraction_hierarchy_for_errors(ch);
-    save_vector(ch_order, ch.order);
-    save_vector(ch_forward_first_out, ch.forward.first_out);
-    save_vector(ch_forward_head, ch.forward.head);
-    save_vector(ch_forward_weight, ch.forward.weight);
-    save_vector(ch_backward_first_out, ch.backward.first_out);
-    save_vector(ch_backward_head, ch.backward.head);
-    save_vector(ch_backward_weight, ch.backward.weight);
+    auto log_message = [](string msg){cout << msg << endl;};
+
+    auto save_ch = [&](const vector<unsigned>&order, const vector<unsigned>&forward_first_out, const vector<unsigned>&forward_head, const vector<unsigned>&forward_weight, const vector<unsigned>&backward_first_out, const vector<unsigned>&backward_head, const vector<unsigned>&backward_weight){
+      cout << "Saving CH ... " << flush;
+      timer = -get_micro_time();
+      save_vector(ch_order, order);
+      save_vector(ch_forward_first_out, forward_first_out);
+      save_vector(ch_forward_head, forward_head);
+      save_vector(ch_forward_weight, forward_weight);
+      save_vector(ch_backward_first_out, backward_first_out);
+      save_vector(ch_backward_head, backward_head);
+      save_vector(ch_backward_weight, backward_weight);
+      timer += get_micro_time();
+      cout << "done in " << timer << "musec" << endl;
+    };
+
+    // RoutingKit always runs witness searches, the parallel contraction is thus
+    // also used on a single thread without them.
+    if(!use_witness_search && thread_count == 0)
+      thread_count = 1;
+
+    if(thread_count == 0){
+      timer = -get_micro_time();
+      ContractionHierarchy ch = ContractionHierarchy::build(node_count, invert_inverse_vector(first_out), head, weight, log_message);
+      timer += get_micro_time();
+      cout << "Building CH took " << timer << "musec" << endl;
+
+      cout << "Checking CH ... " << flush;
+      timer = -get_micro_time();
+      check_contraction_hierarchy_for_errors(ch);
+      timer += get_micro_time();
+      cout << "done in " << timer << "musec" << endl;
+
+      save_ch(ch.order, ch.forward.first_out, ch.forward.head, ch.forward.weight, ch.backward.first_out, ch.backward.head, ch.backward.weight);
+    }else{
+      cout << "Building CH using " << thread_count << " threads" << (use_witness_search ? "" : " without witness searches") << endl;
+      timer = -get_micro_time();
+      ParallelContractionHierarchy ch = compute_parallel_contraction_hierarchy(node_count, invert_inverse_vector(first_out), head, weight, thread_count, log_message, 500, use_witness_search);
+      timer += get_micro_time();
+      cout << "Building CH took " << timer << "musec" << endl;
+
+      cout << "Checking CH ... " << flush;
+      timer = -get_micro_time();
+      check_parallel_contraction_hierarchy_for_errors(ch, invert_inverse_vector(first_out), head, weight);
+      timer += get_micro_time();
+      cout << "done in " << timer << "musec" << endl;
+
+      save_ch(ch.order, ch.forward.first_out, ch.forward.head, ch.forward.weight, ch.backward.first_out, ch.backward.head, ch.backward.weight);
+    }
 
   }catch(exception&err){
     cerr << "Stopped on exception : " << err.what() << endl;
@@ -0,0 +1,121 @@
+#include <routingkit/vector_io.h>
+#include <routingkit/timer.h>
+#include <routingkit/min_max.h>
+
+#include "customization.h"
+
+#include <omp.h>
+
+#include <iostream>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+using namespace RoutingKit;
+using namespace std;
+
+// Recomputes the weights of an existing CH for a new weight vector, see
+// customization.h. The CH must have been built using compute_ch --no-witness.
+int main(int argc, char*argv[]){
+
+  try{
+    string graph_first_out;
+    string graph_head;
+    string graph_weight;
+
+    string ch_order;
+    string ch_forward_first_out;
+    string ch_forward_head;
+    string ch_backward_first_out;
+    string ch_backward_head;
+    string ch_forward_weight;
+    string ch_backward_weight;
+
+    unsigned thread_count = thread::hardware_concurrency();
+
+    vector<string>args;
+    for(int i=1; i<argc; ++i){
+      if(string(argv[i]) == "--threads" && i+1 < argc)
+        thread_count = stoul(argv[++i]);
+      else
+        args.push_back(argv[i]);
+    }
+    if(thread_count == 0)
+      thread_count = 1;
+
+    if(args.size() != 10){
+      cerr << argv[0] << " [--threads N] graph_first_out graph_head graph_weight ch_order ch_forward_first_out ch_forward_head ch_backward_first_out ch_backward_head ch_forward_weight ch_backward_weight" << endl;
+      cerr << "Reads the order and the topology of a CH and writes its weights for the weights in graph_weight." << endl;
+      cerr << "The CH must have been built using compute_ch --no-witness." << endl;
+      return 1;
+    }else{
+      graph_first_out = args[0];
+      graph_head = args[1];
+      graph_weight = args[2];
+      ch_order = args[3];
+      ch_forward_first_out = args[4];
+      ch_forward_head = args[5];
+      ch_backward_first_out = args[6];
+      ch_backward_head = args[7];
+      ch_forward_weight = args[8];
+      ch_backward_weight = args[9];
+    }
+
+    long long timer;
+
+    cout << "Loading graph and CH ... " << flush;
+    timer = -get_micro_time();
+
+    vector<unsigned>first_out = load_vector<unsigned>(graph_first_out);
+    vector<unsigned>head = load_vector<unsigned>(graph_head);
+    vector<unsigned>weight = load_vector<unsigned>(graph_weight);
+    vector<unsigned>order = load_vector<unsigned>(ch_order);
+    vector<unsigned>forward_first_out = load_vector<unsigned>(ch_forward_first_out);
+    vector<unsigned>forward_head = load_vector<unsigned>(ch_forward_head);
+    vector<unsigned>backward_first_out = load_vector<unsigned>(ch_backward_first_out);
+    vector<unsigned>backward_head = load_vector<unsigned>(ch_backward_head);
+
+    timer += get_micro_time();
+    cout << "done in " << timer << "musec" << endl;
+
+    const unsigned node_count = first_out.size()-1;
+    const unsigned arc_count = head.size();
+
+    if(first_out.front() != 0)
+      throw runtime_error("The first element of first out must be 0.");
+    if(first_out.back() != arc_count)
+      throw runtime_error("The last element of first out must be the arc count.");
+    if(head.empty())
+      throw runtime_error("The head vector must not be empty.");
+    if(max_element_of(head) >= node_count)
+      throw runtime_error("The head vector contains an out-of-bounds node id.");
+    if(weight.size() != arc_count)
+      throw runtime_error("The weight vector must be as long as the number of arcs");
+
+    omp_set_num_threads(thread_count);
+
+    cout << "Preparing customization ... " << flush;
+    timer = -get_micro_time();
+    CHCustomization customization(first_out, head, order, forward_first_out, forward_head, backward_first_out, backward_head);
+    timer += get_micro_time();
+    cout << "done in " << timer << "musec" << endl;
+
+    cout << "Customizing " << customization.level_count() << " levels using " << thread_count << " threads ... " << flush;
+    timer = -get_micro_time();
+    vector<unsigned>forward_weight, backward_weight;
+    customization.customize(weight, forward_weight, backward_weight);
+    timer += get_micro_time();
+    cout << "done in " << timer << "musec" << endl;
+
+    cout << "Saving CH weights ... " << flush;
+    timer = -get_micro_time();
+    save_vector(ch_forward_weight, forward_weight);
+    save_vector(ch_backward_weight, backward_weight);
+    timer += get_micro_time();
+    cout << "done in " << timer << "musec" << endl;
+
+  }catch(exception&err){
+    cerr << "Stopped on exception : " << err.what() << endl;
+    return 1;
+  }
+}
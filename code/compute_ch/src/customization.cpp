@@ -0,0 +1,210 @@
+#include "customization.h"
+
+#include <routingkit/constants.h>
+
+#include <omp.h>
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+using namespace RoutingKit;
+using namespace std;
+
+// For every arc z -> x of side with z < x, x gets the lower neighbor z.
+CHCustomization::LowerNeighbors CHCustomization::compute_lower_neighbors(unsigned node_count, const vector<unsigned>&first_out, const vector<unsigned>&head){
+  LowerNeighbors n;
+  n.first.assign(node_count+1, 0);
+  for(unsigned x:head)
+    ++n.first[x+1];
+  for(unsigned x=0; x<node_count; ++x)
+    n.first[x+1] += n.first[x];
+
+  n.node.resize(head.size());
+  n.arc.resize(head.size());
+  vector<unsigned>next = n.first;
+  for(unsigned z=0; z<node_count; ++z){
+    for(unsigned zx=first_out[z]; zx<first_out[z+1]; ++zx){
+      unsigned x = head[zx];
+      n.node[next[x]] = z;
+      n.arc[next[x]] = zx;
+      ++next[x];
+    }
+  }
+  return n;
+}
+
+// Returns the position of the lower neighbor z of x in n or invalid_id.
+unsigned CHCustomization::find_lower_neighbor(const LowerNeighbors&n, unsigned x, unsigned z){
+  auto begin = n.node.begin()+n.first[x], end = n.node.begin()+n.first[x+1];
+  auto i = lower_bound(begin, end, z);
+  if(i == end || *i != z)
+    return invalid_id;
+  return i - n.node.begin();
+}
+
+// Whether the CH contains the arc x -> y of the CH graph.
+bool CHCustomization::has_ch_arc(unsigned x, unsigned y)const{
+  if(x < y)
+    return find_lower_neighbor(forward_lower, y, x) != invalid_id;
+  else
+    return find_lower_neighbor(backward_lower, x, y) != invalid_id;
+}
+
+// Returns the minimum of a_weight[a] + b_weight[b] over the common lower
+// neighbors z of x in a and of y in b, where a connects z with x and b
+// connects z with y.
+unsigned CHCustomization::relax_over_lower_triangles(
+  unsigned x, const LowerNeighbors&a, const vector<unsigned>&a_weight,
+  unsigned y, const LowerNeighbors&b, const vector<unsigned>&b_weight,
+  unsigned dist
+){
+  unsigned i = a.first[x], i_end = a.first[x+1];
+  unsigned j = b.first[y], j_end = b.first[y+1];
+  while(i != i_end && j != j_end){
+    if(a.node[i] < b.node[j]){
+      ++i;
+    }else if(a.node[i] > b.node[j]){
+      ++j;
+    }else{
+      unsigned d = a_weight[a.arc[i]] + b_weight[b.arc[j]];
+      if(d < dist)
+        dist = d;
+      ++i;
+      ++j;
+    }
+  }
+  return dist;
+}
+
+CHCustomization::CHCustomization(
+  const vector<unsigned>&first_out, const vector<unsigned>&head,
+  const vector<unsigned>&order,
+  const vector<unsigned>&forward_first_out, const vector<unsigned>&forward_head,
+  const vector<unsigned>&backward_first_out, const vector<unsigned>&backward_head
+):
+  forward_first_out(forward_first_out), forward_head(forward_head),
+  backward_first_out(backward_first_out), backward_head(backward_head){
+
+  const unsigned node_count = order.size();
+
+  if(first_out.size() != node_count+1)
+    throw runtime_error("The order does not match the graph.");
+
+  vector<unsigned>rank(node_count, invalid_id);
+  for(unsigned r=0; r<node_count; ++r){
+    if(order[r] >= node_count || rank[order[r]] != invalid_id)
+      throw runtime_error("The order must be a permutation of the nodes.");
+    rank[order[r]] = r;
+  }
+
+  for(auto side:{make_pair(&forward_first_out, &forward_head), make_pair(&backward_first_out, &backward_head)}){
+    const vector<unsigned>&ch_first_out = *side.first;
+    const vector<unsigned>&ch_head = *side.second;
+    if(ch_first_out.size() != node_count+1 || ch_first_out.front() != 0 || ch_first_out.back() != ch_head.size())
+      throw runtime_error("The CH first out vectors do not match the graph.");
+    for(unsigned x=0; x<node_count; ++x)
+      for(unsigned xy=ch_first_out[x]; xy<ch_first_out[x+1]; ++xy)
+        if(ch_head[xy] <= x || ch_head[xy] >= node_count)
+          throw runtime_error("The CH contains an arc that does not go to a higher ranked node.");
+  }
+
+  forward_lower = compute_lower_neighbors(node_count, forward_first_out, forward_head);
+  backward_lower = compute_lower_neighbors(node_count, backward_first_out, backward_head);
+
+  // Forward arcs x -> y with x < y are arcs x -> y of the CH graph. Backward arcs
+  // x -> y with x < y are arcs y -> x.
+  ch_arc.assign(head.size(), invalid_id);
+  is_forward_arc.assign(head.size(), false);
+  for(unsigned u=0; u<node_count; ++u){
+    for(unsigned uv=first_out[u]; uv<first_out[u+1]; ++uv){
+      unsigned x = rank[u];
+      unsigned y = rank[head[uv]];
+      if(x == y)
+        continue;
+      unsigned i;
+      if(x < y){
+        i = find_lower_neighbor(forward_lower, y, x);
+        if(i != invalid_id)
+          ch_arc[uv] = forward_lower.arc[i];
+        is_forward_arc[uv] = true;
+      }else{
+        i = find_lower_neighbor(backward_lower, x, y);
+        if(i != invalid_id)
+          ch_arc[uv] = backward_lower.arc[i];
+      }
+      if(i == invalid_id)
+        throw runtime_error("The arc "+to_string(uv)+" of the graph is not part of the CH. Build the CH using compute_ch --no-witness.");
+    }
+  }
+
+  // Contracting x requires the arc u -> v for all upward arcs u -> x and x -> v.
+  bool is_closed = true;
+  #pragma omp parallel for schedule(dynamic, 64) reduction(&&:is_closed)
+  for(unsigned x=0; x<node_count; ++x)
+    for(unsigned xu=backward_first_out[x]; xu<backward_first_out[x+1]; ++xu)
+      for(unsigned xv=forward_first_out[x]; xv<forward_first_out[x+1]; ++xv)
+        if(backward_head[xu] != forward_head[xv] && !has_ch_arc(backward_head[xu], forward_head[xv]))
+          is_closed = false;
+  if(!is_closed)
+    throw runtime_error("The CH lacks shortcuts that were omitted because of witness paths. Build the CH using compute_ch --no-witness.");
+
+  vector<unsigned>level(node_count, 0);
+  unsigned level_count = 0;
+  for(unsigned x=0; x<node_count; ++x){
+    for(auto lower:{&forward_lower, &backward_lower})
+      for(unsigned i=lower->first[x]; i<lower->first[x+1]; ++i)
+        level[x] = max(level[x], level[lower->node[i]]+1);
+    level_count = max(level_count, level[x]+1);
+  }
+  first_node_of_level.assign(level_count+1, 0);
+  for(unsigned x=0; x<node_count; ++x)
+    ++first_node_of_level[level[x]+1];
+  for(unsigned l=0; l<level_count; ++l)
+    first_node_of_level[l+1] += first_node_of_level[l];
+  nodes_by_level.resize(node_count);
+  {
+    vector<unsigned>next = first_node_of_level;
+    for(unsigned x=0; x<node_count; ++x)
+      nodes_by_level[next[level[x]]++] = x;
+  }
+}
+
+void CHCustomization::customize(const vector<unsigned>&weight, vector<unsigned>&forward_weight, vector<unsigned>&backward_weight)const{
+  if(weight.size() != ch_arc.size())
+    throw runtime_error("The weight vector must be as long as the number of arcs");
+
+  forward_weight.assign(forward_head.size(), inf_weight);
+  backward_weight.assign(backward_head.size(), inf_weight);
+  for(unsigned uv=0; uv<weight.size(); ++uv){
+    if(ch_arc[uv] == invalid_id)
+      continue;
+    unsigned w = min(weight[uv], inf_weight);
+    if(is_forward_arc[uv])
+      forward_weight[ch_arc[uv]] = min(forward_weight[ch_arc[uv]], w);
+    else
+      backward_weight[ch_arc[uv]] = min(backward_weight[ch_arc[uv]], w);
+  }
+
+  for(unsigned l=0; l<level_count(); ++l){
+    #pragma omp parallel for schedule(dynamic, 64)
+    for(unsigned i=first_node_of_level[l]; i<first_node_of_level[l+1]; ++i){
+      unsigned x = nodes_by_level[i];
+      // Forward arc x -> y: path x -> z -> y.
+      for(unsigned xy=forward_first_out[x]; xy<forward_first_out[x+1]; ++xy)
+        forward_weight[xy] = relax_over_lower_triangles(
+          x, backward_lower, backward_weight,
+          forward_head[xy], forward_lower, forward_weight,
+          forward_weight[xy]
+        );
+      // Backward arc x -> y: path y -> z -> x.
+      for(unsigned xy=backward_first_out[x]; xy<backward_first_out[x+1]; ++xy)
+        backward_weight[xy] = relax_over_lower_triangles(
+          x, forward_lower, forward_weight,
+          backward_head[xy], backward_lower, backward_weight,
+          backward_weight[xy]
+        );
+    }
+  }
+}
@@ -0,0 +1,76 @@
+#ifndef CUSTOMIZATION_H
+#define CUSTOMIZATION_H
+
+#include <vector>
+
+// Recomputes the weights of an existing CH for a new weight vector. The order and
+// the shortcut topology of the CH are kept, only the forward and the backward
+// weights are computed. The CH is given in the layout of the files written by
+// compute_ch, see ParallelContractionHierarchy.
+//
+// Every CH arc first gets the weight of the original arc it represents, if any.
+// Then the arcs are relaxed over their lower triangles: the arc between x and y
+// can also be taken as a path over a node z that is lower ranked than x and y.
+// The arcs of x only depend on arcs of lower ranked nodes. All nodes of the same
+// level, where the level of x is one more than the maximum level of its lower
+// neighbors, are thus processed in parallel.
+//
+// The customized weights are exact distances only if the topology contains every
+// shortcut that the new weights may need. This is the case if every arc of the
+// graph is in the CH and if for every node x and all neighbors u -> x and x -> v
+// with u != v that are higher ranked than x, the CH contains the arc u -> v. A CH
+// built with witness searches does not fulfill this in general, because a witness
+// for the old weights can be longer with the new weights. The constructor throws
+// a std::runtime_error for such a CH. Use compute_ch --no-witness to build one
+// that can be customized.
+class CHCustomization{
+public:
+  CHCustomization(
+    const std::vector<unsigned>&first_out, const std::vector<unsigned>&head,
+    const std::vector<unsigned>&order,
+    const std::vector<unsigned>&forward_first_out, const std::vector<unsigned>&forward_head,
+    const std::vector<unsigned>&backward_first_out, const std::vector<unsigned>&backward_head
+  );
+
+  // Computes forward_weight and backward_weight for the graph weights weight. The
+  // nodes of a level are processed by the OpenMP threads.
+  void customize(const std::vector<unsigned>&weight, std::vector<unsigned>&forward_weight, std::vector<unsigned>&backward_weight)const;
+
+  unsigned level_count()const{
+    return first_node_of_level.size()-1;
+  }
+
+private:
+  // Lower neighbors of a node in rank space together with the arc that connects
+  // them. The neighbors of every node are ordered by rank.
+  struct LowerNeighbors{
+    std::vector<unsigned>first;
+    std::vector<unsigned>node;
+    std::vector<unsigned>arc;
+  };
+
+  static LowerNeighbors compute_lower_neighbors(unsigned node_count, const std::vector<unsigned>&first_out, const std::vector<unsigned>&head);
+  static unsigned find_lower_neighbor(const LowerNeighbors&n, unsigned x, unsigned z);
+  bool has_ch_arc(unsigned x, unsigned y)const;
+
+  static unsigned relax_over_lower_triangles(
+    unsigned x, const LowerNeighbors&a, const std::vector<unsigned>&a_weight,
+    unsigned y, const LowerNeighbors&b, const std::vector<unsigned>&b_weight,
+    unsigned dist
+  );
+
+  std::vector<unsigned>forward_first_out, forward_head;
+  std::vector<unsigned>backward_first_out, backward_head;
+  LowerNeighbors forward_lower, backward_lower;
+
+  // For every arc of the graph the CH arc that represents it. Arcs that go to a
+  // higher ranked node are in the forward side, the others in the backward side.
+  // Loops have no CH arc.
+  std::vector<unsigned>ch_arc;
+  std::vector<char>is_forward_arc;
+
+  std::vector<unsigned>first_node_of_level;
+  std::vector<unsigned>nodes_by_level;
+};
+
+#endif
@@ -0,0 +1,509 @@
+#include "parallel_contraction_hierarchy.h"
+
+#include <routingkit/constants.h>
+#include <routingkit/timer.h>
+
+#include <omp.h>
+
+#include <algorithm>
+#include <cstdint>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace RoutingKit;
+using namespace std;
+
+namespace{
+
+struct Arc{
+  unsigned node;
+  unsigned weight;
+};
+
+struct Shortcut{
+  unsigned tail;
+  unsigned head;
+  unsigned weight;
+};
+
+unsigned add_weights(unsigned l, unsigned r){
+  uint64_t sum = static_cast<uint64_t>(l) + r;
+  if(sum >= inf_weight)
+    return inf_weight;
+  else
+    return sum;
+}
+
+// Graph of the nodes that are not yet contracted. Parallel arcs are merged. The
+// arcs of a contracted node are no longer changed.
+struct DynamicGraph{
+  vector<vector<Arc>>out, in;
+
+  void add_arc(unsigned u, unsigned v, unsigned w){
+    for(auto&a:out[u]){
+      if(a.node == v){
+        if(w < a.weight){
+          a.weight = w;
+          for(auto&b:in[v])
+            if(b.node == u)
+              b.weight = w;
+        }
+        return;
+      }
+    }
+    out[u].push_back({v, w});
+    in[v].push_back({u, w});
+  }
+
+  // Removes the arcs of the other nodes that point to x. The arcs of x are kept,
+  // they are the upward arcs of x in the CH.
+  void detach_node(unsigned x){
+    auto erase_arcs_to = [](vector<Arc>&arcs, unsigned node){
+      arcs.erase(remove_if(arcs.begin(), arcs.end(), [&](const Arc&a){return a.node == node;}), arcs.end());
+    };
+    for(auto&a:out[x])
+      erase_arcs_to(in[a.node], x);
+    for(auto&a:in[x])
+      erase_arcs_to(out[a.node], x);
+  }
+};
+
+// Dijkstra search with a bounded number of pops. It is used to look for witness
+// paths. Every thread has its own instance.
+class WitnessSearch{
+public:
+  explicit WitnessSearch(unsigned node_count):
+    dist(node_count, inf_weight){}
+
+  template<class IsBlocked>
+  void run(const DynamicGraph&g, unsigned s, unsigned max_dist, unsigned max_pop_count, const IsBlocked&is_blocked){
+    for(auto x:touched)
+      dist[x] = inf_weight;
+    touched.clear();
+    queue.clear();
+
+    dist[s] = 0;
+    touched.push_back(s);
+    push(0, s);
+
+    unsigned pop_count = 0;
+    while(!queue.empty()){
+      pop_heap(queue.begin(), queue.end(), greater<pair<unsigned, unsigned>>());
+      unsigned x_dist = queue.back().first;
+      unsigned x = queue.back().second;
+      queue.pop_back();
+
+      if(x_dist != dist[x])
+        continue;
+      if(x_dist > max_dist)
+        break;
+      if(++pop_count > max_pop_count)
+        break;
+
+      for(auto&a:g.out[x]){
+        unsigned y = a.node;
+        if(is_blocked(y))
+          continue;
+        unsigned y_dist = add_weights(x_dist, a.weight);
+        if(y_dist > max_dist)
+          continue;
+        if(y_dist < dist[y]){
+          if(dist[y] == inf_weight)
+            touched.push_back(y);
+          dist[y] = y_dist;
+          push(y_dist, y);
+        }
+      }
+    }
+  }
+
+  unsigned get_distance(unsigned x)const{
+    return dist[x];
+  }
+
+private:
+  void push(unsigned key, unsigned x){
+    queue.push_back({key, x});
+    push_heap(queue.begin(), queue.end(), greater<pair<unsigned, unsigned>>());
+  }
+
+  vector<unsigned>dist;
+  vector<unsigned>touched;
+  vector<pair<unsigned, unsigned>>queue;
+};
+
+// Appends the shortcuts that are needed when x is contracted. Without
+// witness_search, every pair of neighbors gets a shortcut.
+template<class IsBlocked>
+void find_shortcuts(const DynamicGraph&g, unsigned x, WitnessSearch*witness_search, unsigned max_pop_count, const IsBlocked&is_blocked, vector<Shortcut>&shortcuts){
+  for(auto&ux:g.in[x]){
+    unsigned u = ux.node;
+
+    if(witness_search == nullptr){
+      for(auto&xv:g.out[x])
+        if(xv.node != u)
+          shortcuts.push_back({u, xv.node, add_weights(ux.weight, xv.weight)});
+      continue;
+    }
+
+    // Arcs of weight 0 are allowed, so max_dist can be 0 even if shortcuts
+    // are needed.
+    bool has_target = false;
+    unsigned max_dist = 0;
+    for(auto&xv:g.out[x]){
+      if(xv.node != u){
+        has_target = true;
+        max_dist = max(max_dist, add_weights(ux.weight, xv.weight));
+      }
+    }
+    if(!has_target)
+      continue;
+
+    witness_search->run(g, u, max_dist, max_pop_count, [&](unsigned y){return y == x || is_blocked(y);});
+
+    for(auto&xv:g.out[x]){
+      unsigned v = xv.node;
+      if(v == u)
+        continue;
+      unsigned uv_weight = add_weights(ux.weight, xv.weight);
+      if(witness_search->get_distance(v) > uv_weight)
+        shortcuts.push_back({u, v, uv_weight});
+    }
+  }
+}
+
+unsigned hash_node(unsigned x){
+  return static_cast<uint32_t>(x * 2654435761u);
+}
+
+// Builds one side of the CH from the arcs that the nodes had when they were
+// contracted.
+void build_side(const vector<vector<Arc>>&arcs, const vector<unsigned>&rank, const vector<unsigned>&order, ParallelContractionHierarchy::Side&side){
+  unsigned node_count = order.size();
+  side.first_out.assign(node_count+1, 0);
+  for(unsigned x=0; x<node_count; ++x)
+    side.first_out[x+1] = side.first_out[x] + arcs[order[x]].size();
+  side.head.resize(side.first_out[node_count]);
+  side.weight.resize(side.first_out[node_count]);
+
+  #pragma omp parallel
+  {
+    vector<Arc>sorted_arcs;
+    #pragma omp for schedule(dynamic, 1024)
+    for(unsigned x=0; x<node_count; ++x){
+      sorted_arcs.clear();
+      for(auto&a:arcs[order[x]])
+        sorted_arcs.push_back({rank[a.node], a.weight});
+      sort(sorted_arcs.begin(), sorted_arcs.end(), [](const Arc&l, const Arc&r){return l.node < r.node;});
+      unsigned xy = side.first_out[x];
+      for(auto&a:sorted_arcs){
+        side.head[xy] = a.node;
+        side.weight[xy] = a.weight;
+        ++xy;
+      }
+    }
+  }
+}
+
+}
+
+ParallelContractionHierarchy compute_parallel_contraction_hierarchy(
+  unsigned node_count,
+  const vector<unsigned>&tail, const vector<unsigned>&head, const vector<unsigned>&weight,
+  unsigned thread_count,
+  const function<void(string)>&log_message,
+  unsigned max_pop_count,
+  bool use_witness_search
+){
+  if(thread_count == 0)
+    thread_count = 1;
+  omp_set_num_threads(thread_count);
+
+  long long timer = -get_micro_time();
+
+  // Time spent in the parallel and in the sequential phases of the rounds
+  long long priority_time = 0, selection_time = 0, contraction_time = 0, update_time = 0;
+  long long phase_timer;
+
+  phase_timer = -get_micro_time();
+  DynamicGraph g;
+  g.out.resize(node_count);
+  g.in.resize(node_count);
+  // Without witness searches, the topology must contain every arc, even those
+  // that are unusable for the current weights.
+  for(unsigned xy=0; xy<tail.size(); ++xy)
+    if(tail[xy] != head[xy] && (weight[xy] < inf_weight || !use_witness_search))
+      g.add_arc(tail[xy], head[xy], min(weight[xy], inf_weight));
+  long long build_time = phase_timer + get_micro_time();
+
+  vector<WitnessSearch>witness_search(use_witness_search ? thread_count : 0, WitnessSearch(node_count));
+  auto get_witness_search = [&]()->WitnessSearch*{
+    if(use_witness_search)
+      return &witness_search[omp_get_thread_num()];
+    else
+      return nullptr;
+  };
+  vector<vector<Shortcut>>thread_shortcuts(thread_count);
+
+  ParallelContractionHierarchy ch;
+  vector<unsigned>&rank = ch.rank;
+  rank.assign(node_count, invalid_id);
+  vector<unsigned>level(node_count, 0);
+  vector<long long>priority(node_count, 0);
+  vector<char>needs_update(node_count, true);
+  vector<char>is_contracted(node_count, false);
+
+  auto is_less = [&](unsigned x, unsigned y){
+    if(priority[x] != priority[y])
+      return priority[x] < priority[y];
+    if(hash_node(x) != hash_node(y))
+      return hash_node(x) < hash_node(y);
+    return x < y;
+  };
+
+  vector<unsigned>remaining(node_count);
+  for(unsigned x=0; x<node_count; ++x)
+    remaining[x] = x;
+
+  vector<char>is_selected(node_count, false);
+  vector<unsigned>selected;
+  vector<vector<Shortcut>>shortcuts_of_selected;
+
+  unsigned next_rank = 0;
+  unsigned round = 0;
+  unsigned long long shortcut_count = 0;
+
+  if(log_message)
+    log_message("Built dynamic graph in "+to_string(build_time)+"musec");
+
+  while(!remaining.empty()){
+    // Recompute the priorities of all nodes whose neighborhood changed by simulating their contraction.
+    phase_timer = -get_micro_time();
+    #pragma omp parallel for schedule(dynamic, 64)
+    for(unsigned i=0; i<remaining.size(); ++i){
+      unsigned x = remaining[i];
+      if(needs_update[x]){
+        auto&shortcuts = thread_shortcuts[omp_get_thread_num()];
+        shortcuts.clear();
+        find_shortcuts(g, x, get_witness_search(), max_pop_count, [](unsigned){return false;}, shortcuts);
+        priority[x] = 2*static_cast<long long>(shortcuts.size()) - static_cast<long long>(g.in[x].size() + g.out[x].size()) + level[x];
+        needs_update[x] = false;
+      }
+    }
+    priority_time += phase_timer + get_micro_time();
+
+    // Select the nodes that are local minima in their neighborhood.
+    phase_timer = -get_micro_time();
+    #pragma omp parallel for schedule(dynamic, 1024)
+    for(unsigned i=0; i<remaining.size(); ++i){
+      unsigned x = remaining[i];
+      bool is_minimum = true;
+      for(auto&a:g.out[x])
+        if(!is_less(x, a.node))
+          is_minimum = false;
+      for(auto&a:g.in[x])
+        if(!is_less(x, a.node))
+          is_minimum = false;
+      is_selected[x] = is_minimum;
+    }
+    selection_time += phase_timer + get_micro_time();
+
+    phase_timer = -get_micro_time();
+    selected.clear();
+    for(unsigned x:remaining){
+      if(is_selected[x]){
+        selected.push_back(x);
+        is_contracted[x] = true;
+      }
+    }
+    update_time += phase_timer + get_micro_time();
+
+    // Contract the independent set. Witness paths must not use the other nodes of the set.
+    phase_timer = -get_micro_time();
+    shortcuts_of_selected.resize(selected.size());
+    #pragma omp parallel for schedule(dynamic, 16)
+    for(unsigned i=0; i<selected.size(); ++i){
+      shortcuts_of_selected[i].clear();
+      find_shortcuts(g, selected[i], get_witness_search(), max_pop_count, [&](unsigned y){return is_contracted[y] != 0;}, shortcuts_of_selected[i]);
+    }
+    contraction_time += phase_timer + get_micro_time();
+
+    // All remaining neighbors of a selected node are contracted in later rounds.
+    // The arcs to them are thus the upward arcs of the node and stay with it.
+    phase_timer = -get_micro_time();
+    for(unsigned x:selected){
+      rank[x] = next_rank++;
+      for(auto&a:g.out[x]){
+        level[a.node] = max(level[a.node], level[x]+1);
+        needs_update[a.node] = true;
+      }
+      for(auto&a:g.in[x]){
+        level[a.node] = max(level[a.node], level[x]+1);
+        needs_update[a.node] = true;
+      }
+      g.detach_node(x);
+      is_selected[x] = false;
+    }
+
+    unsigned round_shortcut_count = 0;
+    for(auto&shortcuts:shortcuts_of_selected){
+      for(auto&s:shortcuts)
+        g.add_arc(s.tail, s.head, s.weight);
+      round_shortcut_count += shortcuts.size();
+    }
+    shortcut_count += round_shortcut_count;
+
+    remaining.erase(remove_if(remaining.begin(), remaining.end(), [&](unsigned x){return is_contracted[x] != 0;}), remaining.end());
+    update_time += phase_timer + get_micro_time();
+
+    ++round;
+    if(log_message)
+      log_message(
+        "Round "+to_string(round)+" contracted "+to_string(selected.size())+" nodes and inserted "+to_string(round_shortcut_count)+" shortcuts, "
+        +to_string(remaining.size())+" nodes remain, "+to_string(timer+get_micro_time())+"musec elapsed"
+      );
+  }
+
+  phase_timer = -get_micro_time();
+  ch.order.resize(node_count);
+  for(unsigned x=0; x<node_count; ++x)
+    ch.order[rank[x]] = x;
+  build_side(g.out, rank, ch.order, ch.forward);
+  build_side(g.in, rank, ch.order, ch.backward);
+  long long assembly_time = phase_timer + get_micro_time();
+
+  timer += get_micro_time();
+  if(log_message){
+    log_message("Computed CH in "+to_string(round)+" rounds with "+to_string(shortcut_count)+" shortcuts in "+to_string(timer)+"musec");
+    long long sequential_time = build_time + update_time;
+    log_message(
+      "Parallel phases: priorities "+to_string(priority_time)+"musec, selection "+to_string(selection_time)+"musec, "
+      "contraction "+to_string(contraction_time)+"musec, CH assembly "+to_string(assembly_time)+"musec"
+    );
+    log_message(
+      "Sequential phases: graph building "+to_string(build_time)+"musec, graph update "+to_string(update_time)+"musec, "
+      "that is "+to_string(timer == 0 ? 0 : 100*sequential_time/timer)+"% of the running time"
+    );
+  }
+
+  return ch;
+}
+
+namespace{
+
+// Computes the distances from s to all nodes in rank space. The forward arcs are
+// relaxed in increasing rank order and afterwards the backward arcs in decreasing
+// rank order. No queue is needed as the CH graph is acyclic.
+void compute_ch_distances_from(const ParallelContractionHierarchy&ch, unsigned s, vector<unsigned>&dist){
+  unsigned node_count = ch.rank.size();
+  dist.assign(node_count, inf_weight);
+  dist[ch.rank[s]] = 0;
+  for(unsigned x=ch.rank[s]; x<node_count; ++x)
+    if(dist[x] != inf_weight)
+      for(unsigned xy=ch.forward.first_out[x]; xy<ch.forward.first_out[x+1]; ++xy)
+        dist[ch.forward.head[xy]] = min(dist[ch.forward.head[xy]], add_weights(dist[x], ch.forward.weight[xy]));
+  for(unsigned x=node_count; x-->0;)
+    for(unsigned xy=ch.backward.first_out[x]; xy<ch.backward.first_out[x+1]; ++xy)
+      dist[x] = min(dist[x], add_weights(dist[ch.backward.head[xy]], ch.backward.weight[xy]));
+}
+
+void compute_dijkstra_distances_from(const vector<unsigned>&first_out, const vector<unsigned>&head, const vector<unsigned>&weight, unsigned s, vector<unsigned>&dist){
+  dist.assign(first_out.size()-1, inf_weight);
+  priority_queue<pair<unsigned, unsigned>, vector<pair<unsigned, unsigned>>, greater<pair<unsigned, unsigned>>>queue;
+  dist[s] = 0;
+  queue.push({0, s});
+  while(!queue.empty()){
+    auto top = queue.top();
+    queue.pop();
+    unsigned x = top.second;
+    if(top.first != dist[x])
+      continue;
+    for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
+      unsigned d = add_weights(dist[x], weight[xy]);
+      if(d < dist[head[xy]]){
+        dist[head[xy]] = d;
+        queue.push({d, head[xy]});
+      }
+    }
+  }
+}
+
+} // namespace
+
+void check_parallel_contraction_hierarchy_for_errors(
+  const ParallelContractionHierarchy&ch,
+  const vector<unsigned>&tail, const vector<unsigned>&head, const vector<unsigned>&weight,
+  unsigned source_count
+){
+  unsigned node_count = ch.rank.size();
+  if(ch.order.size() != node_count)
+    throw runtime_error("The CH rank and order have different sizes.");
+  for(unsigned x=0; x<node_count; ++x)
+    if(ch.rank[x] >= node_count || ch.order[ch.rank[x]] != x)
+      throw runtime_error("The CH order is not the inverse of the rank.");
+  for(auto side:{&ch.forward, &ch.backward}){
+    if(side->first_out.size() != node_count+1 || side->first_out.back() != side->head.size() || side->weight.size() != side->head.size())
+      throw runtime_error("The CH arrays have inconsistent sizes.");
+    for(unsigned x=0; x<node_count; ++x)
+      for(unsigned xy=side->first_out[x]; xy<side->first_out[x+1]; ++xy)
+        if(side->head[xy] <= x || side->head[xy] >= node_count)
+          throw runtime_error("The CH contains an arc that does not go to a higher ranked node.");
+  }
+  if(tail.size() != head.size() || weight.size() != head.size())
+    throw runtime_error("The graph arrays have inconsistent sizes.");
+
+  vector<unsigned>first_out(node_count+1, 0);
+  for(unsigned x:tail){
+    if(x >= node_count)
+      throw runtime_error("The graph has a different node count than the CH.");
+    ++first_out[x+1];
+  }
+  for(unsigned x=0; x<node_count; ++x)
+    first_out[x+1] += first_out[x];
+  vector<unsigned>sorted_head(head.size()), sorted_weight(head.size());
+  {
+    vector<unsigned>next_out(first_out.begin(), first_out.end()-1);
+    for(unsigned xy=0; xy<head.size(); ++xy){
+      unsigned pos = next_out[tail[xy]]++;
+      sorted_head[pos] = head[xy];
+      sorted_weight[pos] = weight[xy];
+    }
+  }
+
+  vector<unsigned>sources;
+  if(source_count >= node_count){
+    for(unsigned x=0; x<node_count; ++x)
+      sources.push_back(x);
+  }else{
+    mt19937 gen(42);
+    for(unsigned i=0; i<source_count; ++i)
+      sources.push_back(gen() % node_count);
+  }
+
+  string error;
+  #pragma omp parallel
+  {
+    vector<unsigned>ch_dist, dijkstra_dist;
+    #pragma omp for schedule(dynamic)
+    for(unsigned i=0; i<sources.size(); ++i){
+      unsigned s = sources[i];
+      compute_ch_distances_from(ch, s, ch_dist);
+      compute_dijkstra_distances_from(first_out, sorted_head, sorted_weight, s, dijkstra_dist);
+      for(unsigned t=0; t<node_count; ++t){
+        if(ch_dist[ch.rank[t]] != dijkstra_dist[t]){
+          #pragma omp critical
+          if(error.empty())
+            error = "The CH distance from "+to_string(s)+" to "+to_string(t)+" is "+to_string(ch_dist[ch.rank[t]])+" but Dijkstra's algorithm finds "+to_string(dijkstra_dist[t])+".";
+          break;
+        }
+      }
+    }
+  }
+  if(!error.empty())
+    throw runtime_error(error);
+}
@@ -0,0 +1,56 @@
+#ifndef PARALLEL_CONTRACTION_HIERARCHY_H
+#define PARALLEL_CONTRACTION_HIERARCHY_H
+
+#include <functional>
+#include <string>
+#include <vector>
+
+// A CH in the layout of the files written by compute_ch. Nodes are identified by
+// their rank. The forward side contains an arc x -> y with x < y for every arc
+// x -> y of the CH graph and the backward side contains an arc x -> y with x < y
+// for every arc y -> x. The arcs of every node are ordered by head.
+struct ParallelContractionHierarchy{
+  struct Side{
+    std::vector<unsigned>first_out;
+    std::vector<unsigned>head;
+    std::vector<unsigned>weight;
+  };
+
+  std::vector<unsigned>rank;
+  std::vector<unsigned>order;
+  Side forward;
+  Side backward;
+};
+
+// Computes a CH using thread_count threads. In every round, the priorities of all
+// nodes whose neighborhood changed are recomputed in parallel by simulating their
+// contraction. Then, all nodes whose priority is smaller than the priority of all
+// their neighbors form an independent set and are contracted concurrently. The
+// witness searches of a round only use nodes that are not contracted in the same
+// round. The arcs that a node has when it is contracted are its upward arcs in the
+// CH, so no second contraction pass is needed.
+//
+// Without witness searches, every pair of neighbors of a contracted node gets a
+// shortcut. The topology then does not depend on the weights and can be
+// customized for other weights, see customization.h.
+ParallelContractionHierarchy compute_parallel_contraction_hierarchy(
+  unsigned node_count,
+  const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&weight,
+  unsigned thread_count,
+  const std::function<void(std::string)>&log_message = std::function<void(std::string)>(),
+  unsigned max_pop_count = 500,
+  bool use_witness_search = true
+);
+
+// Checks that the arrays of the CH are consistent and that every arc goes to a
+// higher ranked node. Further, the CH distances from source_count random sources
+// to all targets are compared with Dijkstra's algorithm on the input graph. All
+// sources are checked if source_count is at least node_count. Throws a
+// std::runtime_error if an error is found.
+void check_parallel_contraction_hierarchy_for_errors(
+  const ParallelContractionHierarchy&ch,
+  const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&weight,
+  unsigned source_count = 8
+);
+
+#endif
@@ -0,0 +1,148 @@
+#include "catch.hpp"
+
+#include "customization.h"
+#include "parallel_contraction_hierarchy.h"
+
+#include <routingkit/constants.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <utility>
+#include <vector>
+
+using namespace RoutingKit;
+using namespace std;
+
+namespace{
+
+struct Graph{
+  vector<unsigned>first_out;
+  vector<unsigned>tail;
+  vector<unsigned>head;
+};
+
+// Sorts the arcs by tail. The permutation is applied to weight.
+Graph sort_arcs(unsigned node_count, vector<unsigned>tail, vector<unsigned>head, vector<unsigned>&weight){
+  vector<unsigned>p(tail.size());
+  for(unsigned i=0; i<p.size(); ++i)
+    p[i] = i;
+  stable_sort(p.begin(), p.end(), [&](unsigned l, unsigned r){return tail[l] < tail[r];});
+
+  Graph g;
+  g.first_out.assign(node_count+1, 0);
+  vector<unsigned>sorted_weight;
+  for(unsigned i:p){
+    g.tail.push_back(tail[i]);
+    g.head.push_back(head[i]);
+    sorted_weight.push_back(weight[i]);
+    ++g.first_out[tail[i]+1];
+  }
+  for(unsigned x=0; x<node_count; ++x)
+    g.first_out[x+1] += g.first_out[x];
+  weight = move(sorted_weight);
+  return g;
+}
+
+vector<unsigned> dijkstra(const vector<unsigned>&first_out, const vector<unsigned>&head, const vector<unsigned>&weight, unsigned s){
+  vector<unsigned>dist(first_out.size()-1, inf_weight);
+  priority_queue<pair<unsigned, unsigned>, vector<pair<unsigned, unsigned>>, greater<pair<unsigned, unsigned>>>queue;
+  dist[s] = 0;
+  queue.push({0, s});
+  while(!queue.empty()){
+    unsigned x_dist = queue.top().first;
+    unsigned x = queue.top().second;
+    queue.pop();
+    if(x_dist != dist[x])
+      continue;
+    for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
+      if(weight[xy] >= inf_weight)
+        continue;
+      unsigned y_dist = x_dist + weight[xy];
+      if(y_dist < dist[head[xy]]){
+        dist[head[xy]] = y_dist;
+        queue.push({y_dist, head[xy]});
+      }
+    }
+  }
+  return dist;
+}
+
+// Distance from s to t in the CH: the minimum over all meeting nodes of the
+// upward searches from s in the forward and from t in the backward side.
+unsigned ch_distance(const ParallelContractionHierarchy&ch, const vector<unsigned>&forward_weight, const vector<unsigned>&backward_weight, unsigned s, unsigned t){
+  vector<unsigned>forward_dist = dijkstra(ch.forward.first_out, ch.forward.head, forward_weight, ch.rank[s]);
+  vector<unsigned>backward_dist = dijkstra(ch.backward.first_out, ch.backward.head, backward_weight, ch.rank[t]);
+  unsigned dist = inf_weight;
+  for(unsigned x=0; x<forward_dist.size(); ++x)
+    if(forward_dist[x] != inf_weight && backward_dist[x] != inf_weight)
+      dist = min(dist, forward_dist[x] + backward_dist[x]);
+  return dist;
+}
+
+void require_exact_distances(unsigned node_count, const Graph&g, const vector<unsigned>&weight, const ParallelContractionHierarchy&ch){
+  CHCustomization customization(g.first_out, g.head, ch.order, ch.forward.first_out, ch.forward.head, ch.backward.first_out, ch.backward.head);
+  vector<unsigned>forward_weight, backward_weight;
+  customization.customize(weight, forward_weight, backward_weight);
+
+  for(unsigned s=0; s<node_count; ++s){
+    vector<unsigned>dist = dijkstra(g.first_out, g.head, weight, s);
+    for(unsigned t=0; t<node_count; ++t)
+      REQUIRE(ch_distance(ch, forward_weight, backward_weight, s, t) == dist[t]);
+  }
+}
+
+}
+
+// Nodes x, a, b, c are ranked in this order. With the old weights, the path
+// a -> c -> b is a witness for a -> x -> b. If a -> c gets longer, the shortcut
+// a -> b is needed.
+TEST_CASE("CustomizationWithLongerWitness", "[Customization]"){
+  const unsigned x = 0, a = 1, b = 2, c = 3;
+  vector<unsigned>old_weight = {1, 1, 1, 1};
+  Graph g = sort_arcs(4, {a, x, a, c}, {x, b, c, b}, old_weight);
+  vector<unsigned>new_weight = old_weight;
+  for(unsigned xy=0; xy<g.head.size(); ++xy)
+    if(g.tail[xy] == a && g.head[xy] == c)
+      new_weight[xy] = 10;
+
+  SECTION("WitnessPrunedTopologyIsRejected"){
+    vector<unsigned>order = {x, a, b, c};
+    vector<unsigned>forward_first_out = {0, 1, 2, 2, 2}, forward_head = {b, c};
+    vector<unsigned>backward_first_out = {0, 1, 1, 2, 2}, backward_head = {a, c};
+    REQUIRE_THROWS_AS(
+      CHCustomization(g.first_out, g.head, order, forward_first_out, forward_head, backward_first_out, backward_head),
+      std::runtime_error
+    );
+  }
+
+  SECTION("WitnessFreeTopologyIsExact"){
+    ParallelContractionHierarchy ch = compute_parallel_contraction_hierarchy(4, g.tail, g.head, old_weight, 2, std::function<void(std::string)>(), 500, false);
+    require_exact_distances(4, g, old_weight, ch);
+    require_exact_distances(4, g, new_weight, ch);
+  }
+}
+
+TEST_CASE("CustomizationOfRandomGraphs", "[Customization]"){
+  std::minstd_rand rng(42);
+  const unsigned node_count = 50;
+
+  for(unsigned round=0; round<10; ++round){
+    vector<unsigned>tail, head, old_weight;
+    for(unsigned i=0; i<150; ++i){
+      tail.push_back(rng() % node_count);
+      head.push_back(rng() % node_count);
+      old_weight.push_back(rng() % 100);
+    }
+    Graph g = sort_arcs(node_count, tail, head, old_weight);
+
+    vector<unsigned>new_weight(old_weight.size());
+    for(auto&w:new_weight)
+      w = rng() % 8 == 0 ? inf_weight : rng() % 100;
+
+    ParallelContractionHierarchy ch = compute_parallel_contraction_hierarchy(node_count, g.tail, g.head, old_weight, 3, std::function<void(std::string)>(), 500, false);
+    require_exact_distances(node_count, g, new_weight, ch);
+  }
+}
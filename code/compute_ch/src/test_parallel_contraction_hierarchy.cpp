@@ -0,0 +1,127 @@
+#include "catch.hpp"
+
+#include "parallel_contraction_hierarchy.h"
+
+#include <routingkit/constants.h>
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+using namespace RoutingKit;
+using namespace std;
+
+namespace{
+
+struct RandomGraph{
+  vector<unsigned>tail;
+  vector<unsigned>head;
+  vector<unsigned>weight;
+};
+
+RandomGraph generate_random_graph(std::minstd_rand&rng, unsigned node_count, unsigned arc_count){
+  RandomGraph g;
+  for(unsigned i=0; i<arc_count; ++i){
+    g.tail.push_back(rng() % node_count);
+    g.head.push_back(rng() % node_count);
+    g.weight.push_back(rng() % 100);
+  }
+  return g;
+}
+
+vector<unsigned> dijkstra(unsigned node_count, const RandomGraph&g, unsigned s){
+  vector<unsigned>dist(node_count, inf_weight);
+  priority_queue<pair<unsigned, unsigned>, vector<pair<unsigned, unsigned>>, greater<pair<unsigned, unsigned>>>queue;
+  dist[s] = 0;
+  queue.push({0, s});
+  while(!queue.empty()){
+    unsigned x_dist = queue.top().first;
+    unsigned x = queue.top().second;
+    queue.pop();
+    if(x_dist != dist[x])
+      continue;
+    for(unsigned xy=0; xy<g.tail.size(); ++xy){
+      if(g.tail[xy] != x)
+        continue;
+      unsigned y_dist = x_dist + g.weight[xy];
+      if(y_dist < dist[g.head[xy]]){
+        dist[g.head[xy]] = y_dist;
+        queue.push({y_dist, g.head[xy]});
+      }
+    }
+  }
+  return dist;
+}
+
+// Distances of the upward search from x in one side of the CH. The CH graph is
+// acyclic and all arcs go to higher ranks, so scanning the nodes by rank suffices.
+vector<unsigned> upward_distances(const ParallelContractionHierarchy::Side&side, unsigned x){
+  vector<unsigned>dist(side.first_out.size()-1, inf_weight);
+  dist[x] = 0;
+  for(; x<dist.size(); ++x)
+    if(dist[x] != inf_weight)
+      for(unsigned xy=side.first_out[x]; xy<side.first_out[x+1]; ++xy)
+        dist[side.head[xy]] = min(dist[side.head[xy]], dist[x] + side.weight[xy]);
+  return dist;
+}
+
+void require_exact_distances(unsigned node_count, const RandomGraph&g, const ParallelContractionHierarchy&ch){
+  vector<vector<unsigned>>backward_dist(node_count);
+  for(unsigned t=0; t<node_count; ++t)
+    backward_dist[t] = upward_distances(ch.backward, ch.rank[t]);
+
+  for(unsigned s=0; s<node_count; ++s){
+    vector<unsigned>dist = dijkstra(node_count, g, s);
+    vector<unsigned>forward_dist = upward_distances(ch.forward, ch.rank[s]);
+    for(unsigned t=0; t<node_count; ++t){
+      unsigned ch_dist = inf_weight;
+      for(unsigned x=0; x<node_count; ++x)
+        if(forward_dist[x] != inf_weight && backward_dist[t][x] != inf_weight)
+          ch_dist = min(ch_dist, forward_dist[x] + backward_dist[t][x]);
+      REQUIRE(ch_dist == dist[t]);
+    }
+  }
+}
+
+}
+
+TEST_CASE("ParallelContractionWithWitnessSearchOfRandomGraphs", "[ParallelContractionHierarchy]"){
+  std::minstd_rand rng(42);
+  const unsigned node_count = 60;
+
+  for(unsigned thread_count:{1u, 3u}){
+    for(unsigned max_pop_count:{5u, 500u}){
+      for(unsigned round=0; round<10; ++round){
+        RandomGraph g = generate_random_graph(rng, node_count, 180);
+        ParallelContractionHierarchy ch = compute_parallel_contraction_hierarchy(node_count, g.tail, g.head, g.weight, thread_count, std::function<void(std::string)>(), max_pop_count, true);
+        require_exact_distances(node_count, g, ch);
+        check_parallel_contraction_hierarchy_for_errors(ch, g.tail, g.head, g.weight, node_count);
+      }
+    }
+  }
+}
+
+TEST_CASE("CheckOfParallelContractionHierarchyFindsWrongDistances", "[ParallelContractionHierarchy]"){
+  std::minstd_rand rng(7);
+  const unsigned node_count = 30;
+  RandomGraph g = generate_random_graph(rng, node_count, 90);
+  ParallelContractionHierarchy ch = compute_parallel_contraction_hierarchy(node_count, g.tail, g.head, g.weight, 2);
+  REQUIRE_NOTHROW(check_parallel_contraction_hierarchy_for_errors(ch, g.tail, g.head, g.weight, node_count));
+
+  SECTION("LongerArc"){
+    REQUIRE(!ch.forward.weight.empty());
+    ch.forward.weight[0] += 1000;
+    REQUIRE_THROWS_AS(check_parallel_contraction_hierarchy_for_errors(ch, g.tail, g.head, g.weight, node_count), std::runtime_error);
+  }
+
+  SECTION("DownwardArc"){
+    REQUIRE(!ch.backward.head.empty());
+    ch.backward.head[0] = 0;
+    REQUIRE_THROWS_AS(check_parallel_contraction_hierarchy_for_errors(ch, g.tail, g.head, g.weight, node_count), std::runtime_error);
+  }
+}
@@ -0,0 +1,157 @@
+#include "external_sort.h"
+#include "data_sink.h"
+#include "data_source.h"
+
+#include <algorithm>
+#include <functional>
+#include <queue>
+#include <stdexcept>
+#include <utility>
+#include <stdio.h>
+
+namespace RoutingKit2{
+
+ExternalUInt64Sorter::ExternalUInt64Sorter():max_buffer_size(1), value_count(0){}
+
+ExternalUInt64Sorter::ExternalUInt64Sorter(std::string tmp_file_prefix, uint64_t memory_budget_in_bytes):
+	tmp_file_prefix(std::move(tmp_file_prefix)),
+	max_buffer_size(std::max<uint64_t>(memory_budget_in_bytes / sizeof(uint64_t), 1)),
+	value_count(0){
+}
+
+ExternalUInt64Sorter::ExternalUInt64Sorter(ExternalUInt64Sorter&&o)noexcept:
+	tmp_file_prefix(std::move(o.tmp_file_prefix)),
+	max_buffer_size(o.max_buffer_size),
+	value_count(o.value_count),
+	buffer(std::move(o.buffer)),
+	run_file_list(std::move(o.run_file_list)){
+	o.run_file_list.clear();
+	o.value_count = 0;
+}
+
+ExternalUInt64Sorter&ExternalUInt64Sorter::operator=(ExternalUInt64Sorter&&o)noexcept{
+	if(this != &o){
+		for(auto&f:run_file_list)
+			remove(f.c_str());
+		tmp_file_prefix = std::move(o.tmp_file_prefix);
+		max_buffer_size = o.max_buffer_size;
+		value_count = o.value_count;
+		buffer = std::move(o.buffer);
+		run_file_list = std::move(o.run_file_list);
+		o.run_file_list.clear();
+		o.value_count = 0;
+	}
+	return *this;
+}
+
+ExternalUInt64Sorter::~ExternalUInt64Sorter(){
+	for(auto&f:run_file_list)
+		remove(f.c_str());
+}
+
+void ExternalUInt64Sorter::write_run(){
+	if(buffer.empty())
+		return;
+	std::sort(buffer.begin(), buffer.end());
+	std::string file_name = tmp_file_prefix + std::to_string(run_file_list.size());
+	run_file_list.push_back(file_name);
+	{
+		FileDataSink out(file_name);
+		out((const uint8_t*)buffer.data(), buffer.size()*sizeof(uint64_t));
+	}
+	value_count += buffer.size();
+	buffer.clear();
+}
+
+void ExternalUInt64Sorter::finish(){
+	write_run();
+	std::vector<uint64_t>().swap(buffer);
+}
+
+namespace{
+	class RunReader{
+	public:
+		RunReader(const std::string&file_name, uint64_t buffer_size):
+			source(file_name), buffer(std::max<uint64_t>(buffer_size / sizeof(uint64_t), 1)), pos(0), end(0){
+			refill();
+		}
+
+		bool empty()const{
+			return pos == end;
+		}
+
+		uint64_t front()const{
+			return buffer[pos];
+		}
+
+		void pop(){
+			++pos;
+			if(pos == end)
+				refill();
+		}
+
+	private:
+		void refill(){
+			uint8_t*begin = (uint8_t*)buffer.data();
+			size_t len = buffer.size()*sizeof(uint64_t);
+			size_t filled = 0;
+			while(filled != len){
+				size_t read = source(begin + filled, len - filled);
+				if(read == 0)
+					break;
+				filled += read;
+			}
+			if(filled % sizeof(uint64_t) != 0)
+				throw std::runtime_error("Run file has a size that is not a multiple of 8");
+			pos = 0;
+			end = filled / sizeof(uint64_t);
+		}
+
+		FileDataSource source;
+		std::vector<uint64_t>buffer;
+		size_t pos, end;
+	};
+}
+
+void merge_sorted_runs(
+	std::vector<ExternalUInt64Sorter>&sorter_list,
+	const std::function<void(uint64_t)>&callback,
+	uint64_t read_buffer_size_in_bytes
+){
+	std::vector<std::string>run_file_list;
+	for(auto&s:sorter_list){
+		run_file_list.insert(run_file_list.end(), s.get_run_file_list().begin(), s.get_run_file_list().end());
+		s.release_run_files();
+	}
+
+	try{
+		std::vector<RunReader>reader;
+		reader.reserve(run_file_list.size());
+		for(auto&f:run_file_list)
+			reader.emplace_back(f, read_buffer_size_in_bytes);
+
+		typedef std::pair<uint64_t, size_t> QueueElement;
+		std::priority_queue<QueueElement, std::vector<QueueElement>, std::greater<QueueElement>>queue;
+		for(size_t i=0; i<reader.size(); ++i)
+			if(!reader[i].empty())
+				queue.push({reader[i].front(), i});
+
+		while(!queue.empty()){
+			size_t i = queue.top().second;
+			queue.pop();
+			callback(reader[i].front());
+			reader[i].pop();
+			if(!reader[i].empty())
+				queue.push({reader[i].front(), i});
+		}
+	}catch(...){
+		for(auto&f:run_file_list)
+			remove(f.c_str());
+		throw;
+	}
+
+	for(auto&f:run_file_list)
+		remove(f.c_str());
+}
+
+} // RoutingKit2
@@ -0,0 +1,82 @@
+#ifndef ROUTING_KIT2_EXTERNAL_SORT_H
+#define ROUTING_KIT2_EXTERNAL_SORT_H
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace RoutingKit2{
+
+//! Sorts more uint64_t values than fit into memory. The values are collected in a
+//! buffer. Once the buffer holds memory_budget_in_bytes bytes, it is sorted and
+//! written as a run into a temporary file whose name starts with tmp_file_prefix.
+//! The runs are merged by merge_sorted_runs.
+//!
+//! A sorter is not thread-safe. Several threads can use one sorter each and merge
+//! the runs of all sorters at the end.
+class ExternalUInt64Sorter{
+public:
+	ExternalUInt64Sorter();
+	ExternalUInt64Sorter(std::string tmp_file_prefix, uint64_t memory_budget_in_bytes);
+
+	ExternalUInt64Sorter(const ExternalUInt64Sorter&)=delete;
+	ExternalUInt64Sorter&operator=(const ExternalUInt64Sorter&)=delete;
+
+	ExternalUInt64Sorter(ExternalUInt64Sorter&&)noexcept;
+	ExternalUInt64Sorter&operator=(ExternalUInt64Sorter&&)noexcept;
+
+	//! Removes all run files that were not yet merged.
+	~ExternalUInt64Sorter();
+
+	//! The buffer is allocated with its full size on the first push, so that it
+	//! never grows beyond the memory budget by reallocation.
+	void push(uint64_t x){
+		if(buffer.empty())
+			buffer.reserve(max_buffer_size);
+		buffer.push_back(x);
+		if(buffer.size() == max_buffer_size)
+			write_run();
+	}
+
+	//! Writes the values that are still in the buffer as last run and frees the buffer.
+	void finish();
+
+	//! Returns the total number of values pushed.
+	uint64_t size()const{
+		return value_count + buffer.size();
+	}
+
+	const std::vector<std::string>&get_run_file_list()const{
+		return run_file_list;
+	}
+
+	//! Forgets the run files without removing them. Is used when the files are
+	//! handed over to someone else.
+	void release_run_files(){
+		run_file_list.clear();
+	}
+
+private:
+	void write_run();
+
+	std::string tmp_file_prefix;
+	uint64_t max_buffer_size;
+	uint64_t value_count;
+	std::vector<uint64_t>buffer;
+	std::vector<std::string>run_file_list;
+};
+
+//! Merges the sorted runs of all sorters and calls callback for every value in
+//! increasing order. Duplicates are kept. Every run is read through a buffer of
+//! read_buffer_size_in_bytes bytes. The sorters must be finished. The run files
+//! are removed afterwards.
+void merge_sorted_runs(
+	std::vector<ExternalUInt64Sorter>&sorter_list,
+	const std::function<void(uint64_t)>&callback,
+	uint64_t read_buffer_size_in_bytes = 1<<20
+);
+
+} // RoutingKit2
+
+#endif
@@ -1,6 +1,7 @@
 #include "geo_index.h"
 #include "geo_pos.h"
 #include "polyline.h"
+#include "parallel.h"
 #include <algorithm>
 #include <assert.h>
 
@@ -8,55 +9,244 @@ namespace RoutingKit2{
 
 constexpr size_t max_points_per_leaf = 8;
 
-void GeoIndexBuilder::compute_distance_from_first(size_t begin, size_t end)noexcept{
-    for(size_t i=begin+1; i<end; ++i)
-            data[i].distance_in_sqr_cm = compute_distance_in_sqr_cm(data[begin].pos, data[i].pos);
+// Frames with at least this many items are split with a stable partition
+// instead of std::nth_element. Which method is used only depends on the frame
+// size, which makes the index independent of the thread count.
+constexpr size_t min_stable_partition_size = 1<<16;
+
+// The two halves of a frame are built on different threads if the frame has at
+// least this many items.
+constexpr size_t min_parallel_frame_size = 1<<14;
+
+void GeoIndexBuilder::compute_distance_from_first(size_t begin, size_t end, unsigned thread_count){
+	GeoPos first = data[begin].pos;
+	run_on_thread_ranges(
+		limit_thread_count(thread_count, end-begin, min_parallel_frame_size), end-begin-1,
+		[&](unsigned, uint64_t range_begin, uint64_t range_end){
+			for(size_t i=begin+1+range_begin; i<begin+1+range_end; ++i)
+				data[i].distance_in_sqr_cm = compute_distance_in_sqr_cm(first, data[i].pos);
+		}
+	);
 }
 
 static size_t compute_mid(size_t begin, size_t end)noexcept{
-    return (begin + end)/2;
+	return (begin + end)/2;
+}
+
+// Returns the distance that a sorted [begin, end) would have at begin+rank. The
+// distances are bucketed by their leading bits in parallel. Only the bucket
+// that contains the rank is selected exactly.
+uint64_t GeoIndexBuilder::find_distance_with_rank(size_t begin, size_t end, size_t rank, unsigned thread_count){
+	assert(rank < end - begin);
+
+	const unsigned bucket_bit_count = 11;
+	const size_t bucket_count = size_t(1) << bucket_bit_count;
+
+	thread_count = limit_thread_count(thread_count, end-begin, min_parallel_frame_size);
+
+	std::vector<uint64_t>thread_bits(thread_count, 0);
+	run_on_thread_ranges(
+		thread_count, end-begin,
+		[&](unsigned thread_id, uint64_t range_begin, uint64_t range_end){
+			uint64_t bits = 0;
+			for(size_t i=begin+range_begin; i<begin+range_end; ++i)
+				bits |= data[i].distance_in_sqr_cm;
+			thread_bits[thread_id] = bits;
+		}
+	);
+	uint64_t all_bits = 0;
+	for(uint64_t bits:thread_bits)
+		all_bits |= bits;
+
+	unsigned shift = 0;
+	while((all_bits >> shift) >= bucket_count)
+		++shift;
+
+	std::vector<std::vector<size_t>>thread_bucket_size(thread_count, std::vector<size_t>(bucket_count, 0));
+	run_on_thread_ranges(
+		thread_count, end-begin,
+		[&](unsigned thread_id, uint64_t range_begin, uint64_t range_end){
+			std::vector<size_t>&bucket_size = thread_bucket_size[thread_id];
+			for(size_t i=begin+range_begin; i<begin+range_end; ++i)
+				++bucket_size[data[i].distance_in_sqr_cm >> shift];
+		}
+	);
+
+	uint64_t bucket = 0;
+	for(;;){
+		size_t bucket_size = 0;
+		for(unsigned t=0; t<thread_count; ++t)
+			bucket_size += thread_bucket_size[t][bucket];
+		if(rank < bucket_size)
+			break;
+		rank -= bucket_size;
+		++bucket;
+	}
+
+	std::vector<std::vector<uint64_t>>thread_candidate(thread_count);
+	run_on_thread_ranges(
+		thread_count, end-begin,
+		[&](unsigned thread_id, uint64_t range_begin, uint64_t range_end){
+			std::vector<uint64_t>&candidate = thread_candidate[thread_id];
+			candidate.reserve(thread_bucket_size[thread_id][bucket]);
+			for(size_t i=begin+range_begin; i<begin+range_end; ++i)
+				if((data[i].distance_in_sqr_cm >> shift) == bucket)
+					candidate.push_back(data[i].distance_in_sqr_cm);
+		}
+	);
+
+	std::vector<uint64_t>candidate;
+	for(auto&c:thread_candidate)
+		candidate.insert(candidate.end(), c.begin(), c.end());
+	std::nth_element(candidate.begin(), candidate.begin()+rank, candidate.end());
+	return candidate[rank];
+}
+
+// Moves the items in [begin+1, end) such that the item at mid has the distance
+// that it would have in sorted order. Items with a smaller distance are moved
+// before the items with this distance, items with a larger distance after them.
+// Each group keeps its order.
+void GeoIndexBuilder::partition_by_distance(size_t begin, size_t end, size_t mid, unsigned thread_count){
+	uint64_t mid_distance_in_sqr_cm = find_distance_with_rank(begin+1, end, mid-begin-1, thread_count);
+
+	thread_count = limit_thread_count(thread_count, end-begin, min_parallel_frame_size);
+
+	struct GroupSize{
+		size_t smaller, equal, larger;
+	};
+	std::vector<GroupSize>thread_group_size(thread_count);
+
+	size_t item_count = end-begin-1;
+	run_on_thread_ranges(
+		thread_count, item_count,
+		[&](unsigned thread_id, uint64_t range_begin, uint64_t range_end){
+			GroupSize s = {0, 0, 0};
+			for(size_t i=begin+1+range_begin; i<begin+1+range_end; ++i){
+				if(data[i].distance_in_sqr_cm < mid_distance_in_sqr_cm)
+					++s.smaller;
+				else if(data[i].distance_in_sqr_cm == mid_distance_in_sqr_cm)
+					++s.equal;
+				else
+					++s.larger;
+			}
+			thread_group_size[thread_id] = s;
+		}
+	);
+
+	GroupSize total = {0, 0, 0};
+	for(auto s:thread_group_size){
+		total.smaller += s.smaller;
+		total.equal += s.equal;
+	}
+
+	std::vector<GroupSize>thread_group_begin(thread_count);
+	GroupSize next = {begin+1, begin+1+total.smaller, begin+1+total.smaller+total.equal};
+	for(unsigned t=0; t<thread_count; ++t){
+		thread_group_begin[t] = next;
+		next.smaller += thread_group_size[t].smaller;
+		next.equal += thread_group_size[t].equal;
+		next.larger += thread_group_size[t].larger;
+	}
+
+	assert(begin+1+total.smaller <= mid && mid < begin+1+total.smaller+total.equal);
+
+	run_on_thread_ranges(
+		thread_count, item_count,
+		[&](unsigned thread_id, uint64_t range_begin, uint64_t range_end){
+			GroupSize out = thread_group_begin[thread_id];
+			for(size_t i=begin+1+range_begin; i<begin+1+range_end; ++i){
+				if(data[i].distance_in_sqr_cm < mid_distance_in_sqr_cm)
+					partition_buffer[out.smaller++] = data[i];
+				else if(data[i].distance_in_sqr_cm == mid_distance_in_sqr_cm)
+					partition_buffer[out.equal++] = data[i];
+				else
+					partition_buffer[out.larger++] = data[i];
+			}
+		}
+	);
+
+	run_on_thread_ranges(
+		thread_count, item_count,
+		[&](unsigned, uint64_t range_begin, uint64_t range_end){
+			std::copy(partition_buffer.begin()+begin+1+range_begin, partition_buffer.begin()+begin+1+range_end, data.begin()+begin+1+range_begin);
+		}
+	);
 }
 
 // Preconditions:
 //  * end - begin > max_points_per_leaf
 //  * data[i].distance == compute_distance(data[begin].point, data[i].point for all i with begin < i < end
-void GeoIndexBuilder::recurse_in_construction(size_t begin, size_t end)noexcept{
+void GeoIndexBuilder::recurse_in_construction(size_t begin, size_t end, unsigned thread_count){
 	size_t mid = compute_mid(begin, end);
 
-	std::nth_element(
-	    data.begin()+begin+1,
-	    data.begin()+mid,
-	    data.begin()+end,
-	    [](const Data&l, const Data&r){
-	            return l.distance_in_sqr_cm < r.distance_in_sqr_cm;
-	    }
-	);
-
-	if(mid - begin > max_points_per_leaf){
-	    recurse_in_construction(begin, mid);
+	if(end - begin >= min_stable_partition_size){
+		partition_by_distance(begin, end, mid, thread_count);
+	}else{
+		std::nth_element(
+			data.begin()+begin+1,
+			data.begin()+mid,
+			data.begin()+end,
+			[](const Data&l, const Data&r){
+				return l.distance_in_sqr_cm < r.distance_in_sqr_cm;
+			}
+		);
 	}
 
-	if(end - mid > max_points_per_leaf){
-	    compute_distance_from_first(mid, end);
-	    recurse_in_construction(mid, end);
+	auto build_lower_half = [&](unsigned thread_count){
+		if(mid - begin > max_points_per_leaf){
+			recurse_in_construction(begin, mid, thread_count);
+		}
+	};
+
+	auto build_upper_half = [&](unsigned thread_count){
+		if(end - mid > max_points_per_leaf){
+			compute_distance_from_first(mid, end, thread_count);
+			recurse_in_construction(mid, end, thread_count);
+		}
+	};
+
+	if(thread_count > 1 && end - begin >= min_parallel_frame_size){
+		// The halves are disjoint. Building them concurrently does not change the
+		// result.
+		run_on_threads(
+			2,
+			[&](unsigned thread_id){
+				if(thread_id == 0)
+					build_lower_half(thread_count/2);
+				else
+					build_upper_half(thread_count - thread_count/2);
+			}
+		);
+	}else{
+		build_lower_half(thread_count);
+		build_upper_half(thread_count);
 	}
 }
 
-void GeoIndexBuilder::construct()noexcept{
+void GeoIndexBuilder::construct(unsigned thread_count){
 	size_t begin = 0, end = data.size();
+	if(end - begin >= min_stable_partition_size)
+		partition_buffer.resize(data.size());
 	if(end-begin > max_points_per_leaf){
-	    compute_distance_from_first(begin, end);
-	    recurse_in_construction(begin, end);
+		compute_distance_from_first(begin, end, thread_count);
+		recurse_in_construction(begin, end, thread_count);
 	}
+	std::vector<Data>().swap(partition_buffer);
 }
 
-VecGeoIndex GeoIndexBuilder::build(){
-	construct();
+VecGeoIndex GeoIndexBuilder::build(unsigned thread_count){
+	thread_count = resolve_thread_count(thread_count);
+	construct(thread_count);
 	VecGeoIndex r(data.size());
-	for(size_t i=0; i<r.item_count; ++i){
-		r.pos[i] = data[i].pos;
-		r.id[i] = data[i].id;
-	}
+	run_on_thread_ranges(
+		limit_thread_count(thread_count, r.item_count, min_parallel_frame_size), r.item_count,
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(size_t i=begin; i<end; ++i){
+				r.pos[i] = data[i].pos;
+				r.id[i] = data[i].id;
+			}
+		}
+	);
 	return r;
 }
 
@@ -116,43 +306,137 @@ OptionalWithSentinel<GeoIndexItem> GeoIndexFindWithinRadiusQuery::next(){
 	}
 }
 
-namespace {
-	constexpr uint32_t link_sampling_distance_in_cm = 50000;
+namespace{
+	// Comparing with this order makes std::push_heap and std::pop_heap maintain
+	// a min-heap.
+	struct IsFartherAway{
+		template<class T>
+		bool operator()(const T&l, const T&r)const noexcept{
+			return l.distance_in_sqr_cm > r.distance_in_sqr_cm;
+		}
+	};
+
+	uint64_t cm_to_sqr_cm(uint32_t cm)noexcept{
+		return static_cast<uint64_t>(cm) * cm;
+	}
 }
 
-VecGeoIndex build_link_geo_index(ConstRefLinkShapes map){
-	GeoIndexBuilder builder;
+void GeoIndexFindNearestQuery::push(QueueElement e){
+	if(e.distance_in_sqr_cm > max_distance_in_sqr_cm)
+		return;
+	queue.push_back(e);
+	std::push_heap(queue.begin(), queue.end(), IsFartherAway());
+}
 
+void GeoIndexFindNearestQuery::start(GeoPos center, uint32_t max_item_count, uint32_t max_distance_in_cm){
+	this->center = center;
+	this->remaining_item_count = max_item_count;
+	// An item is within the distance if its rounded down distance in cm is.
+	this->max_distance_in_sqr_cm = cm_to_sqr_cm(max_distance_in_cm) + 2*static_cast<uint64_t>(max_distance_in_cm);
+	queue.clear();
+	if(geo_index.item_count != 0 && max_item_count != 0)
+		push({0, 0, geo_index.item_count, false});
+}
 
-std::vector<LatLon>poly;
-	auto add = [&](GeoPos pos, uint32_t link_id){
-		builder.add(pos, link_id);
-	};
+OptionalWithSentinel<GeoIndexItem> GeoIndexFindNearestQuery::next(){
+	OptionalWithSentinel<GeoIndexItem> ret;
+	if(remaining_item_count == 0)
+		return ret;
+
+	while(!queue.empty()){
+		std::pop_heap(queue.begin(), queue.end(), IsFartherAway());
+		QueueElement e = queue.back();
+		queue.pop_back();
+
+		if(e.is_item){
+			--remaining_item_count;
+			distance_in_sqr_cm = e.distance_in_sqr_cm;
+			ret = OptionalWithSentinel<GeoIndexItem>({geo_index.pos[e.begin], geo_index.id[e.begin]});
+			break;
+		}
 
-	for(uint32_t l=0; l<map.link_count; ++l){
+		size_t frame_size = e.end - e.begin;
+		if(frame_size > max_points_per_leaf){
+			// The items in [begin, mid) are at most as far away from the pivot at
+			// begin as mid. The items in [mid, end) are at least as far away. The
+			// bounds are decreased by 1 as the distances are rounded down.
+			size_t mid = compute_mid(e.begin, e.end);
+			uint32_t dist_pivot_to_mid_in_cm = compute_distance_in_cm(geo_index.pos[e.begin], geo_index.pos[mid]);
+			uint32_t dist_pivot_to_center_in_cm = compute_distance_in_cm(geo_index.pos[e.begin], center);
+
+			uint32_t lower_bound_in_cm = sqr_cm_to_cm(e.distance_in_sqr_cm);
+			uint32_t left_lower_bound_in_cm = lower_bound_in_cm;
+			if(dist_pivot_to_center_in_cm > dist_pivot_to_mid_in_cm + 1)
+				left_lower_bound_in_cm = std::max(left_lower_bound_in_cm, dist_pivot_to_center_in_cm - dist_pivot_to_mid_in_cm - 1);
+			uint32_t right_lower_bound_in_cm = lower_bound_in_cm;
+			if(dist_pivot_to_mid_in_cm > dist_pivot_to_center_in_cm + 1)
+				right_lower_bound_in_cm = std::max(right_lower_bound_in_cm, dist_pivot_to_mid_in_cm - dist_pivot_to_center_in_cm - 1);
+
+			push({cm_to_sqr_cm(left_lower_bound_in_cm), e.begin, mid, false});
+			push({cm_to_sqr_cm(right_lower_bound_in_cm), mid, e.end, false});
+		}else{
+			for(size_t i=e.begin; i<e.end; ++i)
+				push({compute_distance_in_sqr_cm(geo_index.pos[i], center), i, i+1, true});
+		}
+	}
 
-		add(GeoPos(map.node_pos[map.link_tail[l]]), l);
-		if(map.link_length_in_cm[l] >= link_sampling_distance_in_cm){
+	return ret;
+}
 
-			uint32_t remaining_distance_in_cm = link_sampling_distance_in_cm;
+VecGeoIndex build_link_geo_index(ConstRefLinkShapes map, unsigned thread_count){
+	thread_count = resolve_thread_count(thread_count);
 
-			DLinkPointEnumerator enumerator(map, link_to_forward_dlink(l));
-			GeoPos prev(*enumerator.next());
-			while(auto now_ = enumerator.next()){
-				GeoPos now(*now_);
-				uint32_t dist = compute_distance_in_cm(prev, now);
-				while(remaining_distance_in_cm < dist){
-					add(shift_geo_pos(prev, now, remaining_distance_in_cm, dist), l);
-					remaining_distance_in_cm += link_sampling_distance_in_cm;
-				}
+	struct Sample{
+		GeoPos pos;
+		uint32_t link_id;
+	};
 
-				remaining_distance_in_cm -= dist;
-				prev = now;
+	// Every thread samples a contiguous range of links. The samples are added in
+	// the order of the links, i.e., the same as with one thread.
+	unsigned sample_thread_count = limit_thread_count(thread_count, map.link_count, 1<<14);
+	std::vector<std::vector<Sample>>thread_sample(sample_thread_count);
+
+	run_on_thread_ranges(
+		sample_thread_count, map.link_count,
+		[&](unsigned thread_id, uint64_t link_begin, uint64_t link_end){
+			std::vector<Sample>&sample = thread_sample[thread_id];
+			auto add = [&](GeoPos pos, uint32_t link_id){
+				sample.push_back({pos, link_id});
+			};
+
+			for(uint32_t l=link_begin; l<link_end; ++l){
+
+				add(GeoPos(map.node_pos[map.link_tail[l]]), l);
+				if(map.link_length_in_cm[l] >= link_geo_index_sampling_distance_in_cm){
+
+					uint32_t remaining_distance_in_cm = link_geo_index_sampling_distance_in_cm;
+
+					DLinkPointEnumerator enumerator(map, link_to_forward_dlink(l));
+					GeoPos prev(*enumerator.next());
+					while(auto now_ = enumerator.next()){
+						GeoPos now(*now_);
+						uint32_t dist = compute_distance_in_cm(prev, now);
+						while(remaining_distance_in_cm < dist){
+							add(shift_geo_pos(prev, now, remaining_distance_in_cm, dist), l);
+							remaining_distance_in_cm += link_geo_index_sampling_distance_in_cm;
+						}
+
+						remaining_distance_in_cm -= dist;
+						prev = now;
+					}
+				}
 			}
 		}
+	);
+
+	GeoIndexBuilder builder;
+	for(auto&sample:thread_sample){
+		for(auto s:sample)
+			builder.add(s.pos, s.link_id);
+		std::vector<Sample>().swap(sample);
 	}
 
-	return builder.build();
+	return builder.build(thread_count);
 }
 
 void LinkGeoIndexFindWithinRadiusQuery::start(GeoPos center, uint32_t radius_in_cm){
@@ -161,12 +445,12 @@ void LinkGeoIndexFindWithinRadiusQuery::start(GeoPos center, uint32_t radius_in_
 	this->radius_in_sqr_cm = radius_in_cm+1;
 	this->radius_in_sqr_cm *= radius_in_cm+1;
 
-	search.start(center, radius_in_cm + link_sampling_distance_in_cm);
+	search.start(center, radius_in_cm + link_geo_index_sampling_distance_in_cm);
 	was_found.reset_all();
 }
 
 uint32_t LinkGeoIndexFindWithinRadiusQuery::get_radius_in_cm()const noexcept{
-	return search.get_radius_in_cm() - link_sampling_distance_in_cm;
+	return search.get_radius_in_cm() - link_geo_index_sampling_distance_in_cm;
 }
 
 Optional<uint32_t> LinkGeoIndexFindWithinRadiusQuery::next(){
@@ -201,4 +485,62 @@ Optional<uint32_t> LinkGeoIndexFindWithinRadiusQuery::next(){
 }
 
 
+void LinkGeoIndexFindNearestQuery::start(GeoPos center, uint32_t max_link_count, uint32_t max_distance_in_cm){
+	remaining_link_count = max_link_count;
+	max_distance_in_sqr_cm = cm_to_sqr_cm(max_distance_in_cm) + 2*static_cast<uint64_t>(max_distance_in_cm);
+
+	uint64_t max_sample_distance_in_cm = static_cast<uint64_t>(max_distance_in_cm) + link_geo_index_max_distance_from_link_to_sample_in_cm;
+	search.start(center, std::numeric_limits<uint32_t>::max(), std::min<uint64_t>(max_sample_distance_in_cm, std::numeric_limits<uint32_t>::max()));
+	next_sample = search.next();
+
+	candidate_queue.clear();
+	was_found.reset_all();
+}
+
+Optional<NearestLink> LinkGeoIndexFindNearestQuery::next(){
+	Optional<NearestLink> ret;
+	if(remaining_link_count == 0)
+		return ret;
+
+	// A link whose samples were not yet enumerated can not be closer than the
+	// next sample minus link_geo_index_max_distance_from_link_to_sample_in_cm. The
+	// best candidate is final once it is at most this far away.
+	auto is_final = [&]{
+		if(!next_sample.has_value())
+			return true;
+		uint32_t next_sample_distance_in_cm = sqr_cm_to_cm(search.get_distance_in_sqr_cm());
+		if(next_sample_distance_in_cm <= link_geo_index_max_distance_from_link_to_sample_in_cm)
+			return false;
+		return candidate_queue.front().distance_in_sqr_cm <= cm_to_sqr_cm(next_sample_distance_in_cm - link_geo_index_max_distance_from_link_to_sample_in_cm);
+	};
+
+	for(;;){
+		if(!candidate_queue.empty() && is_final())
+			break;
+
+		if(!next_sample.has_value())
+			return ret;
+
+		uint32_t link_id = next_sample->id;
+		next_sample = search.next();
+
+		if(was_found.is_set(link_id))
+			continue;
+		was_found.set(link_id);
+
+		auto q = find_closest_point_offset_and_distance_on_dlink(map, link_to_forward_dlink(link_id), search.get_center());
+		if(q.distance_in_sqr_cm > max_distance_in_sqr_cm)
+			continue;
+
+		candidate_queue.push_back({link_id, q.pos, q.offset_in_cm, q.distance_in_sqr_cm});
+		std::push_heap(candidate_queue.begin(), candidate_queue.end(), IsFartherAway());
+	}
+
+	std::pop_heap(candidate_queue.begin(), candidate_queue.end(), IsFartherAway());
+	ret = candidate_queue.back();
+	candidate_queue.pop_back();
+	--remaining_link_count;
+	return ret;
+}
+
 }
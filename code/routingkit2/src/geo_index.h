@@ -16,13 +16,18 @@ public:
 		data.push_back({pos, id, 0});
 	}
 
-	VecGeoIndex build();
+	//! Builds the index on thread_count threads. A thread_count of 0 means
+	//! std::thread::hardware_concurrency(). The index does not depend on the
+	//! thread count.
+	VecGeoIndex build(unsigned thread_count = 1);
 
 private:
 
-    void compute_distance_from_first(std::size_t begin, std::size_t end)noexcept;
-    void recurse_in_construction(std::size_t begin, std::size_t end)noexcept;
-    void construct()noexcept;
+	void compute_distance_from_first(std::size_t begin, std::size_t end, unsigned thread_count);
+	uint64_t find_distance_with_rank(std::size_t begin, std::size_t end, std::size_t rank, unsigned thread_count);
+	void partition_by_distance(std::size_t begin, std::size_t end, std::size_t mid, unsigned thread_count);
+	void recurse_in_construction(std::size_t begin, std::size_t end, unsigned thread_count);
+	void construct(unsigned thread_count);
 
 	struct Data{
 		GeoPos pos;
@@ -31,6 +36,7 @@ private:
 	};
 
 	std::vector<Data>data;
+	std::vector<Data>partition_buffer;
 };
 
 struct GeoIndexItem{
@@ -108,7 +114,63 @@ private:
 	GeoIndexFindAtLeastWithinRadiusQuery search;
 };
 
-VecGeoIndex build_link_geo_index(ConstRefLinkShapes);
+//! Enumerates the items ordered by increasing distance to the center. At most
+//! max_item_count items with a distance of at most max_distance_in_cm are
+//! returned. The tree built by GeoIndexBuilder is searched best-first: subtrees
+//! are visited in the order of a lower bound on the distance of their items.
+class GeoIndexFindNearestQuery{
+public:
+	explicit GeoIndexFindNearestQuery(ConstRefGeoIndex geo_index)noexcept:
+		geo_index(geo_index){}
+
+	void start(GeoPos center, uint32_t max_item_count, uint32_t max_distance_in_cm = std::numeric_limits<uint32_t>::max());
+	OptionalWithSentinel<GeoIndexItem> next();
+
+	//! The distance of the item last returned by next().
+	uint64_t get_distance_in_sqr_cm()const noexcept{
+		return distance_in_sqr_cm;
+	}
+
+	ConstRefGeoIndex get_geo_index()const noexcept{
+		return geo_index;
+	}
+
+	GeoPos get_center()const noexcept{
+		return center;
+	}
+
+private:
+	ConstRefGeoIndex geo_index;
+
+	GeoPos center;
+	uint32_t remaining_item_count;
+	uint64_t max_distance_in_sqr_cm;
+	uint64_t distance_in_sqr_cm;
+
+	struct QueueElement{
+		// For frames this is a lower bound.
+		uint64_t distance_in_sqr_cm;
+		std::size_t begin;
+		std::size_t end;
+		bool is_item;
+	};
+	std::vector<QueueElement>queue;
+
+	void push(QueueElement e);
+};
+
+//! build_link_geo_index adds the tail of every link and then a sample every
+//! link_geo_index_sampling_distance_in_cm along the link.
+constexpr uint32_t link_geo_index_sampling_distance_in_cm = 50000;
+
+//! Every point of a link is at most this far away from one of the samples of the
+//! link. The samples are placed using rounded distances. The slack of 10m
+//! covers the rounding errors.
+constexpr uint32_t link_geo_index_max_distance_from_link_to_sample_in_cm = link_geo_index_sampling_distance_in_cm + 1000;
+
+//! The samples are computed and the index is built on thread_count threads. The
+//! index does not depend on the thread count.
+VecGeoIndex build_link_geo_index(ConstRefLinkShapes, unsigned thread_count = 1);
 
 
 class LinkGeoIndexFindWithinRadiusQuery{
@@ -140,6 +202,55 @@ private:
 	GeoIndexFindAtLeastWithinRadiusQuery search;
 };
 
+struct NearestLink{
+	uint32_t link_id;
+	//! The closest point on the link.
+	GeoPos pos;
+	//! The distance from the tail of the link to pos along the link.
+	uint32_t offset_in_cm;
+	uint64_t distance_in_sqr_cm;
+};
+
+//! Enumerates the links of an index built by build_link_geo_index ordered by
+//! increasing distance to the center. The distances are exact, i.e., they are
+//! computed with find_closest_point_offset_and_distance_on_dlink. At most
+//! max_link_count links with a distance of at most max_distance_in_cm are
+//! returned. Calling next() k times yields the k nearest links without having to
+//! guess a radius.
+class LinkGeoIndexFindNearestQuery{
+public:
+	LinkGeoIndexFindNearestQuery(ConstRefLinkShapes map, ConstRefGeoIndex geo_index):
+		was_found(map.link_count), map(map), search(geo_index){}
+
+	void start(GeoPos center, uint32_t max_link_count, uint32_t max_distance_in_cm = std::numeric_limits<uint32_t>::max());
+	Optional<NearestLink> next();
+
+	ConstRefGeoIndex get_geo_index()const noexcept{
+		return search.get_geo_index();
+	}
+
+	ConstRefLinkShapes get_link_shapes()const noexcept{
+		return map;
+	}
+
+	GeoPos get_center()const noexcept{
+		return search.get_center();
+	}
+
+private:
+	TimestampFlags was_found;
+	ConstRefLinkShapes map;
+	GeoIndexFindNearestQuery search;
+
+	uint32_t remaining_link_count;
+	uint64_t max_distance_in_sqr_cm;
+
+	OptionalWithSentinel<GeoIndexItem> next_sample;
+
+	// min-heap of the links whose exact distance is known
+	std::vector<NearestLink>candidate_queue;
+};
+
 }
 
 #endif
@@ -18,12 +18,8 @@ struct ServerData{
 struct WorkerData{
     LinkGeoIndexFindWithinRadiusQuery link_geo_query;
 
-    WorkerData(int worker_id, int worker_count, const ServerData&server_data):
-        link_geo_query(server_data.link_shapes, server_data.link_geo_index){
-        (void)worker_id;
-        (void)worker_count;
-        (void)server_data;
-    }
+    explicit WorkerData(const ServerData&server_data):
+        link_geo_query(server_data.link_shapes, server_data.link_geo_index){}
 };
 
 
@@ -163,7 +159,7 @@ void run(int port, ConstRefLinkShapes shapes){
 	config.print_exception_message_in_answer = true;
 
 	LatLon center = compute_map_center(shapes);
-	VecGeoIndex link_geo_index = build_link_geo_index(shapes);
+	VecGeoIndex link_geo_index = build_link_geo_index(shapes, 0);
 
 	auto answer = [&](
 		int, int,
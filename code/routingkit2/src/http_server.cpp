@@ -12,9 +12,20 @@
 #include <string.h>
 #include <assert.h>
 
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include <errno.h>
 #include <unistd.h>
 #include <signal.h>
+#include <arpa/inet.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
 
 namespace RoutingKit2{
     namespace http{
@@ -26,114 +37,11 @@ namespace RoutingKit2{
             max_request_resource_size = 1<<14;
             timeout_in_seconds = 10;
             print_exception_message_in_answer = true;
+            max_connection_count_per_worker = 1<<10;
+            stop_flag = nullptr;
         }
 
         namespace {
-            class SyncSocketSet{
-            public:
-                SyncSocketSet()noexcept;
-                ~SyncSocketSet()noexcept;
-
-                SyncSocketSet(const SyncSocketSet&)=delete;
-                SyncSocketSet&operator=(const SyncSocketSet&)=delete;
-
-                bool blocking_add(int socket)noexcept;
-                void finish()noexcept;
-                int blocking_remove()noexcept;
-
-                static const int set_size = 8;
-            private:
-                std::atomic<int> set[set_size];
-                std::atomic<bool> kill_flag;
-
-                std::condition_variable cv_socket_added, cv_socket_removed;
-                std::mutex m_socket_added, m_socket_removed;
-            };
-
-            static int next(int index)noexcept{
-                ++index;
-                if(index == SyncSocketSet::set_size)
-                    return 0;
-                else
-                    return index;
-            }
-
-            SyncSocketSet::SyncSocketSet()noexcept{
-                for(int i=0; i<set_size; ++i)
-                    set[i].store(-1);
-                kill_flag.store(false);
-            }
-
-            SyncSocketSet::~SyncSocketSet()noexcept{
-                for(int i=0; i<set_size; ++i)
-                    if(set[i] != -1){
-                        int s = set[i].load();
-                        shutdown(s, SHUT_RDWR);
-                        close(s);
-                    }
-            }
-
-            bool SyncSocketSet::blocking_add(int socket)noexcept{
-                assert(socket >= 0);
-
-                if(kill_flag.load())
-                    return false;
-
-                // start_index is used spread out values throughout the set to avoid
-                // some old values staying in the set forever while new elements
-                // being removed with higher priority.
-                //
-                // The mangled socket is used as drop in for a somewhat random
-                // variable.
-                int start_index = (socket & 7) ^ ((socket>>3) & 7);
-
-                int i = start_index;
-                for(;;){
-                    if(set[i] == -1){
-                        int expected = -1;
-                        if(set[i].compare_exchange_weak(expected, socket)){
-                            cv_socket_added.notify_one();
-                            return true;
-                        }
-                    }
-                    i = next(i);
-
-                    if(i == start_index){
-                        std::unique_lock<std::mutex> lock(m_socket_removed);
-                        cv_socket_removed.wait_for(lock, std::chrono::milliseconds(100));
-                    }
-                }
-            }
-
-            int SyncSocketSet::blocking_remove()noexcept{
-                int i = 0;
-                for(;;){
-                    int ret = set[i];
-                    if(ret != -1){
-                        if(set[i].compare_exchange_weak(ret, -1)){
-                            cv_socket_removed.notify_one();
-                            return ret;
-                        }
-                    }
-                    i = next(i);
-
-                    if(i == 0){
-                        if(kill_flag.load()){
-                            return -1;
-                        }
-                        {
-                            std::unique_lock<std::mutex> lock(m_socket_added);
-                            cv_socket_added.wait_for(lock, std::chrono::milliseconds(100));
-                        }
-                    }
-                }
-            }
-
-            void SyncSocketSet::finish()noexcept{
-                kill_flag.store(true);
-                cv_socket_added.notify_one();
-            }
-
             template<class F>
             struct Finally{
                 F func;
@@ -244,15 +152,68 @@ namespace RoutingKit2{
                     return false;
                 }
 
+                // If the current header line is the header uppercase_name, then
+                // [value_begin, value_end) is set to its value without surrounding
+                // spaces. Otherwise false is returned.
+                bool get_header_value(const char*uppercase_name, int&value_begin, int&value_end)noexcept{
+                    int begin = 0;
+                    while(*uppercase_name != 0){
+                        if(begin == buffer_size || *uppercase_name != to_upper(buffer[begin]))
+                            return false;
+                        ++uppercase_name;
+                        ++begin;
+                    }
+                    int end = buffer_size;
+
+                    while(begin != end && is_space(buffer[begin]))
+                        ++begin;
+                    while(begin != end && is_space(buffer[end-1]))
+                        --end;
+                    if(begin == end || buffer[begin] != ':')
+                        return false;
+                    ++begin;
+                    while(begin != end && is_space(buffer[begin]))
+                        ++begin;
+                    value_begin = begin;
+                    value_end = end;
+                    return true;
+                }
+
+                bool does_value_contain_uppercase_string(int begin, int end, const char*s)noexcept{
+                    int len = strlen(s);
+                    for(int i=begin; i+len<=end; ++i){
+                        int j = 0;
+                        while(j != len && to_upper(buffer[i+j]) == s[j])
+                            ++j;
+                        if(j == len)
+                            return true;
+                    }
+                    return false;
+                }
+
                 int body_size;
+                bool is_http_1_0;
+                bool has_connection_close;
+                bool has_connection_keep_alive;
 
             public:
 
                 HTTPRequestHeaderParser(std::string*resource, int max_request_resource_size)noexcept:
-                    resource(resource), max_request_resource_size(max_request_resource_size), error_msg(nullptr), state(State::parse_verb), buffer_size(0), body_size(0){
+                    resource(resource), max_request_resource_size(max_request_resource_size), error_msg(nullptr), state(State::parse_verb), buffer_size(0),
+                    body_size(0), is_http_1_0(false), has_connection_close(false), has_connection_keep_alive(false){
                     resource->clear();
                 }
 
+                //! HTTP/1.1 connections are kept alive unless the client asks to
+                //! close them. HTTP/1.0 connections are only kept alive if the
+                //! client asks for it.
+                bool is_keep_alive()const noexcept{
+                    if(is_http_1_0)
+                        return has_connection_keep_alive && !has_connection_close;
+                    else
+                        return !has_connection_close;
+                }
+
                 const char*get_error()const noexcept {
                     return error_msg;
                 }
@@ -304,6 +265,7 @@ namespace RoutingKit2{
                                 if(!is_uppercase_string_in_buffer("HTTP/1.1") && !is_uppercase_string_in_buffer("HTTP/1.0")){
                                     error_msg = "Only HTTP 1.1 and HTTP 1.0 supported";
                                 }else{
+                                    is_http_1_0 = is_uppercase_string_in_buffer("HTTP/1.0");
                                     state = State::parse_header_line;
                                     buffer_size = 0;
                                 }
@@ -326,25 +288,22 @@ namespace RoutingKit2{
                                     break;
                                 }
 
-                                char content_length[] = "CONTENT-LENGTH";
-                                if(does_buffer_start_with_uppercase_string(content_length)){
-                                    int begin = sizeof(content_length)-1;
-                                    int end = buffer_size;
-
-                                    while(begin != end && is_space(buffer[begin]))
-                                        ++begin;
-                                    while(begin != end && is_space(buffer[end-1]))
-                                        --end;
-                                    if(begin == end || buffer[begin] != ':'){
-                                        error_msg = "Colon missing after content-length in header";
-                                    }else{
-                                        ++begin;
-                                        while(begin != end && is_space(buffer[begin]))
-                                            ++begin;
-                                        if(!parse_unsigned_int(buffer+begin, buffer+end, &body_size)){
-                                            error_msg = "Cannot parse number in content-length header";
-                                        }
+                                int begin, end;
+                                if(get_header_value("CONTENT-LENGTH", begin, end)){
+                                    if(!parse_unsigned_int(buffer+begin, buffer+end, &body_size)){
+                                        error_msg = "Cannot parse number in content-length header";
                                     }
+                                }else if(does_buffer_start_with_uppercase_string("CONTENT-LENGTH")){
+                                    error_msg = "Colon missing after content-length in header";
+                                }else if(get_header_value("TRANSFER-ENCODING", begin, end)){
+                                    // The end of a chunked body cannot be found without
+                                    // decoding it, which would break keep-alive.
+                                    error_msg = "Transfer-Encoding not supported, use Content-Length";
+                                }else if(get_header_value("CONNECTION", begin, end)){
+                                    if(does_value_contain_uppercase_string(begin, end, "CLOSE"))
+                                        has_connection_close = true;
+                                    if(does_value_contain_uppercase_string(begin, end, "KEEP-ALIVE"))
+                                        has_connection_keep_alive = true;
                                 }
 
                                 buffer_size = 0;
@@ -407,127 +366,144 @@ namespace RoutingKit2{
                 }
             };
 
-            bool write_all(int conn_socket, const char*begin, const char*end)noexcept{
-                while(begin != end){
-                    int bytes_written = send(conn_socket, begin, end-begin, MSG_NOSIGNAL);
-                    if(bytes_written < 0)
-                        return false;
-                    begin += bytes_written;
-                }
-                return true;
+            void append_to(std::string&out, const HeaderFormatter&header){
+                out.append(header.begin(), header.end());
             }
 
-            void answer_with_bad_request(int conn_socket)noexcept{
-                char msg[] = "HTTP/1.0 400 Bad request\r\n";
-                write_all(conn_socket, msg, msg + sizeof(msg)-1);
-            };
-
-            void answer_with_bad_request(int conn_socket, const char*error)noexcept{
-                HeaderFormatter out;
+            void append_bad_request(std::string&out, const char*error){
+                HeaderFormatter header;
 
-                out.append_cstr("HTTP/1.0 400 Bad request\r\nContent-Length:");
+                header.append_cstr("HTTP/1.1 400 Bad request\r\nConnection:close\r\nContent-Length:");
                 int len = strlen(error);
-                out.append_unsigned_int(len);
-                out.append_cstr("\r\n\r\n");
-                out.append_cstr(error, len);
+                header.append_unsigned_int(len);
+                header.append_cstr("\r\n\r\n");
+                header.append_cstr(error, len);
 
-                write_all(conn_socket, out.begin(), out.end());
-            };
+                append_to(out, header);
+            }
 
-            void answer_with_exception(int conn_socket, const char*error)noexcept{
-                HeaderFormatter out;
+            void append_bad_request(std::string&out, bool keep_alive){
+                HeaderFormatter header;
 
-                out.append_cstr("HTTP/1.0 500 Internal Server Error\r\nContent-Length:");
+                header.append_cstr("HTTP/1.1 400 Bad request\r\nConnection:");
+                header.append_cstr(keep_alive ? "keep-alive" : "close");
+                header.append_cstr("\r\nContent-Length:0\r\n\r\n");
+
+                append_to(out, header);
+            }
+
+            void append_exception(std::string&out, const char*error, bool keep_alive){
+                HeaderFormatter header;
+
+                header.append_cstr("HTTP/1.1 500 Internal Server Error\r\nConnection:");
+                header.append_cstr(keep_alive ? "keep-alive" : "close");
+                header.append_cstr("\r\nContent-Length:");
 
                 const char*prefix = "exception: ";
                 int prefix_len = strlen(prefix);
                 int error_len = strlen(error);
-                out.append_unsigned_int(error_len + prefix_len);
-                out.append_cstr("\r\n\r\n");
-                out.append_cstr(prefix, prefix_len);
-                out.append_cstr(error, error_len);
-                out.append_char('\n');
+                header.append_unsigned_int(error_len + prefix_len + 1);
+                header.append_cstr("\r\n\r\n");
 
-                write_all(conn_socket, out.begin(), out.end());
-            };
+                append_to(out, header);
+                out.append(prefix, prefix_len);
+                out.append(error, error_len);
+                out.push_back('\n');
+            }
 
-            void answer_with_response(int conn_socket, const Response&response)noexcept{
-                HeaderFormatter out;
+            void append_response(std::string&out, const Response&response, bool keep_alive){
+                HeaderFormatter header;
 
-                out.append_cstr("HTTP/1.0 ");
-                out.append_unsigned_int(response.status);
-                out.append_cstr("\r\nContent-Length:");
-                out.append_unsigned_int(response.body.size());
+                header.append_cstr("HTTP/1.1 ");
+                header.append_unsigned_int(response.status);
+                header.append_cstr(" \r\nConnection:");
+                header.append_cstr(keep_alive ? "keep-alive" : "close");
+                header.append_cstr("\r\nContent-Length:");
+                header.append_unsigned_int(response.body.size());
                 if(!response.mime_type.empty()){
-                    out.append_cstr("\r\nContent-Type:");
-                    out.append_str(response.mime_type);
+                    header.append_cstr("\r\nContent-Type:");
+                    header.append_str(response.mime_type);
                 }
-                out.append_cstr("\r\n\r\n");
+                header.append_cstr("\r\n\r\n");
 
-                if(write_all(conn_socket, out.begin(), out.end()))
-                    write_all(conn_socket, &response.body[0], &response.body[0]+response.body.size());
-            };
+                append_to(out, header);
+                out.append(response.body);
+            }
 
-            struct MemoryBuffer{
-                static const int max_buffer_size = 1 << 16;
-                int buffer_size;
-                char buffer[max_buffer_size];
-            };
+            // After a request, a body buffer with a larger capacity is freed, so
+            // that an idle keep-alive connection does not hold on to it.
+            const std::size_t max_kept_body_capacity = 1<<16;
 
             class HTTPRequestParser{
             private:
                 Request*request;
+                int max_request_resource_size;
                 int max_request_body_size;
                 HTTPRequestHeaderParser header_parser;
                 const char*error_msg;
-                int body_end;
+                bool is_body_size_checked;
             public:
                 HTTPRequestParser(Request*request, int max_request_resource_size, int max_request_body_size):
-                    request(request), max_request_body_size(max_request_body_size),
+                    request(request), max_request_resource_size(max_request_resource_size), max_request_body_size(max_request_body_size),
                     header_parser(&request->resource, max_request_resource_size),
-                    error_msg(nullptr), body_end(0){
+                    error_msg(nullptr), is_body_size_checked(false){
                     request->body.clear();
                 }
 
-                void put(const MemoryBuffer&buffer){
-                    int pos_in_buffer = 0;
-                    while(!header_parser.is_header_complete() && pos_in_buffer != buffer.buffer_size){
-                        header_parser.put(buffer.buffer[pos_in_buffer]);
+                //! Prepares the parser for the next request on the same connection.
+                void reset(){
+                    header_parser = HTTPRequestHeaderParser(&request->resource, max_request_resource_size);
+                    error_msg = nullptr;
+                    is_body_size_checked = false;
+                    if(request->body.capacity() > max_kept_body_capacity)
+                        std::string().swap(request->body);
+                    else
+                        request->body.clear();
+                }
+
+                //! Consumes bytes from [begin, end) until the request is complete
+                //! and returns the first byte that was not consumed. With
+                //! pipelining, the remaining bytes belong to the next request.
+                //!
+                //! The body grows with the bytes that arrived. A client can thus
+                //! not make the server allocate max_request_body_size bytes by
+                //! only sending a header.
+                const char*put(const char*begin, const char*end){
+                    while(!header_parser.is_header_complete() && begin != end){
+                        header_parser.put(*begin);
+                        ++begin;
                         const char*err = header_parser.get_error();
                         if(err){
                             error_msg = err;
-                            return;
+                            return begin;
                         }
-                        ++pos_in_buffer;
                     }
 
                     if(!header_parser.is_header_complete())
-                        return;
+                        return begin;
 
-                    if(request->body.empty()){
-                        int body_size = header_parser.get_body_size();
-                        if(body_size > max_request_body_size){
+                    if(!is_body_size_checked){
+                        if(header_parser.get_body_size() > max_request_body_size){
                             error_msg = "HTTP request body larger than allowed";
-                            return;
+                            return begin;
                         }
-                        request->body.resize(header_parser.get_body_size());
+                        is_body_size_checked = true;
                     }
 
-                    int free_space_in_request_body = request->body.size() - body_end;
-                    int bytes_to_copy = std::min(buffer.buffer_size-pos_in_buffer, free_space_in_request_body);
+                    int missing_body_size = header_parser.get_body_size() - request->body.size();
+                    int bytes_to_copy = std::min<long>(end-begin, missing_body_size);
 
-                    memcpy(&request->body[0] + body_end, buffer.buffer+pos_in_buffer, bytes_to_copy);
-                    body_end += bytes_to_copy;
-                    pos_in_buffer += bytes_to_copy;
-
-                    if(body_end == (int)request->body.size() && pos_in_buffer != buffer.buffer_size){
-                        error_msg = "Body size larger than content-length";
-                        return;
-                    }
+                    request->body.append(begin, bytes_to_copy);
+                    begin += bytes_to_copy;
+                    return begin;
                 }
 
                 bool is_request_complete()const noexcept{
-                    return (int)request->body.size() == body_end && header_parser.is_header_complete();
+                    return header_parser.is_header_complete() && is_body_size_checked && (int)request->body.size() == header_parser.get_body_size();
+                }
+
+                bool is_keep_alive()const noexcept{
+                    return header_parser.is_keep_alive();
                 }
 
                 const char*get_error()const noexcept{
@@ -535,85 +511,419 @@ namespace RoutingKit2{
                 }
             };
 
-            const char* read_from_socket(int conn_socket, MemoryBuffer&buffer){
-                int r = read(conn_socket, buffer.buffer, buffer.max_buffer_size);
-                if(r < 0){
-                    if(r == EAGAIN || r == EWOULDBLOCK)
-                        return "call to read timed out";
-                    else
-                        return "internal server error during call to read while reading from socket";
-                }else if(r == 0){
-                    return "end of file/socket reached before HTTP request was completed";
-                }else{
-                    buffer.buffer_size = r;
-                    return nullptr;
+            struct Connection{
+                int socket;
+                Request request;
+                HTTPRequestParser parser;
+
+                //! Responses that were not yet sent, starting at out_begin.
+                std::string out;
+                std::size_t out_begin;
+
+                //! Set once no further request is read. The connection is
+                //! closed when out has been sent.
+                bool close_after_write;
+                uint32_t epoll_events;
+                std::chrono::steady_clock::time_point last_activity;
+
+                Connection(int socket, const Config&config):
+                    socket(socket),
+                    parser(&request, config.max_request_resource_size, config.max_request_body_size),
+                    out_begin(0), close_after_write(false), epoll_events(0){}
+
+                std::size_t get_pending_output_size()const noexcept{
+                    return out.size() - out_begin;
                 }
-            }
+            };
 
-            void thread_main(
-                SyncSocketSet*socket_set,
-                std::atomic<int>*started_worker_count, std::atomic<int>*finished_worker_count,
-                int worker_id,
-                Config config,
-                detail::RequestHandler handler, void*user_data
-            )noexcept{
-                ++*started_worker_count;
+            // Once this many bytes of responses are waiting to be sent, no
+            // further requests are read from the connection until the client
+            // has read them.
+            const std::size_t max_pending_output_size = 1<<20;
+
+            // Every worker thread is a reactor. It owns an epoll instance, in
+            // which the shared listening socket, its own connections and an
+            // eventfd to stop it are registered. Connections stay with the
+            // worker that accepted them. Requests are answered on this thread.
+            //
+            // While a request is answered, the other connections of the worker
+            // wait. Request handlers should therefore not block. A busy worker
+            // does not wait in epoll_wait, so new connections go to the other
+            // workers.
+            class Worker{
+            public:
+                Worker(int worker_id, const Config&config, int listening_socket, detail::RequestHandler handler, void*user_data);
+                ~Worker();
 
-                Request request;
+                Worker(const Worker&)=delete;
+                Worker&operator=(const Worker&)=delete;
+
+                void run()noexcept;
+                void stop()noexcept;
+
+            private:
+                int worker_id;
+                Config config;
+                int listening_socket;
+                detail::RequestHandler handler;
+                void*user_data;
+
+                int epoll_fd;
+                int stop_fd;
+
+                // While the process is out of file descriptors, the listening
+                // socket is removed from the epoll instance. Otherwise, as it is
+                // level-triggered, epoll_wait would return immediately, and the
+                // failing accept4 would be retried in a busy loop. The same is
+                // done while the worker has max_connection_count_per_worker
+                // connections.
+                bool is_listening;
+                std::chrono::steady_clock::time_point resume_listening_time;
+
+                std::unordered_map<int, std::unique_ptr<Connection>>connection;
+                std::vector<char>read_buffer;
                 Response response;
 
-                int conn_socket;
-                while(conn_socket = socket_set->blocking_remove(), conn_socket != -1){
+                bool start_listening()noexcept;
+                void stop_listening(std::chrono::milliseconds pause)noexcept;
+                bool is_at_connection_limit()const noexcept;
+                void accept_connection()noexcept;
+                void close_connection(Connection&conn)noexcept;
+                void close_timed_out_connections()noexcept;
+                bool read_requests(Connection&conn)noexcept;
+                void answer_requests(Connection&conn, const char*begin, const char*end)noexcept;
+                void answer_request(Connection&conn)noexcept;
+                bool write_responses(Connection&conn)noexcept;
+                void update(Connection&conn, uint32_t events)noexcept;
+            };
 
-                    struct timeval tv;
-                    tv.tv_sec = config.timeout_in_seconds;
-                    tv.tv_usec = 0;
-                    if(setsockopt(conn_socket, SOL_SOCKET, SO_RCVTIMEO, (const char*)&tv, sizeof tv)<0)
-                        continue;
-                    if(setsockopt(conn_socket, SOL_SOCKET, SO_SNDTIMEO, (const char*)&tv, sizeof tv)<0)
-                        continue;
+            Worker::Worker(int worker_id, const Config&config, int listening_socket, detail::RequestHandler handler, void*user_data):
+                worker_id(worker_id), config(config), listening_socket(listening_socket),
+                handler(handler), user_data(user_data), epoll_fd(-1), stop_fd(-1), is_listening(false), read_buffer(1<<16){
 
-                    const char*err = nullptr;
+                auto throw_errno = [](const char*msg){
+                    int err = errno;
+                    throw std::system_error(err, std::system_category(), msg);
+                };
 
-                    HTTPRequestParser request_parser(&request, config.max_request_resource_size, config.max_request_body_size);
-                    MemoryBuffer buffer;
+                epoll_fd = epoll_create1(EPOLL_CLOEXEC);
+                if(epoll_fd < 0)
+                    throw_errno("call to epoll_create1 failed");
 
-                    while(!request_parser.is_request_complete()){
-                        err = read_from_socket(conn_socket, buffer);
-                        if(err)
-                            break;
+                stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+                if(stop_fd < 0){
+                    int err = errno;
+                    close(epoll_fd);
+                    throw std::system_error(err, std::system_category(), "call to eventfd failed");
+                }
 
-                        request_parser.put(buffer);
-                        err = request_parser.get_error();
-                        if(err)
-                            break;
+                auto add = [&](int fd, uint32_t events){
+                    epoll_event e;
+                    e.events = events;
+                    e.data.fd = fd;
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, fd, &e) < 0){
+                        int err = errno;
+                        close(epoll_fd);
+                        close(stop_fd);
+                        throw std::system_error(err, std::system_category(), "call to epoll_ctl failed");
                     }
+                };
 
+                add(stop_fd, EPOLLIN);
+                if(!start_listening()){
+                    int err = errno;
+                    close(epoll_fd);
+                    close(stop_fd);
+                    throw std::system_error(err, std::system_category(), "call to epoll_ctl failed");
+                }
+            }
+
+            Worker::~Worker(){
+                for(auto&c:connection){
+                    shutdown(c.first, SHUT_RDWR);
+                    close(c.first);
+                }
+                close(stop_fd);
+                close(epoll_fd);
+            }
+
+            void Worker::stop()noexcept{
+                uint64_t one = 1;
+                ssize_t r = write(stop_fd, &one, sizeof(one));
+                (void)r;
+            }
+
+            bool Worker::start_listening()noexcept{
+                epoll_event e;
+                #ifdef EPOLLEXCLUSIVE
+                // Only wake up one of the workers per new connection.
+                e.events = EPOLLIN | EPOLLEXCLUSIVE;
+                #else
+                e.events = EPOLLIN;
+                #endif
+                e.data.fd = listening_socket;
+                if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, listening_socket, &e) < 0)
+                    return false;
+                is_listening = true;
+                return true;
+            }
+
+            void Worker::stop_listening(std::chrono::milliseconds pause)noexcept{
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, listening_socket, nullptr);
+                is_listening = false;
+                resume_listening_time = std::chrono::steady_clock::now() + pause;
+            }
+
+            bool Worker::is_at_connection_limit()const noexcept{
+                return connection.size() >= (std::size_t)config.max_connection_count_per_worker;
+            }
+
+            // Accepts at most one connection per wakeup. The listening socket is
+            // level-triggered, so further pending connections wake up a worker
+            // again. This spreads a burst of connections over all workers instead
+            // of letting the first one that wakes up take all of them.
+            void Worker::accept_connection()noexcept{
+                int conn_socket = accept4(listening_socket, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+                if(conn_socket < 0){
+                    // EAGAIN: Another worker took the connection. When running
+                    // out of file descriptors, the connection stays in the
+                    // backlog and is retried after a pause.
+                    if(errno == EMFILE || errno == ENFILE || errno == ENOBUFS || errno == ENOMEM)
+                        stop_listening(std::chrono::milliseconds(100));
+                    return;
+                }
+
+                int val = 1;
+                setsockopt(conn_socket, IPPROTO_TCP, TCP_NODELAY, &val, sizeof(val));
+
+                std::unique_ptr<Connection>conn;
+                try{
+                    conn.reset(new Connection(conn_socket, config));
+                }catch(...){
+                    close(conn_socket);
+                    return;
+                }
+
+                epoll_event e;
+                e.events = EPOLLIN;
+                e.data.fd = conn_socket;
+                if(epoll_ctl(epoll_fd, EPOLL_CTL_ADD, conn_socket, &e) < 0){
+                    close(conn_socket);
+                    return;
+                }
+                conn->epoll_events = EPOLLIN;
+                conn->last_activity = std::chrono::steady_clock::now();
+
+                try{
+                    connection[conn_socket] = std::move(conn);
+                }catch(...){
+                    close(conn_socket);
+                    return;
+                }
+
+                if(is_at_connection_limit())
+                    stop_listening(std::chrono::milliseconds(0));
+            }
+
+            void Worker::close_connection(Connection&conn)noexcept{
+                int conn_socket = conn.socket;
+                epoll_ctl(epoll_fd, EPOLL_CTL_DEL, conn_socket, nullptr);
+                shutdown(conn_socket, SHUT_RDWR);
+                close(conn_socket);
+                connection.erase(conn_socket);
+            }
+
+            void Worker::close_timed_out_connections()noexcept{
+                auto now = std::chrono::steady_clock::now();
+                auto timeout = std::chrono::seconds(config.timeout_in_seconds);
+
+                std::vector<int>timed_out;
+                for(auto&c:connection)
+                    if(now - c.second->last_activity > timeout)
+                        timed_out.push_back(c.first);
+                for(int s:timed_out)
+                    close_connection(*connection[s]);
+            }
+
+            void Worker::answer_request(Connection&conn)noexcept{
+                bool keep_alive = conn.parser.is_keep_alive();
+
+                response.status = 200;
+                response.mime_type.clear();
+                response.body = "Request handler did not modify body; This is an error in the code that uses the HTTP server\n";
+
+                try{
+                    try{
+                        handler(worker_id, config.worker_count, user_data, conn.request, response);
+                        append_response(conn.out, response, keep_alive);
+                    }catch(std::exception&err){
+                        if(config.print_exception_message_in_answer)
+                            append_exception(conn.out, err.what(), keep_alive);
+                        else
+                            append_bad_request(conn.out, keep_alive);
+                    }catch(...){
+                        if(config.print_exception_message_in_answer)
+                            append_exception(conn.out, "unknown exception", keep_alive);
+                        else
+                            append_bad_request(conn.out, keep_alive);
+                    }
+                }catch(...){
+                    // Out of memory while formatting the answer
+                    keep_alive = false;
+                }
+
+                if(!keep_alive)
+                    conn.close_after_write = true;
+            }
+
+            void Worker::answer_requests(Connection&conn, const char*begin, const char*end)noexcept{
+                while(begin != end && !conn.close_after_write){
+                    try{
+                        begin = conn.parser.put(begin, end);
+                    }catch(...){
+                        conn.close_after_write = true;
+                        return;
+                    }
+
+                    const char*err = conn.parser.get_error();
                     if(err){
-                        answer_with_bad_request(conn_socket, err);
+                        // The start of the next request is unknown. The
+                        // connection can therefore not be kept alive.
+                        try{
+                            append_bad_request(conn.out, err);
+                        }catch(...){}
+                        conn.close_after_write = true;
+                        return;
+                    }
+
+                    if(conn.parser.is_request_complete()){
+                        answer_request(conn);
+                        conn.parser.reset();
+                    }
+                }
+            }
+
+            bool Worker::read_requests(Connection&conn)noexcept{
+                while(!conn.close_after_write && conn.get_pending_output_size() < max_pending_output_size){
+                    ssize_t r = recv(conn.socket, &read_buffer[0], read_buffer.size(), 0);
+                    if(r > 0){
+                        conn.last_activity = std::chrono::steady_clock::now();
+                        answer_requests(conn, &read_buffer[0], &read_buffer[0] + r);
+                    }else if(r == 0){
+                        // The client will not send further requests. Answers to
+                        // the complete ones are still sent.
+                        conn.close_after_write = true;
+                    }else if(errno == EINTR){
+                        continue;
+                    }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+                        break;
                     }else{
-                        response.status = 200;
-                        response.body = "Request handler did not modify body; This is an error in the code that uses the HTTP server\n";
+                        return false;
+                    }
+                }
+                return true;
+            }
 
-                        try{
-                            handler(worker_id, config.worker_count, user_data, request, response);
-                            answer_with_response(conn_socket, response);
-                        }catch(std::exception&err){
-                            if(config.print_exception_message_in_answer)
-                                answer_with_exception(conn_socket, err.what());
-                            else
-                                answer_with_bad_request(conn_socket);
-                        }catch(...){
-                            if(config.print_exception_message_in_answer)
-                                answer_with_exception(conn_socket, "unknown exception");
-                            else
-                                answer_with_bad_request(conn_socket);
+            bool Worker::write_responses(Connection&conn)noexcept{
+                while(conn.out_begin != conn.out.size()){
+                    ssize_t r = send(conn.socket, conn.out.data() + conn.out_begin, conn.out.size() - conn.out_begin, MSG_NOSIGNAL);
+                    if(r >= 0){
+                        conn.out_begin += r;
+                        conn.last_activity = std::chrono::steady_clock::now();
+                    }else if(errno == EINTR){
+                        continue;
+                    }else if(errno == EAGAIN || errno == EWOULDBLOCK){
+                        break;
+                    }else{
+                        return false;
+                    }
+                }
+                if(conn.out_begin == conn.out.size()){
+                    conn.out.clear();
+                    conn.out_begin = 0;
+                }
+                return true;
+            }
+
+            void Worker::update(Connection&conn, uint32_t events)noexcept{
+                if((events & (EPOLLERR | EPOLLHUP)) && !(events & EPOLLIN)){
+                    close_connection(conn);
+                    return;
+                }
+
+                if((events & EPOLLIN) && !read_requests(conn)){
+                    close_connection(conn);
+                    return;
+                }
+
+                if(!write_responses(conn)){
+                    close_connection(conn);
+                    return;
+                }
+
+                std::size_t pending = conn.get_pending_output_size();
+                if(conn.close_after_write && pending == 0){
+                    close_connection(conn);
+                    return;
+                }
+
+                uint32_t wanted_events = 0;
+                if(pending != 0)
+                    wanted_events |= EPOLLOUT;
+                if(!conn.close_after_write && pending < max_pending_output_size)
+                    wanted_events |= EPOLLIN;
+
+                if(wanted_events != conn.epoll_events){
+                    epoll_event e;
+                    e.events = wanted_events;
+                    e.data.fd = conn.socket;
+                    if(epoll_ctl(epoll_fd, EPOLL_CTL_MOD, conn.socket, &e) < 0){
+                        close_connection(conn);
+                        return;
+                    }
+                    conn.epoll_events = wanted_events;
+                }
+            }
+
+            void Worker::run()noexcept{
+                const int max_event_count = 64;
+                epoll_event event[max_event_count];
+
+                auto last_timeout_check = std::chrono::steady_clock::now();
+
+                for(;;){
+                    int timeout_in_ms = is_listening ? 1000 : 100;
+                    int event_count = epoll_wait(epoll_fd, event, max_event_count, timeout_in_ms);
+                    if(event_count < 0){
+                        if(errno == EINTR)
+                            continue;
+                        return;
+                    }
+
+                    for(int i=0; i<event_count; ++i){
+                        int fd = event[i].data.fd;
+                        if(fd == stop_fd){
+                            return;
+                        }else if(fd == listening_socket){
+                            if(is_listening)
+                                accept_connection();
+                        }else{
+                            auto c = connection.find(fd);
+                            if(c != connection.end())
+                                update(*c->second, event[i].events);
                         }
                     }
-                    shutdown(conn_socket, SHUT_RDWR);
-                    close(conn_socket);
+
+                    auto now = std::chrono::steady_clock::now();
+                    if(!is_listening && now >= resume_listening_time && !is_at_connection_limit()){
+                        if(!start_listening())
+                            resume_listening_time = now + std::chrono::milliseconds(100);
+                    }
+                    if(now - last_timeout_check >= std::chrono::seconds(1)){
+                        close_timed_out_connections();
+                        last_timeout_check = now;
+                    }
                 }
-                ++*finished_worker_count;
             }
         }
 
@@ -632,8 +942,10 @@ namespace RoutingKit2{
                     throw std::runtime_error("max_request_body_size must be at least 1");
                 if(config.max_request_resource_size < 1)
                     throw std::runtime_error("max_request_resource_size must be at least 1");
+                if(config.max_connection_count_per_worker < 1)
+                    throw std::runtime_error("max_connection_count_per_worker must be at least 1");
 
-                int listing_socket = socket(AF_INET6, SOCK_STREAM, 0);
+                int listing_socket = socket(AF_INET6, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
                 if(listing_socket < 0){
                     int err = errno;
                     throw std::system_error(err, std::system_category(), "call to socket failed");
@@ -649,16 +961,29 @@ namespace RoutingKit2{
                 }
 
                 sockaddr_in6 address;
+                memset(&address, 0, sizeof(address));
                 address.sin6_family = AF_INET6;
                 address.sin6_port = htons(config.port);
-                address.sin6_addr = in6addr_any;
+                if(config.bind_address.empty()){
+                    address.sin6_addr = in6addr_any;
+                }else{
+                    // IPv4 addresses are mapped into the IPv6 address space.
+                    in_addr ipv4_address;
+                    if(inet_pton(AF_INET, config.bind_address.c_str(), &ipv4_address) == 1){
+                        address.sin6_addr.s6_addr[10] = 0xff;
+                        address.sin6_addr.s6_addr[11] = 0xff;
+                        memcpy(&address.sin6_addr.s6_addr[12], &ipv4_address, 4);
+                    }else if(inet_pton(AF_INET6, config.bind_address.c_str(), &address.sin6_addr) != 1){
+                        throw std::runtime_error("bind_address \""+config.bind_address+"\" is no IP address");
+                    }
+                }
 
                 int bind_ret = bind(listing_socket, (struct sockaddr *) &address, sizeof(address));
                 if(bind_ret < 0){
                     int err = errno;
                     throw std::system_error(err, std::system_category(), "call to bind failed");
                 }
-                int listen_ret = listen(listing_socket, 8);
+                int listen_ret = listen(listing_socket, SOMAXCONN);
                 if(listen_ret < 0){
                     int err = errno;
                     throw std::system_error(err, std::system_category(), "call to listen failed");
@@ -689,62 +1014,33 @@ namespace RoutingKit2{
                     sigaction(SIGINT, &new_sigaction, &old_sigaction);
                 }
 
-                SyncSocketSet socket_set;
-
-                std::atomic<int> started_worker_count(0);
-                std::atomic<int> finished_worker_count(0);
+                std::vector<std::unique_ptr<Worker>>worker_list;
+                for(int i=0; i<config.worker_count; ++i)
+                    worker_list.emplace_back(new Worker(i, config, listing_socket, request_handler, request_user_data));
 
-                auto wait_for_all_workers_to_finish = [&]{
-                    while(started_worker_count.load() != finished_worker_count.load())
-                        std::this_thread::sleep_for(std::chrono::microseconds(50));
-                };
+                std::vector<std::thread>thread_list;
 
                 auto f3 = finally([&]{
-                    socket_set.finish();
-                    wait_for_all_workers_to_finish();
+                    for(auto&w:worker_list)
+                        w->stop();
+                    for(auto&t:thread_list)
+                        t.join();
                 });
 
-                int i=0;
-                while(i<(int)config.worker_count){
-                    std::thread(
-                        thread_main, &socket_set,
-                        &started_worker_count, &finished_worker_count, i,
-                        config, request_handler, request_user_data
-                    ).detach();
-                    ++i;
-                    while(started_worker_count.load()!=i){
-                        std::this_thread::sleep_for(std::chrono::microseconds(50));
-                    }
+                for(auto&w:worker_list){
+                    Worker*worker = w.get();
+                    thread_list.emplace_back([worker]{worker->run();});
                 }
 
-                if(finished_worker_count.load() != 0)
-                    throw std::runtime_error("some worker finished early");
-
                 startup_handler(startup_user_data);
 
-                for(;;){
-                    if(sigint_received.load()){
-                        socket_set.finish();
-                        break;
-                    }
-                    // FIXME: If SIGINT happens when main thread is here, the signal is lost...
-                    int conn_socket = accept(listing_socket, nullptr, 0);
-                    if(conn_socket < 0){
-                        int err = errno;
-                        if(err == EINTR){
-                            if(sigint_received.load()){
-                                socket_set.finish();
-                                break;
-                            }
-                        }
-                        throw std::system_error(err, std::system_category(), "call to accept failed");
-                    }
-                    if(!socket_set.blocking_add(conn_socket)){
-                        break;
-                    }
-                }
-
-                wait_for_all_workers_to_finish();
+                // The workers accept and answer all connections. This thread
+                // only waits for SIGINT or the stop flag.
+                auto is_stop_requested = [&]{
+                    return (config.install_int_signal_handler && sigint_received.load()) || (config.stop_flag != nullptr && config.stop_flag->load());
+                };
+                while(!is_stop_requested())
+                    std::this_thread::sleep_for(std::chrono::milliseconds(50));
             }
         }
     }
@@ -5,6 +5,7 @@
 #include <vector>
 #include <memory>
 #include <utility>
+#include <atomic>
 
 namespace RoutingKit2{
     namespace http{
@@ -33,6 +34,11 @@ namespace RoutingKit2{
 
         struct Config{
             int port;
+
+            //! IPv4 or IPv6 address to listen on, e.g., "127.0.0.1" to only accept
+            //! local connections. Empty means all addresses.
+            std::string bind_address;
+
             int worker_count;
             bool install_int_signal_handler;
             int max_request_body_size;
@@ -40,6 +46,15 @@ namespace RoutingKit2{
             int timeout_in_seconds;
             bool print_exception_message_in_answer;
 
+            //! A worker stops accepting connections while it has this many open
+            //! ones. New connections then go to the other workers or wait in the
+            //! backlog.
+            int max_connection_count_per_worker;
+
+            //! If not null, run returns once *stop_flag is set. This allows to
+            //! stop a server without SIGINT.
+            const std::atomic<bool>*stop_flag;
+
             Config();
         };
 
@@ -89,7 +104,7 @@ namespace RoutingKit2{
         void run_with_worker_data(Config config, const ServerData&server_data, const RequestCallback&request_callback, const StartupCallback&startup_callback){
             std::vector<std::unique_ptr<WorkerData>>worker_data_list(config.worker_count);
             for(int i=0; i<config.worker_count; ++i)
-                worker_data_list[i] = std::unique_ptr<WorkerData>(new WorkerData(i, config.worker_count, server_data));
+                worker_data_list[i] = std::unique_ptr<WorkerData>(new WorkerData(server_data));
             run(
                 config,
                 [&](int worker_id, int worker_count, const Request&request, Response&response){
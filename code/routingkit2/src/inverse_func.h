@@ -3,6 +3,7 @@
 
 #include "sort.h"
 #include "min_max.h"
+#include "parallel.h"
 #include "span.h"
 
 #include <assert.h>
@@ -24,45 +25,75 @@ namespace RoutingKit2{
 //! }
 //!
 //! invert_func computes this R.
+//!
+//! All functions optionally run on thread_count threads. A thread_count of 0
+//! means std::thread::hardware_concurrency(). The result does not depend on the
+//! thread count.
+
+namespace detail{
+	const unsigned inverse_func_min_element_count_per_thread = 1<<16;
+}
 
 inline
-void invert_func_and_copy_into(Span<const uint32_t>func, Span<uint32_t>inv_func){
+void invert_func_and_copy_into(Span<const uint32_t>func, Span<uint32_t>inv_func, unsigned thread_count = 1){
 	const uint32_t image_count = inv_func.size()-1;
 	assert(is_sorted_using_less(func));
 	assert(!inv_func.empty());
 	assert(func.empty() || max_element_of(func) < image_count);
 
-	uint32_t dom = 0;
-	for(uint32_t img=0; img<image_count; ++img){
-		while(dom < func.size() && func[dom] < img)
-			++dom;
-		inv_func[img] = dom;
-	}
+	// Every thread fills a range of images. It finds its first preimage by
+	// binary search.
+	thread_count = limit_thread_count(thread_count, image_count, detail::inverse_func_min_element_count_per_thread);
+	run_on_thread_ranges(
+		thread_count, image_count,
+		[&](unsigned, uint64_t img_begin, uint64_t img_end){
+			uint32_t dom = std::lower_bound(func.begin(), func.end(), (uint32_t)img_begin) - func.begin();
+			for(uint32_t img=img_begin; img<img_end; ++img){
+				while(dom < func.size() && func[dom] < img)
+					++dom;
+				inv_func[img] = dom;
+			}
+		}
+	);
 
 	inv_func[image_count] = func.size();
 }
 
 inline
-std::vector<uint32_t>invert_func(Span<const uint32_t>func, uint32_t element_count){
+std::vector<uint32_t>invert_func(Span<const uint32_t>func, uint32_t element_count, unsigned thread_count = 1){
 	std::vector<uint32_t>inv_func(element_count+1);
-	invert_func_and_copy_into(func, inv_func);
+	invert_func_and_copy_into(func, inv_func, thread_count);
 	return inv_func;
 }
 
 inline
-void invert_inverse_func_and_copy_into(Span<const uint32_t>inv_func, Span<uint32_t>func){
+void invert_inverse_func_and_copy_into(Span<const uint32_t>inv_func, Span<uint32_t>func, unsigned thread_count = 1){
 	assert(!inv_func.empty());
 	assert(inv_func.back() == func.size());
-	for(uint32_t i=0; i<inv_func.size()-1; ++i)
-		for(uint32_t j=inv_func[i]; j<inv_func[i+1]; ++j)
-			func[j] = i;
+
+	// The threads split the output and not the images, as the number of
+	// preimages per image can vary a lot.
+	thread_count = limit_thread_count(thread_count, func.size(), detail::inverse_func_min_element_count_per_thread);
+	run_on_thread_ranges(
+		thread_count, func.size(),
+		[&](unsigned, uint64_t dom_begin, uint64_t dom_end){
+			if(dom_begin == dom_end)
+				return;
+			uint32_t i = std::upper_bound(inv_func.begin(), inv_func.end(), (uint32_t)dom_begin) - inv_func.begin() - 1;
+			for(uint32_t j=dom_begin; j<dom_end; ++j){
+				while(inv_func[i+1] <= j)
+					++i;
+				func[j] = i;
+			}
+		}
+	);
 }
 
 inline
-std::vector<uint32_t> invert_inverse_func(Span<const uint32_t>inv_func){
+std::vector<uint32_t> invert_inverse_func(Span<const uint32_t>inv_func, unsigned thread_count = 1){
 	assert(!inv_func.empty());
 	std::vector<unsigned>func(inv_func.back());
-	invert_inverse_func_and_copy_into(inv_func, func);
+	invert_inverse_func_and_copy_into(inv_func, func, thread_count);
 	return func;
 }
 
@@ -0,0 +1,342 @@
+#include "link_snapper.h"
+#include "map.h"
+#include "parallel.h"
+#include "sort.h"
+#include "timestamp_flags.h"
+
+#include <algorithm>
+#include <atomic>
+#include <assert.h>
+#include <math.h>
+
+#if defined(__AVX2__) && defined(__FMA__)
+#include <immintrin.h>
+#endif
+
+namespace RoutingKit2{
+
+namespace{
+	// Number of consecutive points along the Hilbert curve that a thread
+	// processes at once.
+	constexpr uint32_t chunk_size = 64;
+
+	// The floating point distances differ from the exact ones by less than this.
+	// The exact computation rounds the closest point on a segment towards zero
+	// in every coordinate, i.e., it moves by less than sqrt(3) cm. The remainder
+	// covers the rounding errors of the floating point computation.
+	constexpr double approx_error_in_cm = 4.0;
+
+	uint32_t compute_hilbert_index(LatLon p)noexcept{
+		uint32_t x = static_cast<uint32_t>((static_cast<int64_t>(p.lon_in_decamicrodeg) + 18000000) * 65535 / 36000000);
+		uint32_t y = static_cast<uint32_t>((static_cast<int64_t>(p.lat_in_decamicrodeg) + 9000000) * 65535 / 18000000);
+		x = std::min<uint32_t>(x, 65535);
+		y = std::min<uint32_t>(y, 65535);
+
+		uint32_t d = 0;
+		for(uint32_t s = 1u<<15; s != 0; s >>= 1){
+			uint32_t rx = (x & s) != 0;
+			uint32_t ry = (y & s) != 0;
+			d += s * s * ((3 * rx) ^ ry);
+			if(ry == 0){
+				if(rx == 1){
+					x = 65535 - x;
+					y = 65535 - y;
+				}
+				std::swap(x, y);
+			}
+		}
+		return d;
+	}
+
+	uint64_t cm_to_sqr_cm(uint32_t cm)noexcept{
+		return static_cast<uint64_t>(cm) * cm;
+	}
+
+	// Computes the squared distances between the origin and the segments between
+	// consecutive points. The coordinates must be relative to the query point.
+	void compute_approximate_segment_distances(
+		const double*x, const double*y, const double*z,
+		uint32_t segment_count, double*dist
+	)noexcept{
+		uint32_t i = 0;
+		#if defined(__AVX2__) && defined(__FMA__)
+		const __m256d zero = _mm256_setzero_pd();
+		const __m256d one = _mm256_set1_pd(1.0);
+		for(; i + 4 <= segment_count; i += 4){
+			__m256d ax = _mm256_loadu_pd(x+i), ay = _mm256_loadu_pd(y+i), az = _mm256_loadu_pd(z+i);
+			__m256d abx = _mm256_sub_pd(_mm256_loadu_pd(x+i+1), ax);
+			__m256d aby = _mm256_sub_pd(_mm256_loadu_pd(y+i+1), ay);
+			__m256d abz = _mm256_sub_pd(_mm256_loadu_pd(z+i+1), az);
+
+			__m256d num = _mm256_mul_pd(ax, abx);
+			num = _mm256_fmadd_pd(ay, aby, num);
+			num = _mm256_fmadd_pd(az, abz, num);
+			num = _mm256_sub_pd(zero, num);
+
+			__m256d denom = _mm256_mul_pd(abx, abx);
+			denom = _mm256_fmadd_pd(aby, aby, denom);
+			denom = _mm256_fmadd_pd(abz, abz, denom);
+
+			// If denom is 0 then so is num and the quotient is NaN. max returns its
+			// second operand in this case.
+			__m256d t = _mm256_min_pd(_mm256_max_pd(_mm256_div_pd(num, denom), zero), one);
+
+			__m256d dx = _mm256_fmadd_pd(t, abx, ax);
+			__m256d dy = _mm256_fmadd_pd(t, aby, ay);
+			__m256d dz = _mm256_fmadd_pd(t, abz, az);
+
+			__m256d d = _mm256_mul_pd(dx, dx);
+			d = _mm256_fmadd_pd(dy, dy, d);
+			d = _mm256_fmadd_pd(dz, dz, d);
+			_mm256_storeu_pd(dist+i, d);
+		}
+		#endif
+		for(; i < segment_count; ++i){
+			double abx = x[i+1] - x[i], aby = y[i+1] - y[i], abz = z[i+1] - z[i];
+			double num = -(x[i]*abx + y[i]*aby + z[i]*abz);
+			double denom = abx*abx + aby*aby + abz*abz;
+			double t = 0.0;
+			if(denom > 0.0)
+				t = std::min(std::max(num / denom, 0.0), 1.0);
+			double dx = x[i] + t*abx, dy = y[i] + t*aby, dz = z[i] + t*abz;
+			dist[i] = dx*dx + dy*dy + dz*dz;
+		}
+	}
+}
+
+class LinkSnapper::Worker{
+public:
+	explicit Worker(const LinkSnapper&snapper):
+		snapper(snapper),
+		search(snapper.link_geo_index),
+		was_found(snapper.map.link_count){}
+
+	SnappedPoint snap(LatLon point, uint32_t max_distance_in_cm);
+
+private:
+	const LinkSnapper&snapper;
+	GeoIndexFindNearestQuery search;
+	TimestampFlags was_found;
+
+	std::vector<double>x, y, z, dist;
+
+	struct Best{
+		uint32_t link_id;
+		uint32_t segment;
+		GeoPos pos;
+		uint64_t distance_in_sqr_cm;
+	};
+
+	void load_link(uint32_t link_id, GeoPos center);
+	GeoPos get_link_point(uint32_t link_id, uint32_t i)const noexcept;
+	uint32_t compute_offset(const Best&best)const noexcept;
+};
+
+GeoPos LinkSnapper::Worker::get_link_point(uint32_t link_id, uint32_t i)const noexcept{
+	const ConstRefLinkShapes&map = snapper.map;
+	uint32_t shape_begin = map.first_shape_pos_of_link[link_id];
+	uint32_t shape_end = map.first_shape_pos_of_link[link_id+1];
+	if(i == 0)
+		return snapper.node_geo_pos[map.link_tail[link_id]];
+	else if(i <= shape_end - shape_begin)
+		return snapper.shape_geo_pos[shape_begin + i - 1];
+	else
+		return snapper.node_geo_pos[map.link_head[link_id]];
+}
+
+void LinkSnapper::Worker::load_link(uint32_t link_id, GeoPos center){
+	const ConstRefLinkShapes&map = snapper.map;
+	uint32_t shape_begin = map.first_shape_pos_of_link[link_id];
+	uint32_t shape_end = map.first_shape_pos_of_link[link_id+1];
+	uint32_t point_count = shape_end - shape_begin + 2;
+
+	x.resize(point_count);
+	y.resize(point_count);
+	z.resize(point_count);
+	dist.resize(point_count - 1);
+
+	auto load = [&](uint32_t i, GeoPos p){
+		x[i] = static_cast<double>(p.x) - static_cast<double>(center.x);
+		y[i] = static_cast<double>(p.y) - static_cast<double>(center.y);
+		z[i] = static_cast<double>(p.z) - static_cast<double>(center.z);
+	};
+
+	load(0, snapper.node_geo_pos[map.link_tail[link_id]]);
+	for(uint32_t i=shape_begin; i<shape_end; ++i)
+		load(i - shape_begin + 1, snapper.shape_geo_pos[i]);
+	load(point_count-1, snapper.node_geo_pos[map.link_head[link_id]]);
+}
+
+uint32_t LinkSnapper::Worker::compute_offset(const Best&best)const noexcept{
+	// Same accumulation as in find_closest_point_offset_and_distance_on_dlink.
+	int32_t offset = 0;
+	GeoPos prev = get_link_point(best.link_id, 0);
+	for(uint32_t i=1; i<=best.segment; ++i){
+		GeoPos now = get_link_point(best.link_id, i);
+		offset += compute_distance_in_cm(now, prev);
+		prev = now;
+	}
+	offset += compute_distance_in_cm(prev, best.pos);
+	return offset;
+}
+
+SnappedPoint LinkSnapper::Worker::snap(LatLon point, uint32_t max_distance_in_cm){
+	const ConstRefLinkShapes&map = snapper.map;
+	GeoPos center(point);
+
+	uint64_t max_distance_in_sqr_cm = cm_to_sqr_cm(max_distance_in_cm) + 2*static_cast<uint64_t>(max_distance_in_cm);
+	uint64_t max_sample_distance_in_cm = static_cast<uint64_t>(max_distance_in_cm) + link_geo_index_max_distance_from_link_to_sample_in_cm;
+	search.start(center, std::numeric_limits<uint32_t>::max(), std::min<uint64_t>(max_sample_distance_in_cm, std::numeric_limits<uint32_t>::max()));
+	was_found.reset_all();
+
+	Best best;
+	best.link_id = invalid_snapped_link_id;
+	best.distance_in_sqr_cm = std::numeric_limits<uint64_t>::max();
+
+	while(auto sample = search.next()){
+		// Links whose samples were not yet enumerated are at least this far away.
+		if(best.link_id != invalid_snapped_link_id){
+			uint32_t sample_distance_in_cm = sqr_cm_to_cm(search.get_distance_in_sqr_cm());
+			if(sample_distance_in_cm > link_geo_index_max_distance_from_link_to_sample_in_cm && cm_to_sqr_cm(sample_distance_in_cm - link_geo_index_max_distance_from_link_to_sample_in_cm) > best.distance_in_sqr_cm)
+				break;
+		}
+
+		uint32_t link_id = sample->id;
+		if(was_found.is_set(link_id))
+			continue;
+		was_found.set(link_id);
+
+		load_link(link_id, center);
+		uint32_t segment_count = map.first_shape_pos_of_link[link_id+1] - map.first_shape_pos_of_link[link_id] + 1;
+		compute_approximate_segment_distances(x.data(), y.data(), z.data(), segment_count, dist.data());
+
+		double min_approx_distance_in_cm = sqrt(*std::min_element(dist.begin(), dist.begin() + segment_count));
+
+		uint64_t bound_in_sqr_cm = std::min(best.distance_in_sqr_cm, max_distance_in_sqr_cm);
+		if(min_approx_distance_in_cm - approx_error_in_cm > sqrt(static_cast<double>(bound_in_sqr_cm)))
+			continue;
+
+		// Only segments that can be at least as close as the closest one in exact
+		// arithmetic are evaluated exactly.
+		double candidate_bound_in_cm = min_approx_distance_in_cm + 2*approx_error_in_cm;
+		double candidate_bound_in_sqr_cm = candidate_bound_in_cm * candidate_bound_in_cm;
+
+		Best link_best;
+		link_best.link_id = link_id;
+		link_best.distance_in_sqr_cm = std::numeric_limits<uint64_t>::max();
+		for(uint32_t i=0; i<segment_count; ++i){
+			if(dist[i] > candidate_bound_in_sqr_cm)
+				continue;
+			GeoPos candidate = find_closest_point_on_segment(center, get_link_point(link_id, i), get_link_point(link_id, i+1));
+			uint64_t candidate_distance_in_sqr_cm = compute_distance_in_sqr_cm(center, candidate);
+			if(candidate_distance_in_sqr_cm < link_best.distance_in_sqr_cm){
+				link_best.segment = i;
+				link_best.pos = candidate;
+				link_best.distance_in_sqr_cm = candidate_distance_in_sqr_cm;
+			}
+		}
+
+		if(link_best.distance_in_sqr_cm > max_distance_in_sqr_cm)
+			continue;
+
+		if(
+			link_best.distance_in_sqr_cm < best.distance_in_sqr_cm ||
+			(link_best.distance_in_sqr_cm == best.distance_in_sqr_cm && link_id < best.link_id)
+		)
+			best = link_best;
+	}
+
+	SnappedPoint ret;
+	ret.link_id = best.link_id;
+	if(best.link_id != invalid_snapped_link_id){
+		ret.offset_in_cm = compute_offset(best);
+		ret.distance_in_sqr_cm = best.distance_in_sqr_cm;
+	}else{
+		ret.offset_in_cm = 0;
+		ret.distance_in_sqr_cm = std::numeric_limits<uint64_t>::max();
+	}
+	return ret;
+}
+
+LinkSnapper::LinkSnapper(ConstRefLinkShapes map, ConstRefGeoIndex link_geo_index, unsigned thread_count):
+	map(map), link_geo_index(link_geo_index), thread_count(resolve_thread_count(thread_count)),
+	node_geo_pos(map.node_count), shape_geo_pos(map.shape_pos_count){
+
+	run_on_thread_ranges(
+		limit_thread_count(this->thread_count, map.node_count, 1<<16), map.node_count,
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(uint64_t i=begin; i<end; ++i)
+				node_geo_pos[i] = GeoPos(map.node_pos[i]);
+		}
+	);
+
+	run_on_thread_ranges(
+		limit_thread_count(this->thread_count, map.shape_pos_count, 1<<16), map.shape_pos_count,
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(uint64_t i=begin; i<end; ++i)
+				shape_geo_pos[i] = GeoPos(map.shape_pos[i]);
+		}
+	);
+}
+
+LinkSnapper::~LinkSnapper() = default;
+
+std::unique_ptr<LinkSnapper::Worker> LinkSnapper::acquire_worker()const{
+	{
+		std::unique_lock<std::mutex>guard(worker_pool_lock);
+		if(!worker_pool.empty()){
+			std::unique_ptr<Worker>worker = std::move(worker_pool.back());
+			worker_pool.pop_back();
+			return worker;
+		}
+	}
+	return std::unique_ptr<Worker>(new Worker(*this));
+}
+
+void LinkSnapper::release_worker(std::unique_ptr<Worker>worker)const{
+	std::unique_lock<std::mutex>guard(worker_pool_lock);
+	worker_pool.push_back(std::move(worker));
+}
+
+void LinkSnapper::snap_and_copy_into(Span<const LatLon>point, Span<SnappedPoint>result, uint32_t max_distance_in_cm)const{
+	assert(point.size() == result.size());
+
+	std::vector<uint32_t>hilbert_index(point.size());
+	unsigned key_thread_count = limit_thread_count(thread_count, point.size(), 1<<16);
+	run_on_thread_ranges(
+		key_thread_count, point.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(uint64_t i=begin; i<end; ++i)
+				hilbert_index[i] = compute_hilbert_index(point[i]);
+		}
+	);
+	std::vector<unsigned>order = compute_stable_sort_permutation_using_less(hilbert_index, key_thread_count);
+	std::vector<uint32_t>().swap(hilbert_index);
+
+	uint64_t chunk_count = (point.size() + chunk_size - 1) / chunk_size;
+	std::atomic<uint64_t>next_chunk(0);
+
+	run_on_threads(
+		limit_thread_count(thread_count, chunk_count, 1),
+		[&](unsigned){
+			std::unique_ptr<Worker>worker = acquire_worker();
+			for(;;){
+				uint64_t chunk = next_chunk.fetch_add(1, std::memory_order_relaxed);
+				if(chunk >= chunk_count)
+					break;
+				uint64_t end = std::min<uint64_t>((chunk+1)*chunk_size, point.size());
+				for(uint64_t i=chunk*chunk_size; i<end; ++i)
+					result[order[i]] = worker->snap(point[order[i]], max_distance_in_cm);
+			}
+			release_worker(std::move(worker));
+		}
+	);
+}
+
+std::vector<SnappedPoint> LinkSnapper::snap(Span<const LatLon>point, uint32_t max_distance_in_cm)const{
+	std::vector<SnappedPoint>result(point.size());
+	snap_and_copy_into(point, result, max_distance_in_cm);
+	return result;
+}
+
+} // RoutingKit2
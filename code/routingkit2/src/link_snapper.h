@@ -0,0 +1,79 @@
+#ifndef ROUTING_KIT2_LINK_SNAPPER_H
+#define ROUTING_KIT2_LINK_SNAPPER_H
+
+#include "geo_index.h"
+#include "geo_pos.h"
+#include "map_schema.h"
+#include "span.h"
+
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include <stdint.h>
+
+namespace RoutingKit2{
+
+struct SnappedPoint{
+	//! invalid_snapped_link_id if no link is within the maximum distance.
+	uint32_t link_id;
+	//! The distance from the tail of the link to the closest point along the link.
+	uint32_t offset_in_cm;
+	uint64_t distance_in_sqr_cm;
+};
+
+constexpr uint32_t invalid_snapped_link_id = std::numeric_limits<uint32_t>::max();
+
+//! Snaps batches of points to their closest link in an index built by
+//! build_link_geo_index. The result for every point is the closest link as
+//! found by LinkGeoIndexFindNearestQuery. Offset and distance are exactly the
+//! ones of find_closest_point_offset_and_distance_on_dlink for the forward dlink.
+//! If several links are equally close, the one with the smallest ID is chosen.
+//!
+//! The snapper is faster than one query per point for three reasons:
+//!
+//!  * The node and shape positions are converted to GeoPos once in the
+//!    constructor instead of for every candidate link.
+//!  * The distances to all segments of a candidate link are computed with a
+//!    vectorized kernel (AVX2 if available) in floating point arithmetic. The
+//!    exact integer computation is only done for the segments that can be the
+//!    closest and only for links that can beat the best link so far.
+//!  * The points are sorted along a Hilbert curve and processed in chunks on
+//!    thread_count threads. Consecutive points of a thread are close, which
+//!    keeps the touched parts of the index and of the map in the cache.
+//!
+//! A thread_count of 0 means std::thread::hardware_concurrency(). The result
+//! does not depend on the thread count. A snapper can be used by several threads
+//! at the same time. The per-thread query state is kept in a pool and reused by
+//! later calls.
+class LinkSnapper{
+public:
+	LinkSnapper(ConstRefLinkShapes map, ConstRefGeoIndex link_geo_index, unsigned thread_count = 0);
+	~LinkSnapper();
+
+	LinkSnapper(const LinkSnapper&) = delete;
+	LinkSnapper&operator=(const LinkSnapper&) = delete;
+
+	void snap_and_copy_into(Span<const LatLon>point, Span<SnappedPoint>result, uint32_t max_distance_in_cm = std::numeric_limits<uint32_t>::max())const;
+	std::vector<SnappedPoint> snap(Span<const LatLon>point, uint32_t max_distance_in_cm = std::numeric_limits<uint32_t>::max())const;
+
+private:
+	ConstRefLinkShapes map;
+	ConstRefGeoIndex link_geo_index;
+	unsigned thread_count;
+
+	std::vector<GeoPos>node_geo_pos;
+	std::vector<GeoPos>shape_geo_pos;
+
+	class Worker;
+
+	std::unique_ptr<Worker>acquire_worker()const;
+	void release_worker(std::unique_ptr<Worker>worker)const;
+
+	mutable std::mutex worker_pool_lock;
+	mutable std::vector<std::unique_ptr<Worker>>worker_pool;
+};
+
+} // RoutingKit2
+
+#endif
@@ -1,5 +1,6 @@
 #include "map.h"
 #include "prefix_sum.h"
+#include "parallel.h"
 #include "polyline.h"
 #include <string.h>
 #include <iostream>
@@ -16,30 +17,146 @@ namespace RoutingKit2{
 		return true;
 	}
 
-	VecLinkEndsAdjArray build_adj_array(ConstRefLinkEnds map){
-		assert_link_ends_valid(map);
+	namespace{
+		const unsigned build_adj_array_min_link_count_per_thread = 1<<16;
+
+		VecLinkEndsAdjArray build_adj_array_serially(ConstRefLinkEnds map){
+			VecLinkEndsAdjArray adj(map.node_count, map.link_count);
+
+			for(uint32_t x=0; x<=map.node_count; ++x)
+				adj.first_outgoing_dlink_index_of_node[x] = 0;
+
+			for(uint32_t l=0; l<map.link_count; ++l)
+				++adj.first_outgoing_dlink_index_of_node[map.link_tail[l]];
 
-		VecLinkEndsAdjArray adj(map.node_count, map.link_count);
+			for(uint32_t l=0; l<map.link_count; ++l)
+				++adj.first_outgoing_dlink_index_of_node[map.link_head[l]];
+
+			compute_prefix_sum(adj.first_outgoing_dlink_index_of_node_as_ref());
+
+			for(uint32_t l=0; l<map.link_count; ++l){
+				adj.outgoing_dlink[adj.first_outgoing_dlink_index_of_node[map.link_tail[l]]++] = link_to_forward_dlink(l);
+				adj.outgoing_dlink[adj.first_outgoing_dlink_index_of_node[map.link_head[l]]++] = link_to_backward_dlink(l);
+			}
+
+			for(uint32_t x=map.node_count; x != 0; --x)
+				adj.first_outgoing_dlink_index_of_node[x] = adj.first_outgoing_dlink_index_of_node[x-1];
+			adj.first_outgoing_dlink_index_of_node[0] = 0;
+
+			return adj;
+		}
+
+		// The serial version lists the outgoing dlinks of every node ordered by ID.
+		// The parallel version produces the same arrays in two counting sort passes.
+		//
+		// The nodes are split into one contiguous range per thread. In the first
+		// pass every thread counts, for a block of links, how many dlinks go to
+		// each node range and then scatters the dlinks into a buffer grouped by
+		// node range. As the blocks are ordered, the dlinks of each range stay
+		// ordered by ID. In the second pass, every thread sorts the dlinks of its
+		// node range by node. The degree counts of all ranges are combined with a
+		// parallel prefix sum.
+		VecLinkEndsAdjArray build_adj_array_in_parallel(ConstRefLinkEnds map, unsigned thread_count){
+			VecLinkEndsAdjArray adj(map.node_count, map.link_count);
+
+			const uint32_t node_count = map.node_count;
+			const uint32_t link_count = map.link_count;
+			const uint32_t node_range_size = (node_count + thread_count - 1) / thread_count;
+			const unsigned range_count = thread_count;
+
+			auto get_node_range = [&](uint32_t x){
+				return x / node_range_size;
+			};
+
+			std::vector<uint32_t>range_pos((uint64_t)thread_count * range_count, 0);
+
+			run_on_thread_ranges(
+				thread_count, link_count,
+				[&](unsigned thread_id, uint64_t link_begin, uint64_t link_end){
+					uint32_t*count = range_pos.data() + (uint64_t)thread_id * range_count;
+					for(uint32_t l=link_begin; l<link_end; ++l){
+						++count[get_node_range(map.link_tail[l])];
+						++count[get_node_range(map.link_head[l])];
+					}
+				}
+			);
 
-		for(uint32_t x=0; x<=map.node_count; ++x)
-			adj.first_outgoing_dlink_index_of_node[x] = 0;
+			std::vector<uint32_t>range_begin(range_count+1);
+			uint32_t sum = 0;
+			for(unsigned r=0; r<range_count; ++r){
+				range_begin[r] = sum;
+				for(unsigned t=0; t<thread_count; ++t){
+					uint32_t&x = range_pos[(uint64_t)t * range_count + r];
+					uint32_t tmp = sum + x;
+					x = sum;
+					sum = tmp;
+				}
+			}
+			range_begin[range_count] = sum;
+
+			std::vector<uint32_t>dlink_grouped_by_range(2*(uint64_t)link_count);
+
+			run_on_thread_ranges(
+				thread_count, link_count,
+				[&](unsigned thread_id, uint64_t link_begin, uint64_t link_end){
+					uint32_t*pos = range_pos.data() + (uint64_t)thread_id * range_count;
+					for(uint32_t l=link_begin; l<link_end; ++l){
+						dlink_grouped_by_range[pos[get_node_range(map.link_tail[l])]++] = link_to_forward_dlink(l);
+						dlink_grouped_by_range[pos[get_node_range(map.link_head[l])]++] = link_to_backward_dlink(l);
+					}
+				}
+			);
 
-		for(uint32_t l=0; l<map.link_count; ++l)
-			++adj.first_outgoing_dlink_index_of_node[map.link_tail[l]];
+			uint32_t*first_out = adj.first_outgoing_dlink_index_of_node.data();
 
-		for(uint32_t l=0; l<map.link_count; ++l)
-			++adj.first_outgoing_dlink_index_of_node[map.link_head[l]];
+			auto get_node_range_begin = [&](unsigned r){
+				return std::min<uint64_t>((uint64_t)r * node_range_size, node_count);
+			};
 
-		compute_prefix_sum(adj.first_outgoing_dlink_index_of_node_as_ref());
+			run_on_threads(
+				thread_count,
+				[&](unsigned r){
+					std::fill(first_out + get_node_range_begin(r), first_out + get_node_range_begin(r+1), 0);
+					for(uint32_t i=range_begin[r]; i<range_begin[r+1]; ++i)
+						++first_out[dlink_tail(map, dlink_grouped_by_range[i])];
+				}
+			);
+			first_out[node_count] = 0;
+
+			compute_prefix_sum(adj.first_outgoing_dlink_index_of_node_as_ref(), thread_count);
+
+			run_on_threads(
+				thread_count,
+				[&](unsigned r){
+					for(uint32_t i=range_begin[r]; i<range_begin[r+1]; ++i){
+						uint32_t d = dlink_grouped_by_range[i];
+						adj.outgoing_dlink[first_out[dlink_tail(map, d)]++] = d;
+					}
+
+					uint32_t node_begin = get_node_range_begin(r);
+					uint32_t node_end = get_node_range_begin(r+1);
+					if(node_begin != node_end){
+						for(uint32_t x=node_end-1; x != node_begin; --x)
+							first_out[x] = first_out[x-1];
+						first_out[node_begin] = range_begin[r];
+					}
+				}
+			);
 
-		for(uint32_t l=0; l<map.link_count; ++l){
-			adj.outgoing_dlink[adj.first_outgoing_dlink_index_of_node[map.link_tail[l]]++] = link_to_forward_dlink(l);
-			adj.outgoing_dlink[adj.first_outgoing_dlink_index_of_node[map.link_head[l]]++] = link_to_backward_dlink(l);
+			return adj;
 		}
+	}
+
+	VecLinkEndsAdjArray build_adj_array(ConstRefLinkEnds map, unsigned thread_count){
+		assert_link_ends_valid(map);
+
+		thread_count = limit_thread_count(thread_count, map.link_count, build_adj_array_min_link_count_per_thread);
 
-		for(uint32_t x=map.node_count; x != 0; --x)
-			adj.first_outgoing_dlink_index_of_node[x] = adj.first_outgoing_dlink_index_of_node[x-1];
-		adj.first_outgoing_dlink_index_of_node[0] = 0;
+		VecLinkEndsAdjArray adj;
+		if(thread_count == 1 || map.node_count == 0)
+			adj = build_adj_array_serially(map);
+		else
+			adj = build_adj_array_in_parallel(map, thread_count);
 
 		adj.assert_correct_size();
 		assert_link_ends_and_adj_array_consistent(map, adj.as_cref());
@@ -44,7 +44,10 @@ namespace RoutingKit2{
 
 	bool is_dlink_path(ConstRefLinkEnds map, Span<const uint32_t>path);
 
-	VecLinkEndsAdjArray build_adj_array(ConstRefLinkEnds map);
+	//! Builds the outgoing dlinks of every node, ordered by ID, on thread_count
+	//! threads. A thread_count of 0 means std::thread::hardware_concurrency(). The
+	//! result does not depend on the thread count.
+	VecLinkEndsAdjArray build_adj_array(ConstRefLinkEnds map, unsigned thread_count = 1);
 
 	void assert_link_ends_valid(ConstRefLinkEnds map);
 	void throw_if_link_ends_invalid(ConstRefLinkEnds map);
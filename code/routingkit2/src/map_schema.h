@@ -656,6 +656,7 @@ struct RefOSMCarRoads{
 	uint32_t* __restrict__ forbidden_maneuver_dlink; // size = forbidden_maneuver_dlink_count
 	uint32_t* __restrict__ first_link_of_way; // size = way_count + 1
 	uint64_t* __restrict__ node_osm_id; // size = node_count
+	uint64_t* __restrict__ shape_osm_id; // size = shape_pos_count
 	uint64_t* __restrict__ way_osm_id; // size = way_count
 	uint64_t* __restrict__ forbidden_maneuver_osm_id; // size = forbidden_maneuver_count
 
@@ -670,6 +671,7 @@ struct RefOSMCarRoads{
 	Span<uint32_t> forbidden_maneuver_dlink_as_ref()noexcept;
 	Span<uint32_t> first_link_of_way_as_ref()noexcept;
 	Span<uint64_t> node_osm_id_as_ref()noexcept;
+	Span<uint64_t> shape_osm_id_as_ref()noexcept;
 	Span<uint64_t> way_osm_id_as_ref()noexcept;
 	Span<uint64_t> forbidden_maneuver_osm_id_as_ref()noexcept;
 	Span<const uint32_t> link_head_as_ref()const noexcept;
@@ -683,6 +685,7 @@ struct RefOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_ref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_ref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_ref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_ref()const noexcept;
 	Span<const uint32_t> link_head_as_cref()const noexcept;
@@ -696,6 +699,7 @@ struct RefOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_cref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_cref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_cref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_cref()const noexcept;
 
@@ -718,6 +722,7 @@ struct RefOSMCarRoads{
 		uint32_t* __restrict__ forbidden_maneuver_dlink,
 		uint32_t* __restrict__ first_link_of_way,
 		uint64_t* __restrict__ node_osm_id,
+		uint64_t* __restrict__ shape_osm_id,
 		uint64_t* __restrict__ way_osm_id,
 		uint64_t* __restrict__ forbidden_maneuver_osm_id
 	);
@@ -741,6 +746,7 @@ struct ConstRefOSMCarRoads{
 	const uint32_t* __restrict__ forbidden_maneuver_dlink; // size = forbidden_maneuver_dlink_count
 	const uint32_t* __restrict__ first_link_of_way; // size = way_count + 1
 	const uint64_t* __restrict__ node_osm_id; // size = node_count
+	const uint64_t* __restrict__ shape_osm_id; // size = shape_pos_count
 	const uint64_t* __restrict__ way_osm_id; // size = way_count
 	const uint64_t* __restrict__ forbidden_maneuver_osm_id; // size = forbidden_maneuver_count
 
@@ -755,6 +761,7 @@ struct ConstRefOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_ref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_ref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_ref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_ref()const noexcept;
 	Span<const uint32_t> link_head_as_cref()const noexcept;
@@ -768,6 +775,7 @@ struct ConstRefOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_cref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_cref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_cref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_cref()const noexcept;
 
@@ -791,6 +799,7 @@ struct ConstRefOSMCarRoads{
 		const uint32_t* __restrict__ forbidden_maneuver_dlink,
 		const uint32_t* __restrict__ first_link_of_way,
 		const uint64_t* __restrict__ node_osm_id,
+		const uint64_t* __restrict__ shape_osm_id,
 		const uint64_t* __restrict__ way_osm_id,
 		const uint64_t* __restrict__ forbidden_maneuver_osm_id
 	);
@@ -814,6 +823,7 @@ struct VecOSMCarRoads{
 	std::vector<uint32_t>forbidden_maneuver_dlink;
 	std::vector<uint32_t>first_link_of_way;
 	std::vector<uint64_t>node_osm_id;
+	std::vector<uint64_t>shape_osm_id;
 	std::vector<uint64_t>way_osm_id;
 	std::vector<uint64_t>forbidden_maneuver_osm_id;
 
@@ -852,6 +862,7 @@ struct VecOSMCarRoads{
 	Span<uint32_t> forbidden_maneuver_dlink_as_ref()noexcept;
 	Span<uint32_t> first_link_of_way_as_ref()noexcept;
 	Span<uint64_t> node_osm_id_as_ref()noexcept;
+	Span<uint64_t> shape_osm_id_as_ref()noexcept;
 	Span<uint64_t> way_osm_id_as_ref()noexcept;
 	Span<uint64_t> forbidden_maneuver_osm_id_as_ref()noexcept;
 	Span<const uint32_t> link_head_as_ref()const noexcept;
@@ -865,6 +876,7 @@ struct VecOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_ref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_ref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_ref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_ref()const noexcept;
 	Span<const uint32_t> link_head_as_cref()const noexcept;
@@ -878,6 +890,7 @@ struct VecOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_cref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_cref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_cref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_cref()const noexcept;
 };
@@ -900,6 +913,7 @@ struct DirOSMCarRoads{
 	FileArray<uint32_t>forbidden_maneuver_dlink;
 	FileArray<uint32_t>first_link_of_way;
 	FileArray<uint64_t>node_osm_id;
+	FileArray<uint64_t>shape_osm_id;
 	FileArray<uint64_t>way_osm_id;
 	FileArray<uint64_t>forbidden_maneuver_osm_id;
 
@@ -922,6 +936,7 @@ struct DirOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_ref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_ref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_ref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_ref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_ref()const noexcept;
 	Span<const uint32_t> link_head_as_cref()const noexcept;
@@ -935,6 +950,7 @@ struct DirOSMCarRoads{
 	Span<const uint32_t> forbidden_maneuver_dlink_as_cref()const noexcept;
 	Span<const uint32_t> first_link_of_way_as_cref()const noexcept;
 	Span<const uint64_t> node_osm_id_as_cref()const noexcept;
+	Span<const uint64_t> shape_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> way_osm_id_as_cref()const noexcept;
 	Span<const uint64_t> forbidden_maneuver_osm_id_as_cref()const noexcept;
 };
@@ -2816,6 +2832,10 @@ inline Span<uint64_t> RefOSMCarRoads::node_osm_id_as_ref()noexcept{
 	return {node_osm_id, node_osm_id+node_count};
 }
 
+inline Span<uint64_t> RefOSMCarRoads::shape_osm_id_as_ref()noexcept{
+	return {shape_osm_id, shape_osm_id+shape_pos_count};
+}
+
 inline Span<uint64_t> RefOSMCarRoads::way_osm_id_as_ref()noexcept{
 	return {way_osm_id, way_osm_id+way_count};
 }
@@ -2868,6 +2888,10 @@ inline Span<const uint64_t> RefOSMCarRoads::node_osm_id_as_ref()const noexcept{
 	return node_osm_id_as_cref();
 }
 
+inline Span<const uint64_t> RefOSMCarRoads::shape_osm_id_as_ref()const noexcept{
+	return shape_osm_id_as_cref();
+}
+
 inline Span<const uint64_t> RefOSMCarRoads::way_osm_id_as_ref()const noexcept{
 	return way_osm_id_as_cref();
 }
@@ -2920,6 +2944,10 @@ inline Span<const uint64_t> RefOSMCarRoads::node_osm_id_as_cref()const noexcept{
 	return {node_osm_id, node_osm_id+node_count};
 }
 
+inline Span<const uint64_t> RefOSMCarRoads::shape_osm_id_as_cref()const noexcept{
+	return {shape_osm_id, shape_osm_id+shape_pos_count};
+}
+
 inline Span<const uint64_t> RefOSMCarRoads::way_osm_id_as_cref()const noexcept{
 	return {way_osm_id, way_osm_id+way_count};
 }
@@ -2949,6 +2977,7 @@ inline RefOSMCarRoads::RefOSMCarRoads(
 	uint32_t* __restrict__ forbidden_maneuver_dlink,
 	uint32_t* __restrict__ first_link_of_way,
 	uint64_t* __restrict__ node_osm_id,
+	uint64_t* __restrict__ shape_osm_id,
 	uint64_t* __restrict__ way_osm_id,
 	uint64_t* __restrict__ forbidden_maneuver_osm_id
 ):
@@ -2969,6 +2998,7 @@ inline RefOSMCarRoads::RefOSMCarRoads(
 	forbidden_maneuver_dlink(forbidden_maneuver_dlink),
 	first_link_of_way(first_link_of_way),
 	node_osm_id(node_osm_id),
+	shape_osm_id(shape_osm_id),
 	way_osm_id(way_osm_id),
 	forbidden_maneuver_osm_id(forbidden_maneuver_osm_id){}
 
@@ -3016,6 +3046,10 @@ inline Span<const uint64_t> ConstRefOSMCarRoads::node_osm_id_as_ref()const noexc
 	return node_osm_id_as_cref();
 }
 
+inline Span<const uint64_t> ConstRefOSMCarRoads::shape_osm_id_as_ref()const noexcept{
+	return shape_osm_id_as_cref();
+}
+
 inline Span<const uint64_t> ConstRefOSMCarRoads::way_osm_id_as_ref()const noexcept{
 	return way_osm_id_as_cref();
 }
@@ -3068,6 +3102,10 @@ inline Span<const uint64_t> ConstRefOSMCarRoads::node_osm_id_as_cref()const noex
 	return {node_osm_id, node_osm_id+node_count};
 }
 
+inline Span<const uint64_t> ConstRefOSMCarRoads::shape_osm_id_as_cref()const noexcept{
+	return {shape_osm_id, shape_osm_id+shape_pos_count};
+}
+
 inline Span<const uint64_t> ConstRefOSMCarRoads::way_osm_id_as_cref()const noexcept{
 	return {way_osm_id, way_osm_id+way_count};
 }
@@ -3097,6 +3135,7 @@ inline ConstRefOSMCarRoads::ConstRefOSMCarRoads(RefOSMCarRoads o):
 	forbidden_maneuver_dlink(o.forbidden_maneuver_dlink),
 	first_link_of_way(o.first_link_of_way),
 	node_osm_id(o.node_osm_id),
+	shape_osm_id(o.shape_osm_id),
 	way_osm_id(o.way_osm_id),
 	forbidden_maneuver_osm_id(o.forbidden_maneuver_osm_id){}
 
@@ -3118,6 +3157,7 @@ inline ConstRefOSMCarRoads::ConstRefOSMCarRoads(
 	const uint32_t* __restrict__ forbidden_maneuver_dlink,
 	const uint32_t* __restrict__ first_link_of_way,
 	const uint64_t* __restrict__ node_osm_id,
+	const uint64_t* __restrict__ shape_osm_id,
 	const uint64_t* __restrict__ way_osm_id,
 	const uint64_t* __restrict__ forbidden_maneuver_osm_id
 ):
@@ -3138,6 +3178,7 @@ inline ConstRefOSMCarRoads::ConstRefOSMCarRoads(
 	forbidden_maneuver_dlink(forbidden_maneuver_dlink),
 	first_link_of_way(first_link_of_way),
 	node_osm_id(node_osm_id),
+	shape_osm_id(shape_osm_id),
 	way_osm_id(way_osm_id),
 	forbidden_maneuver_osm_id(forbidden_maneuver_osm_id){}
 
@@ -3185,6 +3226,10 @@ inline Span<uint64_t> VecOSMCarRoads::node_osm_id_as_ref()noexcept{
 	return {&node_osm_id[0], &node_osm_id[0]+node_osm_id.size()};
 }
 
+inline Span<uint64_t> VecOSMCarRoads::shape_osm_id_as_ref()noexcept{
+	return {&shape_osm_id[0], &shape_osm_id[0]+shape_osm_id.size()};
+}
+
 inline Span<uint64_t> VecOSMCarRoads::way_osm_id_as_ref()noexcept{
 	return {&way_osm_id[0], &way_osm_id[0]+way_osm_id.size()};
 }
@@ -3237,6 +3282,10 @@ inline Span<const uint64_t> VecOSMCarRoads::node_osm_id_as_ref()const noexcept{
 	return node_osm_id_as_cref();
 }
 
+inline Span<const uint64_t> VecOSMCarRoads::shape_osm_id_as_ref()const noexcept{
+	return shape_osm_id_as_cref();
+}
+
 inline Span<const uint64_t> VecOSMCarRoads::way_osm_id_as_ref()const noexcept{
 	return way_osm_id_as_cref();
 }
@@ -3289,6 +3338,10 @@ inline Span<const uint64_t> VecOSMCarRoads::node_osm_id_as_cref()const noexcept{
 	return {node_osm_id.data(), node_osm_id.data()+node_osm_id.size()};
 }
 
+inline Span<const uint64_t> VecOSMCarRoads::shape_osm_id_as_cref()const noexcept{
+	return {shape_osm_id.data(), shape_osm_id.data()+shape_osm_id.size()};
+}
+
 inline Span<const uint64_t> VecOSMCarRoads::way_osm_id_as_cref()const noexcept{
 	return {way_osm_id.data(), way_osm_id.data()+way_osm_id.size()};
 }
@@ -3325,6 +3378,7 @@ inline VecOSMCarRoads::VecOSMCarRoads(
 	forbidden_maneuver_dlink(forbidden_maneuver_dlink_count),
 	first_link_of_way(way_count + 1),
 	node_osm_id(node_count),
+	shape_osm_id(shape_pos_count),
 	way_osm_id(way_count),
 	forbidden_maneuver_osm_id(forbidden_maneuver_count){}
 
@@ -3353,6 +3407,7 @@ inline void VecOSMCarRoads::resize(
 	forbidden_maneuver_dlink.resize(forbidden_maneuver_dlink_count);
 	first_link_of_way.resize(way_count + 1);
 	node_osm_id.resize(node_count);
+	shape_osm_id.resize(shape_pos_count);
 	way_osm_id.resize(way_count);
 	forbidden_maneuver_osm_id.resize(forbidden_maneuver_count);
 }
@@ -3381,6 +3436,8 @@ inline void VecOSMCarRoads::throw_if_wrong_size()const{
 		 err += ("Column first_link_of_way has wrong size. Expected: "+std::to_string(way_count + 1)+" Actual: "+std::to_string(first_link_of_way.size())+"\n");
 	if(node_osm_id.size() != node_count)
 		 err += ("Column node_osm_id has wrong size. Expected: "+std::to_string(node_count)+" Actual: "+std::to_string(node_osm_id.size())+"\n");
+	if(shape_osm_id.size() != shape_pos_count)
+		 err += ("Column shape_osm_id has wrong size. Expected: "+std::to_string(shape_pos_count)+" Actual: "+std::to_string(shape_osm_id.size())+"\n");
 	if(way_osm_id.size() != way_count)
 		 err += ("Column way_osm_id has wrong size. Expected: "+std::to_string(way_count)+" Actual: "+std::to_string(way_osm_id.size())+"\n");
 	if(forbidden_maneuver_osm_id.size() != forbidden_maneuver_count)
@@ -3401,6 +3458,7 @@ inline void VecOSMCarRoads::assert_correct_size()const noexcept{
 	assert(forbidden_maneuver_dlink.size() == forbidden_maneuver_dlink_count);
 	assert(first_link_of_way.size() == way_count + 1);
 	assert(node_osm_id.size() == node_count);
+	assert(shape_osm_id.size() == shape_pos_count);
 	assert(way_osm_id.size() == way_count);
 	assert(forbidden_maneuver_osm_id.size() == forbidden_maneuver_count);
 }
@@ -3417,6 +3475,7 @@ inline void VecOSMCarRoads::shrink_to_fit(){
 	forbidden_maneuver_dlink.shrink_to_fit();
 	first_link_of_way.shrink_to_fit();
 	node_osm_id.shrink_to_fit();
+	shape_osm_id.shrink_to_fit();
 	way_osm_id.shrink_to_fit();
 	forbidden_maneuver_osm_id.shrink_to_fit();
 }
@@ -3444,6 +3503,7 @@ inline RefOSMCarRoads VecOSMCarRoads::as_ref()noexcept{
 		&forbidden_maneuver_dlink[0],
 		&first_link_of_way[0],
 		&node_osm_id[0],
+		&shape_osm_id[0],
 		&way_osm_id[0],
 		&forbidden_maneuver_osm_id[0]
 	};
@@ -3468,6 +3528,7 @@ inline ConstRefOSMCarRoads VecOSMCarRoads::as_cref()const noexcept{
 		forbidden_maneuver_dlink.data(),
 		first_link_of_way.data(),
 		node_osm_id.data(),
+		shape_osm_id.data(),
 		way_osm_id.data(),
 		forbidden_maneuver_osm_id.data()
 	};
@@ -3512,6 +3573,7 @@ inline DirOSMCarRoads::DirOSMCarRoads(std::string dir){
 	forbidden_maneuver_dlink = FileArray<uint32_t>(dir+"forbidden_maneuver_dlink");
 	first_link_of_way = FileArray<uint32_t>(dir+"first_link_of_way");
 	node_osm_id = FileArray<uint64_t>(dir+"node_osm_id");
+	shape_osm_id = FileArray<uint64_t>(dir+"shape_osm_id");
 	way_osm_id = FileArray<uint64_t>(dir+"way_osm_id");
 	forbidden_maneuver_osm_id = FileArray<uint64_t>(dir+"forbidden_maneuver_osm_id");
 	throw_if_wrong_col_size();
@@ -3549,6 +3611,8 @@ inline void DirOSMCarRoads::throw_if_wrong_col_size()const{
 		 err += ("Column first_link_of_way has wrong size. Expected: "+std::to_string(way_count + 1)+" Actual: "+std::to_string(first_link_of_way.size())+"\n");
 	if(node_osm_id.size() != node_count)
 		 err += ("Column node_osm_id has wrong size. Expected: "+std::to_string(node_count)+" Actual: "+std::to_string(node_osm_id.size())+"\n");
+	if(shape_osm_id.size() != shape_pos_count)
+		 err += ("Column shape_osm_id has wrong size. Expected: "+std::to_string(shape_pos_count)+" Actual: "+std::to_string(shape_osm_id.size())+"\n");
 	if(way_osm_id.size() != way_count)
 		 err += ("Column way_osm_id has wrong size. Expected: "+std::to_string(way_count)+" Actual: "+std::to_string(way_osm_id.size())+"\n");
 	if(forbidden_maneuver_osm_id.size() != forbidden_maneuver_count)
@@ -3576,6 +3640,7 @@ inline ConstRefOSMCarRoads DirOSMCarRoads::as_cref()const noexcept{
 		forbidden_maneuver_dlink.data(),
 		first_link_of_way.data(),
 		node_osm_id.data(),
+		shape_osm_id.data(),
 		way_osm_id.data(),
 		forbidden_maneuver_osm_id.data()
 	};
@@ -3629,6 +3694,10 @@ inline Span<const uint64_t> DirOSMCarRoads::node_osm_id_as_ref()const noexcept{
 	return node_osm_id_as_cref();
 }
 
+inline Span<const uint64_t> DirOSMCarRoads::shape_osm_id_as_ref()const noexcept{
+	return shape_osm_id_as_cref();
+}
+
 inline Span<const uint64_t> DirOSMCarRoads::way_osm_id_as_ref()const noexcept{
 	return way_osm_id_as_cref();
 }
@@ -3681,6 +3750,10 @@ inline Span<const uint64_t> DirOSMCarRoads::node_osm_id_as_cref()const noexcept{
 	return {node_osm_id.data(), node_osm_id.data()+node_osm_id.size()};
 }
 
+inline Span<const uint64_t> DirOSMCarRoads::shape_osm_id_as_cref()const noexcept{
+	return {shape_osm_id.data(), shape_osm_id.data()+shape_osm_id.size()};
+}
+
 inline Span<const uint64_t> DirOSMCarRoads::way_osm_id_as_cref()const noexcept{
 	return {way_osm_id.data(), way_osm_id.data()+way_osm_id.size()};
 }
@@ -3713,6 +3786,7 @@ inline void dump_into_dir(std::string dir, ConstRefOSMCarRoads data){
 	FileDataSink(dir+"forbidden_maneuver_dlink")((const uint8_t*)data.forbidden_maneuver_dlink, (data.forbidden_maneuver_dlink_count)*sizeof(uint32_t));
 	FileDataSink(dir+"first_link_of_way")((const uint8_t*)data.first_link_of_way, (data.way_count + 1)*sizeof(uint32_t));
 	FileDataSink(dir+"node_osm_id")((const uint8_t*)data.node_osm_id, (data.node_count)*sizeof(uint64_t));
+	FileDataSink(dir+"shape_osm_id")((const uint8_t*)data.shape_osm_id, (data.shape_pos_count)*sizeof(uint64_t));
 	FileDataSink(dir+"way_osm_id")((const uint8_t*)data.way_osm_id, (data.way_count)*sizeof(uint64_t));
 	FileDataSink(dir+"forbidden_maneuver_osm_id")((const uint8_t*)data.forbidden_maneuver_osm_id, (data.forbidden_maneuver_count)*sizeof(uint64_t));
 }
@@ -0,0 +1,869 @@
+#include "osm_change.h"
+#include "osm_profile.h"
+#include "osm_turn_restriction.h"
+#include "tag_map.h"
+#include "geo_pos.h"
+
+#include <algorithm>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <unordered_map>
+#include <unordered_set>
+#include <string.h>
+#include <stdlib.h>
+
+namespace RoutingKit2{
+
+namespace{
+	constexpr uint32_t invalid_id = (uint32_t)-1;
+
+	void append_decoded_xml_text(std::string&out, const char*begin, const char*end){
+		while(begin != end){
+			if(*begin != '&'){
+				out.push_back(*begin);
+				++begin;
+				continue;
+			}
+			const char*semicolon = std::find(begin, end, ';');
+			if(semicolon == end)
+				throw std::runtime_error("OSC error: unterminated XML entity");
+			std::string entity(begin+1, semicolon);
+			if(entity == "amp")
+				out.push_back('&');
+			else if(entity == "lt")
+				out.push_back('<');
+			else if(entity == "gt")
+				out.push_back('>');
+			else if(entity == "quot")
+				out.push_back('"');
+			else if(entity == "apos")
+				out.push_back('\'');
+			else if(entity.size() > 1 && entity[0] == '#'){
+				unsigned long c;
+				if(entity[1] == 'x')
+					c = strtoul(entity.c_str()+2, nullptr, 16);
+				else
+					c = strtoul(entity.c_str()+1, nullptr, 10);
+				// encode as UTF-8
+				if(c < 0x80){
+					out.push_back((char)c);
+				}else if(c < 0x800){
+					out.push_back((char)(0xC0 | (c >> 6)));
+					out.push_back((char)(0x80 | (c & 0x3F)));
+				}else if(c < 0x10000){
+					out.push_back((char)(0xE0 | (c >> 12)));
+					out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+					out.push_back((char)(0x80 | (c & 0x3F)));
+				}else{
+					out.push_back((char)(0xF0 | (c >> 18)));
+					out.push_back((char)(0x80 | ((c >> 12) & 0x3F)));
+					out.push_back((char)(0x80 | ((c >> 6) & 0x3F)));
+					out.push_back((char)(0x80 | (c & 0x3F)));
+				}
+			}else
+				throw std::runtime_error("OSC error: unknown XML entity \"&"+entity+";\"");
+			begin = semicolon+1;
+		}
+	}
+
+	struct XMLTag{
+		std::string name;
+		std::vector<std::pair<std::string, std::string>>attribute_list;
+		bool is_opening;
+		bool is_closing;
+
+		const std::string*find(const char*key)const{
+			for(auto&a:attribute_list)
+				if(a.first == key)
+					return &a.second;
+			return nullptr;
+		}
+
+		const std::string&get(const char*key)const{
+			auto x = find(key);
+			if(x == nullptr)
+				throw std::runtime_error("OSC error: XML tag \""+name+"\" is missing the attribute \""+key+"\"");
+			return *x;
+		}
+	};
+
+	bool is_xml_space(char c){
+		return c == ' ' || c == '\t' || c == '\n' || c == '\r';
+	}
+
+	// Calls f for every XML tag. Text between tags, comments, processing
+	// instructions and declarations are skipped. This is enough for osmChange files.
+	template<class F>
+	void for_each_xml_tag(const std::string&xml, const F&f){
+		const char*pos = xml.data();
+		const char*end = xml.data() + xml.size();
+
+		XMLTag tag;
+
+		for(;;){
+			pos = std::find(pos, end, '<');
+			if(pos == end)
+				return;
+
+			if(end - pos >= 4 && !memcmp(pos, "<!--", 4)){
+				const char*comment_end = std::search(pos+4, end, "-->", "-->"+3);
+				if(comment_end == end)
+					throw std::runtime_error("OSC error: unterminated XML comment");
+				pos = comment_end + 3;
+				continue;
+			}
+			if(end - pos >= 2 && (pos[1] == '?' || pos[1] == '!')){
+				pos = std::find(pos, end, '>');
+				if(pos == end)
+					throw std::runtime_error("OSC error: unterminated XML declaration");
+				++pos;
+				continue;
+			}
+
+			++pos;
+			tag.attribute_list.clear();
+			tag.is_opening = true;
+			tag.is_closing = false;
+			if(pos != end && *pos == '/'){
+				tag.is_opening = false;
+				tag.is_closing = true;
+				++pos;
+			}
+
+			const char*name_begin = pos;
+			while(pos != end && !is_xml_space(*pos) && *pos != '>' && *pos != '/')
+				++pos;
+			tag.name.assign(name_begin, pos);
+
+			for(;;){
+				while(pos != end && is_xml_space(*pos))
+					++pos;
+				if(pos == end)
+					throw std::runtime_error("OSC error: unterminated XML tag \""+tag.name+"\"");
+				if(*pos == '>'){
+					++pos;
+					break;
+				}
+				if(*pos == '/'){
+					tag.is_closing = true;
+					++pos;
+					continue;
+				}
+
+				const char*key_begin = pos;
+				while(pos != end && *pos != '=' && !is_xml_space(*pos))
+					++pos;
+				const char*key_end = pos;
+				while(pos != end && is_xml_space(*pos))
+					++pos;
+				if(pos == end || *pos != '=')
+					throw std::runtime_error("OSC error: XML attribute without value in tag \""+tag.name+"\"");
+				++pos;
+				while(pos != end && is_xml_space(*pos))
+					++pos;
+				if(pos == end || (*pos != '"' && *pos != '\''))
+					throw std::runtime_error("OSC error: XML attribute value must be quoted in tag \""+tag.name+"\"");
+				char quote = *pos;
+				++pos;
+				const char*value_begin = pos;
+				pos = std::find(pos, end, quote);
+				if(pos == end)
+					throw std::runtime_error("OSC error: unterminated XML attribute value in tag \""+tag.name+"\"");
+
+				tag.attribute_list.emplace_back(std::string(key_begin, key_end), std::string());
+				append_decoded_xml_text(tag.attribute_list.back().second, value_begin, pos);
+				++pos;
+			}
+
+			f(tag);
+		}
+	}
+
+	uint64_t parse_osm_id(const std::string&str){
+		char*str_end;
+		long long id = strtoll(str.c_str(), &str_end, 10);
+		if(str_end == str.c_str() || *str_end != '\0' || id < 0)
+			throw std::runtime_error("OSC error: \""+str+"\" is no valid OSM ID");
+		return id;
+	}
+
+	double parse_coordinate(const std::string&str){
+		char*str_end;
+		double x = strtod(str.c_str(), &str_end);
+		if(str_end == str.c_str() || *str_end != '\0')
+			throw std::runtime_error("OSC error: \""+str+"\" is no valid coordinate");
+		return x;
+	}
+
+	template<class T>
+	void keep_last_occurrence_only(std::vector<T>&list){
+		std::unordered_set<uint64_t>seen;
+		std::vector<T>result;
+		for(auto i=list.rbegin(); i!=list.rend(); ++i)
+			if(seen.insert(i->osm_id).second)
+				result.push_back(std::move(*i));
+		std::reverse(result.begin(), result.end());
+		list = std::move(result);
+	}
+}
+
+OSMChange parse_osm_change(const std::string&xml){
+	OSMChange change;
+
+	bool is_in_action = false;
+	OSMChangeAction action = OSMChangeAction::modify;
+
+	enum class Element{
+		none,
+		node,
+		way,
+		relation
+	};
+	Element element = Element::none;
+
+	for_each_xml_tag(
+		xml,
+		[&](const XMLTag&tag){
+			if(tag.name == "create" || tag.name == "modify" || tag.name == "delete"){
+				if(tag.is_opening && !tag.is_closing){
+					is_in_action = true;
+					if(tag.name == "create")
+						action = OSMChangeAction::create;
+					else if(tag.name == "modify")
+						action = OSMChangeAction::modify;
+					else
+						action = OSMChangeAction::remove;
+				}else{
+					is_in_action = false;
+				}
+				return;
+			}
+
+			if(!is_in_action)
+				return;
+
+			if(tag.name == "node" || tag.name == "way" || tag.name == "relation"){
+				if(tag.is_opening){
+					uint64_t osm_id = parse_osm_id(tag.get("id"));
+					if(tag.name == "node"){
+						LatLon pos = invalid_lat_lon;
+						auto lat = tag.find("lat"), lon = tag.find("lon");
+						if(lat != nullptr && lon != nullptr)
+							pos = LatLon::from_lat_lon(parse_coordinate(*lat), parse_coordinate(*lon));
+						else if(action != OSMChangeAction::remove)
+							throw std::runtime_error("OSC error: node "+std::to_string(osm_id)+" has no position");
+						change.node_list.push_back({action, osm_id, pos});
+						element = Element::node;
+					}else if(tag.name == "way"){
+						change.way_list.push_back({action, osm_id, {}, {}});
+						element = Element::way;
+					}else{
+						change.relation_list.push_back({action, osm_id, {}, {}});
+						element = Element::relation;
+					}
+				}
+				if(tag.is_closing)
+					element = Element::none;
+			}else if(tag.name == "nd" && tag.is_opening){
+				if(element != Element::way)
+					throw std::runtime_error("OSC error: \"nd\" outside of a way");
+				change.way_list.back().node_osm_id_list.push_back(parse_osm_id(tag.get("ref")));
+			}else if(tag.name == "tag" && tag.is_opening){
+				if(element == Element::way)
+					change.way_list.back().tags.emplace_back(tag.get("k"), tag.get("v"));
+				else if(element == Element::relation)
+					change.relation_list.back().tags.emplace_back(tag.get("k"), tag.get("v"));
+			}else if(tag.name == "member" && tag.is_opening){
+				if(element != Element::relation)
+					throw std::runtime_error("OSC error: \"member\" outside of a relation");
+				const std::string&type = tag.get("type");
+				OSMIDType member_type;
+				if(type == "node")
+					member_type = OSMIDType::node;
+				else if(type == "way")
+					member_type = OSMIDType::way;
+				else if(type == "relation")
+					member_type = OSMIDType::relation;
+				else
+					throw std::runtime_error("OSC error: unknown relation member type \""+type+"\"");
+				auto role = tag.find("role");
+				change.relation_list.back().member_list.push_back({member_type, parse_osm_id(tag.get("ref")), role ? *role : std::string()});
+			}
+		}
+	);
+
+	keep_last_occurrence_only(change.node_list);
+	keep_last_occurrence_only(change.way_list);
+	keep_last_occurrence_only(change.relation_list);
+
+	return change;
+}
+
+OSMChange read_osm_change_file(const std::string&file_name){
+	std::ifstream in(file_name, std::ios::binary);
+	if(!in)
+		throw std::runtime_error("Cannot open OSM change file \""+file_name+"\"");
+	std::string xml((std::istreambuf_iterator<char>(in)), std::istreambuf_iterator<char>());
+	return parse_osm_change(xml);
+}
+
+namespace{
+	uint32_t find_sorted(const std::vector<uint64_t>&list, uint64_t id){
+		auto i = std::lower_bound(list.begin(), list.end(), id);
+		if(i == list.end() || *i != id)
+			return invalid_id;
+		else
+			return i - list.begin();
+	}
+
+	void build_tag_map(TagMap&tag_map, const std::vector<std::pair<std::string, std::string>>&tags){
+		tag_map.build(
+			tags.size(),
+			[&](uint32_t i){return tags[i].first.c_str();},
+			[&](uint32_t i){return tags[i].second.c_str();}
+		);
+	}
+
+	// A changed way whose node positions are all known.
+	struct RebuiltWay{
+		const OSMChangeWay*way;
+		uint32_t old_way;
+		std::vector<LatLon>node_pos;
+	};
+
+	// Returns the link whose shape contains the shape position s.
+	uint32_t find_link_of_shape_pos(const VecOSMCarRoads&map, uint32_t s){
+		return std::upper_bound(map.first_shape_pos_of_link.begin(), map.first_shape_pos_of_link.end(), s) - map.first_shape_pos_of_link.begin() - 1;
+	}
+}
+
+OSMChangeResult apply_osm_change(
+	VecOSMCarRoads&map,
+	const OSMChange&change,
+	const std::function<void(std::string)>&log_message
+){
+	OSMChangeResult result;
+
+	const uint32_t old_way_count = map.way_count;
+	const uint32_t old_link_count = map.link_count;
+
+	std::unordered_map<uint64_t, LatLon>changed_node_pos;
+	for(auto&n:change.node_list)
+		if(n.action != OSMChangeAction::remove)
+			changed_node_pos[n.osm_id] = n.pos;
+
+	std::vector<uint32_t>way_of_link(old_link_count);
+	for(uint32_t w=0; w<old_way_count; ++w)
+		for(uint32_t l=map.first_link_of_way[w]; l<map.first_link_of_way[w+1]; ++l)
+			way_of_link[l] = w;
+
+	// Find the shape nodes that are part of the change. The shape nodes are not
+	// sorted by OSM ID, but the change is small compared to the dataset. Every
+	// shape node occurs only once, otherwise the import would have made it a
+	// routing node.
+
+	std::unordered_map<uint64_t, uint32_t>shape_pos_of_node;
+	{
+		for(auto&n:change.node_list)
+			shape_pos_of_node[n.osm_id] = invalid_id;
+		for(auto&w:change.way_list)
+			for(auto x:w.node_osm_id_list)
+				shape_pos_of_node[x] = invalid_id;
+
+		for(uint32_t s=0; s<map.shape_pos_count; ++s){
+			auto i = shape_pos_of_node.find(map.shape_osm_id[s]);
+			if(i != shape_pos_of_node.end())
+				i->second = s;
+		}
+
+		for(auto i=shape_pos_of_node.begin(); i!=shape_pos_of_node.end();){
+			if(i->second == invalid_id)
+				i = shape_pos_of_node.erase(i);
+			else
+				++i;
+		}
+	}
+
+	auto find_shape_pos = [&](uint64_t osm_id){
+		auto i = shape_pos_of_node.find(osm_id);
+		if(i == shape_pos_of_node.end())
+			return invalid_id;
+		else
+			return i->second;
+	};
+
+	// Decide for every changed way whether it is removed or rebuilt.
+
+	std::vector<bool>is_old_way_removed(old_way_count, false);
+	std::vector<uint32_t>rebuilt_way_of_old_way(old_way_count, invalid_id);
+	std::vector<RebuiltWay>rebuilt_way_list;
+
+	TagMap tag_map;
+
+	for(auto&w:change.way_list){
+		uint32_t old_way = find_sorted(map.way_osm_id, w.osm_id);
+
+		bool is_car_road = false;
+		if(w.action != OSMChangeAction::remove && w.node_osm_id_list.size() >= 2){
+			build_tag_map(tag_map, w.tags);
+			is_car_road = is_osm_way_used_by_cars(w.osm_id, tag_map, log_message);
+		}
+
+		if(!is_car_road){
+			if(old_way != invalid_id){
+				is_old_way_removed[old_way] = true;
+				++result.removed_way_count;
+			}
+			continue;
+		}
+
+		// Nodes that are neither in the change nor in the dataset belong to ways
+		// that are no car roads. Their positions are unknown.
+		std::vector<LatLon>node_pos(w.node_osm_id_list.size());
+		bool is_every_pos_known = true;
+		for(size_t i=0; i<w.node_osm_id_list.size(); ++i){
+			uint64_t osm_id = w.node_osm_id_list[i];
+			auto changed = changed_node_pos.find(osm_id);
+			uint32_t node = find_sorted(map.node_osm_id, osm_id);
+			uint32_t shape_pos = find_shape_pos(osm_id);
+			if(changed != changed_node_pos.end())
+				node_pos[i] = changed->second;
+			else if(node != invalid_id)
+				node_pos[i] = map.node_pos[node];
+			else if(shape_pos != invalid_id)
+				node_pos[i] = map.shape_pos[shape_pos];
+			else{
+				is_every_pos_known = false;
+				break;
+			}
+		}
+
+		if(!is_every_pos_known){
+			result.unpatched_way_osm_id.push_back(w.osm_id);
+			continue;
+		}
+
+		if(old_way != invalid_id)
+			rebuilt_way_of_old_way[old_way] = rebuilt_way_list.size();
+		rebuilt_way_list.push_back({&w, old_way, std::move(node_pos)});
+	}
+
+	auto is_old_way_kept = [&](uint32_t w){
+		return !is_old_way_removed[w] && rebuilt_way_of_old_way[w] == invalid_id;
+	};
+
+	// Nodes that are the end of a rebuilt way or that occur several times in the
+	// rebuilt ways and the kept ways become routing nodes, just as in the import.
+	// A shape node of a kept way that becomes a routing node splits its link.
+
+	std::vector<uint64_t>new_routing_node_osm_id;
+	std::vector<LatLon>new_routing_node_pos;
+	std::unordered_set<uint32_t>is_split_shape_pos;
+	{
+		std::unordered_map<uint64_t, uint32_t>occurrence_count;
+		std::unordered_map<uint64_t, LatLon>pos_of_node;
+		for(auto&w:rebuilt_way_list){
+			auto&list = w.way->node_osm_id_list;
+			for(size_t i=0; i<list.size(); ++i){
+				if(find_sorted(map.node_osm_id, list[i]) != invalid_id)
+					continue;
+				occurrence_count[list[i]] += (i == 0 || i+1 == list.size()) ? 2 : 1;
+				pos_of_node[list[i]] = w.node_pos[i];
+			}
+		}
+		for(auto&x:occurrence_count){
+			uint32_t shape_pos = find_shape_pos(x.first);
+			if(shape_pos != invalid_id && is_old_way_kept(way_of_link[find_link_of_shape_pos(map, shape_pos)])){
+				++x.second;
+				is_split_shape_pos.insert(shape_pos);
+			}
+		}
+		for(auto&x:occurrence_count)
+			if(x.second >= 2)
+				new_routing_node_osm_id.push_back(x.first);
+		std::sort(new_routing_node_osm_id.begin(), new_routing_node_osm_id.end());
+		for(auto x:new_routing_node_osm_id)
+			new_routing_node_pos.push_back(pos_of_node[x]);
+
+		for(auto i=is_split_shape_pos.begin(); i!=is_split_shape_pos.end();){
+			if(find_sorted(new_routing_node_osm_id, map.shape_osm_id[*i]) == invalid_id)
+				i = is_split_shape_pos.erase(i);
+			else
+				++i;
+		}
+	}
+
+	// Merge the old and the new routing nodes. Moved routing nodes get their new
+	// position.
+
+	std::vector<uint32_t>new_node_of_old_node(map.node_count);
+	std::vector<uint64_t>node_osm_id;
+	std::vector<LatLon>node_pos;
+	{
+		node_osm_id.reserve(map.node_count + new_routing_node_osm_id.size());
+		node_pos.reserve(map.node_count + new_routing_node_osm_id.size());
+		uint32_t i = 0, j = 0;
+		while(i < map.node_count || j < new_routing_node_osm_id.size()){
+			if(j == new_routing_node_osm_id.size() || (i < map.node_count && map.node_osm_id[i] < new_routing_node_osm_id[j])){
+				new_node_of_old_node[i] = node_osm_id.size();
+				node_osm_id.push_back(map.node_osm_id[i]);
+				auto changed = changed_node_pos.find(map.node_osm_id[i]);
+				node_pos.push_back(changed != changed_node_pos.end() ? changed->second : map.node_pos[i]);
+				++i;
+			}else{
+				node_osm_id.push_back(new_routing_node_osm_id[j]);
+				node_pos.push_back(new_routing_node_pos[j]);
+				++j;
+			}
+		}
+		result.added_node_count = new_routing_node_osm_id.size();
+	}
+
+	// Kept ways must be reshaped if one of their nodes moved and split if one of
+	// their shape nodes became a routing node.
+
+	std::unordered_map<uint32_t, LatLon>moved_shape_pos;
+	for(auto&x:shape_pos_of_node){
+		auto changed = changed_node_pos.find(x.first);
+		if(changed != changed_node_pos.end() && !(changed->second == map.shape_pos[x.second]))
+			moved_shape_pos[x.second] = changed->second;
+	}
+
+	std::vector<bool>is_old_way_reshaped(old_way_count, false);
+	std::vector<bool>is_old_way_split(old_way_count, false);
+	for(uint32_t l=0; l<old_link_count; ++l){
+		uint32_t w = way_of_link[l];
+		if(!is_old_way_kept(w))
+			continue;
+		if(!(map.node_pos[map.link_tail[l]] == node_pos[new_node_of_old_node[map.link_tail[l]]]) || !(map.node_pos[map.link_head[l]] == node_pos[new_node_of_old_node[map.link_head[l]]]))
+			is_old_way_reshaped[w] = true;
+	}
+	for(auto&x:moved_shape_pos){
+		uint32_t w = way_of_link[find_link_of_shape_pos(map, x.first)];
+		if(is_old_way_kept(w))
+			is_old_way_reshaped[w] = true;
+	}
+	for(auto s:is_split_shape_pos)
+		is_old_way_split[way_of_link[find_link_of_shape_pos(map, s)]] = true;
+
+	// Assemble the new ways in the order of their OSM IDs.
+
+	struct WaySource{
+		uint64_t osm_id;
+		uint32_t old_way;
+		uint32_t rebuilt_way;
+	};
+	std::vector<WaySource>way_source_list;
+	for(uint32_t w=0; w<old_way_count; ++w)
+		if(!is_old_way_removed[w])
+			way_source_list.push_back({map.way_osm_id[w], w, rebuilt_way_of_old_way[w]});
+	for(uint32_t i=0; i<rebuilt_way_list.size(); ++i)
+		if(rebuilt_way_list[i].old_way == invalid_id)
+			way_source_list.push_back({rebuilt_way_list[i].way->osm_id, invalid_id, i});
+	std::sort(way_source_list.begin(), way_source_list.end(), [](const WaySource&l, const WaySource&r){return l.osm_id < r.osm_id;});
+
+	VecOSMCarRoads out;
+	out.node_osm_id = std::move(node_osm_id);
+	out.node_pos = std::move(node_pos);
+	out.first_shape_pos_of_link.push_back(0);
+	out.first_link_of_way.push_back(0);
+
+	auto to_routing_index = [&](uint64_t osm_id){
+		return find_sorted(out.node_osm_id, osm_id);
+	};
+
+	auto add_link = [&](uint32_t tail, uint32_t head, uint32_t length_in_cm){
+		out.link_tail.push_back(tail);
+		out.link_head.push_back(head);
+		out.link_length_in_cm.push_back(length_in_cm);
+		out.first_shape_pos_of_link.push_back(out.shape_pos.size());
+	};
+
+	// An old link is replaced by the new links [first_new_link_of_old_link[l],
+	// end_new_link_of_old_link[l]), which form a path from its tail to its head.
+	// The range is empty if the link does not exist anymore.
+	std::vector<uint32_t>first_new_link_of_old_link(old_link_count, invalid_id);
+	std::vector<uint32_t>end_new_link_of_old_link(old_link_count, invalid_id);
+
+	for(auto&s:way_source_list){
+		out.way_osm_id.push_back(s.osm_id);
+
+		if(s.rebuilt_way == invalid_id){
+			bool is_reshaped = is_old_way_reshaped[s.old_way];
+			bool is_split = is_old_way_split[s.old_way];
+			if(is_split)
+				++result.split_way_count;
+			else if(is_reshaped)
+				++result.reshaped_way_count;
+
+			for(uint32_t l=map.first_link_of_way[s.old_way]; l<map.first_link_of_way[s.old_way+1]; ++l){
+				uint32_t new_link_begin = out.link_tail.size();
+				first_new_link_of_old_link[l] = new_link_begin;
+				uint32_t tail = new_node_of_old_node[map.link_tail[l]];
+				uint32_t head = new_node_of_old_node[map.link_head[l]];
+				uint32_t forward_time = map.dlink_traversal_time_in_ms[link_to_forward_dlink(l)];
+				uint32_t backward_time = map.dlink_traversal_time_in_ms[link_to_backward_dlink(l)];
+				uint32_t length = map.link_length_in_cm[l];
+
+				if(!is_reshaped && !is_split){
+					out.shape_pos.insert(
+						out.shape_pos.end(),
+						map.shape_pos.begin() + map.first_shape_pos_of_link[l],
+						map.shape_pos.begin() + map.first_shape_pos_of_link[l+1]
+					);
+					out.shape_osm_id.insert(
+						out.shape_osm_id.end(),
+						map.shape_osm_id.begin() + map.first_shape_pos_of_link[l],
+						map.shape_osm_id.begin() + map.first_shape_pos_of_link[l+1]
+					);
+					add_link(tail, head, length);
+					out.dlink_traversal_time_in_ms.push_back(forward_time);
+					out.dlink_traversal_time_in_ms.push_back(backward_time);
+				}else{
+					// The tags of the way are unknown. The traversal times are
+					// thus scaled with the length of the new links.
+					uint32_t prev_node = tail;
+					LatLon prev_pos = out.node_pos[tail];
+					uint32_t distance_since_prev_node_in_cm = 0;
+					for(uint32_t p=map.first_shape_pos_of_link[l]; p<map.first_shape_pos_of_link[l+1]; ++p){
+						auto moved = moved_shape_pos.find(p);
+						LatLon now_pos = moved != moved_shape_pos.end() ? moved->second : map.shape_pos[p];
+						distance_since_prev_node_in_cm += compute_distance_in_cm(GeoPos(prev_pos), GeoPos(now_pos));
+						prev_pos = now_pos;
+						if(is_split_shape_pos.count(p)){
+							uint32_t now_node = to_routing_index(map.shape_osm_id[p]);
+							add_link(prev_node, now_node, distance_since_prev_node_in_cm);
+							prev_node = now_node;
+							distance_since_prev_node_in_cm = 0;
+						}else{
+							out.shape_pos.push_back(now_pos);
+							out.shape_osm_id.push_back(map.shape_osm_id[p]);
+						}
+					}
+					distance_since_prev_node_in_cm += compute_distance_in_cm(GeoPos(prev_pos), GeoPos(out.node_pos[head]));
+					add_link(prev_node, head, distance_since_prev_node_in_cm);
+
+					uint32_t new_length = 0;
+					for(uint32_t i=new_link_begin; i<out.link_tail.size(); ++i)
+						new_length += out.link_length_in_cm[i];
+
+					for(uint32_t i=new_link_begin; i<out.link_tail.size(); ++i){
+						auto scale = [&](uint32_t time){
+							if(time == std::numeric_limits<uint32_t>::max())
+								return time;
+							if(length == 0)
+								return new_length == 0 ? time : static_cast<uint32_t>(static_cast<uint64_t>(time) * out.link_length_in_cm[i] / new_length);
+							return static_cast<uint32_t>(static_cast<uint64_t>(time) * out.link_length_in_cm[i] / length);
+						};
+						out.dlink_traversal_time_in_ms.push_back(scale(forward_time));
+						out.dlink_traversal_time_in_ms.push_back(scale(backward_time));
+					}
+				}
+				end_new_link_of_old_link[l] = out.link_tail.size();
+			}
+		}else{
+			const RebuiltWay&w = rebuilt_way_list[s.rebuilt_way];
+			auto&list = w.way->node_osm_id_list;
+			++result.rebuilt_way_count;
+
+			uint32_t link_begin = out.link_tail.size();
+
+			uint32_t prev_node = to_routing_index(list.front());
+			LatLon first_pos = w.node_pos.front();
+			LatLon prev_pos = first_pos;
+			uint32_t distance_since_prev_pos_in_cm = 0;
+
+			for(size_t i=1; i<list.size(); ++i){
+				LatLon now_pos = w.node_pos[i];
+				distance_since_prev_pos_in_cm += compute_distance_in_cm(GeoPos(prev_pos), GeoPos(now_pos));
+				prev_pos = now_pos;
+
+				uint32_t now_node = to_routing_index(list[i]);
+				if(now_node != invalid_id){
+					add_link(prev_node, now_node, distance_since_prev_pos_in_cm);
+					prev_node = now_node;
+					distance_since_prev_pos_in_cm = 0;
+				}else{
+					out.shape_pos.push_back(now_pos);
+					out.shape_osm_id.push_back(list[i]);
+				}
+			}
+
+			uint32_t link_end = out.link_tail.size();
+			out.dlink_traversal_time_in_ms.resize(2*link_end);
+
+			build_tag_map(tag_map, w.way->tags);
+			SpeedOrDuration speed_or_duration = get_osm_way_speed_or_duration(w.way->osm_id, first_pos, prev_pos, tag_map, log_message);
+
+			auto compute_traversal_time = [](uint32_t length_in_cm, uint32_t speed_in_kmh){
+				if(speed_in_kmh == 0){
+					return std::numeric_limits<uint32_t>::max();
+				}else{
+					uint32_t time_in_ms = (36*length_in_cm) / speed_in_kmh;
+					return time_in_ms;
+				}
+			};
+
+			if(speed_or_duration.holds_speed()){
+				for(uint32_t i=link_begin; i<link_end; ++i){
+					out.dlink_traversal_time_in_ms[link_to_forward_dlink(i)] = compute_traversal_time(out.link_length_in_cm[i], speed_or_duration.forward_speed_in_kmh());
+					out.dlink_traversal_time_in_ms[link_to_backward_dlink(i)] = compute_traversal_time(out.link_length_in_cm[i], speed_or_duration.backward_speed_in_kmh());
+				}
+			}else{
+				uint32_t way_length_in_cm = 0;
+				for(uint32_t i=link_begin; i<link_end; ++i)
+					way_length_in_cm += out.link_length_in_cm[i];
+
+				for(uint32_t i=link_begin; i<link_end; ++i){
+					if(link_end == link_begin+1 || way_length_in_cm == 0){
+						out.dlink_traversal_time_in_ms[link_to_forward_dlink(i)] = speed_or_duration.forward_duration_in_ms();
+						out.dlink_traversal_time_in_ms[link_to_backward_dlink(i)] = speed_or_duration.backward_duration_in_ms();
+					}else{
+						auto scale=[](uint32_t dur_in_ms, uint32_t len_in_cm, uint32_t total_len_in_cm){
+							return static_cast<uint32_t>(static_cast<uint64_t>(dur_in_ms) * static_cast<uint64_t>(len_in_cm) / static_cast<uint64_t>(total_len_in_cm));
+						};
+						out.dlink_traversal_time_in_ms[link_to_forward_dlink(i)] = scale(speed_or_duration.forward_duration_in_ms(), out.link_length_in_cm[i], way_length_in_cm);
+						out.dlink_traversal_time_in_ms[link_to_backward_dlink(i)] = scale(speed_or_duration.backward_duration_in_ms(), out.link_length_in_cm[i], way_length_in_cm);
+					}
+				}
+			}
+
+			// If the links connect the same nodes as before, then the forbidden
+			// maneuvers on them remain valid.
+			if(w.old_way != invalid_id){
+				uint32_t old_link_begin = map.first_link_of_way[w.old_way];
+				uint32_t old_link_end = map.first_link_of_way[w.old_way+1];
+				bool has_same_links = link_end - link_begin == old_link_end - old_link_begin;
+				for(uint32_t i=0; i<link_end-link_begin && has_same_links; ++i)
+					if(out.link_tail[link_begin+i] != new_node_of_old_node[map.link_tail[old_link_begin+i]] || out.link_head[link_begin+i] != new_node_of_old_node[map.link_head[old_link_begin+i]])
+						has_same_links = false;
+				if(has_same_links){
+					for(uint32_t i=0; i<link_end-link_begin; ++i){
+						first_new_link_of_old_link[old_link_begin+i] = link_begin+i;
+						end_new_link_of_old_link[old_link_begin+i] = link_begin+i+1;
+					}
+				}
+			}
+		}
+
+		out.first_link_of_way.push_back(out.link_tail.size());
+	}
+
+	out.node_count = out.node_osm_id.size();
+	out.link_count = out.link_tail.size();
+	out.shape_pos_count = out.shape_pos.size();
+	out.way_count = out.way_osm_id.size();
+
+	// Created and modified turn restrictions are matched onto the new links just
+	// as in the import.
+
+	std::unordered_set<uint64_t>changed_relation;
+	std::vector<OSMManeuver>changed_maneuver_list;
+	{
+		auto to_way_index = [&](uint64_t osm_id){
+			return find_sorted(out.way_osm_id, osm_id);
+		};
+
+		std::vector<OSMRelationMember>member_list;
+		for(auto&r:change.relation_list){
+			changed_relation.insert(r.osm_id);
+			if(r.action == OSMChangeAction::remove)
+				continue;
+			member_list.clear();
+			for(auto&m:r.member_list)
+				member_list.push_back({m.type, m.osm_id, m.role.c_str()});
+			build_tag_map(tag_map, r.tags);
+			decode_osm_turn_restriction(r.osm_id, member_list, tag_map, to_routing_index, to_way_index, changed_maneuver_list, log_message);
+		}
+	}
+
+	build_forbidden_maneuvers(out, std::move(changed_maneuver_list), log_message);
+
+	// Keep the forbidden maneuvers whose links still exist and whose relation did
+	// not change. They are merged with the ones of the changed relations by OSM ID.
+	//
+	// If a link of a maneuver was split, then the maneuver goes over all new links
+	// of a via link but only over the new link next to the via part of the from
+	// and the to link, just as the import would match it.
+
+	std::vector<uint32_t>first_dlink_of_forbidden_maneuver = {0};
+	std::vector<uint32_t>forbidden_maneuver_dlink;
+	std::vector<uint64_t>forbidden_maneuver_osm_id;
+
+	uint32_t changed_maneuver = 0;
+	auto add_changed_maneuvers_before = [&](uint64_t osm_id){
+		for(; changed_maneuver<out.forbidden_maneuver_count && out.forbidden_maneuver_osm_id[changed_maneuver] < osm_id; ++changed_maneuver){
+			forbidden_maneuver_dlink.insert(
+				forbidden_maneuver_dlink.end(),
+				out.forbidden_maneuver_dlink.begin() + out.first_dlink_of_forbidden_maneuver[changed_maneuver],
+				out.forbidden_maneuver_dlink.begin() + out.first_dlink_of_forbidden_maneuver[changed_maneuver+1]
+			);
+			first_dlink_of_forbidden_maneuver.push_back(forbidden_maneuver_dlink.size());
+			forbidden_maneuver_osm_id.push_back(out.forbidden_maneuver_osm_id[changed_maneuver]);
+		}
+	};
+
+	for(uint32_t m=0; m<map.forbidden_maneuver_count; ++m){
+		uint64_t osm_id = map.forbidden_maneuver_osm_id[m];
+		if(changed_relation.count(osm_id))
+			continue;
+
+		uint32_t dlink_begin = map.first_dlink_of_forbidden_maneuver[m];
+		uint32_t dlink_end = map.first_dlink_of_forbidden_maneuver[m+1];
+
+		bool is_valid = true;
+		for(uint32_t i=dlink_begin; i<dlink_end; ++i)
+			if(first_new_link_of_old_link[dlink_to_link(map.forbidden_maneuver_dlink[i])] == invalid_id)
+				is_valid = false;
+
+		if(!is_valid){
+			if(result.dropped_maneuver_osm_id.empty() || result.dropped_maneuver_osm_id.back() != osm_id)
+				result.dropped_maneuver_osm_id.push_back(osm_id);
+			continue;
+		}
+
+		add_changed_maneuvers_before(osm_id);
+		for(uint32_t i=dlink_begin; i<dlink_end; ++i){
+			uint32_t dlink = map.forbidden_maneuver_dlink[i];
+			uint32_t old_link = dlink_to_link(dlink);
+			uint32_t begin = first_new_link_of_old_link[old_link];
+			uint32_t end = end_new_link_of_old_link[old_link];
+			if(is_forward_dlink(dlink)){
+				if(i == dlink_begin)
+					begin = end-1;
+				if(i+1 == dlink_end)
+					end = begin+1;
+				for(uint32_t l=begin; l<end; ++l)
+					forbidden_maneuver_dlink.push_back(link_to_forward_dlink(l));
+			}else{
+				if(i == dlink_begin)
+					end = begin+1;
+				if(i+1 == dlink_end)
+					begin = end-1;
+				for(uint32_t l=end; l>begin; --l)
+					forbidden_maneuver_dlink.push_back(link_to_backward_dlink(l-1));
+			}
+		}
+		first_dlink_of_forbidden_maneuver.push_back(forbidden_maneuver_dlink.size());
+		forbidden_maneuver_osm_id.push_back(osm_id);
+	}
+	add_changed_maneuvers_before(std::numeric_limits<uint64_t>::max());
+
+	std::sort(result.dropped_maneuver_osm_id.begin(), result.dropped_maneuver_osm_id.end());
+	result.dropped_maneuver_osm_id.erase(std::unique(result.dropped_maneuver_osm_id.begin(), result.dropped_maneuver_osm_id.end()), result.dropped_maneuver_osm_id.end());
+
+	out.first_dlink_of_forbidden_maneuver = std::move(first_dlink_of_forbidden_maneuver);
+	out.forbidden_maneuver_dlink = std::move(forbidden_maneuver_dlink);
+	out.forbidden_maneuver_osm_id = std::move(forbidden_maneuver_osm_id);
+	out.forbidden_maneuver_count = out.forbidden_maneuver_osm_id.size();
+	out.forbidden_maneuver_dlink_count = out.forbidden_maneuver_dlink.size();
+
+	map = std::move(out);
+
+	return result;
+}
+
+} // RoutingKit2
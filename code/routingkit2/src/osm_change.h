@@ -0,0 +1,112 @@
+#ifndef ROUTING_KIT2_OSM_CHANGE_H
+#define ROUTING_KIT2_OSM_CHANGE_H
+
+#include "map.h"
+#include "geo_pos.h"
+#include "osm_types.h"
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace RoutingKit2{
+
+enum class OSMChangeAction{
+	create,
+	modify,
+	remove
+};
+
+struct OSMChangeNode{
+	OSMChangeAction action;
+	uint64_t osm_id;
+	LatLon pos;
+};
+
+struct OSMChangeWay{
+	OSMChangeAction action;
+	uint64_t osm_id;
+	std::vector<uint64_t>node_osm_id_list;
+	std::vector<std::pair<std::string, std::string>>tags;
+};
+
+struct OSMChangeRelationMember{
+	OSMIDType type;
+	uint64_t osm_id;
+	std::string role;
+};
+
+struct OSMChangeRelation{
+	OSMChangeAction action;
+	uint64_t osm_id;
+	std::vector<OSMChangeRelationMember>member_list;
+	std::vector<std::pair<std::string, std::string>>tags;
+};
+
+//! The contents of an OSM change file. If an element occurs several times, then
+//! only its last occurrence is kept.
+struct OSMChange{
+	std::vector<OSMChangeNode>node_list;
+	std::vector<OSMChangeWay>way_list;
+	std::vector<OSMChangeRelation>relation_list;
+};
+
+//! Parses an uncompressed OSM change file (.osc) in the osmChange XML format.
+OSMChange read_osm_change_file(const std::string&file_name);
+OSMChange parse_osm_change(const std::string&xml);
+
+struct OSMChangeResult{
+	uint32_t removed_way_count = 0;
+	uint32_t rebuilt_way_count = 0;
+	uint32_t reshaped_way_count = 0;
+	uint32_t split_way_count = 0;
+	uint32_t added_node_count = 0;
+
+	//! Ways that could not be patched because a node position is unknown. A way
+	//! can only be rebuilt if all its nodes are in the change or in the dataset,
+	//! either as routing nodes or as shape nodes. Other nodes do not belong to car
+	//! roads and their position is unknown. These ways keep their old version.
+	std::vector<uint64_t>unpatched_way_osm_id;
+
+	//! Relations whose forbidden maneuvers were removed because one of their links
+	//! was removed or rebuilt.
+	std::vector<uint64_t>dropped_maneuver_osm_id;
+
+	//! True if the result differs from a full reimport only in ways that are
+	//! harmless for routing, i.e., left over routing nodes that could be shape nodes.
+	bool is_complete()const{
+		return unpatched_way_osm_id.empty() && dropped_maneuver_osm_id.empty();
+	}
+};
+
+//! Applies an OSM change to a dataset created by import_car_roads_from_osm_pbf_file.
+//! Only the ways that are part of the change and the ways with moved or new
+//! routing nodes or moved shape nodes are recomputed. All other links, shapes,
+//! traversal times and forbidden maneuvers are copied and renumbered.
+//!
+//! Shape nodes are identified by shape_osm_id. If a changed way uses a shape node
+//! of a way that is not part of the change, then that node becomes a routing node
+//! and the unchanged way is split at it, just as in the import. Datasets written
+//! before shape_osm_id was added to OSMCarRoads lack this column and cannot be
+//! loaded as OSMCarRoads. They must be imported again. Their other columns can
+//! still be loaded as CarRoads or LinkShapes.
+//!
+//! The traversal times of ways that are not part of the change are scaled with the
+//! length of the new links, as their tags are unknown. Forbidden maneuvers over
+//! split links are moved onto the new links.
+//!
+//! Created and modified turn restrictions are matched onto the new links in the
+//! same way as in the import.
+//!
+//! Routing nodes are never removed, even if they are no longer needed.
+OSMChangeResult apply_osm_change(
+	VecOSMCarRoads&map,
+	const OSMChange&change,
+	const std::function<void(std::string)>&log_message = [](std::string){}
+);
+
+} // RoutingKit2
+
+#endif
@@ -11,6 +11,10 @@
 #include <sstream>
 #include <algorithm>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <exception>
+#include <vector>
 #include <string.h>
 #include <assert.h>
 
@@ -54,11 +58,15 @@ namespace{
 
 	constexpr uint32_t pbf_decompressor_read_size = 64 << 20;
 
-	class OsmPBFDecompressor {
+	// Reads the blobs of an OSM PBF file sequentially and hands out the raw, still
+	// compressed OSMData blobs. Header blocks are interpreted and unknown blocks are
+	// skipped.
+	class OsmPBFBlobReader {
 	public:
-		OsmPBFDecompressor():status(0){}
-		OsmPBFDecompressor(RefDataSource data_source):
+		OsmPBFBlobReader():status(0), has_lookahead_blob(false){}
+		OsmPBFBlobReader(RefDataSource data_source):
 			status(0),
+			has_lookahead_blob(false),
 			reader(data_source, pbf_decompressor_read_size){
 		}
 
@@ -66,194 +74,198 @@ namespace{
 			return status;
 		}
 
-		RefDataSource as_ref(){
-			return [&](uint8_t*buffer, size_t how_much_to_read) -> size_t{
-				assert(how_much_to_read == pbf_decompressor_read_size);
-
-				const uint8_t*blob_begin, *blob_end;
-
-				for(;;){
-					uint8_t*p = reader.read(4);
-					if(p == nullptr)
-						return 0;
-
-					uint32_t header_size = ntohl(unaligned_load<uint32_t>(p));
-
-					uint32_t data_size = (uint32_t)-1;
-
-					char block_type[16] = "";
-
-					const uint8_t*buffer = reader.read_or_throw(header_size);
-					decode_protobuf_message_with_callbacks(
-						buffer, buffer+header_size,
-						[&](uint64_t key_id, uint64_t num){
-							if(key_id == 3)
-								data_size = num;
-						},
-						[&](uint64_t key_id, double num){},
-						[&](uint64_t key_id, const uint8_t*str_begin, const uint8_t*str_end){
-							if(key_id == 1){
-								size_t len = str_end - str_begin;
-								if(len > sizeof(block_type)-1)
-									len = sizeof(block_type)-1;
-								memcpy(block_type, str_begin, len);
-								block_type[len] = '\0';
-							}
-						}
-					);
+		// Reads ahead until the header information is available, i.e., until the
+		// first OSMData blob was found. The blob is buffered and returned by the next
+		// call to read_next_data_blob.
+		void read_header_info(){
+			if((status & is_header_info_available_bit) == 0 && !has_lookahead_blob){
+				has_lookahead_blob = read_next_data_blob_from_file(lookahead_blob);
+				status |= is_header_info_available_bit;
+			}
+		}
 
-					if(data_size == (uint32_t)-1)
-						throw std::runtime_error("Cannot parse OSM blob header because it is missing the data size");
+		// Copies the next OSMData blob into blob. Returns false if the end of the file
+		// was reached.
+		bool read_next_data_blob(std::vector<uint8_t>&blob){
+			if(has_lookahead_blob){
+				std::swap(blob, lookahead_blob);
+				has_lookahead_blob = false;
+				return true;
+			}
+			return read_next_data_blob_from_file(blob);
+		}
 
-					if(!strcmp(block_type, "OSMData")){
-						status |= is_header_info_available_bit | was_blob_read_bit;
+	private:
+		bool read_next_data_blob_from_file(std::vector<uint8_t>&blob){
+			for(;;){
+				uint8_t*p = reader.read(4);
+				if(p == nullptr)
+					return false;
 
-						blob_begin = reader.read_or_throw(data_size);
-						blob_end = blob_begin + data_size;
-						break;
-					} else if(!strcmp(block_type, "OSMHeader")) {
-						if((status & is_header_info_available_bit) != 0 && (status & was_blob_read_bit) != 0)
-							throw std::runtime_error("OSM PBF file header block must preceed all blob blocks");
-						if((status & is_header_info_available_bit) != 0 && (status & was_header_read_bit) != 0)
-							throw std::runtime_error("OSM PBF file contains two header blocks");
+				uint32_t header_size = ntohl(unaligned_load<uint32_t>(p));
 
-						bool is_ordered = false;
-						const uint8_t*buffer = reader.read_or_throw(data_size);
-						decode_protobuf_message_with_callbacks(
-							buffer, buffer+data_size,
-							[&](uint64_t key_id, uint64_t num){},
-							[&](uint64_t key_id, double num){},
-							[&](uint64_t key_id, const uint8_t*blob_begin, const uint8_t*blob_end){
-								const char*str_begin = (const char*)blob_begin;
-								const char*str_end = (const char*)blob_end;
-
-								if(key_id == 4){ // must support
-									if(!std::equal(str_begin, str_end, "DenseNodes"))
-										throw std::runtime_error("Required OSM PBF feature \""+std::string(str_begin, str_end)+"\" is unknown");
-								}else if(key_id == 5){ // may exploit
-									if(std::equal(str_begin, str_end, "Sort.Type_then_ID"))
-										is_ordered = true;
-								}
-							}
-						);
-						if(is_ordered)
-							status = is_header_info_available_bit | is_ordered_bit | was_header_read_bit;
-						else
-							status = is_header_info_available_bit | was_header_read_bit;
-					} else {
-						reader.read(data_size);
-						continue;
-					}
-				}
+				uint32_t data_size = (uint32_t)-1;
 
-				const uint8_t
-					*uncompressed_begin = nullptr,
-					*uncompressed_end = nullptr,
-					*compressed_begin = nullptr,
-					*compressed_end = nullptr;
-				uint64_t uncompressed_data_size = (uint64_t)-1;
+				char block_type[16] = "";
 
+				const uint8_t*buffer = reader.read_or_throw(header_size);
 				decode_protobuf_message_with_callbacks(
-					blob_begin, blob_end,
+					buffer, buffer+header_size,
 					[&](uint64_t key_id, uint64_t num){
-						if(key_id == 2)
-							uncompressed_data_size = num;
+						if(key_id == 3)
+							data_size = num;
 					},
 					[&](uint64_t key_id, double num){},
 					[&](uint64_t key_id, const uint8_t*str_begin, const uint8_t*str_end){
 						if(key_id == 1){
-							uncompressed_begin = str_begin;
-							uncompressed_end = str_end;
-						}else if(key_id == 3){
-							compressed_begin = str_begin;
-							compressed_end = str_end;
+							size_t len = str_end - str_begin;
+							if(len > sizeof(block_type)-1)
+								len = sizeof(block_type)-1;
+							memcpy(block_type, str_begin, len);
+							block_type[len] = '\0';
 						}
 					}
 				);
 
-				if(uncompressed_begin != nullptr && compressed_begin != nullptr)
-					throw std::runtime_error("PBF error: Blob must not contain both compressed and uncompressed data");
-				if(uncompressed_begin == nullptr && compressed_begin == nullptr)
-					throw std::runtime_error("PBF error: Blob contains neither compressed nor uncompressed data");
-				if(uncompressed_data_size == (uint64_t)-1)
-					throw std::runtime_error("PBF error: Blob does not contain the size of the uncompressed data");
-				if(uncompressed_begin){
-					if(uncompressed_data_size > how_much_to_read-4)
-						throw std::runtime_error("PBF error: Blob is too large. It is "+std::to_string(uncompressed_data_size) + " but may be at most "+std::to_string(how_much_to_read-4));
-					if(uncompressed_data_size != (std::uint64_t)(uncompressed_end - uncompressed_begin))
-						throw std::runtime_error("PBF error: claimed uncompressed blob size does not correspond to actual blob size");
-					unaligned_store<uint32_t>(buffer, uncompressed_data_size);
-					buffer += 4;
-					memcpy(buffer, uncompressed_begin, uncompressed_data_size);
-					return uncompressed_data_size + 4;
-				}else{
-					uint64_t compressed_data_size = compressed_end - compressed_begin;
-					if(uncompressed_data_size > how_much_to_read-4)
-						throw std::runtime_error("PBF error: Blob is too large. It is "+std::to_string(uncompressed_data_size) + " but may be at most "+std::to_string(how_much_to_read-4));
-
-					unaligned_store<uint32_t>(buffer, uncompressed_data_size);
-					buffer += 4;
-
-					z_stream z;
-					z.next_in   = (unsigned char*) compressed_begin;
-					z.avail_in  = compressed_data_size;
-					z.next_out  = (unsigned char*) buffer;
-					z.avail_out = how_much_to_read-4;
-					z.zalloc    = Z_NULL;
-					z.zfree     = Z_NULL;
-					z.opaque    = Z_NULL;
-
-					if(inflateInit(&z) != Z_OK) {
-						throw std::runtime_error("PBF error: Failed to initialize zlib stream.");
-					}
-					if(inflate(&z, Z_FINISH) != Z_STREAM_END) {
-						throw std::runtime_error("PBF error: Failed to completely inflate zlib stream. Probably the OSM blob decompresses to something larger than reported in the header.");
-					}
-					if(inflateEnd(&z) != Z_OK) {
-						throw std::runtime_error("PBF error: Failed to cleanup zlib stream.");
-					}
-					if(z.total_out != uncompressed_data_size) {
-						throw std::runtime_error("PBF error: OSM blob decompresses to fewer bytes than reported in the header.");
-					}
-					return uncompressed_data_size + 4;
+				if(data_size == (uint32_t)-1)
+					throw std::runtime_error("Cannot parse OSM blob header because it is missing the data size");
+
+				if(!strcmp(block_type, "OSMData")){
+					status |= is_header_info_available_bit | was_blob_read_bit;
+
+					const uint8_t*blob_begin = reader.read_or_throw(data_size);
+					blob.assign(blob_begin, blob_begin + data_size);
+					return true;
+				} else if(!strcmp(block_type, "OSMHeader")) {
+					if((status & is_header_info_available_bit) != 0 && (status & was_blob_read_bit) != 0)
+						throw std::runtime_error("OSM PBF file header block must preceed all blob blocks");
+					if((status & is_header_info_available_bit) != 0 && (status & was_header_read_bit) != 0)
+						throw std::runtime_error("OSM PBF file contains two header blocks");
+
+					bool is_ordered = false;
+					const uint8_t*buffer = reader.read_or_throw(data_size);
+					decode_protobuf_message_with_callbacks(
+						buffer, buffer+data_size,
+						[&](uint64_t key_id, uint64_t num){},
+						[&](uint64_t key_id, double num){},
+						[&](uint64_t key_id, const uint8_t*blob_begin, const uint8_t*blob_end){
+							const char*str_begin = (const char*)blob_begin;
+							const char*str_end = (const char*)blob_end;
+
+							if(key_id == 4){ // must support
+								if(!std::equal(str_begin, str_end, "DenseNodes"))
+									throw std::runtime_error("Required OSM PBF feature \""+std::string(str_begin, str_end)+"\" is unknown");
+							}else if(key_id == 5){ // may exploit
+								if(std::equal(str_begin, str_end, "Sort.Type_then_ID"))
+									is_ordered = true;
+							}
+						}
+					);
+					if(is_ordered)
+						status = is_header_info_available_bit | is_ordered_bit | was_header_read_bit;
+					else
+						status = is_header_info_available_bit | was_header_read_bit;
+				} else {
+					reader.read(data_size);
 				}
-			};
+			}
 		}
-	private:
+
 		uint64_t status;
+		bool has_lookahead_blob;
+		std::vector<uint8_t>lookahead_blob;
 		BufferedAsyncReader reader;
 	};
-}
-
-namespace {
-	void internal_read_osm_pbf(
-		BufferedAsyncReader&reader,
-		std::function<void(uint64_t osm_node_id, LatLon p, const TagMap&tags)>node_callback,
-		std::function<void(uint64_t osm_way_id, const std::vector<std::uint64_t>&osm_node_id_list, const TagMap&tags)>way_callback,
-		std::function<void(uint64_t osm_relation_id, const std::vector<OSMRelationMember>&member_list, const TagMap&tags)>relation_callback,
-		std::function<void(std::string msg)>log_message
-	){
-		TagMap tag_map;
-		std::vector<OSMRelationMember>member_list;
-		std::vector<uint64_t>node_list;
 
-		std::vector<const char*>string_table;
-		std::vector<uint32_t>key_list;
-		std::vector<uint32_t>value_list;
-
-		std::vector<std::pair<const uint8_t*, const uint8_t*>>group_list;
-
-		for(;;){
-			uint8_t*primblock_begin, *primblock_end;
-			{
-				uint8_t*s_ptr = reader.read(4);
-				if(s_ptr == nullptr)
-					break;
-				uint32_t s = unaligned_load<uint32_t>(s_ptr);
-				primblock_begin = reader.read_or_throw(s);
-				primblock_end = primblock_begin + s;
+	// Decompresses an OSMData blob into the primitive block that it contains.
+	// This function is thread-safe.
+	void decompress_blob(const uint8_t*blob_begin, const uint8_t*blob_end, std::vector<uint8_t>&primblock){
+		const uint8_t
+			*uncompressed_begin = nullptr,
+			*uncompressed_end = nullptr,
+			*compressed_begin = nullptr,
+			*compressed_end = nullptr;
+		uint64_t uncompressed_data_size = (uint64_t)-1;
+
+		decode_protobuf_message_with_callbacks(
+			blob_begin, blob_end,
+			[&](uint64_t key_id, uint64_t num){
+				if(key_id == 2)
+					uncompressed_data_size = num;
+			},
+			[&](uint64_t key_id, double num){},
+			[&](uint64_t key_id, const uint8_t*str_begin, const uint8_t*str_end){
+				if(key_id == 1){
+					uncompressed_begin = str_begin;
+					uncompressed_end = str_end;
+				}else if(key_id == 3){
+					compressed_begin = str_begin;
+					compressed_end = str_end;
+				}
+			}
+		);
+
+		if(uncompressed_begin != nullptr && compressed_begin != nullptr)
+			throw std::runtime_error("PBF error: Blob must not contain both compressed and uncompressed data");
+		if(uncompressed_begin == nullptr && compressed_begin == nullptr)
+			throw std::runtime_error("PBF error: Blob contains neither compressed nor uncompressed data");
+		if(uncompressed_data_size == (uint64_t)-1)
+			throw std::runtime_error("PBF error: Blob does not contain the size of the uncompressed data");
+		if(uncompressed_data_size > pbf_decompressor_read_size-4)
+			throw std::runtime_error("PBF error: Blob is too large. It is "+std::to_string(uncompressed_data_size) + " but may be at most "+std::to_string(pbf_decompressor_read_size-4));
+
+		if(uncompressed_begin){
+			if(uncompressed_data_size != (std::uint64_t)(uncompressed_end - uncompressed_begin))
+				throw std::runtime_error("PBF error: claimed uncompressed blob size does not correspond to actual blob size");
+			primblock.assign(uncompressed_begin, uncompressed_end);
+		}else{
+			uint64_t compressed_data_size = compressed_end - compressed_begin;
+
+			primblock.resize(uncompressed_data_size);
+
+			z_stream z;
+			z.next_in   = (unsigned char*) compressed_begin;
+			z.avail_in  = compressed_data_size;
+			z.next_out  = (unsigned char*) primblock.data();
+			z.avail_out = uncompressed_data_size;
+			z.zalloc    = Z_NULL;
+			z.zfree     = Z_NULL;
+			z.opaque    = Z_NULL;
+
+			if(inflateInit(&z) != Z_OK) {
+				throw std::runtime_error("PBF error: Failed to initialize zlib stream.");
+			}
+			int inflate_result = inflate(&z, Z_FINISH);
+			inflateEnd(&z);
+			if(inflate_result != Z_STREAM_END) {
+				throw std::runtime_error("PBF error: Failed to completely inflate zlib stream. Probably the OSM blob decompresses to something larger than reported in the header.");
 			}
+			if(z.total_out != uncompressed_data_size) {
+				throw std::runtime_error("PBF error: OSM blob decompresses to fewer bytes than reported in the header.");
+			}
+		}
+	}
+}
 
+namespace {
+	using InternalNodeCallback = std::function<void(unsigned worker_id, uint64_t osm_node_id, LatLon p, const TagMap&tags)>;
+	using InternalWayCallback = std::function<void(unsigned worker_id, uint64_t osm_way_id, const std::vector<std::uint64_t>&osm_node_id_list, const TagMap&tags)>;
+	using InternalRelationCallback = std::function<void(unsigned worker_id, uint64_t osm_relation_id, const std::vector<OSMRelationMember>&member_list, const TagMap&tags)>;
+
+	// Decodes primitive blocks and calls the callbacks for their elements. Every
+	// thread needs its own decoder as it contains the scratch buffers. The worker id
+	// of the thread is passed to the callbacks.
+	class OsmPBFPrimitiveBlockDecoder{
+	public:
+		explicit OsmPBFPrimitiveBlockDecoder(unsigned worker_id):worker_id(worker_id){}
+
+		void decode(
+			uint8_t*primblock_begin, uint8_t*primblock_end,
+			const InternalNodeCallback&node_callback,
+			const InternalWayCallback&way_callback,
+			const InternalRelationCallback&relation_callback,
+			const std::function<void(std::string msg)>&log_message
+		){
 			string_table.clear();
 			group_list.clear();
 
@@ -361,7 +373,7 @@ namespace {
 				);
 
 				// FIXME: eliminate doubles
-				node_callback(osm_node_id, LatLon::from_lat_lon(latitude, longitude), tag_map);
+				node_callback(worker_id, osm_node_id, LatLon::from_lat_lon(latitude, longitude), tag_map);
 			};
 
 			auto decode_dense_node = [&](const uint8_t*begin, const uint8_t*end){
@@ -437,7 +449,7 @@ namespace {
 
 
 					// FIXME: eliminate doubles
-					node_callback(osm_node_id, LatLon::from_lat_lon(latitude, longitude), tag_map);
+					node_callback(worker_id, osm_node_id, LatLon::from_lat_lon(latitude, longitude), tag_map);
 				}
 				if(latitude_begin != latitude_end)
 					throw std::runtime_error("PBF error: dense node latitude array has a different length than the node ID array.");
@@ -520,7 +532,7 @@ namespace {
 				else if(node_list.size() == 1)
 					log_message("Warning: OSM way "+std::to_string(osm_way_id)+" has only one node; ignoring way");
 				else
-					way_callback(osm_way_id, node_list, tag_map);
+					way_callback(worker_id, osm_way_id, node_list, tag_map);
 			};
 
 			auto decode_relation = [&](const uint8_t*begin, const uint8_t*end){
@@ -612,7 +624,7 @@ namespace {
 						throw std::runtime_error("PBF error: Unknown relation type.");
 					member_list.push_back({member_type, member_id, role});
 				}
-				relation_callback(osm_relation_id, member_list, tag_map);
+				relation_callback(worker_id, osm_relation_id, member_list, tag_map);
 			};
 
 			for(auto g:group_list){
@@ -634,6 +646,287 @@ namespace {
 				);
 			}
 		}
+
+	private:
+		unsigned worker_id;
+
+		TagMap tag_map;
+		std::vector<OSMRelationMember>member_list;
+		std::vector<uint64_t>node_list;
+
+		std::vector<const char*>string_table;
+		std::vector<uint32_t>key_list;
+		std::vector<uint32_t>value_list;
+
+		std::vector<std::pair<const uint8_t*, const uint8_t*>>group_list;
+	};
+
+	// Buffers the elements of a decoded primitive block so that the callbacks can be
+	// invoked later. The strings of the buffered tags and roles point into the
+	// primitive block, which must thus outlive the buffered elements.
+	class DecodedPrimitiveBlock{
+	public:
+		DecodedPrimitiveBlock(){
+			node_recorder = [this](unsigned, uint64_t osm_node_id, LatLon p, const TagMap&tags){
+				element_list.push_back({ElementType::node, osm_node_id, (uint32_t)tag_list.size(), (uint32_t)pos_list.size()});
+				pos_list.push_back(p);
+				record_tags(tags);
+			};
+			way_recorder = [this](unsigned, uint64_t osm_way_id, const std::vector<std::uint64_t>&osm_node_id_list, const TagMap&tags){
+				element_list.push_back({ElementType::way, osm_way_id, (uint32_t)tag_list.size(), (uint32_t)node_list.size()});
+				node_list.insert(node_list.end(), osm_node_id_list.begin(), osm_node_id_list.end());
+				record_tags(tags);
+			};
+			relation_recorder = [this](unsigned, uint64_t osm_relation_id, const std::vector<OSMRelationMember>&member_list, const TagMap&tags){
+				element_list.push_back({ElementType::relation, osm_relation_id, (uint32_t)tag_list.size(), (uint32_t)this->member_list.size()});
+				this->member_list.insert(this->member_list.end(), member_list.begin(), member_list.end());
+				record_tags(tags);
+			};
+			log_recorder = [this](std::string msg){
+				element_list.push_back({ElementType::log_message, 0, (uint32_t)tag_list.size(), (uint32_t)message_list.size()});
+				message_list.push_back(std::move(msg));
+			};
+		}
+
+		DecodedPrimitiveBlock(const DecodedPrimitiveBlock&) = delete;
+		DecodedPrimitiveBlock&operator=(const DecodedPrimitiveBlock&) = delete;
+
+		// Decodes a primitive block into the buffer. Only the elements for which a
+		// callback is given are buffered.
+		void decode(
+			OsmPBFPrimitiveBlockDecoder&decoder,
+			uint8_t*primblock_begin, uint8_t*primblock_end,
+			bool has_node_callback, bool has_way_callback, bool has_relation_callback
+		){
+			element_list.clear();
+			tag_list.clear();
+			pos_list.clear();
+			node_list.clear();
+			member_list.clear();
+			message_list.clear();
+
+			decoder.decode(
+				primblock_begin, primblock_end,
+				has_node_callback ? node_recorder : nullptr,
+				has_way_callback ? way_recorder : nullptr,
+				has_relation_callback ? relation_recorder : nullptr,
+				log_recorder
+			);
+		}
+
+		// Invokes the callbacks for the buffered elements in decoding order.
+		void replay(
+			unsigned worker_id,
+			const InternalNodeCallback&node_callback,
+			const InternalWayCallback&way_callback,
+			const InternalRelationCallback&relation_callback,
+			const std::function<void(std::string msg)>&log_message
+		){
+			for(size_t i=0; i<element_list.size(); ++i){
+				const Element&e = element_list[i];
+				bool is_last = i+1 == element_list.size();
+				uint32_t tag_end = is_last ? tag_list.size() : element_list[i+1].tag_begin;
+				tag_map.build(
+					tag_end - e.tag_begin,
+					[&](uint32_t j){ return tag_list[e.tag_begin+j].key; },
+					[&](uint32_t j){ return tag_list[e.tag_begin+j].value; }
+				);
+				switch(e.type){
+				case ElementType::node:
+					node_callback(worker_id, e.osm_id, pos_list[e.list_begin], tag_map);
+					break;
+				case ElementType::way:{
+					uint32_t list_end = next_list_begin(i, ElementType::way, node_list.size());
+					way_node_list.assign(node_list.begin()+e.list_begin, node_list.begin()+list_end);
+					way_callback(worker_id, e.osm_id, way_node_list, tag_map);
+					break;
+				}
+				case ElementType::relation:{
+					uint32_t list_end = next_list_begin(i, ElementType::relation, member_list.size());
+					relation_member_list.assign(member_list.begin()+e.list_begin, member_list.begin()+list_end);
+					relation_callback(worker_id, e.osm_id, relation_member_list, tag_map);
+					break;
+				}
+				case ElementType::log_message:
+					log_message(std::move(message_list[e.list_begin]));
+					break;
+				}
+			}
+		}
+
+	private:
+		enum class ElementType{
+			node,
+			way,
+			relation,
+			log_message
+		};
+
+		// The tags of an element end where the tags of the next element begin. The
+		// list_begin of an element is an index into the list of its type.
+		struct Element{
+			ElementType type;
+			uint64_t osm_id;
+			uint32_t tag_begin;
+			uint32_t list_begin;
+		};
+
+		void record_tags(const TagMap&tags){
+			tag_list.insert(tag_list.end(), tags.begin(), tags.end());
+		}
+
+		uint32_t next_list_begin(size_t i, ElementType type, size_t list_size)const{
+			for(++i; i<element_list.size(); ++i)
+				if(element_list[i].type == type)
+					return element_list[i].list_begin;
+			return list_size;
+		}
+
+		std::vector<Element>element_list;
+		std::vector<TagMap::Entry>tag_list;
+		std::vector<LatLon>pos_list;
+		std::vector<uint64_t>node_list;
+		std::vector<OSMRelationMember>member_list;
+		std::vector<std::string>message_list;
+
+		InternalNodeCallback node_recorder;
+		InternalWayCallback way_recorder;
+		InternalRelationCallback relation_recorder;
+		std::function<void(std::string msg)>log_recorder;
+
+		TagMap tag_map;
+		std::vector<uint64_t>way_node_list;
+		std::vector<OSMRelationMember>relation_member_list;
+	};
+
+	unsigned get_default_thread_count(unsigned thread_count){
+		if(thread_count == 0)
+			thread_count = std::thread::hardware_concurrency();
+		if(thread_count == 0)
+			thread_count = 1;
+		return thread_count;
+	}
+
+	// The callbacks of the serial interface do not get a worker id.
+	InternalNodeCallback ignore_worker_id(std::function<void(uint64_t osm_node_id, LatLon p, const TagMap&tags)>node_callback){
+		if(!node_callback)
+			return nullptr;
+		return [node_callback](unsigned, uint64_t osm_node_id, LatLon p, const TagMap&tags){
+			node_callback(osm_node_id, p, tags);
+		};
+	}
+
+	InternalWayCallback ignore_worker_id(std::function<void(uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback){
+		if(!way_callback)
+			return nullptr;
+		return [way_callback](unsigned, uint64_t osm_way_id, const std::vector<std::uint64_t>&osm_node_id_list, const TagMap&tags){
+			way_callback(osm_way_id, osm_node_id_list, tags);
+		};
+	}
+
+	InternalRelationCallback ignore_worker_id(std::function<void(uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback){
+		if(!relation_callback)
+			return nullptr;
+		return [relation_callback](unsigned, uint64_t osm_relation_id, const std::vector<OSMRelationMember>&member_list, const TagMap&tags){
+			relation_callback(osm_relation_id, member_list, tags);
+		};
+	}
+
+	// Reads the blobs sequentially from blob_reader and decompresses and decodes
+	// them on thread_count threads, one of which is the calling thread. The blob
+	// reader is accessed by one thread at a time. The callbacks may be invoked from
+	// any of the threads. If serialize_callbacks is true, they are never invoked
+	// concurrently: every thread decodes its blocks into a DecodedPrimitiveBlock
+	// and only the delivery of the buffered elements to the callbacks is
+	// serialized. Otherwise, the callbacks are invoked directly while decoding and
+	// the callbacks of different threads run concurrently.
+	//
+	// If keep_file_order is true, then the primitive blocks are delivered in file
+	// order. A thread that decoded a block waits until all preceding blocks are
+	// delivered. Otherwise, the blocks are delivered in the order in which their
+	// decoding finishes.
+	void internal_read_osm_pbf(
+		OsmPBFBlobReader&blob_reader,
+		bool keep_file_order,
+		bool serialize_callbacks,
+		unsigned thread_count,
+		InternalNodeCallback node_callback,
+		InternalWayCallback way_callback,
+		InternalRelationCallback relation_callback,
+		std::function<void(std::string msg)>log_message
+	){
+		assert(serialize_callbacks || !keep_file_order);
+
+		std::mutex reader_lock;
+		uint64_t next_blob_id = 0;
+		bool was_end_of_file_reached = false;
+
+		std::mutex delivery_lock;
+		std::condition_variable block_was_delivered;
+		uint64_t next_blob_id_to_deliver = 0;
+
+		std::atomic<bool>was_error_encountered(false);
+		std::exception_ptr error;
+
+		auto worker = [&](unsigned worker_id){
+			std::vector<uint8_t>blob, primblock;
+			OsmPBFPrimitiveBlockDecoder decoder(worker_id);
+			DecodedPrimitiveBlock decoded_block;
+			try{
+				for(;;){
+					uint64_t blob_id;
+					{
+						std::unique_lock<std::mutex>guard(reader_lock);
+						if(was_end_of_file_reached || was_error_encountered)
+							break;
+						if(!blob_reader.read_next_data_blob(blob)){
+							was_end_of_file_reached = true;
+							break;
+						}
+						blob_id = next_blob_id++;
+					}
+
+					decompress_blob(blob.data(), blob.data()+blob.size(), primblock);
+
+					if(!serialize_callbacks){
+						decoder.decode(primblock.data(), primblock.data()+primblock.size(), node_callback, way_callback, relation_callback, log_message);
+						continue;
+					}
+
+					decoded_block.decode(decoder, primblock.data(), primblock.data()+primblock.size(), (bool)node_callback, (bool)way_callback, (bool)relation_callback);
+
+					std::unique_lock<std::mutex>guard(delivery_lock);
+					if(keep_file_order){
+						block_was_delivered.wait(guard, [&]{return next_blob_id_to_deliver == blob_id || was_error_encountered;});
+						if(was_error_encountered)
+							break;
+					}
+					decoded_block.replay(worker_id, node_callback, way_callback, relation_callback, log_message);
+					++next_blob_id_to_deliver;
+					if(keep_file_order)
+						block_was_delivered.notify_all();
+				}
+			}catch(...){
+				{
+					std::unique_lock<std::mutex>guard(delivery_lock);
+					if(!was_error_encountered){
+						error = std::current_exception();
+						was_error_encountered = true;
+					}
+				}
+				block_was_delivered.notify_all();
+			}
+		};
+
+		std::vector<std::thread>helper_thread;
+		for(unsigned i=1; i<thread_count; ++i)
+			helper_thread.emplace_back(worker, i);
+		worker(0);
+		for(auto&t:helper_thread)
+			t.join();
+
+		if(error)
+			std::rethrow_exception(error);
 	}
 }
 
@@ -642,14 +935,48 @@ void unordered_read_osm_pbf(
 	std::function<void(uint64_t osm_node_id, LatLon p, const TagMap&tags)>node_callback,
 	std::function<void(uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback,
 	std::function<void(uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback,
+	std::function<void(std::string msg)>log_message,
+	unsigned thread_count
+){
+	assert(node_callback || way_callback || relation_callback);
+
+	FileDataSource data_source(file_name);
+	OsmPBFBlobReader blob_reader(data_source.as_ref());
+	internal_read_osm_pbf(blob_reader, false, true, get_default_thread_count(thread_count), ignore_worker_id(node_callback), ignore_worker_id(way_callback), ignore_worker_id(relation_callback), log_message);
+}
+
+void concurrent_unordered_read_osm_pbf(
+	const std::string&file_name,
+	unsigned thread_count,
+	std::function<void(unsigned worker_id, uint64_t osm_node_id, LatLon p, const TagMap&tags)>node_callback,
+	std::function<void(unsigned worker_id, uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback,
+	std::function<void(unsigned worker_id, uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback,
 	std::function<void(std::string msg)>log_message
 ){
 	assert(node_callback || way_callback || relation_callback);
+	thread_count = get_default_thread_count(thread_count);
+
+	std::mutex log_lock;
+	auto synchronized_log_message = [&](std::string msg){
+		std::unique_lock<std::mutex>guard(log_lock);
+		log_message(std::move(msg));
+	};
+
+	InternalWayCallback internal_way_callback;
+	if(way_callback)
+		internal_way_callback = [&](unsigned worker_id, uint64_t osm_way_id, const std::vector<std::uint64_t>&osm_node_id_list, const TagMap&tags){
+			way_callback(worker_id, osm_way_id, osm_node_id_list, tags);
+		};
+
+	InternalRelationCallback internal_relation_callback;
+	if(relation_callback)
+		internal_relation_callback = [&](unsigned worker_id, uint64_t osm_relation_id, const std::vector<OSMRelationMember>&member_list, const TagMap&tags){
+			relation_callback(worker_id, osm_relation_id, member_list, tags);
+		};
 
 	FileDataSource data_source(file_name);
-	OsmPBFDecompressor decompressor(data_source.as_ref());
-	BufferedAsyncReader reader(decompressor.as_ref(), pbf_decompressor_read_size);
-	internal_read_osm_pbf(reader, node_callback, way_callback, relation_callback, log_message);
+	OsmPBFBlobReader blob_reader(data_source.as_ref());
+	internal_read_osm_pbf(blob_reader, false, false, thread_count, node_callback, internal_way_callback, internal_relation_callback, synchronized_log_message);
 }
 
 void ordered_read_osm_pbf(
@@ -658,48 +985,42 @@ void ordered_read_osm_pbf(
 	std::function<void(uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback,
 	std::function<void(uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback,
 	std::function<void(std::string msg)>log_message,
-	bool file_is_ordered_even_though_file_header_says_that_it_is_unordered
+	bool file_is_ordered_even_though_file_header_says_that_it_is_unordered,
+	unsigned thread_count
 ){
 	assert(node_callback || way_callback || relation_callback);
 
+	thread_count = get_default_thread_count(thread_count);
+
 	FileDataSource data_source(file_name);
-	OsmPBFDecompressor decompressor(data_source.as_ref());
-	BufferedAsyncReader reader(decompressor.as_ref(), pbf_decompressor_read_size);
+	OsmPBFBlobReader blob_reader(data_source.as_ref());
 
-	if(!file_is_ordered_even_though_file_header_says_that_it_is_unordered){
-		while((decompressor.get_status() & is_header_info_available_bit) == 0){
-			std::atomic_thread_fence(std::memory_order::memory_order_seq_cst);
-			std::this_thread::yield();
-		}
-	}
+	if(!file_is_ordered_even_though_file_header_says_that_it_is_unordered)
+		blob_reader.read_header_info();
 
-	if(file_is_ordered_even_though_file_header_says_that_it_is_unordered || (decompressor.get_status() & is_ordered_bit) != 0){
-		internal_read_osm_pbf(reader, node_callback, way_callback, relation_callback, log_message);
+	if(file_is_ordered_even_though_file_header_says_that_it_is_unordered || (blob_reader.get_status() & is_ordered_bit) != 0){
+		internal_read_osm_pbf(blob_reader, true, true, thread_count, ignore_worker_id(node_callback), ignore_worker_id(way_callback), ignore_worker_id(relation_callback), log_message);
 	} else {
 		if(node_callback){
-			internal_read_osm_pbf(reader, node_callback, nullptr, nullptr, log_message);
+			internal_read_osm_pbf(blob_reader, true, true, thread_count, ignore_worker_id(node_callback), nullptr, nullptr, log_message);
 			if(relation_callback || way_callback){
-				reader = BufferedAsyncReader();
-				decompressor = OsmPBFDecompressor();
+				blob_reader = OsmPBFBlobReader();
 				data_source.rewind();
-				decompressor = OsmPBFDecompressor(data_source.as_ref());
-				reader = BufferedAsyncReader(decompressor.as_ref(), pbf_decompressor_read_size);
+				blob_reader = OsmPBFBlobReader(data_source.as_ref());
 			}
 		}
 
 		if(way_callback){
-			internal_read_osm_pbf(reader, nullptr, way_callback, nullptr, log_message);
+			internal_read_osm_pbf(blob_reader, true, true, thread_count, nullptr, ignore_worker_id(way_callback), nullptr, log_message);
 			if(relation_callback){
-				reader = BufferedAsyncReader();
-				decompressor = OsmPBFDecompressor();
+				blob_reader = OsmPBFBlobReader();
 				data_source.rewind();
-				decompressor = OsmPBFDecompressor(data_source.as_ref());
-				reader = BufferedAsyncReader(decompressor.as_ref(), pbf_decompressor_read_size);
+				blob_reader = OsmPBFBlobReader(data_source.as_ref());
 			}
 		}
 
 		if(relation_callback){
-			internal_read_osm_pbf(reader, nullptr, nullptr, relation_callback, log_message);
+			internal_read_osm_pbf(blob_reader, true, true, thread_count, nullptr, nullptr, ignore_worker_id(relation_callback), log_message);
 		}
 	}
 }
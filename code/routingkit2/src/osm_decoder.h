@@ -13,11 +13,41 @@
 
 namespace RoutingKit2{
 
+// Both functions decompress and decode the blobs of the file on thread_count
+// threads. A thread_count of 0 means std::thread::hardware_concurrency(). The
+// callbacks are never invoked concurrently but may be invoked from any thread.
+//
+// unordered_read_osm_pbf invokes the callbacks in an arbitrary order.
+// ordered_read_osm_pbf invokes them in file order. If the file is not sorted,
+// then it reads the file up to three times, once for the nodes, once for the ways
+// and once for the relations.
+
 void unordered_read_osm_pbf(
 	const std::string&file_name,
 	std::function<void(uint64_t osm_node_id, LatLon p, const TagMap&tags)>node_callback,
 	std::function<void(uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback,
 	std::function<void(uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback,
+	std::function<void(std::string msg)>log_message = [](std::string){},
+	unsigned thread_count = 0
+);
+
+// Just as unordered_read_osm_pbf but the callbacks are invoked concurrently from
+// thread_count threads. Each thread decodes whole primitive blocks and passes its
+// worker id, a number in [0, thread_count), to the callbacks. A thread_count of 0
+// means std::thread::hardware_concurrency(), or 1 if it is unknown. Callbacks
+// with the same worker id are never invoked concurrently. Callers can thus keep
+// one shard of their output per worker and merge the shards at the end. The
+// TagMap and the lists passed to a callback are only valid for the duration of
+// the call.
+//
+// log_message is synchronized internally. Callbacks that want to log from within
+// the callback must take care of synchronization themselves.
+void concurrent_unordered_read_osm_pbf(
+	const std::string&file_name,
+	unsigned thread_count,
+	std::function<void(unsigned worker_id, uint64_t osm_node_id, LatLon p, const TagMap&tags)>node_callback,
+	std::function<void(unsigned worker_id, uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback,
+	std::function<void(unsigned worker_id, uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback,
 	std::function<void(std::string msg)>log_message = [](std::string){}
 );
 
@@ -27,7 +57,8 @@ void ordered_read_osm_pbf(
 	std::function<void(uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&tags)>way_callback,
 	std::function<void(uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags)>relation_callback,
 	std::function<void(std::string msg)>log_message = [](std::string){},
-	bool file_is_ordered_even_though_file_header_says_that_it_is_unordered = false
+	bool file_is_ordered_even_though_file_header_says_that_it_is_unordered = false,
+	unsigned thread_count = 0
 );
 
 } // RoutingKit2
@@ -7,10 +7,17 @@
 #include "inverse_func.h"
 #include "str.h"
 #include "turn.h"
+#include "osm_turn_restriction.h"
 #include "gpoly.h"
 #include "map.h"
 #include "polyline.h"
+#include "external_sort.h"
+#include "parallel.h"
 #include <algorithm>
+#include <mutex>
+#include <thread>
+#include <sys/resource.h>
+#include <unistd.h>
 
 #include <iostream>
 using namespace std;
@@ -19,450 +26,146 @@ namespace RoutingKit2{
 
 namespace {
 	constexpr uint32_t invalid_id = (uint32_t)-1;
+}
 
-	enum class ManeuverType{
-		forbidden,
-		mandatory
-	};
-
-	struct Maneuver{
-		uint64_t osm_relation_id;
-		uint32_t from_way;
-		uint32_t via_node;
-		std::vector<uint32_t>via_way_list;
-		uint32_t to_way;
-		TurnDir dir;
-		ManeuverType type;
-	};
+namespace{
+	uint64_t get_peak_rss_in_bytes(){
+		rusage usage;
+		if(getrusage(RUSAGE_SELF, &usage) != 0)
+			return 0;
+		return (uint64_t)usage.ru_maxrss * 1024;
+	}
 
-	template<class F>
-	void forall_nodes_of_way(ConstRefOSMCarRoads map, uint32_t way_id, const F&f){
-		uint32_t begin = map.first_link_of_way[way_id];
-		uint32_t end = map.first_link_of_way[way_id+1];
-		if(begin != end){
-			if(!f(map.link_tail[begin]))
-				return;
-			for(uint32_t l=begin; l<end; ++l)
-				if(!f(map.link_head[l]))
-					break;
-		}
+	void log_peak_rss(const std::function<void(std::string)>&log_message, const std::string&phase){
+		log_message("Peak RSS "+phase+" : "+std::to_string(get_peak_rss_in_bytes() >> 20)+" MiB");
 	}
+}
 
-	struct ManeuverMatching{
-		std::vector<uint32_t>first_dlink_of_maneuver;
-		std::vector<uint32_t>maneuver_dlink;
-		std::vector<ManeuverType>maneuver_type;
-		std::vector<uint64_t>maneuver_osm_id;
-	};
+VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, std::vector<uint64_t>extra_node_osm_id, std::function<void(std::string)>log_message){
+	return import_car_roads_from_osm_pbf_file(file_name, std::move(extra_node_osm_id), std::move(log_message), OSMImportMemoryConfig());
+}
 
-	struct ManeuverMatcher{
-		ConstRefOSMCarRoads map;
-		std::vector<bool>node_flag1, node_flag2;
-		const std::function<void(std::string)>&log_message;
-
-		ManeuverMatching result;
-
-		explicit ManeuverMatcher(ConstRefOSMCarRoads map, const std::function<void(std::string)>&log_message):
-			map(map),
-			node_flag1(map.node_count, false),
-			node_flag2(map.node_count, false),
-			log_message(log_message){}
-
-		template<class F>
-		void handle_from_to(
-			uint32_t from_way, uint32_t from_via_node,
-			uint32_t to_way, uint32_t to_via_node,
-			uint64_t osm_relation_id,
-			TurnDir dir,
-			const F&add_maneuver
-		){
-			std::vector<uint32_t>from_dlink_candidate;
-
-			for(uint32_t l=map.first_link_of_way[from_way]; l!=map.first_link_of_way[from_way+1]; ++l){
-				if(map.link_tail[l] == from_via_node){
-					uint32_t dlink = link_to_backward_dlink(l);
-					if(map.dlink_traversal_time_in_ms[dlink] != std::numeric_limits<uint32_t>::max())
-						from_dlink_candidate.push_back(dlink);
-				}
-				if(map.link_head[l] == from_via_node){
-					uint32_t dlink = link_to_forward_dlink(l);
-					if(map.dlink_traversal_time_in_ms[dlink] != std::numeric_limits<uint32_t>::max())
-						from_dlink_candidate.push_back(dlink);
-				}
-			}
-			std::vector<uint32_t>to_dlink_candidate;
+VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, std::vector<uint64_t>extra_node_osm_id, std::function<void(std::string)>log_message, const OSMImportMemoryConfig&memory_config){
+	std::vector<uint64_t>osm_shape_node_list;
 
-			for(uint32_t l=map.first_link_of_way[to_way]; l!=map.first_link_of_way[to_way+1]; ++l){
-				if(map.link_tail[l] == to_via_node){
-					uint32_t dlink = link_to_forward_dlink(l);
-					if(map.dlink_traversal_time_in_ms[dlink] != std::numeric_limits<uint32_t>::max())
-						to_dlink_candidate.push_back(dlink);
-				}
-				if(map.link_head[l] == to_via_node){
-					uint32_t dlink = link_to_backward_dlink(l);
-					if(map.dlink_traversal_time_in_ms[dlink] != std::numeric_limits<uint32_t>::max())
-						to_dlink_candidate.push_back(dlink);
-				}
-			}
+	VecOSMCarRoads map;
 
-			if(from_dlink_candidate.empty()){
-				log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is a turn restriction where the \"from\"-way does not pass through the \"via\"-node -> ignoring restriction");
-				return;
-			}
+	const bool use_external_memory = memory_config.memory_budget_in_bytes != 0;
 
-			if(to_dlink_candidate.empty()){
-				log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is a turn restriction where the \"to\"-way does not pass through the \"via\"-node -> ignoring restriction");
-				return;
-			}
+	const unsigned thread_count = resolve_thread_count(0);
 
-			if(from_dlink_candidate.size() == 1 && to_dlink_candidate.size() == 1){
-				uint32_t
-					from_dlink = from_dlink_candidate.front(),
-					to_dlink = to_dlink_candidate.front();
-				add_maneuver(from_dlink, to_dlink);
-				if(!has_turn_direction(TurnGeo(map, from_dlink, to_dlink), dir)){
-					log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is a turn restriction where only one potential turn exists because of oneways. However, this turn does not fulfill the given direction -> assuming direction is wrong and importing restriction");
-				}
-			}else{
-				bool created_maneuver = false;
-				for(uint32_t from_dlink:from_dlink_candidate){
-					for(uint32_t to_dlink:to_dlink_candidate){
-						if(has_turn_direction(TurnGeo(map, from_dlink, to_dlink), dir)){
-							add_maneuver(from_dlink, to_dlink);
-							if(created_maneuver)
-								log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is a turn restriction where two turns fulfill the given direction -> assuming both turns are forbidden");
-							created_maneuver = true;
-						}
-					}
-				}
-				if(!created_maneuver)
-					log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is a turn restriction where no turn fulfills the given direction and the oneway constelation allows for several interpretations -> it is unclear what is forbidden -> ignoring restriction");
-			}
+	{
+		std::mutex log_lock;
+		auto synchronized_log_message = [&](std::string msg){
+			std::unique_lock<std::mutex>guard(log_lock);
+			log_message(std::move(msg));
+		};
+
+		// Every worker fills its own shard. The shards are concatenated afterwards.
+		// The order does not matter as both vectors are sorted below.
+		//
+		// In external memory mode, the shape nodes are not collected in memory but
+		// passed to an external sorter per worker. Only the sorters' buffers count
+		// against the memory budget.
+		struct Shard{
+			std::vector<uint64_t>way_osm_id;
+			std::vector<uint64_t>osm_shape_node_list;
+		};
+		std::vector<Shard>shard(thread_count);
+
+		std::vector<ExternalUInt64Sorter>shape_node_sorter;
+		if(use_external_memory){
+			std::string tmp_file_prefix = memory_config.tmp_dir + "/routingkit2_import_" + std::to_string(getpid()) + "_";
+			for(unsigned i=0; i<thread_count; ++i)
+				shape_node_sorter.emplace_back(tmp_file_prefix + std::to_string(i) + "_", memory_config.memory_budget_in_bytes / thread_count);
 		}
 
-		void match_simple(const Maneuver&m){
-			assert(m.via_way_list.empty());
-
-			auto&in_to_way = node_flag1;
-
-			auto set_mark_of_nodes_of_way = [&](uint32_t way_id, bool val){
-				forall_nodes_of_way(
-					map, way_id,
-					[&](uint32_t x){
-						in_to_way[x] = val;
-						return true; // continue
-					}
-				);
-			};
-
-			auto mark_nodes_of_way = [&](uint32_t way_id){
-				set_mark_of_nodes_of_way(way_id, true);
-			};
-
-			auto unmark_nodes_of_way = [&](uint32_t way_id){
-				set_mark_of_nodes_of_way(way_id, false);
-			};
-
-			uint32_t via_node = m.via_node;
-			if(via_node == invalid_id){
-				mark_nodes_of_way(m.to_way);
-
-				bool ambiguous = false;
-				forall_nodes_of_way(
-					map, m.from_way,
-					[&](uint32_t x){
-						if(in_to_way[x]){
-							if(via_node == invalid_id){
-								via_node = x;
-							}else{
-								log_message("OSM relation with ID "+std::to_string(m.osm_relation_id)+" is a turn restriction without \"via\"-node and the two referenced ways cross twice -> it is unclear what is forbidden -> ignoring restriction");
-								ambiguous = true;
-								return false; // break
-							}
+		concurrent_unordered_read_osm_pbf(
+			file_name,
+			thread_count,
+			nullptr,
+			[&](unsigned worker_id, uint64_t way_osm_id, Span<const uint64_t>node_osm_id_list, const TagMap&tags){
+				if(is_osm_way_used_by_cars(way_osm_id, tags, synchronized_log_message)){
+					Shard&s = shard[worker_id];
+					s.way_osm_id.push_back(way_osm_id);
+					if(use_external_memory){
+						ExternalUInt64Sorter&sorter = shape_node_sorter[worker_id];
+						for(auto node_osm_id:node_osm_id_list){
+							sorter.push(node_osm_id);
 						}
-						return true; // continue
-					}
-				);
-				unmark_nodes_of_way(m.to_way);
-				if(ambiguous)
-					return;
-				if(via_node == invalid_id){
-					log_message("OSM relation with ID "+std::to_string(m.osm_relation_id)+" is a turn restriction without \"via\"-node and the two referenced ways do not cross -> it is unclear what is forbidden -> ignoring restriction");
-					return;
-				}
-			}
-
-			auto add_maneuver = [&](uint32_t from_dlink, uint32_t to_dlink){
-				result.maneuver_type.push_back(m.type);
-				result.first_dlink_of_maneuver.push_back(result.maneuver_dlink.size());
-				result.maneuver_dlink.push_back(from_dlink);
-				result.maneuver_dlink.push_back(to_dlink);
-				result.maneuver_osm_id.push_back(m.osm_relation_id);
-				assert(
-					is_dlink_path(
-						map,
-						{
-							&result.maneuver_dlink[0]+result.first_dlink_of_maneuver.back(),
-							&result.maneuver_dlink[0]+result.maneuver_dlink.size()
+						sorter.push(node_osm_id_list.front());
+						sorter.push(node_osm_id_list.back());
+					}else{
+						for(auto node_osm_id:node_osm_id_list){
+							s.osm_shape_node_list.push_back(node_osm_id);
 						}
-					)
-				);
-			};
-
-			handle_from_to(
-				m.from_way, via_node,
-				m.to_way, via_node,
-				m.osm_relation_id, m.dir,
-				add_maneuver
-			);
-		}
-
-		void match_complex(const Maneuver&m){
-			assert(!m.via_way_list.empty());
-
-			std::vector<bool>&in_prev_way = node_flag1;
-			std::vector<bool>&in_next_way = node_flag2;
-
-			auto set_mark_of_nodes_of_way = [&](std::vector<bool>&node_flag, uint32_t way_id, bool val){
-				forall_nodes_of_way(
-					map, way_id,
-					[&](uint32_t x){
-						node_flag[x] = val;
-						return true; // continue
-					}
-				);
-			};
-
-			auto mark_nodes_of_way = [&](std::vector<bool>&node_flag, uint32_t way_id){
-				set_mark_of_nodes_of_way(node_flag, way_id, true);
-			};
-
-			auto unmark_nodes_of_way = [&](std::vector<bool>&node_flag, uint32_t way_id){
-				set_mark_of_nodes_of_way(node_flag, way_id, false);
-			};
-
-			std::vector<uint32_t>intermediate_dlink_list;
-
-			bool all_ways_matched = true;
-			for(uint32_t i=0; i<m.via_way_list.size(); ++i){
-				uint32_t
-					prev_way = i==0 ? m.from_way : m.via_way_list[i-1],
-					way = m.via_way_list[i],
-					next_way = i==m.via_way_list.size() -1 ? m.to_way : m.via_way_list[i+1];
-
-				mark_nodes_of_way(in_prev_way, prev_way);
-				mark_nodes_of_way(in_next_way, next_way);
-
-				bool way_matched = false;
-
-				{
-					uint32_t
-						first_link = invalid_id,
-						last_link = invalid_id;
-
-					for(uint32_t link=map.first_link_of_way[way]; link!=map.first_link_of_way[way+1]; ++link){
-						if(in_prev_way[map.link_tail[link]])
-							first_link = link;
-						if(in_next_way[map.link_head[link]])
-							last_link = link;
-					}
-
-					if(first_link != invalid_id && last_link != invalid_id && first_link <= last_link){
-						for(uint32_t link = first_link; link <= last_link; ++link)
-							intermediate_dlink_list.push_back(link_to_forward_dlink(link));
-						way_matched = true;
-					}
-				}
-
-				if(!way_matched){
-					uint32_t
-						first_link = invalid_id,
-						last_link = invalid_id;
-
-					for(uint32_t link=map.first_link_of_way[way+1]-1; link!=map.first_link_of_way[way]-1; --link){
-						if(in_prev_way[map.link_head[link]])
-							first_link = link;
-						if(in_next_way[map.link_tail[link]])
-							last_link = link;
-					}
-
-					if(first_link != invalid_id && last_link != invalid_id && first_link >= last_link){
-						for(uint32_t link = first_link; link >= last_link; --link)
-							intermediate_dlink_list.push_back(link_to_backward_dlink(link));
-						continue;
+						s.osm_shape_node_list.push_back(node_osm_id_list.front());
+						s.osm_shape_node_list.push_back(node_osm_id_list.back());
 					}
 				}
-
-				unmark_nodes_of_way(in_prev_way, prev_way);
-				unmark_nodes_of_way(in_next_way, next_way);
-
-				if(!way_matched){
-					log_message("OSM relation with ID "+std::to_string(m.osm_relation_id)+" is a turn restriction with ways as \"via\". However, cannot connect the "+std::to_string(map.way_osm_id[way])+" way to the way before and/or after-> it is unclear what is forbidden -> ignoring restriction");
-					all_ways_matched = false;
-					break;
-				}
-			}
-
-			if(!all_ways_matched)
-				return;
-
-			if(intermediate_dlink_list.empty()){
-				log_message("OSM relation with ID "+std::to_string(m.osm_relation_id)+" is a turn restriction with ways as \"via\". However, the via ways do not result in links -> ignoring restriction");
-				return;
-			}
-
-			auto add_maneuver = [&](uint32_t from_dlink, uint32_t to_dlink){
-				result.maneuver_type.push_back(m.type);
-				result.first_dlink_of_maneuver.push_back(result.maneuver_dlink.size());
-				result.maneuver_dlink.push_back(from_dlink);
-				result.maneuver_dlink.insert(
-					result.maneuver_dlink.end(),
-					intermediate_dlink_list.begin(),
-					intermediate_dlink_list.end()
-				);
-				result.maneuver_osm_id.push_back(m.osm_relation_id);
-				result.maneuver_dlink.push_back(to_dlink);
-				assert(
-					is_dlink_path(
-						map,
-						{
-							&result.maneuver_dlink[0]+result.first_dlink_of_maneuver.back(),
-							&result.maneuver_dlink[0]+result.maneuver_dlink.size()
-						}
-					)
-				);
-			};
-
-			handle_from_to(
-				m.from_way, dlink_tail(map, intermediate_dlink_list.front()),
-				m.to_way, dlink_head(map, intermediate_dlink_list.front()),
-				m.osm_relation_id, m.dir,
-				add_maneuver
-			);
-		}
-
-		void match_finish(){
-			result.first_dlink_of_maneuver.push_back(result.maneuver_dlink.size());
+			},
+			nullptr,
+			log_message
+		);
+
+		size_t way_count = 0, shape_node_count = 0;
+		for(auto&s:shard){
+			way_count += s.way_osm_id.size();
+			shape_node_count += s.osm_shape_node_list.size();
 		}
-
-		void match_all(const std::vector<Maneuver>&maneuver_list){
-			log_message("FOO "+std::to_string(maneuver_list.size()));
-			for(auto&m:maneuver_list){
-				if(m.via_way_list.empty())
-					match_simple(m);
-				else
-					match_complex(m);
-			}
-			match_finish();
+		map.way_osm_id.reserve(way_count);
+		osm_shape_node_list.reserve(shape_node_count);
+		for(auto&s:shard){
+			map.way_osm_id.insert(map.way_osm_id.end(), s.way_osm_id.begin(), s.way_osm_id.end());
+			osm_shape_node_list.insert(osm_shape_node_list.end(), s.osm_shape_node_list.begin(), s.osm_shape_node_list.end());
+			std::vector<uint64_t>().swap(s.way_osm_id);
+			std::vector<uint64_t>().swap(s.osm_shape_node_list);
 		}
 
-	};
-
-	void build_forbidden_maneuvers_and_convert_mandatory_to_forbidden(VecOSMCarRoads&map, const ManeuverMatching&mm, const std::function<void(std::string)>log_message){
-		VecLinkEndsAdjArray adj = build_adj_array(map.as_cref());
-
-		map.first_dlink_of_forbidden_maneuver.clear();
-		map.forbidden_maneuver_dlink.clear();
-		map.forbidden_maneuver_osm_id.clear();
-
-		uint32_t maneuver_count = mm.first_dlink_of_maneuver.size()-1;
-		assert(mm.maneuver_type.size() == maneuver_count);
-		assert(mm.maneuver_osm_id.size() == maneuver_count);
-
-		for(uint32_t m=0; m<maneuver_count; ++m){
-			if(mm.maneuver_type[m] == ManeuverType::forbidden){
-				map.first_dlink_of_forbidden_maneuver.push_back(map.forbidden_maneuver_dlink.size());
-				map.forbidden_maneuver_dlink.insert(
-					map.forbidden_maneuver_dlink.end(),
-					mm.maneuver_dlink.begin() + mm.first_dlink_of_maneuver[m],
-					mm.maneuver_dlink.begin() + mm.first_dlink_of_maneuver[m+1]
-				);
-				map.forbidden_maneuver_osm_id.push_back(mm.maneuver_osm_id[m]);
-
-				assert(
-					is_dlink_path(
-						map.as_cref(),
-						{
-							&map.forbidden_maneuver_dlink[0]+map.first_dlink_of_forbidden_maneuver.back(),
-							&map.forbidden_maneuver_dlink[0]+map.forbidden_maneuver_dlink.size()
-						}
-					)
-				);
-			}else{
-				const uint32_t*begin = &mm.maneuver_dlink[0] + mm.first_dlink_of_maneuver[m];
-				const uint32_t*end = &mm.maneuver_dlink[0] + mm.first_dlink_of_maneuver[m+1];
-
-				uint32_t maneuver_len = end - begin;
-
-				bool created_maneuver = false;
-
-				for(uint32_t i=1; i<maneuver_len; ++i){
-					unsigned t = dlink_tail(map.as_cref(), begin[i]);
-					for(uint32_t a=adj.first_outgoing_dlink_index_of_node[t]; a<adj.first_outgoing_dlink_index_of_node[t+1]; ++a){
-						unsigned dlink = adj.outgoing_dlink[a];
-						if(dlink != begin[i] && dlink != reverse_dlink(begin[i-1])){
-							created_maneuver = true;
-							map.first_dlink_of_forbidden_maneuver.push_back(map.forbidden_maneuver_dlink.size());
-							map.forbidden_maneuver_dlink.insert(
-								map.forbidden_maneuver_dlink.end(),
-								begin,
-								begin+i
-							);
-							map.forbidden_maneuver_dlink.push_back(dlink);
-							map.forbidden_maneuver_osm_id.push_back(mm.maneuver_osm_id[m]);
-							assert(
-								is_dlink_path(
-									map.as_cref(),
-									{
-										&map.forbidden_maneuver_dlink[0]+map.first_dlink_of_forbidden_maneuver.back(),
-										&map.forbidden_maneuver_dlink[0]+map.forbidden_maneuver_dlink.size()
-									}
-								)
-							);
-						}
-					}
-				}
-				if(!created_maneuver)
-					log_message("OSM relation with ID "+std::to_string(mm.maneuver_osm_id[m])+" is a mandatory turn restriction along a path where a no deviation is possible -> restriction has no effect -> restriction ignored");
+		log_peak_rss(log_message, "after collecting the ways");
 
+		if(use_external_memory){
+			uint64_t run_count = 0;
+			for(auto&sorter:shape_node_sorter){
+				sorter.finish();
+				run_count += sorter.get_run_file_list().size();
 			}
+			log_message("Merging "+std::to_string(run_count)+" sorted runs of shape nodes");
+
+			// Nodes that occur more than once are routing nodes. The other nodes
+			// are pure shape nodes. This is the same split as below but done while
+			// merging, so the full list is never in memory.
+			uint64_t prev_node = 0;
+			uint64_t prev_node_count = 0;
+			auto flush_prev_node = [&]{
+				if(prev_node_count > 1)
+					map.node_osm_id.push_back(prev_node);
+				else if(prev_node_count == 1)
+					osm_shape_node_list.push_back(prev_node);
+			};
+			merge_sorted_runs(
+				shape_node_sorter,
+				[&](uint64_t node){
+					if(prev_node_count != 0 && node == prev_node){
+						++prev_node_count;
+					}else{
+						flush_prev_node();
+						prev_node = node;
+						prev_node_count = 1;
+					}
+				},
+				memory_config.memory_budget_in_bytes / std::max<uint64_t>(run_count, 1)
+			);
+			flush_prev_node();
+			osm_shape_node_list.shrink_to_fit();
 		}
-
-		map.forbidden_maneuver_count = map.first_dlink_of_forbidden_maneuver.size();
-		map.first_dlink_of_forbidden_maneuver.push_back(map.forbidden_maneuver_dlink.size());
-		map.forbidden_maneuver_dlink_count = map.forbidden_maneuver_dlink.size();
 	}
-}
-
-
-
-
-VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, std::vector<uint64_t>extra_node_osm_id, std::function<void(std::string)>log_message){
-	std::vector<uint64_t>osm_shape_node_list;
-
-	VecOSMCarRoads map;
-
-	unordered_read_osm_pbf(
-		file_name,
-		nullptr,
-		[&](uint64_t way_osm_id, Span<const uint64_t>node_osm_id_list, const TagMap&tags){
-			if(is_osm_way_used_by_cars(way_osm_id, tags, log_message)){
-				map.way_osm_id.push_back(way_osm_id);
-				for(auto node_osm_id:node_osm_id_list){
-					osm_shape_node_list.push_back(node_osm_id);
-				}
-				osm_shape_node_list.push_back(node_osm_id_list.front());
-				osm_shape_node_list.push_back(node_osm_id_list.back());
-			}
-		},
-		nullptr,
-		log_message
-	);
 
 	map.way_count = map.way_osm_id.size();
 
 	std::sort(map.way_osm_id.begin(), map.way_osm_id.end());
-	std::sort(osm_shape_node_list.begin(), osm_shape_node_list.end());
+	if(!use_external_memory)
+		std::sort(osm_shape_node_list.begin(), osm_shape_node_list.end());
 
         if(!extra_node_osm_id.empty()){
                 std::sort(extra_node_osm_id.begin(), extra_node_osm_id.end());
@@ -476,7 +179,7 @@ VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, s
                 );
         }
 
-	{
+	if(!use_external_memory){
 		auto
 			in = osm_shape_node_list.begin(),
 			in_end = osm_shape_node_list.end(),
@@ -555,7 +258,7 @@ VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, s
 
 	std::vector<uint32_t>link_way;
 
-	std::vector<Maneuver> maneuver_list;
+	std::vector<OSMManeuver> maneuver_list;
 
 	ordered_read_osm_pbf(
 		file_name,
@@ -602,6 +305,7 @@ VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, s
 					} else {
 						LatLon now_pos = shape_pos[shape_index];
 						map.shape_pos.push_back(now_pos);
+						map.shape_osm_id.push_back(node_osm_id_list[i]);
 						distance_since_prev_pos_in_cm += compute_distance_in_cm(GeoPos(prev_pos), GeoPos(now_pos));
 						prev_pos = now_pos;
 					}
@@ -649,151 +353,7 @@ VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, s
 			}
 		},
 		[&](uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags){
-			const char*restriction = tags["restriction"];
-			if(!restriction)
-				return;
-
-			std::vector<uint32_t>from_way_list;
-			uint32_t via_node = invalid_id;
-			std::vector<uint32_t>via_way_list;
-			std::vector<uint32_t>to_way_list;
-
-			uint32_t via_count = 0;
-			uint32_t from_count = 0;
-			uint32_t to_count = 0;
-
-			for(unsigned i=0; i<member_list.size(); ++i){
-				if(str_eq(member_list[i].role, "via")){
-					if(member_list[i].type == OSMIDType::node){
-						if(via_node != invalid_id || !via_way_list.empty()){
-							log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has several conflicting \"via\" roles, ignoring restriction");
-							return;
-						}
-						++via_count;
-						via_node = to_routing_index(member_list[i].id);
-						if(via_node == invalid_id){
-							return;
-						}
-					}else if(member_list[i].type == OSMIDType::way){
-						if(via_node != invalid_id){
-							log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has several \"via\" roles, ignoring restriction");
-							return;
-						}
-						++via_count;
-						uint32_t via_way = to_way_index(member_list[i].id);
-						if(via_way == invalid_id)
-							return;
-						via_way_list.push_back(via_way);
-					}else{
-						log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has a \"via\" role that is a restriction. Only via nodes and via ways are supported. Ignoring restriction");
-						return;
-					}
-				}else if(str_eq(member_list[i].role, "from")){
-					if(member_list[i].type != OSMIDType::way){
-						log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has a \"from\" that is no way -> ignoring restriction");
-						return;
-					}
-					++from_count;
-					uint32_t way_id = to_way_index(member_list[i].id);
-					if(way_id != invalid_id)
-						from_way_list.push_back(way_id);
-				}else if(str_eq(member_list[i].role, "to")){
-					if(member_list[i].type != OSMIDType::way){
-						log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has a \"to\" that is no way -> ignoring restriction");
-						return;
-					}
-					++to_count;
-					uint32_t way_id = to_way_index(member_list[i].id);
-					if(way_id != invalid_id)
-						to_way_list.push_back(way_id);
-				}else if(str_eq(member_list[i].role, "location_hint")){
-					// ignore
-				}else{
-					if(log_message)
-						log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" and unknown role \""+member_list[i].role+"\" -> ignoring role");
-				}
-			}
-			if(from_count == 0){
-				log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has no \"from\" role -> ignoring restriction");
-				return;
-			}
-			if(to_count == 0){
-				log_message("OSM turn restriction with ID "+std::to_string(osm_relation_id)+" has no \"to\" role -> ignoring restriction");
-				return;
-			}
-
-			// This happens when a turn restriction involves a road closed for cars.
-			if(from_way_list.empty() || to_way_list.empty())
-				return;
-
-			if(starts_with("only_", restriction)){
-				if(from_way_list.size() != 1){
-					log_message("OSM mandatory turn restriction with ID "+std::to_string(osm_relation_id)+" has several \"from\" roles -> ignoring restriction");
-					return;
-				}
-				if(to_way_list.size() != 1){
-					log_message("OSM mandatory turn restriction with ID "+std::to_string(osm_relation_id)+" has several \"to\" roles -> ignoring restriction");
-					return;
-				}
-
-				struct MandatoryTurnType{
-					const char*name;
-					TurnDir dir;
-				};
-				MandatoryTurnType type_list [] = {
-					{"only_right_turn", TurnDir::right},
-					{"only_left_turn", TurnDir::left},
-					{"only_straight_on", TurnDir::straight},
-					{"only_uturn", TurnDir::uturn}
-				};
-				for(MandatoryTurnType&t:type_list){
-					if(str_eq(restriction, t.name)){
-						maneuver_list.push_back({
-							osm_relation_id,
-							from_way_list.front(),
-							via_node,
-							via_way_list,
-							to_way_list.back(),
-							t.dir,
-							ManeuverType::mandatory
-						});
-						return;
-					}
-				}
-				log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is an unknown mandatory turn restriction with the value \""+restriction+"\" -> ignoring restriction");
-			}else{
-				struct ForbiddenTurnType{
-					const char*name;
-					TurnDir dir;
-				};
-				ForbiddenTurnType type_list [] = {
-					{"no_left_turn", TurnDir::left},
-					{"no_right_turn", TurnDir::right},
-					{"no_straight_on", TurnDir::straight},
-					{"no_exit", TurnDir::straight},
-					{"no_entry", TurnDir::straight},
-					{"no_u_turn", TurnDir::uturn}
-				};
-				for(ForbiddenTurnType&t:type_list){
-					if(str_eq(restriction, t.name)){
-						for(uint32_t from_way:from_way_list){
-							for(uint32_t to_way:to_way_list){
-								maneuver_list.push_back({
-									osm_relation_id,
-									from_way,
-									via_node,
-									via_way_list,
-									to_way,
-									t.dir,
-									ManeuverType::forbidden
-								});
-							}
-						}
-						return;
-					}
-				}
-				log_message("OSM relation with ID "+std::to_string(osm_relation_id)+" is an unknown forbidden turn restriction with the value \""+restriction+"\" -> ignoring restriction");
-			}
+			decode_osm_turn_restriction(osm_relation_id, member_list, tags, to_routing_index, to_way_index, maneuver_list, log_message);
 		},
 		log_message
 	);
@@ -802,61 +362,64 @@ VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, s
 	map.shape_pos_count = map.shape_pos.size();
 
 	if(!is_sorted_using_less(link_way)){
-		auto p = compute_stable_sort_permutation_using_key(link_way, map.link_count, [](uint32_t x){return x;});
-		link_way = apply_permutation(p, link_way);
-		map.link_head = apply_permutation(p, map.link_head);
-		map.link_tail = apply_permutation(p, map.link_tail);
-		map.link_length_in_cm = apply_permutation(p, map.link_length_in_cm);
+		auto p = compute_stable_sort_permutation_using_key(link_way, map.way_count, [](uint32_t x){return x;}, thread_count);
+		link_way = apply_permutation(p, link_way, thread_count);
+		map.link_head = apply_permutation(p, map.link_head, thread_count);
+		map.link_tail = apply_permutation(p, map.link_tail, thread_count);
+		map.link_length_in_cm = apply_permutation(p, map.link_length_in_cm, thread_count);
 
 		std::vector<uint32_t>dlink_traversal_time_in_ms(map.dlink_traversal_time_in_ms.size());
-		for(uint32_t l=0; l<map.link_count; ++l){
-			dlink_traversal_time_in_ms[link_to_forward_dlink(l)] = map.dlink_traversal_time_in_ms[link_to_forward_dlink(p[l])];
-			dlink_traversal_time_in_ms[link_to_backward_dlink(l)] = map.dlink_traversal_time_in_ms[link_to_backward_dlink(p[l])];
-		}
-		map.dlink_traversal_time_in_ms = std::move(dlink_traversal_time_in_ms);
-
 		std::vector<uint32_t>first_shape_pos_of_link(map.link_count+1, 0);
-		for(uint32_t l=0; l<map.link_count; ++l)
-			first_shape_pos_of_link[l] = map.first_shape_pos_of_link[p[l]+1]-map.first_shape_pos_of_link[p[l]];
-		compute_prefix_sum(first_shape_pos_of_link);
+		run_on_thread_ranges(
+			thread_count, map.link_count,
+			[&](unsigned, uint64_t begin, uint64_t end){
+				for(uint32_t l=begin; l<end; ++l){
+					dlink_traversal_time_in_ms[link_to_forward_dlink(l)] = map.dlink_traversal_time_in_ms[link_to_forward_dlink(p[l])];
+					dlink_traversal_time_in_ms[link_to_backward_dlink(l)] = map.dlink_traversal_time_in_ms[link_to_backward_dlink(p[l])];
+					first_shape_pos_of_link[l] = map.first_shape_pos_of_link[p[l]+1]-map.first_shape_pos_of_link[p[l]];
+				}
+			}
+		);
+		map.dlink_traversal_time_in_ms = std::move(dlink_traversal_time_in_ms);
+		compute_prefix_sum(first_shape_pos_of_link, thread_count);
 
 		std::vector<LatLon>shape_pos(map.shape_pos_count);
-		for(uint32_t l=0; l<map.link_count; ++l){
-			std::copy(
-				&map.shape_pos[0] + map.first_shape_pos_of_link[p[l]],
-				&map.shape_pos[0] + map.first_shape_pos_of_link[p[l]+1],
-				&shape_pos[0] + first_shape_pos_of_link[l]
-			);
-		}
+		std::vector<uint64_t>shape_osm_id(map.shape_pos_count);
+		run_on_thread_ranges(
+			thread_count, map.link_count,
+			[&](unsigned, uint64_t begin, uint64_t end){
+				for(uint32_t l=begin; l<end; ++l){
+					std::copy(
+						map.shape_pos.begin() + map.first_shape_pos_of_link[p[l]],
+						map.shape_pos.begin() + map.first_shape_pos_of_link[p[l]+1],
+						shape_pos.begin() + first_shape_pos_of_link[l]
+					);
+					std::copy(
+						map.shape_osm_id.begin() + map.first_shape_pos_of_link[p[l]],
+						map.shape_osm_id.begin() + map.first_shape_pos_of_link[p[l]+1],
+						shape_osm_id.begin() + first_shape_pos_of_link[l]
+					);
+				}
+			}
+		);
 
 		map.first_shape_pos_of_link = std::move(first_shape_pos_of_link);
 		map.shape_pos = std::move(shape_pos);
+		map.shape_osm_id = std::move(shape_osm_id);
 	}
 
-	map.first_link_of_way = invert_func(link_way, map.way_count);
+	map.first_link_of_way = invert_func(link_way, map.way_count, thread_count);
 
 	map.forbidden_maneuver_count = 0;
 	map.forbidden_maneuver_dlink_count = 0;
 	map.first_dlink_of_forbidden_maneuver = {0};
 
-	std::sort(
-		maneuver_list.begin(), maneuver_list.end(),
-		[](const Maneuver&l, const Maneuver&r){
-			return l.osm_relation_id < r.osm_relation_id;
-		}
-	);
-
-	ManeuverMatching maneuver_matching;
-	{
-		ManeuverMatcher matcher(map.as_ref(), log_message);
-		matcher.match_all(maneuver_list);
-		maneuver_matching = std::move(matcher.result);
-	}
-
-	build_forbidden_maneuvers_and_convert_mandatory_to_forbidden(map, maneuver_matching, log_message);
+	build_forbidden_maneuvers(map, std::move(maneuver_list), log_message, thread_count);
 
 	map.assert_correct_size();
 	assert_osm_car_roads_valid(map.as_cref());
+	log_peak_rss(log_message, "at the end of the import");
+
 	return map;
 }
 
@@ -9,6 +9,17 @@ namespace RoutingKit2{
 
 VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, std::vector<uint64_t>extra_node_osm_id, std::function<void(std::string)>log_message);
 
+// If memory_budget_in_bytes is not 0, then the OSM IDs of the shape nodes, which
+// are the largest temporary data of the import, are not sorted in memory. Instead
+// sorted runs of at most memory_budget_in_bytes bytes in total are written to
+// temporary files in tmp_dir and merged afterwards. The result is the same.
+struct OSMImportMemoryConfig{
+	uint64_t memory_budget_in_bytes = 0;
+	std::string tmp_dir = ".";
+};
+
+VecOSMCarRoads import_car_roads_from_osm_pbf_file(const std::string&file_name, std::vector<uint64_t>extra_node_osm_id, std::function<void(std::string)>log_message, const OSMImportMemoryConfig&memory_config);
+
 } // RoutingKit2
 
 #endif
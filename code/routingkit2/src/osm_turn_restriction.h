@@ -0,0 +1,56 @@
+#ifndef ROUTING_KIT2_OSM_TURN_RESTRICTION_H
+#define ROUTING_KIT2_OSM_TURN_RESTRICTION_H
+
+#include "map.h"
+#include "osm_types.h"
+#include "tag_map.h"
+#include "turn.h"
+#include "span.h"
+
+#include <functional>
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+namespace RoutingKit2{
+
+enum class OSMManeuverType{
+	forbidden,
+	mandatory
+};
+
+//! A turn restriction in terms of the ways and routing nodes of a dataset. It is
+//! not yet matched onto links. via_node is invalid if the relation has no via node.
+struct OSMManeuver{
+	uint64_t osm_relation_id;
+	uint32_t from_way;
+	uint32_t via_node;
+	std::vector<uint32_t>via_way_list;
+	uint32_t to_way;
+	TurnDir dir;
+	OSMManeuverType type;
+};
+
+//! Decodes an OSM turn restriction relation and appends its maneuvers to
+//! maneuver_list. Relations without a restriction tag are ignored.
+//! to_routing_index and to_way_index map OSM IDs onto the routing nodes and ways
+//! of the dataset. They return (uint32_t)-1 for nodes that are no routing nodes
+//! and ways that are no car roads.
+void decode_osm_turn_restriction(
+	uint64_t osm_relation_id, Span<const OSMRelationMember>member_list, const TagMap&tags,
+	const std::function<uint32_t(uint64_t)>&to_routing_index,
+	const std::function<uint32_t(uint64_t)>&to_way_index,
+	std::vector<OSMManeuver>&maneuver_list,
+	const std::function<void(std::string)>&log_message
+);
+
+//! Matches the maneuvers onto the dlinks of map and replaces the forbidden
+//! maneuvers of map with the result. Mandatory maneuvers are converted into the
+//! forbidden maneuvers that deviate from them. The links, ways and routing nodes
+//! of map must be complete. The adjacency array is built on thread_count threads.
+//! A thread_count of 0 means std::thread::hardware_concurrency().
+void build_forbidden_maneuvers(VecOSMCarRoads&map, std::vector<OSMManeuver>maneuver_list, const std::function<void(std::string)>&log_message, unsigned thread_count = 1);
+
+} // RoutingKit2
+
+#endif
@@ -0,0 +1,85 @@
+#ifndef ROUTING_KIT2_PARALLEL_H
+#define ROUTING_KIT2_PARALLEL_H
+
+#include <algorithm>
+#include <exception>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+
+namespace RoutingKit2{
+
+//! Returns the number of threads that should be used. A thread_count of 0 means
+//! std::thread::hardware_concurrency().
+inline unsigned resolve_thread_count(unsigned thread_count){
+	if(thread_count == 0)
+		thread_count = std::thread::hardware_concurrency();
+	if(thread_count == 0)
+		thread_count = 1;
+	return thread_count;
+}
+
+//! Resolves thread_count and reduces it such that every thread gets at least
+//! min_element_count_per_thread of the element_count elements.
+inline unsigned limit_thread_count(unsigned thread_count, uint64_t element_count, uint64_t min_element_count_per_thread){
+	thread_count = resolve_thread_count(thread_count);
+	uint64_t max_thread_count = std::max<uint64_t>(element_count / std::max<uint64_t>(min_element_count_per_thread, 1), 1);
+	return static_cast<unsigned>(std::min<uint64_t>(thread_count, max_thread_count));
+}
+
+//! Thread thread_id of thread_count threads processes the elements in
+//! [get_thread_range_begin(n, thread_count, thread_id), get_thread_range_begin(n, thread_count, thread_id+1)).
+inline uint64_t get_thread_range_begin(uint64_t element_count, unsigned thread_count, unsigned thread_id){
+	return element_count / thread_count * thread_id + std::min<uint64_t>(element_count % thread_count, thread_id);
+}
+
+//! Calls f(thread_id) for every thread_id in [0, thread_count). The calling
+//! thread runs thread_id 0. If thread_count is 1 no thread is started. If a call
+//! throws, the first exception is rethrown after all threads finished.
+template<class F>
+void run_on_threads(unsigned thread_count, const F&f){
+	if(thread_count <= 1){
+		f(0u);
+		return;
+	}
+
+	std::exception_ptr error;
+	std::mutex error_lock;
+	auto run = [&](unsigned thread_id){
+		try{
+			f(thread_id);
+		}catch(...){
+			std::lock_guard<std::mutex>guard(error_lock);
+			if(!error)
+				error = std::current_exception();
+		}
+	};
+
+	std::vector<std::thread>helper;
+	helper.reserve(thread_count-1);
+	for(unsigned i=1; i<thread_count; ++i)
+		helper.emplace_back(run, i);
+	run(0);
+	for(auto&t:helper)
+		t.join();
+
+	if(error)
+		std::rethrow_exception(error);
+}
+
+//! Splits [0, element_count) into thread_count contiguous blocks and calls
+//! f(thread_id, begin, end) for each of them on its own thread.
+template<class F>
+void run_on_thread_ranges(unsigned thread_count, uint64_t element_count, const F&f){
+	run_on_threads(
+		thread_count,
+		[&](unsigned thread_id){
+			f(thread_id, get_thread_range_begin(element_count, thread_count, thread_id), get_thread_range_begin(element_count, thread_count, thread_id+1));
+		}
+	);
+}
+
+} // RoutingKit2
+
+#endif
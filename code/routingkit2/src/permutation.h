@@ -2,10 +2,12 @@
 #define ROUTING_KIT2_PERMUTATION_H
 
 #include "span.h"
+#include "parallel.h"
 
 #include <vector>
 #include <assert.h>
 #include <algorithm>
+#include <type_traits>
 #include <utility>
 
 namespace RoutingKit2{
@@ -15,6 +17,24 @@ namespace RoutingKit2{
 //
 //  Applying a permutation p to the elements of a vector v consists of computing the vector {p[v[0]], p[v[1]], p[v[2]], ... , p[v[n]]}
 //
+//  The functions that take a thread_count distribute the work onto that many
+//  threads, if the permutation is large enough. A thread_count of 0 means
+//  std::thread::hardware_concurrency(). The output is independent of the
+//  thread count.
+//
+
+namespace detail{
+	const unsigned permutation_min_element_count_per_thread = 1<<16;
+
+	// Different threads write different elements of the output. This is a data
+	// race for the bit-packed std::vector<bool>.
+	template<class Out>
+	unsigned get_permutation_thread_count(unsigned thread_count, unsigned element_count){
+		if(std::is_same<typename std::decay<Out>::type, std::vector<bool>>::value)
+			return 1;
+		return limit_thread_count(thread_count, element_count, permutation_min_element_count_per_thread);
+	}
+}
 
 inline
 bool is_permutation(Span<const unsigned>p){
@@ -30,107 +50,149 @@ bool is_permutation(Span<const unsigned>p){
 }
 
 template<class In, class Out>
-void apply_permutation_and_copy_into(Span<const unsigned>p, const In&in, Out&out){
+void apply_permutation_and_copy_into(Span<const unsigned>p, const In&in, Out&out, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(p.size() == in.size() && "permutation and input must have the same size");
 	assert(p.size() == out.size() && "permutation and output must have the same size");
 
-	for(unsigned i=0; i<p.size(); ++i)
-		out[i] = in[p[i]];
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Out>(thread_count, p.size()),
+		p.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				out[i] = in[p[i]];
+		}
+	);
 }
 
 template<class In, class Out>
-void apply_permutation_and_move_into(Span<const unsigned>p, In&&in, Out&out){
+void apply_permutation_and_move_into(Span<const unsigned>p, In&&in, Out&out, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(p.size() == in.size() && "permutation and input span must have the same size");
 	assert(p.size() == out.size() && "permutation and output span must have the same size");
 
-	for(unsigned i=0; i<p.size(); ++i)
-		out[i] = std::move(in[p[i]]);
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Out>(thread_count, p.size()),
+		p.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				out[i] = std::move(in[p[i]]);
+		}
+	);
 }
 
 template<class In, class Out>
-void apply_inverse_permutation_and_copy_into(Span<const unsigned>p, const In&in, Out&out){
+void apply_inverse_permutation_and_copy_into(Span<const unsigned>p, const In&in, Out&out, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(p.size() == in.size() && "permutation and input span must have the same size");
 	assert(p.size() == out.size() && "permutation and output span must have the same size");
 
-	for(unsigned i=0; i<p.size(); ++i)
-		out[p[i]] = in[i];
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Out>(thread_count, p.size()),
+		p.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				out[p[i]] = in[i];
+		}
+	);
 }
 
 template<class In, class Out>
-void apply_inverse_permutation_and_move_into(Span<const unsigned>p, const In&in, Out&out){
+void apply_inverse_permutation_and_move_into(Span<const unsigned>p, const In&in, Out&out, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(p.size() == in.size() && "permutation and input span must have the same size");
 	assert(p.size() == out.size() && "permutation and output span must have the same size");
 
-	for(unsigned i=0; i<p.size(); ++i)
-		out[p[i]] = std::move(in[i]);
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Out>(thread_count, p.size()),
+		p.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				out[p[i]] = std::move(in[i]);
+		}
+	);
 }
 
 template<class C>
-auto apply_permutation(Span<const unsigned>p, const C&v) -> std::vector<typename C::value_type>{
+auto apply_permutation(Span<const unsigned>p, const C&v, unsigned thread_count = 1) -> std::vector<typename C::value_type>{
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(p.size() == v.size() && "permutation and span must have the same size");
 
 	std::vector<typename C::value_type>r(v.size());
-	apply_permutation_and_copy_into(p, v, r);
+	apply_permutation_and_copy_into(p, v, r, thread_count);
 	return r;
 }
 
 
 template<class C>
-auto apply_inverse_permutation(Span<const unsigned>p, const C&v)-> std::vector<typename C::value_type>{
+auto apply_inverse_permutation(Span<const unsigned>p, const C&v, unsigned thread_count = 1)-> std::vector<typename C::value_type>{
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(p.size() == v.size() && "permutation and span must have the same size");
 
 	std::vector<typename C::value_type>r(v.size());
-	apply_inverse_permutation_and_copy_into(p, v, r);
+	apply_inverse_permutation_and_copy_into(p, v, r, thread_count);
 	return r;
 }
 
 inline
-void inplace_apply_permutation_to_elements_of(Span<const unsigned>p, Span<unsigned>v){
+void inplace_apply_permutation_to_elements_of(Span<const unsigned>p, Span<unsigned>v, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(std::all_of(v.begin(), v.end(), [&](unsigned x){return x < p.size();}) && "v has an out of bounds element");
 
-	for(unsigned i=0; i<v.size(); ++i)
-		v[i] = p[v[i]];
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Span<unsigned>>(thread_count, v.size()),
+		v.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				v[i] = p[v[i]];
+		}
+	);
 }
 
 inline
-std::vector<unsigned> apply_permutation_to_elements_of(Span<const unsigned>p, Span<const unsigned>v){
+std::vector<unsigned> apply_permutation_to_elements_of(Span<const unsigned>p, Span<const unsigned>v, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 	assert(std::all_of(v.begin(), v.end(), [&](unsigned x){return x < p.size();}) && "v has an out of bounds element");
 
 	std::vector<unsigned> r(v.begin(), v.end());
-	inplace_apply_permutation_to_elements_of(p, r);
+	inplace_apply_permutation_to_elements_of(p, r, thread_count);
 	return r;
 }
 
 inline
-void invert_permutation_and_copy_into(Span<const unsigned>in, Span<unsigned>out){
+void invert_permutation_and_copy_into(Span<const unsigned>in, Span<unsigned>out, unsigned thread_count = 1){
 	assert(is_permutation(in) && "in must be a permutation");
 	assert(in.size() == out.size() && "in and out must have the same size");
 
-	for(unsigned i=0; i<in.size(); ++i)
-		out[in[i]] = i;
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Span<unsigned>>(thread_count, in.size()),
+		in.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				out[in[i]] = i;
+		}
+	);
 }
 
 inline
-std::vector<unsigned> invert_permutation(Span<const unsigned>p){
+std::vector<unsigned> invert_permutation(Span<const unsigned>p, unsigned thread_count = 1){
 	assert(is_permutation(p) && "p must be a permutation");
 
 	std::vector<unsigned> inv_p(p.size());
-	invert_permutation_and_copy_into(p, inv_p);
+	invert_permutation_and_copy_into(p, inv_p, thread_count);
 	return inv_p;
 }
 
 inline
-void copy_identity_permutation_into(Span<unsigned>p){
-	for(unsigned i=0; i<p.size(); ++i)
-		p[i] = i;
+void copy_identity_permutation_into(Span<unsigned>p, unsigned thread_count = 1){
+	run_on_thread_ranges(
+		detail::get_permutation_thread_count<Span<unsigned>>(thread_count, p.size()),
+		p.size(),
+		[&](unsigned, uint64_t begin, uint64_t end){
+			for(unsigned i=begin; i<end; ++i)
+				p[i] = i;
+		}
+	);
 }
 
 
@@ -2,7 +2,9 @@
 #define ROUTING_KIT2_PREFIX_SUM_H
 
 #include "span.h"
+#include "parallel.h"
 #include <stdint.h>
+#include <vector>
 
 namespace RoutingKit2{
 	namespace detail {
@@ -15,6 +17,45 @@ namespace RoutingKit2{
 				sum += tmp;
 			}
 		}
+
+		const unsigned prefix_sum_min_element_count_per_thread = 1<<16;
+
+		// Every thread sums its block. The block sums are prefix summed serially.
+		// Afterwards every thread computes the prefix sum of its block starting
+		// from the sum of the blocks before it.
+		template<class T>
+		void compute_prefix_sum(Span<T>v, unsigned thread_count){
+			thread_count = limit_thread_count(thread_count, v.size(), prefix_sum_min_element_count_per_thread);
+			if(thread_count == 1){
+				compute_prefix_sum(v);
+				return;
+			}
+
+			std::vector<T>block_sum(thread_count);
+			run_on_thread_ranges(
+				thread_count, v.size(),
+				[&](unsigned thread_id, uint64_t begin, uint64_t end){
+					T sum = 0;
+					for(uint64_t i=begin; i<end; ++i)
+						sum += v[i];
+					block_sum[thread_id] = sum;
+				}
+			);
+
+			compute_prefix_sum(Span<T>(block_sum));
+
+			run_on_thread_ranges(
+				thread_count, v.size(),
+				[&](unsigned thread_id, uint64_t begin, uint64_t end){
+					T sum = block_sum[thread_id];
+					for(uint64_t i=begin; i<end; ++i){
+						T tmp = v[i];
+						v[i] = sum;
+						sum += tmp;
+					}
+				}
+			);
+		}
 	}
 
 	inline void compute_prefix_sum(Span<uint8_t>v){ detail::compute_prefix_sum(v); }
@@ -25,6 +66,17 @@ namespace RoutingKit2{
 	inline void compute_prefix_sum(Span<int16_t>v){ detail::compute_prefix_sum(v); }
 	inline void compute_prefix_sum(Span<int32_t>v){ detail::compute_prefix_sum(v); }
 	inline void compute_prefix_sum(Span<int64_t>v){ detail::compute_prefix_sum(v); }
+
+	// The same as above but on thread_count threads. A thread_count of 0 means
+	// std::thread::hardware_concurrency().
+	inline void compute_prefix_sum(Span<uint8_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<uint16_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<uint32_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<uint64_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<int8_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<int16_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<int32_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
+	inline void compute_prefix_sum(Span<int64_t>v, unsigned thread_count){ detail::compute_prefix_sum(v, thread_count); }
 }
 
 #endif
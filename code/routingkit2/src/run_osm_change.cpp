@@ -0,0 +1,92 @@
+#include "map.h"
+#include "osm_change.h"
+using namespace RoutingKit2;
+
+#include <iostream>
+#include <fstream>
+#include <algorithm>
+#include <stdexcept>
+using namespace std;
+
+template<class T>
+static void copy_span(std::vector<T>&out, Span<const T>in){
+	out.assign(in.begin(), in.end());
+}
+
+static void print_id_list(const char*what, const std::vector<uint64_t>&id_list){
+	if(id_list.empty())
+		return;
+	cout << what << " :";
+	for(size_t i=0; i<id_list.size() && i<20; ++i)
+		cout << ' ' << id_list[i];
+	if(id_list.size() > 20)
+		cout << " ... (" << id_list.size() << " in total)";
+	cout << endl;
+}
+
+int main(int argc, char*argv[]){
+	try{
+		if(argc != 4){
+			cout << "usage: "<<argv[0] << " input_directory change.osc output_directory" << endl;
+			cout << "Applies an OSM change file to a directory created by run_osm_import. The output directory may be the input directory." << endl;
+			return 1;
+		}
+
+		// Directories written by run_osm_import before shape_osm_id existed lack
+		// this column. The shape nodes of such a map cannot be matched against the
+		// change, so it must be imported again.
+		if(!std::ifstream(std::string(argv[1]) + "/shape_osm_id"))
+			throw std::runtime_error(std::string(argv[1]) + " has no shape_osm_id column. It was written by an older run_osm_import and must be imported again before changes can be applied.");
+
+		VecOSMCarRoads map;
+		{
+			DirOSMCarRoads dir(argv[1]);
+			map.node_count = dir.node_count;
+			map.link_count = dir.link_count;
+			map.shape_pos_count = dir.shape_pos_count;
+			map.forbidden_maneuver_count = dir.forbidden_maneuver_count;
+			map.forbidden_maneuver_dlink_count = dir.forbidden_maneuver_dlink_count;
+			map.way_count = dir.way_count;
+			copy_span(map.link_head, dir.link_head_as_cref());
+			copy_span(map.link_tail, dir.link_tail_as_cref());
+			copy_span(map.link_length_in_cm, dir.link_length_in_cm_as_cref());
+			copy_span(map.node_pos, dir.node_pos_as_cref());
+			copy_span(map.first_shape_pos_of_link, dir.first_shape_pos_of_link_as_cref());
+			copy_span(map.shape_pos, dir.shape_pos_as_cref());
+			copy_span(map.dlink_traversal_time_in_ms, dir.dlink_traversal_time_in_ms_as_cref());
+			copy_span(map.first_dlink_of_forbidden_maneuver, dir.first_dlink_of_forbidden_maneuver_as_cref());
+			copy_span(map.forbidden_maneuver_dlink, dir.forbidden_maneuver_dlink_as_cref());
+			copy_span(map.first_link_of_way, dir.first_link_of_way_as_cref());
+			copy_span(map.node_osm_id, dir.node_osm_id_as_cref());
+			copy_span(map.shape_osm_id, dir.shape_osm_id_as_cref());
+			copy_span(map.way_osm_id, dir.way_osm_id_as_cref());
+			copy_span(map.forbidden_maneuver_osm_id, dir.forbidden_maneuver_osm_id_as_cref());
+		}
+
+		OSMChange change = read_osm_change_file(argv[2]);
+		cout << "change contains " << change.node_list.size() << " nodes, " << change.way_list.size() << " ways and " << change.relation_list.size() << " relations" << endl;
+
+		OSMChangeResult result = apply_osm_change(
+			map,
+			change,
+			[&](string msg){
+				cout << msg << endl;
+			}
+		);
+
+		throw_if_osm_car_roads_invalid(map.as_cref());
+		dump_into_dir(argv[3], map.as_cref());
+
+		cout << "removed ways : " << result.removed_way_count << endl;
+		cout << "rebuilt ways : " << result.rebuilt_way_count << endl;
+		cout << "reshaped ways : " << result.reshaped_way_count << endl;
+		cout << "split ways : " << result.split_way_count << endl;
+		cout << "added routing nodes : " << result.added_node_count << endl;
+		print_id_list("unpatched ways", result.unpatched_way_osm_id);
+		print_id_list("dropped restrictions", result.dropped_maneuver_osm_id);
+		cout << "result complete : " << (result.is_complete() ? "yes" : "no") << endl;
+	}catch(std::exception&err){
+		cerr << "Exception: " << err.what() << endl;
+		return 1;
+	}
+}
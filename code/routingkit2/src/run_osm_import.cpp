@@ -10,17 +10,30 @@ using namespace std;
 
 int main(int argc, char*argv[]){
 	try{
-                if(argc < 2){
-                        cout << "usage: "<<argv[0] << " in.pbf output_directory [traffic1.csv [traffic2.csv [...]]]" << endl;
+                OSMImportMemoryConfig memory_config;
+
+                vector<string>args;
+                for(int i=1; i<argc; ++i){
+                        if(string(argv[i]) == "--memory-budget-mb" && i+1 < argc)
+                                memory_config.memory_budget_in_bytes = stoull(argv[++i]) << 20;
+                        else if(string(argv[i]) == "--tmp-dir" && i+1 < argc)
+                                memory_config.tmp_dir = argv[++i];
+                        else
+                                args.push_back(argv[i]);
+                }
+
+                if(args.size() < 2){
+                        cout << "usage: "<<argv[0] << " [--memory-budget-mb N [--tmp-dir dir]] in.pbf output_directory [traffic1.csv [traffic2.csv [...]]]" << endl;
+                        cout << "With --memory-budget-mb the shape nodes are sorted in external memory using temporary files in the --tmp-dir directory." << endl;
                         return 1;
                 }
 
                 vector<uint64_t>osm_node_traffic_end_point;
 
-                for(int i=3; i<argc; ++i){
-                        std::ifstream in(argv[i]);
+                for(size_t i=2; i<args.size(); ++i){
+                        std::ifstream in(args[i]);
                         if(!in){
-                                cout << "Cannot open "<< argv[i]<<" skipping" << endl;
+                                cout << "Cannot open "<< args[i]<<" skipping" << endl;
                         }else{
                                 string line;
                                 while(getline(in, line)){
@@ -38,14 +51,15 @@ int main(int argc, char*argv[]){
                 osm_node_traffic_end_point.erase(std::unique(osm_node_traffic_end_point.begin(), osm_node_traffic_end_point.end()), osm_node_traffic_end_point.end());
 
                 auto map = import_car_roads_from_osm_pbf_file(
-                        argv[1],
+                        args[0],
                         osm_node_traffic_end_point,
                         [&](string msg){
 		                cout << msg << endl;
-	                }
+	                },
+                        memory_config
                 );
 
-                dump_into_dir(argv[2], map.as_ref());
+                dump_into_dir(args[1], map.as_ref());
 	}catch(std::exception&err){
 		cerr << "Exception: " << err.what() << endl;
 	}
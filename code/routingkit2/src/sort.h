@@ -2,12 +2,15 @@
 #define ROUTING_KIT2_SORT_H
 
 #include "permutation.h"
+#include "parallel.h"
 #include "span.h"
 
 #include <vector>
 #include <assert.h>
+#include <stdint.h>
 #include <algorithm>
 #include <functional>
+#include <type_traits>
 
 namespace RoutingKit2{
 
@@ -49,6 +52,13 @@ namespace RoutingKit2{
 //     final parameter and write their output into this parameter. The
 //     "_and_copy_into" have no return value.
 //
+// The "key" and "less" functions take an optional thread_count as very last
+// parameter. A thread_count of 0 means std::thread::hardware_concurrency().
+// Large inputs are sorted with a parallel LSD radix sort on that many threads.
+// The "less" functions use the radix sort for unsigned integer values even on a
+// single thread. The radix sort is stable, so the result does not depend on the
+// thread count. If thread_count is not 1, then get_key is called concurrently.
+//
 
 template<class V, class C>
 void compute_stable_sort_permutation_using_comparator_and_copy_into(const V&v, const C&is_less, Span<unsigned>p){
@@ -129,6 +139,119 @@ bool is_sorted_using_comparator(const V&v, const C&is_less){
 namespace detail{
 	const unsigned bucket_sort_min_key_to_element_ratio = 16;
 
+	const unsigned radix_sort_min_element_count = 1<<10;
+	const unsigned radix_sort_min_element_count_per_thread = 1<<15;
+	const unsigned radix_sort_max_digit_bit_count = 11;
+
+	template<class Key>
+	unsigned compute_bit_count(Key max_key){
+		unsigned bit_count = 0;
+		while(max_key != 0){
+			++bit_count;
+			max_key >>= 1;
+		}
+		return bit_count;
+	}
+
+	// Computes a stable sort permutation of key using an LSD radix sort. Every key
+	// must be smaller than 2^bit_count. key is used as buffer and its contents are
+	// unspecified afterwards.
+	//
+	// Every pass works on thread_count contiguous blocks of the input. Each thread
+	// counts the digits in its block. The bucket of digit d of thread t starts
+	// behind the buckets of all smaller digits and behind the buckets of digit d of
+	// all threads before t. The scatter is therefore stable.
+	template<class Key>
+	void compute_radix_sort_permutation_and_copy_into(std::vector<Key>&key, unsigned bit_count, Span<unsigned>p, unsigned thread_count){
+		assert(key.size() == p.size() && "key and permutation must have the same size");
+
+		const unsigned element_count = p.size();
+		thread_count = limit_thread_count(thread_count, element_count, radix_sort_min_element_count_per_thread);
+
+		copy_identity_permutation_into(p, thread_count);
+		if(bit_count == 0)
+			return;
+
+		const unsigned pass_count = (bit_count + radix_sort_max_digit_bit_count - 1) / radix_sort_max_digit_bit_count;
+		const unsigned digit_bit_count = (bit_count + pass_count - 1) / pass_count;
+		const unsigned bucket_count = 1u << digit_bit_count;
+		const Key digit_mask = bucket_count - 1;
+
+		std::vector<unsigned>tmp_p(element_count);
+		std::vector<Key>tmp_key(pass_count > 1 ? element_count : 0);
+		std::vector<unsigned>bucket_pos((uint64_t)thread_count * bucket_count);
+
+		unsigned*in_p = p.begin();
+		unsigned*out_p = tmp_p.data();
+		Key*in_key = key.data();
+		Key*out_key = tmp_key.data();
+
+		for(unsigned pass=0; pass<pass_count; ++pass){
+			const unsigned shift = pass * digit_bit_count;
+			const bool is_last_pass = pass+1 == pass_count;
+
+			run_on_thread_ranges(
+				thread_count, element_count,
+				[&](unsigned thread_id, uint64_t begin, uint64_t end){
+					unsigned*count = bucket_pos.data() + (uint64_t)thread_id * bucket_count;
+					std::fill(count, count + bucket_count, 0);
+					for(unsigned i=begin; i<end; ++i)
+						++count[(in_key[i] >> shift) & digit_mask];
+				}
+			);
+
+			unsigned sum = 0;
+			for(unsigned d=0; d<bucket_count; ++d){
+				for(unsigned t=0; t<thread_count; ++t){
+					unsigned&x = bucket_pos[(uint64_t)t * bucket_count + d];
+					unsigned tmp = sum + x;
+					x = sum;
+					sum = tmp;
+				}
+			}
+
+			run_on_thread_ranges(
+				thread_count, element_count,
+				[&](unsigned thread_id, uint64_t begin, uint64_t end){
+					unsigned*pos = bucket_pos.data() + (uint64_t)thread_id * bucket_count;
+					for(unsigned i=begin; i<end; ++i){
+						unsigned target = pos[(in_key[i] >> shift) & digit_mask]++;
+						out_p[target] = in_p[i];
+						if(!is_last_pass)
+							out_key[target] = in_key[i];
+					}
+				}
+			);
+
+			std::swap(in_p, out_p);
+			std::swap(in_key, out_key);
+		}
+
+		if(in_p != p.begin()){
+			run_on_thread_ranges(
+				thread_count, element_count,
+				[&](unsigned, uint64_t begin, uint64_t end){
+					std::copy(in_p + begin, in_p + end, p.begin() + begin);
+				}
+			);
+		}
+	}
+
+	template<class V, class K>
+	void compute_radix_sort_permutation_using_key_and_copy_into(const V&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count){
+		std::vector<unsigned>key(v.size());
+		run_on_thread_ranges(
+			thread_count, v.size(),
+			[&](unsigned, uint64_t begin, uint64_t end){
+				for(unsigned i=begin; i<end; ++i){
+					key[i] = get_key(v[i]);
+					assert(key[i] < key_count && "key is too large");
+				}
+			}
+		);
+		compute_radix_sort_permutation_and_copy_into(key, compute_bit_count(key_count == 0 ? 0u : key_count-1), p, thread_count);
+	}
+
 	template<class V, class K>
 	std::vector<unsigned>compute_key_pos(const V&v, unsigned key_count, const K&get_key){
 		std::vector<unsigned>key_pos(key_count, 0);
@@ -187,9 +310,12 @@ namespace detail{
 	// be stable.
 
 	template<bool is_stable, class V, class K>
-	void compute_maybe_stable_sort_permutation_using_key_and_copy_into(const V&v, unsigned key_count, const K&get_key, Span<unsigned>p){
+	void compute_maybe_stable_sort_permutation_using_key_and_copy_into(const V&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count){
 		assert(v.size() == p.size() && "array and permutation must have the same size");
-		if(v.size() >= key_count / bucket_sort_min_key_to_element_ratio){
+		thread_count = limit_thread_count(thread_count, v.size(), radix_sort_min_element_count_per_thread);
+		if(thread_count > 1){
+			compute_radix_sort_permutation_using_key_and_copy_into(v, key_count, get_key, p, thread_count);
+		}else if(v.size() >= key_count / bucket_sort_min_key_to_element_ratio){
 			std::vector<unsigned>key_pos = detail::compute_key_pos(v, key_count, get_key);
 			for(unsigned i=0; i<v.size(); ++i){
 				unsigned k = get_key(v[i]);
@@ -205,9 +331,14 @@ namespace detail{
 	}
 
 	template<bool is_stable, class V, class K>
-	void compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into(const V&v, unsigned key_count, const K&get_key, Span<unsigned>p){
+	void compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into(const V&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count){
 		assert(v.size() == p.size() && "array and permutation must have the same size");
-		if(v.size() >= key_count / bucket_sort_min_key_to_element_ratio){
+		thread_count = limit_thread_count(thread_count, v.size(), radix_sort_min_element_count_per_thread);
+		if(thread_count > 1){
+			std::vector<unsigned>tmp(v.size());
+			compute_radix_sort_permutation_using_key_and_copy_into(v, key_count, get_key, tmp, thread_count);
+			invert_permutation_and_copy_into(tmp, p, thread_count);
+		}else if(v.size() >= key_count / bucket_sort_min_key_to_element_ratio){
 			std::vector<unsigned>key_pos = detail::compute_key_pos(v, key_count, get_key);
 			for(unsigned i=0; i<v.size(); ++i){
 				unsigned k = get_key(v[i]);
@@ -224,54 +355,54 @@ namespace detail{
 }
 
 template<class T, class K>
-void compute_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p){
+void compute_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count = 1){
 	assert(v.size() == p.size() && "array and permutation must have the same size");
-	return detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p);
+	return detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p, thread_count);
 }
 
 template<class T, class K>
-std::vector<unsigned> compute_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key){
+std::vector<unsigned> compute_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key, unsigned thread_count = 1){
 	std::vector<unsigned>p(v.size());
-	detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p);
+	detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p, thread_count);
 	return p;
 }
 
 template<class T, class K>
-void compute_stable_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p){
+void compute_stable_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count = 1){
 	assert(v.size() == p.size() && "array and permutation must have the same size");
-	return detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p);
+	return detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p, thread_count);
 }
 
 template<class T, class K>
-std::vector<unsigned> compute_stable_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key){
+std::vector<unsigned> compute_stable_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key, unsigned thread_count = 1){
 	std::vector<unsigned>p(v.size());
-	detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p);
+	detail::compute_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p, thread_count);
 	return p;
 }
 
 template<class T, class K>
-void compute_inverse_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p){
+void compute_inverse_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count = 1){
 	assert(v.size() == p.size() && "array and permutation must have the same size");
-	return detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p);
+	return detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p, thread_count);
 }
 
 template<class T, class K>
-std::vector<unsigned> compute_inverse_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key){
+std::vector<unsigned> compute_inverse_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key, unsigned thread_count = 1){
 	std::vector<unsigned>p(v.size());
-	detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p);
+	detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<false>(v, key_count, get_key, p, thread_count);
 	return p;
 }
 
 template<class T, class K>
-void compute_inverse_stable_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p){
+void compute_inverse_stable_sort_permutation_using_key_and_copy_into(const std::vector<T>&v, unsigned key_count, const K&get_key, Span<unsigned>p, unsigned thread_count = 1){
 	assert(v.size() == p.size() && "array and permutation must have the same size");
-	return detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p);
+	return detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p, thread_count);
 }
 
 template<class T, class K>
-std::vector<unsigned> compute_inverse_stable_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key){
+std::vector<unsigned> compute_inverse_stable_sort_permutation_using_key(const std::vector<T>&v, unsigned key_count, const K&get_key, unsigned thread_count = 1){
 	std::vector<unsigned>p(v.size());
-	detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p);
+	detail::compute_inverse_maybe_stable_sort_permutation_using_key_and_copy_into<true>(v, key_count, get_key, p, thread_count);
 	return p;
 }
 
@@ -284,48 +415,111 @@ bool is_sorted_using_key(const V&v, unsigned key_count, const K&get_key){
 	return true;
 }
 
+namespace detail{
+	template<class T>
+	struct IsRadixSortable:
+		std::integral_constant<
+			bool,
+			std::is_integral<T>::value && std::is_unsigned<T>::value && !std::is_same<T, bool>::value && sizeof(T) <= sizeof(uint64_t)
+		>{};
+
+	template<bool is_stable, class V>
+	void compute_maybe_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned, std::false_type /*is_radix_sortable*/){
+		typedef typename std::remove_const<typename V::value_type>::type T;
+		if(is_stable)
+			compute_stable_sort_permutation_using_comparator_and_copy_into(v, std::less<T>(), p);
+		else
+			compute_sort_permutation_using_comparator_and_copy_into(v, std::less<T>(), p);
+	}
+
+	template<bool is_stable, class V>
+	void compute_maybe_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count, std::true_type /*is_radix_sortable*/){
+		if(v.size() < radix_sort_min_element_count){
+			compute_maybe_stable_sort_permutation_using_less_and_copy_into<is_stable>(v, p, thread_count, std::false_type());
+			return;
+		}
+
+		typedef typename std::conditional<sizeof(typename V::value_type) <= sizeof(uint32_t), uint32_t, uint64_t>::type Key;
+		thread_count = limit_thread_count(thread_count, v.size(), radix_sort_min_element_count_per_thread);
+
+		std::vector<Key>key(v.size());
+		std::vector<Key>max_key(thread_count, 0);
+		run_on_thread_ranges(
+			thread_count, v.size(),
+			[&](unsigned thread_id, uint64_t begin, uint64_t end){
+				Key m = 0;
+				for(unsigned i=begin; i<end; ++i){
+					key[i] = v[i];
+					m = std::max(m, key[i]);
+				}
+				max_key[thread_id] = m;
+			}
+		);
+
+		compute_radix_sort_permutation_and_copy_into(key, compute_bit_count(*std::max_element(max_key.begin(), max_key.end())), p, thread_count);
+	}
+
+	template<bool is_stable, class V>
+	void compute_maybe_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count){
+		assert(v.size() == p.size() && "array and permutation must have the same size");
+		compute_maybe_stable_sort_permutation_using_less_and_copy_into<is_stable>(v, p, thread_count, IsRadixSortable<typename std::remove_const<typename V::value_type>::type>());
+	}
+
+	template<bool is_stable, class V>
+	void compute_inverse_maybe_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count){
+		assert(v.size() == p.size() && "array and permutation must have the same size");
+		std::vector<unsigned>tmp(v.size());
+		compute_maybe_stable_sort_permutation_using_less_and_copy_into<is_stable>(v, tmp, thread_count);
+		invert_permutation_and_copy_into(tmp, p, thread_count);
+	}
+}
+
 template<class V>
-void compute_sort_permutation_using_less(const V&v, Span<unsigned>p){
-	assert(v.size() == p.size() && "array and permutation must have the same size");
-	compute_sort_permutation_using_comparator_and_copy_into(v, std::less<typename V::value_type>());
+void compute_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count = 1){
+	detail::compute_maybe_stable_sort_permutation_using_less_and_copy_into<false>(v, p, thread_count);
 }
 
 template<class V>
-void compute_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p){
-	assert(v.size() == p.size() && "array and permutation must have the same size");
-	compute_stable_sort_permutation_using_comparator_and_copy_into(v, std::less<typename V::value_type>());
+void compute_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count = 1){
+	detail::compute_maybe_stable_sort_permutation_using_less_and_copy_into<true>(v, p, thread_count);
 }
 
 template<class V>
-void compute_inverse_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p){
-	assert(v.size() == p.size() && "array and permutation must have the same size");
-	compute_inverse_sort_permutation_using_comparator_and_copy_into(v, std::less<typename V::value_type>());
+void compute_inverse_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count = 1){
+	detail::compute_inverse_maybe_stable_sort_permutation_using_less_and_copy_into<false>(v, p, thread_count);
 }
 
 template<class V>
-void compute_inverse_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p){
-	assert(v.size() == p.size() && "array and permutation must have the same size");
-	compute_inverse_stable_sort_permutation_using_comparator_and_copy_into(v, std::less<typename V::value_type>());
+void compute_inverse_stable_sort_permutation_using_less_and_copy_into(const V&v, Span<unsigned>p, unsigned thread_count = 1){
+	detail::compute_inverse_maybe_stable_sort_permutation_using_less_and_copy_into<true>(v, p, thread_count);
 }
 
 template<class V>
-std::vector<unsigned> compute_sort_permutation_using_less(const V&v){
-	return compute_sort_permutation_using_comparator(v, std::less<typename V::value_type>());
+std::vector<unsigned> compute_sort_permutation_using_less(const V&v, unsigned thread_count = 1){
+	std::vector<unsigned>p(v.size());
+	compute_sort_permutation_using_less_and_copy_into(v, p, thread_count);
+	return p;
 }
 
 template<class V>
-std::vector<unsigned> compute_stable_sort_permutation_using_less(const V&v){
-	return compute_stable_sort_permutation_using_comparator(v, std::less<typename V::value_type>());
+std::vector<unsigned> compute_stable_sort_permutation_using_less(const V&v, unsigned thread_count = 1){
+	std::vector<unsigned>p(v.size());
+	compute_stable_sort_permutation_using_less_and_copy_into(v, p, thread_count);
+	return p;
 }
 
 template<class V>
-std::vector<unsigned> compute_inverse_sort_permutation_using_less(const V&v){
-	return compute_inverse_sort_permutation_using_comparator(v, std::less<typename V::value_type>());
+std::vector<unsigned> compute_inverse_sort_permutation_using_less(const V&v, unsigned thread_count = 1){
+	std::vector<unsigned>p(v.size());
+	compute_inverse_sort_permutation_using_less_and_copy_into(v, p, thread_count);
+	return p;
 }
 
 template<class V>
-std::vector<unsigned> compute_inverse_stable_sort_permutation_using_less(const V&v){
-	return compute_inverse_stable_sort_permutation_using_comparator(v, std::less<typename V::value_type>());
+std::vector<unsigned> compute_inverse_stable_sort_permutation_using_less(const V&v, unsigned thread_count = 1){
+	std::vector<unsigned>p(v.size());
+	compute_inverse_stable_sort_permutation_using_less_and_copy_into(v, p, thread_count);
+	return p;
 }
 
 template<class V>
@@ -0,0 +1,68 @@
+#include "external_sort.h"
+
+#include "catch.hpp"
+
+#include <vector>
+#include <algorithm>
+#include <random>
+#include <stdio.h>
+
+using namespace RoutingKit2;
+using namespace std;
+
+TEST_CASE("ExternalSortMatchesSort", "[ExternalSort]"){
+	std::minstd_rand rng(42);
+
+	unsigned budget_list[] = {8, 64, 1000, 1<<20};
+
+	for(unsigned budget:budget_list){
+		for(unsigned sorter_count:{1, 3}){
+			vector<uint64_t>expected;
+			vector<ExternalUInt64Sorter>sorter_list;
+			for(unsigned i=0; i<sorter_count; ++i)
+				sorter_list.emplace_back("test_external_sort_tmp_"+to_string(i)+"_", budget);
+
+			for(unsigned i=0; i<5000; ++i){
+				uint64_t x = rng() % 1000;
+				x = (x << 40) | rng();
+				if(i % 7 == 0)
+					x = 42;
+				expected.push_back(x);
+				sorter_list[rng() % sorter_count].push(x);
+			}
+
+			uint64_t pushed = 0;
+			for(auto&s:sorter_list){
+				s.finish();
+				pushed += s.size();
+			}
+			REQUIRE(pushed == expected.size());
+
+			vector<string>run_file_list;
+			for(auto&s:sorter_list)
+				run_file_list.insert(run_file_list.end(), s.get_run_file_list().begin(), s.get_run_file_list().end());
+
+			vector<uint64_t>actual;
+			merge_sorted_runs(sorter_list, [&](uint64_t x){actual.push_back(x);}, 64);
+
+			sort(expected.begin(), expected.end());
+			REQUIRE(actual == expected);
+
+			for(auto&f:run_file_list){
+				FILE*file = fopen(f.c_str(), "rb");
+				REQUIRE(file == nullptr);
+			}
+		}
+	}
+}
+
+TEST_CASE("ExternalSortEmpty", "[ExternalSort]"){
+	vector<ExternalUInt64Sorter>sorter_list;
+	sorter_list.emplace_back("test_external_sort_tmp_empty_", 1024);
+	sorter_list[0].finish();
+	REQUIRE(sorter_list[0].get_run_file_list().empty());
+
+	bool was_called = false;
+	merge_sorted_runs(sorter_list, [&](uint64_t){was_called = true;});
+	REQUIRE(!was_called);
+}
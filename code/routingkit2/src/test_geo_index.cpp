@@ -1,5 +1,9 @@
 #include "geo_index.h"
+#include "map.h"
+#include "test_random_link_shapes.h"
 #include <random>
+#include <algorithm>
+#include <limits>
 
 #include "catch.hpp"
 
@@ -83,3 +87,137 @@ TEST_CASE("RandomPoints", "[GeoPosIndex]"){
 	}
 
 }
+
+TEST_CASE("ParallelBuild", "[GeoPosIndex]"){
+	std::minstd_rand gen;
+	gen.seed(seed);
+
+	// Large enough that the top frames are split with the parallel partition.
+	// Every fourth point is a duplicate, which yields many equal distances.
+	const uint32_t large_item_count = 300000;
+	std::vector<GeoPos>pos;
+	for(uint32_t i=0; i<large_item_count; ++i){
+		if(i % 4 == 3)
+			pos.push_back(pos[gen() % i]);
+		else
+			pos.push_back(rand_geo_pos(gen));
+	}
+
+	auto build = [&](unsigned thread_count){
+		GeoIndexBuilder builder;
+		for(uint32_t i=0; i<large_item_count; ++i)
+			builder.add(pos[i], i);
+		return builder.build(thread_count);
+	};
+
+	VecGeoIndex serial = build(1);
+	for(unsigned thread_count:{2, 3, 4}){
+		VecGeoIndex parallel = build(thread_count);
+		REQUIRE(parallel.id == serial.id);
+		REQUIRE(parallel.pos == serial.pos);
+	}
+
+	GeoIndexFindWithinRadiusQuery query(serial.as_cref());
+	for(uint32_t i=0; i<20; ++i){
+		GeoPos center = rand_geo_pos(gen);
+		uint32_t radius = 200000;
+
+		std::vector<bool>found(large_item_count, false);
+		query.start(center, radius);
+		while(auto next=query.next())
+			found[next->id] = true;
+
+		for(uint32_t j=0; j<large_item_count; ++j)
+			REQUIRE(found[j] == (compute_distance_in_cm(center, pos[j]) <= radius));
+	}
+}
+
+TEST_CASE("NearestPoints", "[GeoPosIndex]"){
+	std::minstd_rand gen;
+	gen.seed(seed);
+
+	std::vector<GeoPos>pos(item_count);
+	for(auto&p:pos)
+		p = rand_geo_pos(gen);
+
+	VecGeoIndex vec_geo_index;
+	{
+		GeoIndexBuilder builder;
+		for(uint32_t i=0; i<item_count; ++i)
+			builder.add(pos[i], i);
+		vec_geo_index = builder.build();
+	}
+
+	GeoIndexFindNearestQuery query(vec_geo_index.as_cref());
+
+	for(uint32_t k:{1, 7, 100}){
+		for(uint32_t max_distance:{100000u, std::numeric_limits<uint32_t>::max()}){
+			for(uint32_t i=0; i<test_query_count; ++i){
+				GeoPos center = rand_geo_pos(gen);
+
+				std::vector<uint64_t>expected;
+				for(uint32_t j=0; j<item_count; ++j)
+					if(compute_distance_in_cm(center, pos[j]) <= max_distance)
+						expected.push_back(compute_distance_in_sqr_cm(center, pos[j]));
+				std::sort(expected.begin(), expected.end());
+				if(expected.size() > k)
+					expected.resize(k);
+
+				std::vector<uint64_t>actual;
+				query.start(center, k, max_distance);
+				while(auto next=query.next()){
+					REQUIRE(next->pos == pos[next->id]);
+					REQUIRE(query.get_distance_in_sqr_cm() == compute_distance_in_sqr_cm(center, next->pos));
+					actual.push_back(query.get_distance_in_sqr_cm());
+				}
+
+				REQUIRE(actual == expected);
+			}
+		}
+	}
+}
+
+TEST_CASE("NearestLinks", "[GeoPosIndex]"){
+	std::minstd_rand gen;
+	gen.seed(seed);
+
+	const uint32_t node_count = 2000;
+	const uint32_t link_count = 3000;
+	VecLinkShapes map = generate_random_test_link_shapes(gen, node_count, link_count);
+
+	VecGeoIndex geo_index = build_link_geo_index(map.as_cref());
+	LinkGeoIndexFindNearestQuery query(map.as_cref(), geo_index.as_cref());
+
+	for(uint32_t k:{1, 5, 40}){
+		for(uint32_t max_distance:{30000u, std::numeric_limits<uint32_t>::max()}){
+			for(uint32_t i=0; i<100; ++i){
+				GeoPos center(generate_random_test_lat_lon(gen));
+
+				std::vector<uint64_t>expected;
+				for(uint32_t l=0; l<link_count; ++l){
+					uint64_t d = find_closest_point_offset_and_distance_on_dlink(map.as_cref(), link_to_forward_dlink(l), center).distance_in_sqr_cm;
+					if(sqr_cm_to_cm(d) <= max_distance)
+						expected.push_back(d);
+				}
+				std::sort(expected.begin(), expected.end());
+				if(expected.size() > k)
+					expected.resize(k);
+
+				std::vector<uint64_t>actual;
+				std::vector<bool>found(link_count, false);
+				query.start(center, k, max_distance);
+				while(auto next=query.next()){
+					REQUIRE(!found[next->link_id]);
+					found[next->link_id] = true;
+					auto q = find_closest_point_offset_and_distance_on_dlink(map.as_cref(), link_to_forward_dlink(next->link_id), center);
+					REQUIRE(next->distance_in_sqr_cm == q.distance_in_sqr_cm);
+					REQUIRE(next->offset_in_cm == q.offset_in_cm);
+					REQUIRE(next->pos == q.pos);
+					actual.push_back(next->distance_in_sqr_cm);
+				}
+
+				REQUIRE(actual == expected);
+			}
+		}
+	}
+}
@@ -0,0 +1,428 @@
+#include "http_server.h"
+
+#include "catch.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace RoutingKit2;
+
+namespace{
+	// Returns a port that is currently not in use. The kernel picks it when
+	// binding to port 0.
+	int find_free_port(){
+		int s = socket(AF_INET, SOCK_STREAM, 0);
+		REQUIRE(s >= 0);
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = 0;
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		REQUIRE(bind(s, (sockaddr*)&address, sizeof(address)) == 0);
+		socklen_t len = sizeof(address);
+		REQUIRE(getsockname(s, (sockaddr*)&address, &len) == 0);
+		close(s);
+		return ntohs(address.sin_port);
+	}
+
+	// Runs a server on a free port in a background thread. It answers every
+	// request with "<resource> <body size>" and is stopped by the destructor.
+	class TestServer{
+	public:
+		explicit TestServer(http::Config config_):config(config_), stop_flag(false), is_running(false){
+			config.port = find_free_port();
+			config.install_int_signal_handler = false;
+			config.stop_flag = &stop_flag;
+
+			server = std::thread([this]{
+				http::run(
+					config,
+					[](int, int, const http::Request&req, http::Response&res){
+						res.body = req.resource + " " + std::to_string(req.body.size());
+						res.mime_type = "text/plain";
+					},
+					[this]{
+						std::lock_guard<std::mutex>guard(lock);
+						is_running = true;
+						cv.notify_all();
+					}
+				);
+			});
+
+			std::unique_lock<std::mutex>guard(lock);
+			cv.wait(guard, [&]{return is_running;});
+		}
+
+		~TestServer(){
+			stop_flag.store(true);
+			server.join();
+		}
+
+		int port()const{
+			return config.port;
+		}
+
+	private:
+		http::Config config;
+		std::atomic<bool>stop_flag;
+		std::thread server;
+
+		std::mutex lock;
+		std::condition_variable cv;
+		bool is_running;
+	};
+
+	int connect_to(int port){
+		int s = socket(AF_INET, SOCK_STREAM, 0);
+		REQUIRE(s >= 0);
+
+		sockaddr_in address = {};
+		address.sin_family = AF_INET;
+		address.sin_port = htons(port);
+		address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		REQUIRE(connect(s, (sockaddr*)&address, sizeof(address)) == 0);
+		return s;
+	}
+
+	void set_receive_timeout(int s, std::chrono::milliseconds timeout){
+		timeval t;
+		t.tv_sec = timeout.count() / 1000;
+		t.tv_usec = (timeout.count() % 1000) * 1000;
+		REQUIRE(setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &t, sizeof(t)) == 0);
+	}
+
+	// The server stops reading once a request is bad, so a failed send is not
+	// an error.
+	void send_all(int s, const std::string&data){
+		std::size_t sent = 0;
+		while(sent < data.size()){
+			ssize_t r = send(s, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+			if(r <= 0)
+				break;
+			sent += r;
+		}
+	}
+
+	std::string make_post(const std::string&resource, const std::string&body, const std::string&extra_header = ""){
+		return
+			"POST " + resource + " HTTP/1.1\r\n" + extra_header +
+			"Content-Length:" + std::to_string(body.size()) + "\r\n\r\n" + body;
+	}
+
+	// A client connection that reads one response at a time. Bytes after the
+	// end of a response are kept for the next one.
+	class Client{
+	public:
+		explicit Client(int port):s(connect_to(port)){
+			set_receive_timeout(s, std::chrono::seconds(5));
+		}
+
+		~Client(){
+			if(s >= 0)
+				close(s);
+		}
+
+		void send(const std::string&data){
+			send_all(s, data);
+		}
+
+		void set_timeout(std::chrono::milliseconds timeout){
+			set_receive_timeout(s, timeout);
+		}
+
+		// Returns the next response including its header, or an empty string if
+		// the connection was closed or the timeout expired first.
+		std::string read_response(){
+			std::size_t header_end;
+			while((header_end = buffer.find("\r\n\r\n")) == std::string::npos)
+				if(!fill())
+					return std::string();
+			header_end += 4;
+
+			std::size_t body_size = 0;
+			std::size_t pos = buffer.find("Content-Length:");
+			if(pos != std::string::npos && pos < header_end)
+				body_size = std::stoul(buffer.substr(pos + 15));
+
+			while(buffer.size() < header_end + body_size)
+				if(!fill())
+					return std::string();
+
+			std::string response = buffer.substr(0, header_end + body_size);
+			buffer.erase(0, header_end + body_size);
+			return response;
+		}
+
+		// True if the server closed the connection.
+		bool is_closed(){
+			return buffer.empty() && !fill() && last_recv == 0;
+		}
+
+		void disconnect(){
+			close(s);
+			s = -1;
+		}
+
+	private:
+		int s;
+		std::string buffer;
+		ssize_t last_recv = 1;
+
+		bool fill(){
+			char tmp[4096];
+			last_recv = recv(s, tmp, sizeof(tmp), 0);
+			if(last_recv <= 0)
+				return false;
+			buffer.append(tmp, last_recv);
+			return true;
+		}
+	};
+
+	bool has_header(const std::string&response, const std::string&header){
+		return response.find("\r\n" + header + "\r\n") != std::string::npos;
+	}
+
+	std::string get_body(const std::string&response){
+		return response.substr(response.find("\r\n\r\n") + 4);
+	}
+}
+
+TEST_CASE("MaxRequestBodySize", "[HTTPServer]"){
+	// Larger than the default, as a /traffic request of the route server with
+	// 4 bytes per arc of a graph with 3M arcs.
+	const int body_size = 4*3000000;
+
+	http::Config config;
+	config.worker_count = 2;
+	config.max_request_body_size = body_size;
+	TestServer server(config);
+
+	{
+		Client client(server.port());
+		client.send(make_post("/traffic", std::string(body_size, 'x'), "Connection:close\r\n"));
+		std::string response = client.read_response();
+		REQUIRE(response.compare(0, 12, "HTTP/1.1 200") == 0);
+		REQUIRE(get_body(response) == "/traffic 12000000");
+	}
+
+	{
+		Client client(server.port());
+		client.send(make_post("/traffic", std::string(body_size+1, 'x'), "Connection:close\r\n"));
+		std::string response = client.read_response();
+		REQUIRE(response.compare(0, 16, "HTTP/1.1 400 Bad") == 0);
+		REQUIRE(client.is_closed());
+	}
+}
+
+TEST_CASE("BindAddress", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+
+	SECTION("IPv4 loopback"){
+		config.bind_address = "127.0.0.1";
+		TestServer server(config);
+		Client client(server.port());
+		client.send(make_post("/a", "x"));
+		REQUIRE(get_body(client.read_response()) == "/a 1");
+	}
+
+	SECTION("Invalid address"){
+		config.port = find_free_port();
+		config.install_int_signal_handler = false;
+		config.bind_address = "localhost";
+		REQUIRE_THROWS_AS(http::run(config, [](int, int, const http::Request&, http::Response&){}), std::runtime_error);
+	}
+}
+
+TEST_CASE("BodyArrivesInPieces", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	TestServer server(config);
+
+	Client client(server.port());
+	std::string request = make_post("/a", std::string(100000, 'x'));
+	for(std::size_t i=0; i<request.size(); i+=30000){
+		client.send(request.substr(i, 30000));
+		std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	}
+	REQUIRE(get_body(client.read_response()) == "/a 100000");
+
+	// The connection stays usable after a body that was larger than the kept
+	// buffer.
+	client.send(make_post("/b", "xyz"));
+	REQUIRE(get_body(client.read_response()) == "/b 3");
+}
+
+TEST_CASE("KeepAlive", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	TestServer server(config);
+
+	Client client(server.port());
+	for(int i=0; i<3; ++i){
+		client.send(make_post("/a", std::string(i, 'x')));
+		std::string response = client.read_response();
+		REQUIRE(has_header(response, "Connection:keep-alive"));
+		REQUIRE(get_body(response) == "/a " + std::to_string(i));
+	}
+}
+
+TEST_CASE("PipelinedRequests", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	TestServer server(config);
+
+	Client client(server.port());
+	client.send(make_post("/a", "x") + make_post("/b", "") + make_post("/c", "xyz", "Connection:close\r\n"));
+
+	REQUIRE(get_body(client.read_response()) == "/a 1");
+	REQUIRE(get_body(client.read_response()) == "/b 0");
+	std::string last = client.read_response();
+	REQUIRE(get_body(last) == "/c 3");
+	REQUIRE(has_header(last, "Connection:close"));
+	REQUIRE(client.is_closed());
+}
+
+TEST_CASE("HTTP10ConnectionClose", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	TestServer server(config);
+
+	SECTION("HTTP/1.0 closes by default"){
+		Client client(server.port());
+		client.send("GET /a HTTP/1.0\r\n\r\n");
+		std::string response = client.read_response();
+		REQUIRE(has_header(response, "Connection:close"));
+		REQUIRE(get_body(response) == "/a 0");
+		REQUIRE(client.is_closed());
+	}
+
+	SECTION("HTTP/1.0 with keep-alive"){
+		Client client(server.port());
+		client.send("GET /a HTTP/1.0\r\nConnection: Keep-Alive\r\n\r\n");
+		REQUIRE(has_header(client.read_response(), "Connection:keep-alive"));
+		client.send("GET /b HTTP/1.0\r\n\r\n");
+		REQUIRE(get_body(client.read_response()) == "/b 0");
+		REQUIRE(client.is_closed());
+	}
+
+	SECTION("HTTP/1.1 with close"){
+		Client client(server.port());
+		client.send("GET /a HTTP/1.1\r\nConnection: close\r\n\r\n");
+		REQUIRE(has_header(client.read_response(), "Connection:close"));
+		REQUIRE(client.is_closed());
+	}
+}
+
+TEST_CASE("IdleTimeout", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	config.timeout_in_seconds = 1;
+	TestServer server(config);
+
+	Client client(server.port());
+	client.send(make_post("/a", ""));
+	REQUIRE(get_body(client.read_response()) == "/a 0");
+
+	auto begin = std::chrono::steady_clock::now();
+	REQUIRE(client.is_closed());
+	auto idle_time = std::chrono::steady_clock::now() - begin;
+	REQUIRE(idle_time >= std::chrono::milliseconds(900));
+	REQUIRE(idle_time < std::chrono::seconds(4));
+}
+
+TEST_CASE("ConnectionLimitPerWorker", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	config.max_connection_count_per_worker = 2;
+	TestServer server(config);
+
+	Client first(server.port());
+	Client second(server.port());
+	first.send(make_post("/a", ""));
+	REQUIRE(get_body(first.read_response()) == "/a 0");
+	second.send(make_post("/b", ""));
+	REQUIRE(get_body(second.read_response()) == "/b 0");
+
+	// The third connection waits in the backlog.
+	Client third(server.port());
+	third.set_timeout(std::chrono::milliseconds(300));
+	third.send(make_post("/c", ""));
+	REQUIRE(third.read_response().empty());
+
+	first.disconnect();
+	third.set_timeout(std::chrono::seconds(5));
+	REQUIRE(get_body(third.read_response()) == "/c 0");
+
+	second.send(make_post("/b", ""));
+	REQUIRE(get_body(second.read_response()) == "/b 0");
+}
+
+TEST_CASE("PauseListeningWhenOutOfFileDescriptors", "[HTTPServer]"){
+	http::Config config;
+	config.worker_count = 1;
+	TestServer server(config);
+
+	rlimit old_limit;
+	REQUIRE(getrlimit(RLIMIT_NOFILE, &old_limit) == 0);
+
+	int lowest_free_fd = dup(0);
+	REQUIRE(lowest_free_fd >= 0);
+	close(lowest_free_fd);
+
+	rlimit new_limit = old_limit;
+	new_limit.rlim_cur = lowest_free_fd + 16;
+	REQUIRE(setrlimit(RLIMIT_NOFILE, &new_limit) == 0);
+
+	// Use up all file descriptors but one, which is taken by the client.
+	std::vector<int>filler;
+	for(;;){
+		int fd = dup(0);
+		if(fd < 0)
+			break;
+		filler.push_back(fd);
+	}
+	REQUIRE(!filler.empty());
+	close(filler.back());
+	filler.pop_back();
+
+	std::string response;
+	{
+		Client client(server.port());
+		client.set_timeout(std::chrono::milliseconds(300));
+		client.send(make_post("/a", ""));
+
+		// The server cannot accept the connection. It must pause instead of
+		// retrying accept4 in a busy loop.
+		timespec cpu_begin, cpu_end;
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_begin);
+		response = client.read_response();
+		clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &cpu_end);
+		double cpu_time_in_s = (cpu_end.tv_sec - cpu_begin.tv_sec) + (cpu_end.tv_nsec - cpu_begin.tv_nsec) / 1e9;
+
+		for(int fd:filler)
+			close(fd);
+		REQUIRE(setrlimit(RLIMIT_NOFILE, &old_limit) == 0);
+
+		REQUIRE(response.empty());
+		REQUIRE(cpu_time_in_s < 0.15);
+
+		// Once file descriptors are available again, the connection is accepted.
+		client.set_timeout(std::chrono::seconds(5));
+		response = client.read_response();
+	}
+	REQUIRE(get_body(response) == "/a 0");
+}
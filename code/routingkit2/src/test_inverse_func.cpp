@@ -1,5 +1,7 @@
 #include "inverse_func.h"
 #include <limits>
+#include <random>
+#include <algorithm>
 
 #include "catch.hpp"
 
@@ -31,3 +33,23 @@ TEST_CASE("InverseFuncRoundTrip", "[InverseFunc]"){
 
 	REQUIRE(func == invert_inverse_func(inv_func));
 }
+
+TEST_CASE("ParallelInverseFunc", "[InverseFunc]"){
+	std::minstd_rand rng(42);
+	for(uint32_t element_count:{0u, 1u, 100u, 500000u}){
+		for(uint32_t func_size:{0u, 7u, 300000u}){
+			if(element_count == 0 && func_size != 0)
+				continue;
+			vector<uint32_t>func(func_size);
+			for(auto&x:func)
+				x = (rng() % 8 == 0) ? element_count-1 : rng() % element_count;
+			sort(func.begin(), func.end());
+
+			auto inv_func = invert_func(func, element_count);
+			for(unsigned thread_count:{2u, 5u, 0u}){
+				REQUIRE(invert_func(func, element_count, thread_count) == inv_func);
+				REQUIRE(invert_inverse_func(inv_func, thread_count) == func);
+			}
+		}
+	}
+}
@@ -0,0 +1,75 @@
+#include "link_snapper.h"
+#include "geo_index.h"
+#include "map.h"
+#include "test_random_link_shapes.h"
+#include <random>
+#include <limits>
+
+#include "catch.hpp"
+
+using namespace RoutingKit2;
+using namespace std;
+
+TEST_CASE("SnapPointsToLinks", "[LinkSnapper]"){
+	std::minstd_rand gen;
+	gen.seed(42);
+
+	const uint32_t node_count = 2000;
+	const uint32_t link_count = 3000;
+	VecLinkShapes map = generate_random_test_link_shapes(gen, node_count, link_count);
+
+	VecGeoIndex geo_index = build_link_geo_index(map.as_cref());
+
+	std::vector<LatLon>point;
+	for(uint32_t i=0; i<500; ++i)
+		point.push_back(generate_random_test_lat_lon(gen));
+	// Points on nodes and shape points
+	for(uint32_t i=0; i<50; ++i){
+		point.push_back(map.node_pos[gen() % node_count]);
+		point.push_back(map.shape_pos[gen() % map.shape_pos_count]);
+	}
+
+	for(uint32_t max_distance:{5000u, std::numeric_limits<uint32_t>::max()}){
+		LinkSnapper snapper(map.as_cref(), geo_index.as_cref(), 1);
+		std::vector<SnappedPoint>result = snapper.snap(point, max_distance);
+		REQUIRE(result.size() == point.size());
+
+		for(uint32_t i=0; i<point.size(); ++i){
+			GeoPos center(point[i]);
+
+			uint32_t expected_link = invalid_snapped_link_id;
+			GeoPosOffsetAndDistance expected;
+			for(uint32_t l=0; l<link_count; ++l){
+				auto q = find_closest_point_offset_and_distance_on_dlink(map.as_cref(), link_to_forward_dlink(l), center);
+				if(sqr_cm_to_cm(q.distance_in_sqr_cm) > max_distance)
+					continue;
+				if(expected_link == invalid_snapped_link_id || q.distance_in_sqr_cm < expected.distance_in_sqr_cm){
+					expected_link = l;
+					expected = q;
+				}
+			}
+
+			REQUIRE(result[i].link_id == expected_link);
+			if(expected_link != invalid_snapped_link_id){
+				REQUIRE(result[i].distance_in_sqr_cm == expected.distance_in_sqr_cm);
+				REQUIRE(result[i].offset_in_cm == expected.offset_in_cm);
+			}
+		}
+
+		LinkSnapper parallel_snapper(map.as_cref(), geo_index.as_cref(), 4);
+		std::vector<SnappedPoint>parallel_result = parallel_snapper.snap(point, max_distance);
+		for(uint32_t i=0; i<point.size(); ++i){
+			REQUIRE(parallel_result[i].link_id == result[i].link_id);
+			REQUIRE(parallel_result[i].offset_in_cm == result[i].offset_in_cm);
+			REQUIRE(parallel_result[i].distance_in_sqr_cm == result[i].distance_in_sqr_cm);
+		}
+
+		// The second call reuses the workers of the first one.
+		std::vector<SnappedPoint>reused_result = parallel_snapper.snap(point, max_distance);
+		for(uint32_t i=0; i<point.size(); ++i){
+			REQUIRE(reused_result[i].link_id == result[i].link_id);
+			REQUIRE(reused_result[i].offset_in_cm == result[i].offset_in_cm);
+			REQUIRE(reused_result[i].distance_in_sqr_cm == result[i].distance_in_sqr_cm);
+		}
+	}
+}
@@ -2,6 +2,8 @@
 
 #include "catch.hpp"
 
+#include <random>
+
 using namespace RoutingKit2;
 
 TEST_CASE("DLink", "[Map]"){
@@ -23,3 +25,24 @@ TEST_CASE("DLink", "[Map]"){
 		REQUIRE(r == link_to_backward_dlink(l));
 	}
 }
+
+TEST_CASE("ParallelBuildAdjArray", "[Map]"){
+	std::minstd_rand rng(42);
+	for(uint32_t node_count:{1u, 5u, 1000u, 300000u}){
+		for(uint32_t link_count:{0u, 10u, 400000u}){
+			VecLinkEnds map(node_count, link_count);
+			for(uint32_t l=0; l<link_count; ++l){
+				// Skewed heads such that some node ranges get far more dlinks than others.
+				map.link_tail[l] = rng() % node_count;
+				map.link_head[l] = (rng() % 4 == 0) ? map.link_tail[l] : (rng() % (node_count/4+1)) % node_count;
+			}
+
+			auto expected = build_adj_array(map.as_cref());
+			for(unsigned thread_count:{2u, 3u, 16u, 0u}){
+				auto actual = build_adj_array(map.as_cref(), thread_count);
+				REQUIRE(actual.first_outgoing_dlink_index_of_node == expected.first_outgoing_dlink_index_of_node);
+				REQUIRE(actual.outgoing_dlink == expected.outgoing_dlink);
+			}
+		}
+	}
+}
@@ -0,0 +1,216 @@
+#include "osm_change.h"
+
+#include "catch.hpp"
+
+using namespace RoutingKit2;
+
+TEST_CASE("ParseOSMChange", "[OSMChange]"){
+	const char*xml =
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<osmChange version=\"0.6\">\n"
+		"<!-- <node id=\"9\" lat=\"1\" lon=\"1\"/> -->\n"
+		"<create>\n"
+		"  <node id=\"5\" lat=\"48.5\" lon=\"8.25\"/>\n"
+		"  <node id='5' lat='48.75' lon='8.5'/>\n"
+		"</create>\n"
+		"<modify>\n"
+		"  <way id=\"7\" version=\"2\">\n"
+		"    <nd ref=\"1\"/>\n"
+		"    <nd ref=\"5\"/>\n"
+		"    <tag k=\"highway\" v=\"primary\"/>\n"
+		"    <tag k=\"name\" v=\"A &amp; &quot;B&quot; &#x41;\"/>\n"
+		"  </way>\n"
+		"</modify>\n"
+		"<delete>\n"
+		"  <node id=\"6\"/>\n"
+		"  <relation id=\"3\">\n"
+		"    <member type=\"way\" ref=\"7\" role=\"from\"/>\n"
+		"  </relation>\n"
+		"</delete>\n"
+		"</osmChange>\n";
+
+	OSMChange change = parse_osm_change(xml);
+
+	REQUIRE(change.node_list.size() == 2);
+	REQUIRE(change.node_list[0].osm_id == 5);
+	REQUIRE(change.node_list[0].action == OSMChangeAction::create);
+	REQUIRE(change.node_list[0].pos == LatLon::from_lat_lon(48.75, 8.5));
+	REQUIRE(change.node_list[1].osm_id == 6);
+	REQUIRE(change.node_list[1].action == OSMChangeAction::remove);
+
+	REQUIRE(change.way_list.size() == 1);
+	REQUIRE(change.way_list[0].action == OSMChangeAction::modify);
+	REQUIRE(change.way_list[0].node_osm_id_list == std::vector<uint64_t>{1, 5});
+	REQUIRE(change.way_list[0].tags.size() == 2);
+	REQUIRE(change.way_list[0].tags[1].second == "A & \"B\" A");
+
+	REQUIRE(change.relation_list.size() == 1);
+	REQUIRE(change.relation_list[0].action == OSMChangeAction::remove);
+	REQUIRE(change.relation_list[0].member_list.size() == 1);
+	REQUIRE(change.relation_list[0].member_list[0].type == OSMIDType::way);
+	REQUIRE(change.relation_list[0].member_list[0].role == "from");
+}
+
+TEST_CASE("ApplyOSMChange", "[OSMChange]"){
+	// Way 100 goes through the nodes 10, 15 and 20. Node 15 is a shape node.
+	VecOSMCarRoads map;
+	map.node_count = 2;
+	map.link_count = 1;
+	map.shape_pos_count = 1;
+	map.forbidden_maneuver_count = 0;
+	map.forbidden_maneuver_dlink_count = 0;
+	map.way_count = 1;
+	map.node_osm_id = {10, 20};
+	map.node_pos = {LatLon::from_lat_lon(48.0, 8.0), LatLon::from_lat_lon(48.0, 8.002)};
+	map.link_tail = {0};
+	map.link_head = {1};
+	map.link_length_in_cm = {14880};
+	map.first_shape_pos_of_link = {0, 1};
+	map.shape_pos = {LatLon::from_lat_lon(48.0, 8.001)};
+	map.shape_osm_id = {15};
+	map.dlink_traversal_time_in_ms = {10728, 10728};
+	map.first_dlink_of_forbidden_maneuver = {0};
+	map.first_link_of_way = {0, 1};
+	map.way_osm_id = {100};
+
+	SECTION("NewWay"){
+		OSMChange change;
+		change.node_list.push_back({OSMChangeAction::create, 30, LatLon::from_lat_lon(48.001, 8.002)});
+		change.node_list.push_back({OSMChangeAction::create, 40, LatLon::from_lat_lon(48.002, 8.002)});
+		change.way_list.push_back({OSMChangeAction::create, 50, {20, 30, 40}, {{"highway", "primary"}}});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.is_complete());
+		REQUIRE(result.rebuilt_way_count == 1);
+		REQUIRE(result.added_node_count == 1);
+
+		REQUIRE(map.node_osm_id == std::vector<uint64_t>{10, 20, 40});
+		REQUIRE(map.way_osm_id == std::vector<uint64_t>{50, 100});
+		REQUIRE(map.link_count == 2);
+		REQUIRE(map.link_tail == std::vector<uint32_t>{1, 0});
+		REQUIRE(map.link_head == std::vector<uint32_t>{2, 1});
+		REQUIRE(map.shape_pos.size() == 2);
+		REQUIRE(map.shape_pos[0] == LatLon::from_lat_lon(48.001, 8.002));
+		REQUIRE(map.link_length_in_cm[1] == 14880);
+		REQUIRE(map.dlink_traversal_time_in_ms[2] == 10728);
+		throw_if_osm_car_roads_invalid(map.as_cref());
+	}
+
+	SECTION("MovedShapeNode"){
+		OSMChange change;
+		change.node_list.push_back({OSMChangeAction::modify, 15, LatLon::from_lat_lon(48.0005, 8.001)});
+		change.way_list.push_back({OSMChangeAction::modify, 100, {10, 15, 20}, {{"highway", "primary"}}});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.is_complete());
+		REQUIRE(map.link_count == 1);
+		REQUIRE(map.shape_pos[0] == LatLon::from_lat_lon(48.0005, 8.001));
+		REQUIRE(map.link_length_in_cm[0] > 14880);
+	}
+
+	SECTION("UnknownShapeNode"){
+		OSMChange change;
+		change.way_list.push_back({OSMChangeAction::modify, 100, {10, 15, 16, 20}, {{"highway", "primary"}}});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.unpatched_way_osm_id == std::vector<uint64_t>{100});
+		REQUIRE(map.shape_pos[0] == LatLon::from_lat_lon(48.0, 8.001));
+	}
+
+	SECTION("CreatedRestriction"){
+		OSMChange change;
+		change.node_list.push_back({OSMChangeAction::create, 30, LatLon::from_lat_lon(48.001, 8.002)});
+		change.way_list.push_back({OSMChangeAction::create, 50, {20, 30}, {{"highway", "primary"}}});
+		change.relation_list.push_back({
+			OSMChangeAction::create, 60,
+			{{OSMIDType::way, 100, "from"}, {OSMIDType::node, 20, "via"}, {OSMIDType::way, 50, "to"}},
+			{{"type", "restriction"}, {"restriction", "no_left_turn"}}
+		});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.is_complete());
+		REQUIRE(map.way_osm_id == std::vector<uint64_t>{50, 100});
+		REQUIRE(map.forbidden_maneuver_count == 1);
+		REQUIRE(map.forbidden_maneuver_osm_id == std::vector<uint64_t>{60});
+		REQUIRE(map.forbidden_maneuver_dlink == std::vector<uint32_t>{link_to_forward_dlink(1), link_to_forward_dlink(0)});
+		throw_if_osm_car_roads_invalid(map.as_cref());
+	}
+
+	SECTION("ModifiedShapeNodeOfUnchangedWay"){
+		// Node 15 becomes a routing node that splits way 100, which is not part of
+		// the change.
+		OSMChange change;
+		change.node_list.push_back({OSMChangeAction::modify, 15, LatLon::from_lat_lon(48.0005, 8.001)});
+		change.node_list.push_back({OSMChangeAction::create, 30, LatLon::from_lat_lon(48.001, 8.001)});
+		change.way_list.push_back({OSMChangeAction::create, 50, {15, 30}, {{"highway", "primary"}}});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.is_complete());
+		REQUIRE(result.split_way_count == 1);
+		REQUIRE(result.added_node_count == 2);
+
+		REQUIRE(map.node_osm_id == std::vector<uint64_t>{10, 15, 20, 30});
+		REQUIRE(map.node_pos[1] == LatLon::from_lat_lon(48.0005, 8.001));
+		REQUIRE(map.way_osm_id == std::vector<uint64_t>{50, 100});
+		REQUIRE(map.link_tail == std::vector<uint32_t>{1, 0, 1});
+		REQUIRE(map.link_head == std::vector<uint32_t>{3, 1, 2});
+		REQUIRE(map.first_link_of_way == std::vector<uint32_t>{0, 1, 3});
+		REQUIRE(map.shape_pos_count == 0);
+		REQUIRE(map.shape_osm_id.empty());
+		REQUIRE(map.link_length_in_cm[1] + map.link_length_in_cm[2] > 14880);
+		for(uint32_t l=1; l<3; ++l)
+			REQUIRE(map.dlink_traversal_time_in_ms[link_to_forward_dlink(l)] == 10728ull * map.link_length_in_cm[l] / 14880);
+		throw_if_osm_car_roads_invalid(map.as_cref());
+	}
+
+	SECTION("SplitLinkKeepsRestriction"){
+		// Way 200 continues way 100 from node 20 to 25. A U-turn restriction from way
+		// 200 over node 20 onto way 100 must move onto the part of way 100 next to
+		// node 20 when way 100 is split at node 15.
+		map.node_count = 3;
+		map.link_count = 2;
+		map.way_count = 2;
+		map.node_osm_id = {10, 20, 25};
+		map.node_pos.push_back(LatLon::from_lat_lon(48.0, 8.003));
+		map.link_tail = {0, 1};
+		map.link_head = {1, 2};
+		map.link_length_in_cm = {14880, 7440};
+		map.first_shape_pos_of_link = {0, 1, 1};
+		map.dlink_traversal_time_in_ms = {10728, 10728, 5364, 5364};
+		map.first_link_of_way = {0, 1, 2};
+		map.way_osm_id = {100, 200};
+		map.forbidden_maneuver_count = 1;
+		map.forbidden_maneuver_dlink_count = 2;
+		map.first_dlink_of_forbidden_maneuver = {0, 2};
+		map.forbidden_maneuver_dlink = {link_to_backward_dlink(1), link_to_backward_dlink(0)};
+		map.forbidden_maneuver_osm_id = {300};
+		throw_if_osm_car_roads_invalid(map.as_cref());
+
+		OSMChange change;
+		change.node_list.push_back({OSMChangeAction::create, 30, LatLon::from_lat_lon(48.001, 8.001)});
+		change.way_list.push_back({OSMChangeAction::create, 50, {15, 30}, {{"highway", "primary"}}});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.is_complete());
+		REQUIRE(result.split_way_count == 1);
+
+		REQUIRE(map.node_osm_id == std::vector<uint64_t>{10, 15, 20, 25, 30});
+		REQUIRE(map.way_osm_id == std::vector<uint64_t>{50, 100, 200});
+		REQUIRE(map.link_tail == std::vector<uint32_t>{1, 0, 1, 2});
+		REQUIRE(map.link_head == std::vector<uint32_t>{4, 1, 2, 3});
+		REQUIRE(map.forbidden_maneuver_osm_id == std::vector<uint64_t>{300});
+		REQUIRE(map.forbidden_maneuver_dlink == std::vector<uint32_t>{link_to_backward_dlink(3), link_to_backward_dlink(2)});
+		throw_if_osm_car_roads_invalid(map.as_cref());
+	}
+
+	SECTION("RemovedWay"){
+		OSMChange change;
+		change.way_list.push_back({OSMChangeAction::modify, 100, {10, 15, 20}, {{"highway", "footway"}}});
+
+		OSMChangeResult result = apply_osm_change(map, change);
+		REQUIRE(result.removed_way_count == 1);
+		REQUIRE(map.link_count == 0);
+		REQUIRE(map.way_count == 0);
+		REQUIRE(map.node_count == 2);
+	}
+}
@@ -0,0 +1,300 @@
+#include "osm_decoder.h"
+
+#include "catch.hpp"
+
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <stdint.h>
+#include <stdio.h>
+
+using namespace RoutingKit2;
+using namespace std;
+
+namespace{
+
+struct test_exception{};
+
+void put_var_uint(vector<uint8_t>&out, uint64_t x){
+	while(x >= 0x80){
+		out.push_back((x & 0x7F) | 0x80);
+		x >>= 7;
+	}
+	out.push_back(x);
+}
+
+void put_uint_field(vector<uint8_t>&out, uint64_t key_id, uint64_t x){
+	put_var_uint(out, key_id << 3);
+	put_var_uint(out, x);
+}
+
+void put_bytes_field(vector<uint8_t>&out, uint64_t key_id, const vector<uint8_t>&bytes){
+	put_var_uint(out, (key_id << 3) | 2);
+	put_var_uint(out, bytes.size());
+	out.insert(out.end(), bytes.begin(), bytes.end());
+}
+
+void put_bytes_field(vector<uint8_t>&out, uint64_t key_id, const string&str){
+	put_bytes_field(out, key_id, vector<uint8_t>(str.begin(), str.end()));
+}
+
+// A way with the nodes 1 and 2 and without tags. If has_id is false, the OSM ID
+// is missing, which the decoder reports as error.
+vector<uint8_t> encode_way(uint64_t osm_way_id, bool has_id = true){
+	vector<uint8_t>way;
+	if(has_id)
+		put_uint_field(way, 1, osm_way_id);
+	vector<uint8_t>node_list;
+	put_var_uint(node_list, 2); // zigzag encoded delta +1
+	put_var_uint(node_list, 2);
+	put_bytes_field(way, 8, node_list);
+	return way;
+}
+
+// Writes an OSM PBF file without header block and with uncompressed blobs.
+// Block i contains the ways block_way_list[i]. The way with OSM ID broken_way_id
+// is written without its ID.
+void write_test_pbf(const string&file_name, const vector<vector<uint64_t>>&block_way_list, uint64_t broken_way_id = 0){
+	vector<uint8_t>file;
+	for(auto&way_list:block_way_list){
+		vector<uint8_t>group;
+		for(uint64_t w:way_list)
+			put_bytes_field(group, 3, encode_way(w, w != broken_way_id));
+
+		vector<uint8_t>string_table;
+		put_bytes_field(string_table, 1, string(""));
+
+		vector<uint8_t>block;
+		put_bytes_field(block, 1, string_table);
+		put_bytes_field(block, 2, group);
+
+		vector<uint8_t>blob;
+		put_bytes_field(blob, 1, block);
+		put_uint_field(blob, 2, block.size());
+
+		vector<uint8_t>blob_header;
+		put_bytes_field(blob_header, 1, string("OSMData"));
+		put_uint_field(blob_header, 3, blob.size());
+
+		uint32_t header_size = blob_header.size();
+		for(int i=3; i>=0; --i)
+			file.push_back((header_size >> (8*i)) & 0xFF);
+		file.insert(file.end(), blob_header.begin(), blob_header.end());
+		file.insert(file.end(), blob.begin(), blob.end());
+	}
+
+	FILE*f = fopen(file_name.c_str(), "wb");
+	REQUIRE(f != nullptr);
+	REQUIRE(fwrite(file.data(), 1, file.size(), f) == file.size());
+	fclose(f);
+}
+
+// The ways are numbered from 1 in file order. The block sizes vary, so the
+// decoding of the blocks finishes in a different order than they start.
+vector<vector<uint64_t>> generate_block_way_list(){
+	vector<vector<uint64_t>>block_way_list;
+	uint64_t next_way_id = 1;
+	for(unsigned i=0; i<50; ++i){
+		unsigned way_count = i % 7 == 0 ? 2000 : 1 + i % 5;
+		block_way_list.emplace_back();
+		for(unsigned j=0; j<way_count; ++j)
+			block_way_list.back().push_back(next_way_id++);
+	}
+	return block_way_list;
+}
+
+vector<uint64_t> concat(const vector<vector<uint64_t>>&block_way_list){
+	vector<uint64_t>way_list;
+	for(auto&b:block_way_list)
+		way_list.insert(way_list.end(), b.begin(), b.end());
+	return way_list;
+}
+
+// Checks that the ways of every block are delivered consecutively and in file
+// order, i.e., that blocks are not interleaved.
+void require_whole_blocks(const vector<uint64_t>&way_list, const vector<vector<uint64_t>>&block_way_list){
+	vector<unsigned>block_of_way(1);
+	for(unsigned i=0; i<block_way_list.size(); ++i)
+		for(size_t j=0; j<block_way_list[i].size(); ++j)
+			block_of_way.push_back(i);
+
+	size_t pos = 0;
+	while(pos < way_list.size()){
+		const auto&block = block_way_list[block_of_way[way_list[pos]]];
+		REQUIRE(pos + block.size() <= way_list.size());
+		REQUIRE(equal(block.begin(), block.end(), way_list.begin() + pos));
+		pos += block.size();
+	}
+}
+
+const char*test_file_name = "test_osm_decoder_tmp.pbf";
+
+}
+
+TEST_CASE("OrderedReadOsmPbfKeepsFileOrder", "[OsmDecoder]"){
+	auto block_way_list = generate_block_way_list();
+	write_test_pbf(test_file_name, block_way_list);
+
+	for(unsigned thread_count:{1, 4, 0}){
+		vector<uint64_t>way_list;
+		ordered_read_osm_pbf(
+			test_file_name,
+			nullptr,
+			[&](uint64_t osm_way_id, Span<const uint64_t>osm_node_id_list, const TagMap&){
+				REQUIRE(osm_node_id_list.size() == 2);
+				way_list.push_back(osm_way_id);
+			},
+			nullptr,
+			[](std::string){},
+			true,
+			thread_count
+		);
+		REQUIRE(way_list == concat(block_way_list));
+	}
+
+	remove(test_file_name);
+}
+
+TEST_CASE("UnorderedReadOsmPbfDeliversWholeBlocks", "[OsmDecoder]"){
+	auto block_way_list = generate_block_way_list();
+	write_test_pbf(test_file_name, block_way_list);
+
+	for(unsigned thread_count:{1, 4, 0}){
+		vector<uint64_t>way_list;
+		unordered_read_osm_pbf(
+			test_file_name,
+			nullptr,
+			[&](uint64_t osm_way_id, Span<const uint64_t>, const TagMap&){
+				way_list.push_back(osm_way_id);
+			},
+			nullptr,
+			[](std::string){},
+			thread_count
+		);
+		require_whole_blocks(way_list, block_way_list);
+		sort(way_list.begin(), way_list.end());
+		REQUIRE(way_list == concat(block_way_list));
+	}
+
+	remove(test_file_name);
+}
+
+TEST_CASE("ConcurrentUnorderedReadOsmPbfShardsByWorker", "[OsmDecoder]"){
+	auto block_way_list = generate_block_way_list();
+	write_test_pbf(test_file_name, block_way_list);
+
+	for(unsigned thread_count:{1, 4, 0}){
+		unsigned worker_count = thread_count;
+		if(worker_count == 0)
+			worker_count = max(std::thread::hardware_concurrency(), 1u);
+
+		vector<vector<uint64_t>>way_list_of_worker(worker_count);
+		concurrent_unordered_read_osm_pbf(
+			test_file_name,
+			thread_count,
+			nullptr,
+			[&](unsigned worker_id, uint64_t osm_way_id, Span<const uint64_t>, const TagMap&){
+				if(worker_id >= worker_count)
+					throw std::runtime_error("worker id out of range");
+				way_list_of_worker[worker_id].push_back(osm_way_id);
+			},
+			nullptr,
+			[](std::string){}
+		);
+
+		vector<uint64_t>way_list;
+		for(auto&w:way_list_of_worker){
+			require_whole_blocks(w, block_way_list);
+			way_list.insert(way_list.end(), w.begin(), w.end());
+		}
+		sort(way_list.begin(), way_list.end());
+		REQUIRE(way_list == concat(block_way_list));
+	}
+
+	remove(test_file_name);
+}
+
+TEST_CASE("ReadOsmPbfPropagatesDecodingErrors", "[OsmDecoder]"){
+	auto block_way_list = generate_block_way_list();
+	write_test_pbf(test_file_name, block_way_list, block_way_list[20][0]);
+
+	for(unsigned thread_count:{1, 4}){
+		REQUIRE_THROWS_AS(
+			ordered_read_osm_pbf(test_file_name, nullptr, [](uint64_t, Span<const uint64_t>, const TagMap&){}, nullptr, [](std::string){}, true, thread_count),
+			std::runtime_error
+		);
+		REQUIRE_THROWS_AS(
+			unordered_read_osm_pbf(test_file_name, nullptr, [](uint64_t, Span<const uint64_t>, const TagMap&){}, nullptr, [](std::string){}, thread_count),
+			std::runtime_error
+		);
+		REQUIRE_THROWS_AS(
+			concurrent_unordered_read_osm_pbf(test_file_name, thread_count, nullptr, [](unsigned, uint64_t, Span<const uint64_t>, const TagMap&){}, nullptr),
+			std::runtime_error
+		);
+	}
+
+	remove(test_file_name);
+}
+
+TEST_CASE("ReadOsmPbfPropagatesCallbackExceptions", "[OsmDecoder]"){
+	auto block_way_list = generate_block_way_list();
+	write_test_pbf(test_file_name, block_way_list);
+	const uint64_t throwing_way_id = block_way_list[30][0];
+
+	for(unsigned thread_count:{1, 4}){
+		// In file order, no way behind the throwing one may be delivered.
+		vector<uint64_t>way_list;
+		REQUIRE_THROWS_AS(
+			ordered_read_osm_pbf(
+				test_file_name,
+				nullptr,
+				[&](uint64_t osm_way_id, Span<const uint64_t>, const TagMap&){
+					if(osm_way_id == throwing_way_id)
+						throw test_exception();
+					way_list.push_back(osm_way_id);
+				},
+				nullptr,
+				[](std::string){},
+				true,
+				thread_count
+			),
+			test_exception
+		);
+		vector<uint64_t>expected_way_list = concat(block_way_list);
+		expected_way_list.resize(throwing_way_id-1);
+		REQUIRE(way_list == expected_way_list);
+
+		REQUIRE_THROWS_AS(
+			unordered_read_osm_pbf(
+				test_file_name,
+				nullptr,
+				[&](uint64_t osm_way_id, Span<const uint64_t>, const TagMap&){
+					if(osm_way_id == throwing_way_id)
+						throw test_exception();
+				},
+				nullptr,
+				[](std::string){},
+				thread_count
+			),
+			test_exception
+		);
+
+		REQUIRE_THROWS_AS(
+			concurrent_unordered_read_osm_pbf(
+				test_file_name,
+				thread_count,
+				nullptr,
+				[&](unsigned, uint64_t osm_way_id, Span<const uint64_t>, const TagMap&){
+					if(osm_way_id == throwing_way_id)
+						throw test_exception();
+				},
+				nullptr
+			),
+			test_exception
+		);
+	}
+
+	remove(test_file_name);
+}
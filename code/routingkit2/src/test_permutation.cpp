@@ -79,3 +79,25 @@ TEST_CASE("random_permutation", "[Permutation]"){
 	auto q = random_permutation(10, std::minstd_rand0(42));
 	REQUIRE(is_permutation(q));
 }
+
+TEST_CASE("parallel_permutation", "[Permutation]"){
+	std::minstd_rand rng(42);
+	for(unsigned n:{0u, 1u, 1000u, 500000u}){
+		P p = random_permutation(n, rng);
+		P v(n);
+		for(auto&x:v)
+			x = rng();
+
+		P expected_inv_p = invert_permutation(p);
+		P expected_apply = apply_permutation(p, v);
+		P expected_inverse_apply = apply_inverse_permutation(p, v);
+		P expected_elements = apply_permutation_to_elements_of(p, expected_inv_p);
+
+		for(unsigned thread_count:{1u, 2u, 7u, 0u}){
+			REQUIRE(invert_permutation(p, thread_count) == expected_inv_p);
+			REQUIRE(apply_permutation(p, v, thread_count) == expected_apply);
+			REQUIRE(apply_inverse_permutation(p, v, thread_count) == expected_inverse_apply);
+			REQUIRE(apply_permutation_to_elements_of(p, expected_inv_p, thread_count) == expected_elements);
+		}
+	}
+}
@@ -0,0 +1,29 @@
+#include "prefix_sum.h"
+#include <random>
+
+#include "catch.hpp"
+
+using namespace RoutingKit2;
+using namespace std;
+
+TEST_CASE("PrefixSum", "[PrefixSum]"){
+	vector<uint32_t>v = {3, 0, 2, 5};
+	compute_prefix_sum(v);
+	REQUIRE(v == (vector<uint32_t>{0, 3, 3, 5}));
+}
+
+TEST_CASE("ParallelPrefixSum", "[PrefixSum]"){
+	std::minstd_rand rng(42);
+	for(uint32_t n:{0u, 1u, 1000u, 500000u}){
+		vector<uint32_t>v(n);
+		for(auto&x:v)
+			x = rng() % 1000;
+		auto expected = v;
+		compute_prefix_sum(expected);
+		for(unsigned thread_count:{1u, 2u, 7u, 0u}){
+			auto actual = v;
+			compute_prefix_sum(actual, thread_count);
+			REQUIRE(actual == expected);
+		}
+	}
+}
@@ -0,0 +1,59 @@
+#ifndef ROUTING_KIT2_TEST_RANDOM_LINK_SHAPES_H
+#define ROUTING_KIT2_TEST_RANDOM_LINK_SHAPES_H
+
+#include "map.h"
+#include "geo_pos.h"
+#include <random>
+#include <stdint.h>
+
+namespace RoutingKit2{
+
+// Test helper: a uniformly random position in a 20km x 20km area.
+inline LatLon generate_random_test_lat_lon(std::minstd_rand&gen){
+	return LatLon::from_lat_lon_in_decamicrodeg(4800000 + gen() % 18000, 800000 + gen() % 27000);
+}
+
+// Test helper: random links between random nodes in the area of
+// generate_random_test_lat_lon. Most links have up to two shape points, some
+// have enough to fill several vector registers. Shape points are either random
+// or close to the previous point. Many links are longer than the sampling
+// distance of the geo index.
+inline VecLinkShapes generate_random_test_link_shapes(std::minstd_rand&gen, uint32_t node_count, uint32_t link_count){
+	VecLinkShapes map;
+	map.node_count = node_count;
+	map.link_count = link_count;
+	for(uint32_t i=0; i<node_count; ++i)
+		map.node_pos.push_back(generate_random_test_lat_lon(gen));
+	map.first_shape_pos_of_link.push_back(0);
+	for(uint32_t l=0; l<link_count; ++l){
+		uint32_t tail = gen() % node_count;
+		uint32_t head = gen() % node_count;
+		map.link_tail.push_back(tail);
+		map.link_head.push_back(head);
+
+		LatLon prev_lat_lon = map.node_pos[tail];
+		GeoPos prev(prev_lat_lon);
+		uint32_t length = 0;
+		uint32_t shape_count = gen() % 4 == 0 ? gen() % 20 : gen() % 3;
+		for(uint32_t i=0; i<shape_count; ++i){
+			LatLon shape;
+			if(gen() % 2 == 0)
+				shape = generate_random_test_lat_lon(gen);
+			else
+				shape = LatLon::from_lat_lon_in_decamicrodeg(prev_lat_lon.lat_in_decamicrodeg + gen() % 201 - 100, prev_lat_lon.lon_in_decamicrodeg + gen() % 201 - 100);
+			map.shape_pos.push_back(shape);
+			length += compute_distance_in_cm(prev, GeoPos(shape));
+			prev_lat_lon = shape;
+			prev = GeoPos(shape);
+		}
+		length += compute_distance_in_cm(prev, GeoPos(map.node_pos[head]));
+		map.link_length_in_cm.push_back(length);
+		map.first_shape_pos_of_link.push_back(map.shape_pos.size());
+	}
+	map.shape_pos_count = map.shape_pos.size();
+	return map;
+}
+
+} // RoutingKit2
+
+#endif
@@ -189,3 +189,34 @@ TEST_CASE("StableInverseSortPoint", "[Sort]"){
 		REQUIRE(q == compute_inverse_stable_sort_permutation_using_comparator(v, is_less));
 	}
 }
+
+TEST_CASE("ParallelSort", "[Sort]"){
+	std::minstd_rand rng(42);
+	unsigned thread_count_list[] = {1, 2, 3, 8, 0};
+	for(unsigned range:range_list){
+		vector<unsigned>v(200000);
+		for(auto&x:v)
+			x = rng()%range;
+
+		vector<uint64_t>w(v.size());
+		for(unsigned i=0; i<v.size(); ++i)
+			w[i] = (uint64_t(v[i]) << 31) ^ (rng() % 3);
+
+		auto get_key = [](unsigned x){return x;};
+
+		auto q = compute_stable_sort_permutation_using_comparator(v, [](unsigned l, unsigned r){return l<r;});
+		auto inv_q = invert_permutation(q);
+		auto r = compute_stable_sort_permutation_using_comparator(w, [](uint64_t l, uint64_t r){return l<r;});
+
+		for(unsigned thread_count:thread_count_list){
+			REQUIRE(q == compute_stable_sort_permutation_using_key(v, range, get_key, thread_count));
+			REQUIRE(is_sorted_using_less(apply_permutation(compute_sort_permutation_using_key(v, range, get_key, thread_count), v, thread_count)));
+			REQUIRE(inv_q == compute_inverse_stable_sort_permutation_using_key(v, range, get_key, thread_count));
+			REQUIRE(q == compute_stable_sort_permutation_using_less(v, thread_count));
+			REQUIRE(inv_q == compute_inverse_stable_sort_permutation_using_less(v, thread_count));
+			REQUIRE(r == compute_stable_sort_permutation_using_less(w, thread_count));
+			REQUIRE(is_sorted_using_less(apply_permutation(compute_sort_permutation_using_less(w, thread_count), w, thread_count)));
+			REQUIRE(is_sorted_using_less(apply_inverse_permutation(compute_inverse_sort_permutation_using_less(w, thread_count), w, thread_count)));
+		}
+	}
+}
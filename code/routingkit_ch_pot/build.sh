@@ -1,2 +1,3 @@
 #!/bin/sh
-g++ ch_pot.cpp -O3 -DNDEBUG -o ch_pot -lroutingkit
+g++ ch_pot.cpp ../routingkit2/src/file_array.cpp -O3 -DNDEBUG -march=native -o ch_pot -lroutingkit -pthread
+g++ route_server.cpp ../routingkit2/src/file_array.cpp ../routingkit2/src/http_server.cpp ../routingkit2/src/geo_index.cpp ../routingkit2/src/geo_pos.cpp ../routingkit2/src/gpoly.cpp ../routingkit2/src/map.cpp ../routingkit2/src/data_sink.cpp ../routingkit2/src/data_source.cpp ../routingkit2/src/protobuf_var_int.cpp -O3 -DNDEBUG -o route_server -lroutingkit -pthread
@@ -8,295 +8,170 @@
 #include <routingkit/graph_util.h>
 #include <routingkit/dijkstra.h>
 
+#include "ch_pot.h"
+#include "../routingkit2/src/file_array.h"
+#include "../routingkit2/src/span.h"
+
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <string.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
 #include <iostream>
+#include <memory>
+#include <mutex>
+#include <random>
 #include <string>
+#include <thread>
 #include <vector>
 
 using namespace RoutingKit;
 using namespace std;
 
-std::vector<unsigned>compute_pseudo_dfs_node_order(const std::vector<unsigned>&first_out, const std::vector<unsigned>&head){
-        unsigned node_count = first_out.size()-1;
-        std::vector<bool>was_pushed(node_count, false);
-        std::vector<unsigned>order(node_count);
-        unsigned order_end = 0;
-        std::vector<unsigned>stack(node_count);
-        unsigned stack_end = 0;
-        for(unsigned s=0; s<node_count; ++s){
-                if(!was_pushed[s]){
-                        stack[stack_end++] = s;
-                        was_pushed[s] = true;
-
-                        while(stack_end != 0){
-                                unsigned x = stack[--stack_end];
-                                order[order_end++] = x;
-                                for(unsigned xy=first_out[x]; xy!=first_out[x+1]; ++xy){
-                                        unsigned y = head[x];
-                                        if(!was_pushed[y]){
-                                                stack[stack_end++] = y;
-                                                was_pushed[y] = true;                                        
-                                        }
-                                }
-                        }
-                }
+// Counts a hardware event of the calling thread using perf_event_open. If the
+// event is not supported or perf_event_paranoid forbids it, is_available() is
+// false and all counts are 0.
+class HardwareEventCounter{
+public:
+        HardwareEventCounter(uint32_t type, uint64_t config){
+                perf_event_attr attr;
+                memset(&attr, 0, sizeof(attr));
+                attr.size = sizeof(attr);
+                attr.type = type;
+                attr.config = config;
+                attr.disabled = 1;
+                attr.exclude_kernel = 1;
+                attr.exclude_hv = 1;
+                fd = syscall(__NR_perf_event_open, &attr, 0, -1, -1, 0);
         }
-        return order;
-}
 
-struct ZeroPot{
-        unsigned eval(unsigned source_node){
-                return 0;
-        }
+        HardwareEventCounter(const HardwareEventCounter&) = delete;
+        HardwareEventCounter&operator=(const HardwareEventCounter&) = delete;
 
-        void set_target(unsigned target_node){
+        ~HardwareEventCounter(){
+                if(fd != -1)
+                        close(fd);
+        }
 
+        bool is_available()const{
+                return fd != -1;
         }
 
-        void preprocess(unsigned node_count, const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&lower_bound_weight, const ContractionHierarchy&ch){
-                
+        void reset(){
+                if(fd != -1)
+                        ioctl(fd, PERF_EVENT_IOC_RESET, 0);
         }
-};
 
-struct PotUsingCHQuery{
-        void preprocess(unsigned node_count, const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&lower_bound_weight, const ContractionHierarchy&ch){
-                ch_query.reset(ch);
+        void start(){
+                if(fd != -1)
+                        ioctl(fd, PERF_EVENT_IOC_ENABLE, 0);
         }
 
-        void set_target(unsigned target_node){
-                this->target_node = target_node;
+        void stop(){
+                if(fd != -1)
+                        ioctl(fd, PERF_EVENT_IOC_DISABLE, 0);
         }
 
-        unsigned eval(unsigned source_node){
-                return ch_query.reset().add_source(source_node).add_target(target_node).run().get_distance();
+        uint64_t get_count()const{
+                uint64_t count = 0;
+                if(fd != -1 && read(fd, &count, sizeof(count)) != sizeof(count))
+                        count = 0;
+                return count;
         }
 
-        ContractionHierarchyQuery ch_query;
-        unsigned target_node;
+private:
+        int fd;
 };
 
+// L1 data cache and last level cache read misses. The kernel offers no generic
+// L2 event, the last level cache is the closest portable one.
+struct CacheMissCounter{
+        HardwareEventCounter l1d_miss, ll_miss;
 
-struct PotUsingCHManyToOneQuery{
-        void preprocess(unsigned node_count, const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&lower_bound_weight, const ContractionHierarchy&ch){
-                ch_query.reset(ch);
-                pot.resize(node_count);
-                for(unsigned i=0; i<node_count; ++i)
-                        pot[i] = i;
-                ch_query.pin_sources(pot);
-        }
+        CacheMissCounter():
+                l1d_miss(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_L1D | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)),
+                ll_miss(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_LL | (PERF_COUNT_HW_CACHE_OP_READ << 8) | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16)){}
 
-        void set_target(unsigned target_node){
-                ch_query.reset_target().add_target(target_node).run_to_pinned_sources().get_distances_to_sources(pot.data());
+        void reset(){
+                l1d_miss.reset();
+                ll_miss.reset();
         }
 
-        unsigned eval(unsigned source_node){
-                return pot[source_node];
+        void start(){
+                l1d_miss.start();
+                ll_miss.start();
         }
 
-        ContractionHierarchyQuery ch_query;
-        std::vector<unsigned>pot;
-};
-
-struct QueryWeight{
-
-        QueryWeight(const std::vector<unsigned>&lower_bound_weight, unsigned percent_extra):
-                lower_bound_weight(lower_bound_weight), percent(percent_extra+100){}
-
-        unsigned eval(unsigned arc)const{
-                if(lower_bound_weight[arc] < inf_weight)
-                        return static_cast<uint64_t>(lower_bound_weight[arc])*percent / 100;
-                else
-                        return inf_weight;
+        void stop(){
+                l1d_miss.stop();
+                ll_miss.stop();
         }
 
-        const std::vector<unsigned>&lower_bound_weight;
-        unsigned percent;
+        bool is_available()const{
+                return l1d_miss.is_available() && ll_miss.is_available();
+        }
 };
 
-struct CHPot{
-        const ContractionHierarchy*ch;
-        std::vector<unsigned>tentative_distance;
-        TimestampFlags was_pot_computed, was_pushed;
-        MinIDQueue queue;
-        #ifndef NDEBUG
-        ContractionHierarchyQuery ch_query;
-        unsigned target_node;
-        #endif        
-
-        void preprocess(unsigned node_count, const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&lower_bound_weight, const ContractionHierarchy&ch){
-                tentative_distance.resize(node_count);
-                was_pushed = TimestampFlags(node_count);
-                was_pot_computed = TimestampFlags(node_count);
-                queue = MinIDQueue(node_count);
-                this->ch = &ch;
-                #ifndef NDEBUG
-                ch_query.reset(ch);
-                #endif
-        }
-
-        void set_target(unsigned target_node){
-                #ifndef NDEBUG
-                this->target_node = target_node;
-                #endif
-
-                unsigned t = ch->rank[target_node];
-
-                was_pushed.reset_all();
-                queue.clear();
-                queue.push({t, 0});
-                was_pushed.set(t);
-                tentative_distance[t] = 0;
-                
-                #ifndef NDEBUG
-                unsigned last_key = 0;
-                #endif
-
-                while(!queue.empty()){
-                        auto e = queue.pop();
-                        unsigned x = e.id;
-                        unsigned x_dist = e.key;
-                        #ifndef NDEBUG
-                        assert(e.key >= last_key);
-                        last_key = e.key;
-                        assert(was_pushed.is_set(x));
-                        unsigned correct_dist = ch_query.reset().add_source(ch->order[x]).add_target(target_node).run().get_distance();
-                        assert(correct_dist <= x_dist);
-                        #endif
-                        for(unsigned xy = ch->backward.first_out[x]; xy < ch->backward.first_out[x+1]; ++xy){
-                                unsigned xy_dist = ch->backward.weight[xy];
-                                if(xy_dist < inf_weight){
-                                        unsigned y = ch->backward.head[xy];
-                                        unsigned y_dist = x_dist + xy_dist;
-
-                                        #ifndef NDEBUG
-                                        unsigned correct_y_dist = ch_query.reset().add_source(ch->order[y]).add_target(target_node).run().get_distance();
-                                        unsigned correct_x_dist = ch_query.reset().add_source(ch->order[x]).add_target(target_node).run().get_distance();
-                                        assert(correct_y_dist <= y_dist);
-                                        #endif
-
-                                        if(!was_pushed.is_set(y)){
-                                                tentative_distance[y] = y_dist;
-                                                was_pushed.set(y);
-                                                queue.push({y, y_dist});
-                                        }else if(tentative_distance[y] > y_dist){
-                                                tentative_distance[y] = y_dist;
-                                                if(queue.contains_id(y)){
-                                                        queue.decrease_key({y, y_dist});
-                                                }
+std::vector<unsigned>compute_pseudo_dfs_node_order(ConstArray first_out, ConstArray head){
+        unsigned node_count = first_out.size()-1;
+        std::vector<bool>was_pushed(node_count, false);
+        std::vector<unsigned>order(node_count);
+        unsigned order_end = 0;
+        std::vector<unsigned>stack(node_count);
+        unsigned stack_end = 0;
+        for(unsigned s=0; s<node_count; ++s){
+                if(!was_pushed[s]){
+                        stack[stack_end++] = s;
+                        was_pushed[s] = true;
+
+                        while(stack_end != 0){
+                                unsigned x = stack[--stack_end];
+                                order[order_end++] = x;
+                                for(unsigned xy=first_out[x]; xy!=first_out[x+1]; ++xy){
+                                        unsigned y = head[x];
+                                        if(!was_pushed[y]){
+                                                stack[stack_end++] = y;
+                                                was_pushed[y] = true;                                        
                                         }
                                 }
                         }
                 }
-
-                was_pot_computed.reset_all();
         }
+        return order;
+}
 
-private:
-        unsigned eval_using_ch_node_order(unsigned x){
-                if(!was_pot_computed.is_set(x)){
-                        unsigned x_dist;
-                        if(was_pushed.is_set(x))
-                                x_dist = tentative_distance[x];
-                        else
-                                x_dist = inf_weight;
-
-                        for(unsigned xy = ch->forward.first_out[x]; xy < ch->forward.first_out[x+1]; ++xy){
-                                unsigned xy_dist = ch->forward.weight[xy];
-                                unsigned y = ch->forward.head[xy];
-                                unsigned y_dist = eval_using_ch_node_order(y);
-                                unsigned d = xy_dist + y_dist;
-                                if(d < x_dist)
-                                        x_dist = d; 
-                        }
-                        tentative_distance[x] = x_dist;
-                        was_pot_computed.set(x);
-                }
-                return tentative_distance[x];
-        }
-public:
+// Wraps an ID queue and counts the operations performed on it.
+template<class IDQueue>
+struct CountingIDQueue : IDQueue{
+        using IDQueue::IDQueue;
 
-        unsigned eval(unsigned source_node){
-                unsigned x_pot = eval_using_ch_node_order(ch->rank[source_node]);
-                #ifndef NDEBUG
-                unsigned correct_dist = ch_query.reset().add_source(source_node).add_target(target_node).run().get_distance();
-                assert(correct_dist == x_pot);
-                #endif
+        unsigned long long push_count = 0;
+        unsigned long long pop_count = 0;
+        unsigned long long decrease_key_count = 0;
 
-                return x_pot;
+        void push(IDKeyPair p){
+                ++push_count;
+                IDQueue::push(p);
         }
 
+        IDKeyPair pop(){
+                ++pop_count;
+                return IDQueue::pop();
+        }
 
-};
-
-template<class QueryWeight, class Potential>
-struct AStar{
-        const std::vector<unsigned>&first_out;
-        const std::vector<unsigned>&head;
-        const QueryWeight&query_weight;
-        Potential&pot;
-        MinIDQueue queue;
-        std::vector<unsigned>tentative_distance;
-        TimestampFlags was_pushed;
-
-        AStar(const std::vector<unsigned>&first_out, const std::vector<unsigned>&head, const QueryWeight&query_weight, Potential&pot):
-                first_out(first_out), head(head), 
-                query_weight(query_weight), pot(pot),
-                queue(first_out.size()-1),
-                tentative_distance(first_out.size()-1, inf_weight),
-                was_pushed(first_out.size()-1){}
-
-        unsigned run(unsigned source_node, unsigned target_node){
-                was_pushed.reset_all();
-                queue.clear();
-                tentative_distance[source_node] = 0;
-                queue.push({source_node, pot.eval(source_node)});
-                was_pushed.set(source_node);
-                
-                #ifndef NDEBUG
-                unsigned last_key = 0;
-                #endif
-
-                while(!queue.empty()){
-                        auto e = queue.pop();
-                        #ifndef NDEBUG
-                        assert(e.key >= last_key);
-                        last_key = e.key;
-                        assert(was_pushed.is_set(e.id));
-                        assert(e.key == pot.eval(e.id) + tentative_distance[e.id]);
-                        #endif
-                        unsigned x = e.id;
-                        unsigned x_dist = tentative_distance[x];
-                        if(x == target_node)
-                                break;
-                        for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
-                                unsigned y = head[xy];
-                                unsigned xy_dist = query_weight.eval(xy);
-                                if(xy_dist < inf_weight){
-                                        unsigned y_pot = pot.eval(y);
-                                        unsigned y_dist = x_dist + xy_dist;
-
-                                        if(was_pushed.is_set(y)){
-                                                if(tentative_distance[y] > y_dist){
-                                                        queue.decrease_key({y, y_dist+y_pot});
-                                                        tentative_distance[y] = y_dist;
-                                                }
-                                        }else{
-                                                was_pushed.set(y);
-                                                tentative_distance[y] = y_dist;
-                                                queue.push({y, y_dist+y_pot});
-                                        }
-                                }
-                        }
-                }
-
-                if(was_pushed.is_set(target_node))
-                        return tentative_distance[target_node] ;
-                else
-                        return inf_weight;
+        void decrease_key(IDKeyPair p){
+                ++decrease_key_count;
+                IDQueue::decrease_key(p);
         }
 };
 
-template<class Potential, class QueryWeight>
-void test_astar(const char*name, const std::vector<unsigned>&first_out, const std::vector<unsigned>&tail, const std::vector<unsigned>&head, const std::vector<unsigned>&lower_bound_weight, const QueryWeight&query_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const std::vector<unsigned>&ref_dist, const ContractionHierarchy&ch){
+template<class Potential, template<class, class>class Search = AStar, class QueryWeight, class CH>
+void test_astar(const char*name, ConstArray first_out, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const QueryWeight&query_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const std::vector<unsigned>&ref_dist, const CH&ch){
         unsigned node_count = first_out.size()-1;
         unsigned query_count = source.size();
         unsigned arc_count = tail.size();
@@ -325,13 +200,16 @@ void test_astar(const char*name, const std::vector<unsigned>&first_out, const st
         }*/
 
 
-        AStar<QueryWeight, Potential> a_star(first_out, head, query_weight, pot);
+        Search<QueryWeight, Potential> a_star(first_out, head, query_weight, pot);
 
         cout << "Start "<< name << endl;
 
         long long set_target_timer = 0;
         long long search_timer = 0;
 
+        CacheMissCounter search_cache_miss;
+        search_cache_miss.reset();
+
         for(unsigned q=0; q<query_count; ++q){
                 set_target_timer -= get_micro_time();
 
@@ -340,9 +218,11 @@ void test_astar(const char*name, const std::vector<unsigned>&first_out, const st
                 auto t = get_micro_time();
                 set_target_timer += t;
                 search_timer -= t;
+                search_cache_miss.start();
 
                 unsigned result = a_star.run(source[q], target[q]);
 
+                search_cache_miss.stop();
                 if(result != ref_dist[q]){
                         cout << "Query "<<q << " wrong; should be "<<ref_dist[q] << " but is "<< result << " source = "<<source[q] << " target = " << target[q] << endl;
                 }
@@ -350,10 +230,559 @@ void test_astar(const char*name, const std::vector<unsigned>&first_out, const st
                 search_timer += get_micro_time();
         }
 
+        uint64_t l1d_miss = search_cache_miss.l1d_miss.get_count()/query_count;
+        uint64_t ll_miss = search_cache_miss.ll_miss.get_count()/query_count;
+
         cout << "Avg. set target time : "<< set_target_timer/query_count<< " musec"<<endl;
         cout << "Avg. search time : " << search_timer/query_count << " musec" << endl;
+        if(search_cache_miss.is_available()){
+                cout << "Avg. search L1D read misses : " << l1d_miss << endl;
+                cout << "Avg. search LL read misses : " << ll_miss << endl;
+        }else{
+                cout << "Cache miss counters are not available" << endl;
+        }
 
-        cerr << name << ',' << preproc_timer << ',' << set_target_timer/query_count << ',' << search_timer/query_count << endl;
+        cerr << name << ',' << preproc_timer << ',' << set_target_timer/query_count << ',' << search_timer/query_count << ',' << l1d_miss << ',' << ll_miss << endl;
+}
+
+// Hands out query ids to worker threads. Every worker has its own deque of
+// queries and takes from its front. If it runs empty, it steals from the back
+// of the other workers' deques.
+class WorkStealingQueryQueue{
+public:
+        WorkStealingQueryQueue(unsigned worker_count, unsigned query_count){
+                for(unsigned w=0; w<worker_count; ++w){
+                        worker_queue.emplace_back(new WorkerQueue);
+                        unsigned query_begin = static_cast<uint64_t>(query_count)*w/worker_count;
+                        unsigned query_end = static_cast<uint64_t>(query_count)*(w+1)/worker_count;
+                        for(unsigned q=query_begin; q<query_end; ++q)
+                                worker_queue[w]->query.push_back(q);
+                }
+        }
+
+        bool pop(unsigned worker, unsigned&q){
+                {
+                        WorkerQueue&own = *worker_queue[worker];
+                        std::lock_guard<std::mutex> guard(own.lock);
+                        if(!own.query.empty()){
+                                q = own.query.front();
+                                own.query.pop_front();
+                                return true;
+                        }
+                }
+                unsigned worker_count = worker_queue.size();
+                for(unsigned i=1; i<worker_count; ++i){
+                        WorkerQueue&victim = *worker_queue[(worker+i)%worker_count];
+                        std::lock_guard<std::mutex> guard(victim.lock);
+                        if(!victim.query.empty()){
+                                q = victim.query.back();
+                                victim.query.pop_back();
+                                return true;
+                        }
+                }
+                return false;
+        }
+
+private:
+        struct WorkerQueue{
+                std::mutex lock;
+                std::deque<unsigned>query;
+        };
+        std::vector<std::unique_ptr<WorkerQueue>>worker_queue;
+};
+
+// Runs all queries on thread_count threads. The graph, the CH and the query
+// weights are shared read-only. Every thread has its own Potential and AStar.
+template<class Potential, class QueryWeight>
+void test_parallel_astar(const char*name, unsigned thread_count, ConstArray first_out, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const QueryWeight&query_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const std::vector<unsigned>&ref_dist, const ContractionHierarchy&ch){
+        unsigned node_count = first_out.size()-1;
+        unsigned query_count = source.size();
+        if(query_count == 0)
+                return;
+
+        std::vector<long long>query_time(query_count);
+        std::atomic<unsigned>wrong_query_count(0);
+
+        WorkStealingQueryQueue query_queue(thread_count, query_count);
+
+        cout << "Start "<< name << " on " << thread_count << " threads" << endl;
+
+        // The threads preprocess on their own and then wait until all are done,
+        // so that only the queries are timed.
+        std::atomic<unsigned>ready_thread_count(0);
+        std::atomic<bool>are_queries_started(false);
+
+        std::vector<std::thread>worker;
+        for(unsigned w=0; w<thread_count; ++w){
+                worker.emplace_back([&, w]{
+                        Potential pot;
+                        pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+                        AStar<QueryWeight, Potential> a_star(first_out, head, query_weight, pot);
+
+                        ++ready_thread_count;
+                        while(!are_queries_started)
+                                std::this_thread::yield();
+
+                        unsigned q;
+                        while(query_queue.pop(w, q)){
+                                long long query_timer = -get_micro_time();
+                                pot.set_target(target[q]);
+                                unsigned result = a_star.run(source[q], target[q]);
+                                query_timer += get_micro_time();
+
+                                query_time[q] = query_timer;
+                                if(result != ref_dist[q])
+                                        ++wrong_query_count;
+                        }
+                });
+        }
+
+        while(ready_thread_count != thread_count)
+                std::this_thread::yield();
+        long long timer = -get_micro_time();
+        are_queries_started = true;
+
+        for(auto&w:worker)
+                w.join();
+
+        timer += get_micro_time();
+
+        if(wrong_query_count != 0)
+                cout << wrong_query_count << " queries wrong" << endl;
+
+        std::sort(query_time.begin(), query_time.end());
+        long long p50 = query_time[query_count/2];
+        long long p99 = query_time[static_cast<uint64_t>(query_count)*99/100];
+        double queries_per_sec = timer == 0 ? 0.0 : 1e6*query_count/timer;
+
+        cout << "Total query time : " << timer << " musec" << endl;
+        cout << "Throughput : " << queries_per_sec << " queries/sec" << endl;
+        cout << "p50 query time : " << p50 << " musec" << endl;
+        cout << "p99 query time : " << p99 << " musec" << endl;
+
+        cerr << name << ',' << thread_count << ',' << queries_per_sec << ',' << p50 << ',' << p99 << endl;
+}
+
+// Runs CHPot and AStar with the given queue type and reports the number of queue
+// operations and the time per query.
+template<class IDQueue, class QueryWeight>
+void test_queue(const char*name, ConstArray first_out, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const QueryWeight&query_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const std::vector<unsigned>&ref_dist, const ContractionHierarchy&ch){
+        typedef CountingIDQueue<IDQueue> Queue;
+        typedef BasicCHPot<Queue> Potential;
+
+        unsigned node_count = first_out.size()-1;
+        unsigned query_count = source.size();
+        if(query_count == 0)
+                return;
+
+        Potential pot;
+        pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+        AStar<QueryWeight, Potential, Queue> a_star(first_out, head, query_weight, pot);
+
+        cout << "Start queue benchmark of " << name << endl;
+
+        long long set_target_timer = 0;
+        long long search_timer = 0;
+
+        for(unsigned q=0; q<query_count; ++q){
+                set_target_timer -= get_micro_time();
+                pot.set_target(target[q]);
+                auto t = get_micro_time();
+                set_target_timer += t;
+                search_timer -= t;
+                unsigned result = a_star.run(source[q], target[q]);
+                search_timer += get_micro_time();
+
+                if(result != ref_dist[q]){
+                        cout << "Query "<<q << " wrong; should be "<<ref_dist[q] << " but is "<< result << " source = "<<source[q] << " target = " << target[q] << endl;
+                }
+        }
+
+        cout << "Avg. set target pushes/pops/decrease keys : " << pot.queue.push_count/query_count << '/' << pot.queue.pop_count/query_count << '/' << pot.queue.decrease_key_count/query_count << endl;
+        cout << "Avg. set target time : "<< set_target_timer/query_count<< " musec"<<endl;
+        cout << "Avg. search pushes/pops/decrease keys : " << a_star.queue.push_count/query_count << '/' << a_star.queue.pop_count/query_count << '/' << a_star.queue.decrease_key_count/query_count << endl;
+        cout << "Avg. search time : " << search_timer/query_count << " musec" << endl;
+
+        cerr
+                << name << ','
+                << pot.queue.push_count/query_count << ',' << pot.queue.pop_count/query_count << ',' << pot.queue.decrease_key_count/query_count << ',' << set_target_timer/query_count << ','
+                << a_star.queue.push_count/query_count << ',' << a_star.queue.pop_count/query_count << ',' << a_star.queue.decrease_key_count/query_count << ',' << search_timer/query_count << endl;
+}
+
+struct BatchQueryStatistic{
+        unsigned set_target_count = 0;
+        long long set_target_time = 0;
+        long long search_time = 0;
+};
+
+// Answers all queries and returns the distances in the order of the input. If
+// group_by_target is set, the queries are sorted by target and set_target is only
+// called once per distinct target. All queries of a target then share the
+// potentials that were already computed for it.
+template<class Potential, class AStar>
+std::vector<unsigned>run_queries(Potential&pot, AStar&a_star, const std::vector<unsigned>&source, const std::vector<unsigned>&target, bool group_by_target, BatchQueryStatistic&stat){
+        unsigned query_count = source.size();
+
+        std::vector<unsigned>query_order(query_count);
+        for(unsigned q=0; q<query_count; ++q)
+                query_order[q] = q;
+        if(group_by_target)
+                std::stable_sort(query_order.begin(), query_order.end(), [&](unsigned l, unsigned r){return target[l] < target[r];});
+
+        std::vector<unsigned>dist(query_count);
+        unsigned current_target = invalid_id;
+
+        for(unsigned q:query_order){
+                if(!group_by_target || target[q] != current_target){
+                        stat.set_target_time -= get_micro_time();
+                        pot.set_target(target[q]);
+                        stat.set_target_time += get_micro_time();
+                        ++stat.set_target_count;
+                        current_target = target[q];
+                }
+
+                stat.search_time -= get_micro_time();
+                dist[q] = a_star.run(source[q], target[q]);
+                stat.search_time += get_micro_time();
+        }
+        return dist;
+}
+
+template<class Potential, class QueryWeight>
+void test_target_grouped_astar(const char*name, ConstArray first_out, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const QueryWeight&query_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const std::vector<unsigned>&ref_dist, const ContractionHierarchy&ch){
+        unsigned node_count = first_out.size()-1;
+        unsigned query_count = source.size();
+        if(query_count == 0)
+                return;
+
+        Potential pot;
+        pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+        AStar<QueryWeight, Potential> a_star(first_out, head, query_weight, pot);
+
+        BatchQueryStatistic stat[2];
+        for(unsigned group_by_target=0; group_by_target<2; ++group_by_target){
+                cout << "Start " << name << (group_by_target ? " grouped by target" : " in input order") << endl;
+
+                std::vector<unsigned>dist = run_queries(pot, a_star, source, target, group_by_target, stat[group_by_target]);
+                for(unsigned q=0; q<query_count; ++q)
+                        if(dist[q] != ref_dist[q])
+                                cout << "Query "<<q << " wrong; should be "<<ref_dist[q] << " but is "<< dist[q] << " source = "<<source[q] << " target = " << target[q] << endl;
+
+                cout << "Number of set target calls : " << stat[group_by_target].set_target_count << endl;
+                cout << "Total set target time : " << stat[group_by_target].set_target_time << " musec" << endl;
+                cout << "Total search time : " << stat[group_by_target].search_time << " musec" << endl;
+        }
+
+        long long ungrouped_time = stat[0].set_target_time + stat[0].search_time;
+        long long grouped_time = stat[1].set_target_time + stat[1].search_time;
+
+        cout << "Time saved by grouping : " << ungrouped_time - grouped_time << " musec" << endl;
+
+        cerr << name << ',' << stat[1].set_target_count << ',' << ungrouped_time/query_count << ',' << grouped_time/query_count << endl;
+}
+
+// Measures only the potential evaluation. After every set_target, the potential is
+// evaluated at the source and at eval_count further random nodes. The random nodes
+// are the same for every Potential, so the returned checksum must agree.
+template<class Potential>
+uint64_t test_pot_eval(const char*name, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, unsigned eval_count, const ContractionHierarchy&ch){
+        unsigned node_count = ch.node_count();
+        unsigned query_count = source.size();
+
+        Potential pot;
+        long long preproc_timer = -get_micro_time();
+        pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+        preproc_timer += get_micro_time();
+
+        std::minstd_rand gen(42);
+        std::uniform_int_distribution<unsigned> node_dist(0, node_count-1);
+        std::vector<unsigned>eval_node(eval_count);
+
+        cout << "Start eval benchmark of "<< name << endl;
+
+        long long set_target_timer = 0;
+        long long eval_timer = 0;
+        uint64_t checksum = 0;
+
+        CacheMissCounter eval_cache_miss;
+        eval_cache_miss.reset();
+
+        for(unsigned q=0; q<query_count; ++q){
+                for(auto&x:eval_node)
+                        x = node_dist(gen);
+
+                set_target_timer -= get_micro_time();
+                pot.set_target(target[q]);
+                auto t = get_micro_time();
+                set_target_timer += t;
+                eval_timer -= t;
+                eval_cache_miss.start();
+
+                checksum += pot.eval(source[q]);
+                for(auto x:eval_node)
+                        checksum += pot.eval(x);
+
+                eval_cache_miss.stop();
+                eval_timer += get_micro_time();
+        }
+
+        uint64_t l1d_miss = eval_cache_miss.l1d_miss.get_count()/query_count;
+        uint64_t ll_miss = eval_cache_miss.ll_miss.get_count()/query_count;
+
+        cout << "Preprocess time : "<< preproc_timer << " musec"<<endl;
+        cout << "Avg. set target time : "<< set_target_timer/query_count<< " musec"<<endl;
+        cout << "Avg. eval time : " << eval_timer/query_count << " musec" << endl;
+        if(eval_cache_miss.is_available()){
+                cout << "Avg. eval L1D read misses : " << l1d_miss << endl;
+                cout << "Avg. eval LL read misses : " << ll_miss << endl;
+        }else{
+                cout << "Cache miss counters are not available" << endl;
+        }
+        cout << "Checksum : " << checksum << endl;
+
+        cerr << name << ',' << eval_count << ',' << set_target_timer/query_count << ',' << eval_timer/query_count << ',' << l1d_miss << ',' << ll_miss << endl;
+
+        return checksum;
+}
+
+// Measures the time needed to compute the potentials of all targets. The
+// potentials are computed lane_count targets at a time with MultiTargetPot. A
+// lane_count of 0 means one PotUsingCHManyToOneQuery::set_target per target.
+// After every batch, the potential of every source to every target of the batch
+// is added to the returned checksum.
+template<unsigned lane_count>
+uint64_t test_multi_target_pot(const char*name, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const ContractionHierarchy&ch){
+        unsigned node_count = ch.node_count();
+        unsigned target_count = target.size();
+
+        PotUsingCHManyToOneQuery single_pot;
+        MultiTargetPot<lane_count == 0 ? 1 : lane_count> multi_pot;
+
+        long long preproc_timer = -get_micro_time();
+        if(lane_count == 0)
+                single_pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+        else
+                multi_pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+        preproc_timer += get_micro_time();
+
+        cout << "Start multi target benchmark of "<< name << endl;
+
+        long long set_target_timer = 0;
+        uint64_t checksum = 0;
+        unsigned batch_size = lane_count == 0 ? 1 : lane_count;
+        for(unsigned begin=0; begin<target_count; begin+=batch_size){
+                unsigned end = std::min(begin+batch_size, target_count);
+
+                set_target_timer -= get_micro_time();
+                if(lane_count == 0)
+                        single_pot.set_target(target[begin]);
+                else
+                        multi_pot.set_targets({target.data()+begin, target.data()+end});
+                set_target_timer += get_micro_time();
+
+                for(unsigned i=0; i<end-begin; ++i){
+                        if(lane_count != 0)
+                                multi_pot.select_target(i);
+                        for(unsigned s:source)
+                                checksum += lane_count == 0 ? single_pot.eval(s) : multi_pot.eval(s);
+                }
+        }
+
+        cout << "Preprocess time : "<< preproc_timer << " musec"<<endl;
+        cout << "Avg. set target time per target : "<< set_target_timer/target_count << " musec"<<endl;
+        cout << "Checksum : " << checksum << endl;
+
+        cerr << name << ',' << lane_count << ',' << set_target_timer/target_count << endl;
+
+        return checksum;
+}
+
+// Runs the queries on thread_count threads while another thread publishes new
+// random traffic weights every publish_interval_in_ms. Every query pins the
+// weights and is checked against Dijkstra with the same pinned weights.
+int test_live_traffic(unsigned thread_count, unsigned publish_interval_in_ms, ConstArray first_out, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const ContractionHierarchy&ch){
+        unsigned node_count = first_out.size()-1;
+        unsigned query_count = source.size();
+
+        QueryWeightStore store(lower_bound_weight, 3, thread_count);
+
+        std::atomic<bool>are_queries_finished(false);
+        std::atomic<unsigned>wrong_query_count(0);
+        std::atomic<long long>total_query_time(0);
+        unsigned publish_count = 0;
+        long long total_publish_time = 0;
+
+        cout << "Start live traffic test on " << thread_count << " threads" << endl;
+
+        std::thread writer([&]{
+                std::minstd_rand gen(42);
+                while(!are_queries_finished){
+                        std::this_thread::sleep_for(std::chrono::milliseconds(publish_interval_in_ms));
+
+                        long long timer = -get_micro_time();
+                        std::vector<unsigned>weight(lower_bound_weight.size());
+                        for(unsigned xy=0; xy<weight.size(); ++xy){
+                                if(lower_bound_weight[xy] < inf_weight)
+                                        weight[xy] = static_cast<uint64_t>(lower_bound_weight[xy])*(100 + gen()%50)/100;
+                                else
+                                        weight[xy] = inf_weight;
+                        }
+                        store.publish(std::move(weight));
+                        timer += get_micro_time();
+
+                        total_publish_time += timer;
+                        ++publish_count;
+                }
+        });
+
+        std::vector<std::thread>worker;
+        for(unsigned w=0; w<thread_count; ++w){
+                worker.emplace_back([&, w]{
+                        PinnedQueryWeight weight;
+                        CHPot pot;
+                        pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+                        AStar<PinnedQueryWeight, CHPot> a_star(first_out, head, weight, pot);
+                        ZeroPot zero_pot;
+                        AStar<PinnedQueryWeight, ZeroPot> dijkstra(first_out, head, weight, zero_pot);
+
+                        for(unsigned q=w; q<query_count; q+=thread_count){
+                                QueryWeightPin pin(store, w, weight);
+
+                                long long query_timer = -get_micro_time();
+                                pot.set_target(target[q]);
+                                unsigned result = a_star.run(source[q], target[q]);
+                                query_timer += get_micro_time();
+                                total_query_time += query_timer;
+
+                                if(result != dijkstra.run(source[q], target[q]))
+                                        ++wrong_query_count;
+                        }
+                });
+        }
+        for(auto&w:worker)
+                w.join();
+        are_queries_finished = true;
+        writer.join();
+
+        cout << "Publish count : " << publish_count << endl;
+        if(publish_count != 0)
+                cout << "Avg. publish time : " << total_publish_time/publish_count << " musec" << endl;
+        cout << "Avg. query time : " << total_query_time/query_count << " musec" << endl;
+        cout << "Kept replaced weights : " << store.reclaim() << endl;
+        if(wrong_query_count != 0){
+                cout << wrong_query_count << " queries wrong" << endl;
+                return 1;
+        }
+        return 0;
+}
+
+// Selects the region_size nodes closest to the first source as region. Then
+// computes the potentials of target_count targets in the region using
+// RPHASTPot and using PotUsingCHManyToOneQuery and compares them at all nodes
+// of the region.
+int test_rphast(unsigned region_size, unsigned target_count, const std::vector<unsigned>&first_out, const std::vector<unsigned>&tail, const std::vector<unsigned>&head, ConstArray lower_bound_weight, const std::vector<unsigned>&source, const ContractionHierarchy&ch){
+        unsigned node_count = ch.node_count();
+
+        std::vector<unsigned>region;
+        {
+                Dijkstra dij(first_out, tail, head);
+                dij.reset().add_source(source[0]);
+                while(!dij.is_finished() && region.size() < region_size)
+                        region.push_back(dij.settle([&](unsigned arc, unsigned){return lower_bound_weight[arc];}).node);
+        }
+        cout << "Region size : " << region.size() << endl;
+
+        std::vector<unsigned>region_target;
+        for(unsigned i=0; i<target_count; ++i)
+                region_target.push_back(region[static_cast<uint64_t>(i)*region.size()/target_count]);
+
+        PotUsingCHManyToOneQuery many_to_one;
+        many_to_one.preprocess(node_count, tail, head, lower_bound_weight, ch);
+
+        RPHASTPot rphast;
+        rphast.preprocess(node_count, tail, head, lower_bound_weight, ch);
+        long long select_timer = -get_micro_time();
+        rphast.select_nodes(region);
+        select_timer += get_micro_time();
+        cout << "Extracted CH node count : " << rphast.get_local_node_count() << endl;
+        cout << "Select time : " << select_timer << " musec" << endl;
+
+        long long many_to_one_timer = 0;
+        long long rphast_timer = 0;
+        for(unsigned t:region_target){
+                many_to_one_timer -= get_micro_time();
+                many_to_one.set_target(t);
+                many_to_one_timer += get_micro_time();
+
+                rphast_timer -= get_micro_time();
+                rphast.set_target(t);
+                rphast_timer += get_micro_time();
+
+                for(unsigned x:region){
+                        if(rphast.eval(x) != many_to_one.eval(x)){
+                                cout << "RPHAST and many-to-one potentials differ" << endl;
+                                return 1;
+                        }
+                }
+        }
+
+        cout << "Avg. many-to-one set target time : " << many_to_one_timer/target_count << " musec" << endl;
+        cout << "Avg. RPHAST set target time : " << rphast_timer/target_count << " musec" << endl;
+        cerr << "rphast," << region.size() << ',' << rphast.get_local_node_count() << ',' << select_timer << ',' << many_to_one_timer/target_count << ',' << rphast_timer/target_count << endl;
+        return 0;
+}
+
+// Computes the matrix between the first matrix_size sources and targets with
+// ManyToManyCHQuery and compares it against one PotUsingCHManyToOneQuery per
+// target, which was the way to compute matrices before.
+int test_many_to_many(unsigned matrix_size, unsigned thread_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const std::vector<unsigned>&source, const std::vector<unsigned>&target, const ContractionHierarchy&ch){
+        unsigned node_count = ch.node_count();
+
+        std::vector<unsigned>matrix_source(matrix_size), matrix_target(matrix_size);
+        for(unsigned i=0; i<matrix_size; ++i){
+                matrix_source[i] = source[i % source.size()];
+                matrix_target[i] = target[i % target.size()];
+        }
+        if(matrix_size > source.size()){
+                std::minstd_rand gen(42);
+                std::uniform_int_distribution<unsigned> node_dist(0, node_count-1);
+                for(unsigned i=source.size(); i<matrix_size; ++i){
+                        matrix_source[i] = node_dist(gen);
+                        matrix_target[i] = node_dist(gen);
+                }
+        }
+
+        cout << "Start many-to-one matrix benchmark" << endl;
+        std::vector<unsigned>ref_matrix(static_cast<uint64_t>(matrix_size)*matrix_size);
+        long long many_to_one_timer = -get_micro_time();
+        {
+                PotUsingCHManyToOneQuery pot;
+                pot.preprocess(node_count, tail, head, lower_bound_weight, ch);
+                for(unsigned j=0; j<matrix_size; ++j){
+                        pot.set_target(matrix_target[j]);
+                        for(unsigned i=0; i<matrix_size; ++i)
+                                ref_matrix[static_cast<uint64_t>(i)*matrix_size+j] = pot.eval(matrix_source[i]);
+                }
+        }
+        many_to_one_timer += get_micro_time();
+        cout << "Many-to-one time : " << many_to_one_timer << " musec" << endl;
+
+        ContractionHierarchyView ch_view(ch);
+        for(unsigned t:{1u, thread_count}){
+                cout << "Start bucket many-to-many benchmark with " << t << " threads" << endl;
+                ManyToManyCHQuery query(ch_view, t);
+                long long timer = -get_micro_time();
+                std::vector<unsigned>matrix = query.run(matrix_source, matrix_target);
+                timer += get_micro_time();
+                cout << "Many-to-many time : " << timer << " musec" << endl;
+
+                if(matrix != ref_matrix){
+                        cout << "Many-to-many and many-to-one matrices differ" << endl;
+                        return 1;
+                }
+                cerr << "many_to_many," << matrix_size << ',' << t << ',' << many_to_one_timer << ',' << timer << endl;
+        }
+        return 0;
 }
 
 void keep_only_queries_with_path(std::vector<unsigned>&source, std::vector<unsigned>&target, std::vector<unsigned>&dist){
@@ -372,7 +801,60 @@ void keep_only_queries_with_path(std::vector<unsigned>&source, std::vector<unsig
         dist.erase(dist.begin()+out, dist.end());
 }
 
+// Maps the graph in the working directory and a CH written by compute_ch into
+// memory instead of loading them into vectors. The graph is not reordered, as
+// this would require a private copy.
+int test_astar_on_mapped_files(const std::string&ch_dir){
+        cout << "Map graph and CH" << endl;
+        long long timer = -get_micro_time();
+
+        RoutingKit2::FileArray<unsigned>mapped_first_out("first_out");
+        RoutingKit2::FileArray<unsigned>mapped_tail("tail");
+        RoutingKit2::FileArray<unsigned>mapped_head("head");
+        RoutingKit2::FileArray<unsigned>mapped_lower_bound_weight("travel_time");
+        MappedContractionHierarchy mapped_ch(ch_dir);
+
+        timer += get_micro_time();
+        cout << "Map time : " << timer << " musec" << endl;
+
+        ConstArray first_out = as_const_array(mapped_first_out);
+        ConstArray tail = as_const_array(mapped_tail);
+        ConstArray head = as_const_array(mapped_head);
+        ConstArray lower_bound_weight = as_const_array(mapped_lower_bound_weight);
+        ContractionHierarchyView ch = mapped_ch.as_view();
+
+        if(ch.node_count() != first_out.size()-1){
+                cout << "The CH in " << ch_dir << " does not match the graph" << endl;
+                return 1;
+        }
+
+        std::vector<unsigned>source = load_vector<unsigned>("source");
+        std::vector<unsigned>target = load_vector<unsigned>("target");
+        source.resize(200);
+        target.resize(source.size());
+
+        QueryWeight query_weight(lower_bound_weight, 3);
+
+        cout << "Running Dijkstra" << endl;
+        std::vector<unsigned>ref_dist(source.size());
+        {
+                ZeroPot zero_pot;
+                AStar<QueryWeight, ZeroPot> dijkstra(first_out, head, query_weight, zero_pot);
+                for(unsigned q=0; q<source.size(); ++q)
+                        ref_dist[q] = dijkstra.run(source[q], target[q]);
+        }
+        keep_only_queries_with_path(source, target, ref_dist);
+
+        cout << "Query count : " << source.size() << endl;
+
+        test_astar<CHPot>("ch_pot_mapped", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+        return 0;
+}
+
 int main(int argc, char*argv[]){
+        if(argc > 1 && std::string(argv[1]) == "mmap")
+                return test_astar_on_mapped_files(argc > 2 ? std::string(argv[2]) + "/" : "lower_bound_ch/");
+
 	std::vector<unsigned>tail = load_vector<unsigned>("tail");
         std::vector<unsigned>head = load_vector<unsigned>("head");
         std::vector<unsigned>first_out = load_vector<unsigned>("first_out");
@@ -384,6 +866,19 @@ int main(int argc, char*argv[]){
         source.resize(200);
         target.resize(source.size());
 
+        if(argc > 1 && std::string(argv[1]) == "group"){
+                // Optionally turn the queries into a many-to-one workload with few distinct targets
+                if(argc > 2){
+                        unsigned distinct_target_count = std::stoul(argv[2]);
+                        if(distinct_target_count == 0){
+                                cout << "The number of distinct targets must be positive" << endl;
+                                return 1;
+                        }
+                        for(unsigned q=distinct_target_count; q<target.size(); ++q)
+                                target[q] = target[q % distinct_target_count];
+                }
+        }
+
         unsigned node_count = first_out.size()-1;
 
         {
@@ -419,7 +914,77 @@ int main(int argc, char*argv[]){
                 cout << "Save CH to file " << endl;
         }
 
-        unsigned arc_count = tail.size();
+        if(argc > 1 && std::string(argv[1]) == "bench_eval"){
+                unsigned eval_count = 1000;
+                if(argc > 2)
+                        eval_count = std::stoul(argv[2]);
+
+                uint64_t recursive_checksum = test_pot_eval<RecursiveCHPot>("ch_pot_recursive", tail, head, lower_bound_weight, source, target, eval_count, ch);
+                uint64_t iterative_checksum = test_pot_eval<CHPot>("ch_pot_iterative", tail, head, lower_bound_weight, source, target, eval_count, ch);
+                if(recursive_checksum != iterative_checksum){
+                        cout << "Recursive and iterative potentials differ" << endl;
+                        return 1;
+                }
+                return 0;
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "bench_layout"){
+                unsigned eval_count = 1000;
+                if(argc > 2)
+                        eval_count = std::stoul(argv[2]);
+
+                uint64_t rank_checksum = test_pot_eval<CHPot>("ch_pot_rank_layout", tail, head, lower_bound_weight, source, target, eval_count, ch);
+                uint64_t reordered_checksum = test_pot_eval<ReorderedCHPot>("ch_pot_reordered_layout", tail, head, lower_bound_weight, source, target, eval_count, ch);
+                if(rank_checksum != reordered_checksum){
+                        cout << "Potentials with rank and reordered layout differ" << endl;
+                        return 1;
+                }
+                return 0;
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "bench_multi_target"){
+                uint64_t single_checksum = test_multi_target_pot<0>("many_to_one", tail, head, lower_bound_weight, source, target, ch);
+                uint64_t checksum_8 = test_multi_target_pot<8>("multi_target_8", tail, head, lower_bound_weight, source, target, ch);
+                uint64_t checksum_16 = test_multi_target_pot<16>("multi_target_16", tail, head, lower_bound_weight, source, target, ch);
+                if(single_checksum != checksum_8 || single_checksum != checksum_16){
+                        cout << "Single and multi target potentials differ" << endl;
+                        return 1;
+                }
+                return 0;
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "live_traffic"){
+                unsigned thread_count = std::thread::hardware_concurrency();
+                if(argc > 2)
+                        thread_count = std::stoul(argv[2]);
+                if(thread_count == 0)
+                        thread_count = 1;
+                unsigned publish_interval_in_ms = 10;
+                if(argc > 3)
+                        publish_interval_in_ms = std::stoul(argv[3]);
+                return test_live_traffic(thread_count, publish_interval_in_ms, first_out, tail, head, lower_bound_weight, source, target, ch);
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "bench_rphast"){
+                unsigned region_size = 10000;
+                if(argc > 2)
+                        region_size = std::stoul(argv[2]);
+                return test_rphast(region_size, 100, first_out, tail, head, lower_bound_weight, source, ch);
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "matrix"){
+                unsigned matrix_size = 1000;
+                if(argc > 2)
+                        matrix_size = std::stoul(argv[2]);
+                unsigned thread_count = std::thread::hardware_concurrency();
+                if(argc > 3)
+                        thread_count = std::stoul(argv[3]);
+                if(thread_count == 0)
+                        thread_count = 1;
+
+                return test_many_to_many(matrix_size, thread_count, tail, head, lower_bound_weight, source, target, ch);
+        }
+
         unsigned query_count = source.size();
 
         std::vector<unsigned>ref_dist(query_count);
@@ -466,6 +1031,30 @@ int main(int argc, char*argv[]){
                 cout << ref_dist[i] << " ";
         }
         cout << endl;
+
+        if(argc > 1 && std::string(argv[1]) == "group"){
+                test_target_grouped_astar<PotUsingCHManyToOneQuery>("many_to_one", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                test_target_grouped_astar<CHPot>("ch_pot", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                return 0;
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "bench_queue"){
+                test_queue<MinIDQueue>("binary_heap", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                test_queue<RadixIDQueue>("radix_heap", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                return 0;
+        }
+
+        if(argc > 1 && std::string(argv[1]) == "batch"){
+                unsigned thread_count = std::thread::hardware_concurrency();
+                if(argc > 2)
+                        thread_count = std::stoul(argv[2]);
+                if(thread_count == 0)
+                        thread_count = 1;
+
+                test_parallel_astar<PotUsingCHManyToOneQuery>("many_to_one", thread_count, first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                test_parallel_astar<CHPot>("ch_pot", thread_count, first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                return 0;
+        }
        
         
         for(unsigned i=0; i<20; ++i){
@@ -474,6 +1063,10 @@ int main(int argc, char*argv[]){
                 test_astar<PotUsingCHManyToOneQuery>("many_to_one", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
                 cerr << i << ',';
                 test_astar<CHPot>("ch_pot", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                cerr << i << ',';
+                test_astar<CHPot, FusedAStar>("ch_pot_fused", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
+                cerr << i << ',';
+                test_astar<BidirectionalPot<CHPot>, BidirectionalAStar>("bidir_ch_pot", first_out, tail, head, lower_bound_weight, query_weight, source, target, ref_dist, ch);
         }
 
     
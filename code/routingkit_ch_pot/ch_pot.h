@@ -0,0 +1,1634 @@
+#ifndef CH_POT_H
+#define CH_POT_H
+
+// Potentials and A* searches shared by the ch_pot benchmark and the route server.
+
+#include <routingkit/timestamp_flag.h>
+#include <routingkit/contraction_hierarchy.h>
+#include <routingkit/id_queue.h>
+
+#include "../routingkit2/src/file_array.h"
+#include "../routingkit2/src/parallel.h"
+#include "../routingkit2/src/span.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#ifdef __AVX2__
+#include <immintrin.h>
+#endif
+
+using namespace RoutingKit;
+
+// Read-only view of an array. It can refer to a std::vector or to a file that is
+// mapped into memory. Mapped files are shared between all processes on a host.
+typedef RoutingKit2::Span<const unsigned> ConstArray;
+
+inline ConstArray as_const_array(const RoutingKit2::FileArray<unsigned>&a){
+        return {a.data(), a.data()+a.size()};
+}
+
+// The parts of a ContractionHierarchy needed by CHPot as views.
+struct ContractionHierarchyView{
+        struct Side{
+                ConstArray first_out;
+                ConstArray head;
+                ConstArray weight;
+        };
+
+        ConstArray rank;
+        ConstArray order;
+        Side forward;
+        Side backward;
+
+        ContractionHierarchyView(){}
+
+        explicit ContractionHierarchyView(const ContractionHierarchy&ch):
+                rank(ch.rank), order(ch.order),
+                forward{ch.forward.first_out, ch.forward.head, ch.forward.weight},
+                backward{ch.backward.first_out, ch.backward.head, ch.backward.weight}{}
+
+        unsigned node_count()const{
+                return rank.size();
+        }
+};
+
+// A CH stored in the format written by compute_ch and mapped into memory. Only
+// the rank is computed on load because compute_ch does not store it.
+struct MappedContractionHierarchy{
+        RoutingKit2::FileArray<unsigned>order;
+        RoutingKit2::FileArray<unsigned>forward_first_out, forward_head, forward_weight;
+        RoutingKit2::FileArray<unsigned>backward_first_out, backward_head, backward_weight;
+        std::vector<unsigned>rank;
+
+        explicit MappedContractionHierarchy(const std::string&dir):
+                order(dir+"order"),
+                forward_first_out(dir+"forward_first_out"), forward_head(dir+"forward_head"), forward_weight(dir+"forward_weight"),
+                backward_first_out(dir+"backward_first_out"), backward_head(dir+"backward_head"), backward_weight(dir+"backward_weight"),
+                rank(order.size()){
+                for(unsigned r=0; r<order.size(); ++r)
+                        rank[order[r]] = r;
+        }
+
+        ContractionHierarchyView as_view()const{
+                ContractionHierarchyView view;
+                view.rank = rank;
+                view.order = as_const_array(order);
+                view.forward = {as_const_array(forward_first_out), as_const_array(forward_head), as_const_array(forward_weight)};
+                view.backward = {as_const_array(backward_first_out), as_const_array(backward_head), as_const_array(backward_weight)};
+                return view;
+        }
+};
+
+// Radix heap with the same interface as MinIDQueue. It requires that keys are
+// monotone, i.e., that no key smaller than the last popped key is ever pushed.
+// This holds for Dijkstra and for A* with a consistent potential. Bucket 0
+// contains the elements whose key equals the last popped key. Bucket i>0
+// contains the elements whose key differs from it first in bit i-1.
+class RadixIDQueue{
+public:
+        RadixIDQueue():last_popped_key(0), element_count(0){}
+
+        explicit RadixIDQueue(unsigned id_count):
+                bucket_of_id(id_count),
+                pos_in_bucket(id_count, invalid_id),
+                key_of_id(id_count),
+                last_popped_key(0),
+                element_count(0){}
+
+        bool contains_id(unsigned id)const{
+                return pos_in_bucket[id] != invalid_id;
+        }
+
+        bool empty()const{
+                return element_count == 0;
+        }
+
+        unsigned size()const{
+                return element_count;
+        }
+
+        unsigned id_count()const{
+                return key_of_id.size();
+        }
+
+        void clear(){
+                for(auto&b:bucket){
+                        for(unsigned id:b)
+                                pos_in_bucket[id] = invalid_id;
+                        b.clear();
+                }
+                last_popped_key = 0;
+                element_count = 0;
+        }
+
+        void push(IDKeyPair p){
+                assert(!contains_id(p.id));
+                assert(p.key >= last_popped_key);
+                key_of_id[p.id] = p.key;
+                insert_into_bucket(p.id);
+                ++element_count;
+        }
+
+        IDKeyPair peek(){
+                assert(!empty());
+                if(bucket[0].empty())
+                        refill_first_bucket();
+                unsigned id = bucket[0].back();
+                return {id, key_of_id[id]};
+        }
+
+        IDKeyPair pop(){
+                IDKeyPair p = peek();
+                bucket[0].pop_back();
+                pos_in_bucket[p.id] = invalid_id;
+                --element_count;
+                return p;
+        }
+
+        void decrease_key(IDKeyPair p){
+                assert(contains_id(p.id));
+                assert(p.key <= key_of_id[p.id]);
+                assert(p.key >= last_popped_key);
+                remove_from_bucket(p.id);
+                key_of_id[p.id] = p.key;
+                insert_into_bucket(p.id);
+        }
+
+        unsigned get_key(unsigned id)const{
+                assert(contains_id(id));
+                return key_of_id[id];
+        }
+
+private:
+        static const unsigned bucket_count = 33;
+
+        unsigned bucket_index(unsigned key)const{
+                if(key == last_popped_key)
+                        return 0;
+                else
+                        return 32 - __builtin_clz(key ^ last_popped_key);
+        }
+
+        void insert_into_bucket(unsigned id){
+                unsigned b = bucket_index(key_of_id[id]);
+                bucket_of_id[id] = b;
+                pos_in_bucket[id] = bucket[b].size();
+                bucket[b].push_back(id);
+        }
+
+        void remove_from_bucket(unsigned id){
+                std::vector<unsigned>&b = bucket[bucket_of_id[id]];
+                unsigned last = b.back();
+                b[pos_in_bucket[id]] = last;
+                pos_in_bucket[last] = pos_in_bucket[id];
+                b.pop_back();
+        }
+
+        // Moves the elements of the first non-empty bucket into lower buckets. All
+        // elements with the smallest key end up in bucket 0.
+        void refill_first_bucket(){
+                unsigned i = 1;
+                while(bucket[i].empty())
+                        ++i;
+
+                unsigned min_key = key_of_id[bucket[i][0]];
+                for(unsigned id:bucket[i])
+                        if(key_of_id[id] < min_key)
+                                min_key = key_of_id[id];
+                last_popped_key = min_key;
+
+                redistribute_buffer.swap(bucket[i]);
+                for(unsigned id:redistribute_buffer)
+                        insert_into_bucket(id);
+                redistribute_buffer.clear();
+        }
+
+        std::vector<unsigned>bucket[bucket_count];
+        std::vector<unsigned char>bucket_of_id;
+        std::vector<unsigned>pos_in_bucket;
+        std::vector<unsigned>key_of_id;
+        std::vector<unsigned>redistribute_buffer;
+        unsigned last_popped_key;
+        unsigned element_count;
+};
+
+struct ZeroPot{
+        unsigned eval(unsigned source_node){
+                return 0;
+        }
+
+        void set_target(unsigned target_node){
+
+        }
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                
+        }
+};
+
+struct PotUsingCHQuery{
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                ch_query.reset(ch);
+        }
+
+        void set_target(unsigned target_node){
+                this->target_node = target_node;
+        }
+
+        unsigned eval(unsigned source_node){
+                return ch_query.reset().add_source(source_node).add_target(target_node).run().get_distance();
+        }
+
+        ContractionHierarchyQuery ch_query;
+        unsigned target_node;
+};
+
+
+struct PotUsingCHManyToOneQuery{
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                ch_query.reset(ch);
+                pot.resize(node_count);
+                for(unsigned i=0; i<node_count; ++i)
+                        pot[i] = i;
+                ch_query.pin_sources(pot);
+        }
+
+        void set_target(unsigned target_node){
+                ch_query.reset_target().add_target(target_node).run_to_pinned_sources().get_distances_to_sources(pot.data());
+        }
+
+        unsigned eval(unsigned source_node){
+                return pot[source_node];
+        }
+
+        ContractionHierarchyQuery ch_query;
+        std::vector<unsigned>pot;
+};
+
+struct QueryWeight{
+
+        QueryWeight(ConstArray lower_bound_weight, unsigned percent_extra):
+                lower_bound_weight(lower_bound_weight), percent(percent_extra+100){}
+
+        unsigned eval(unsigned arc)const{
+                if(lower_bound_weight[arc] < inf_weight)
+                        return static_cast<uint64_t>(lower_bound_weight[arc])*percent / 100;
+                else
+                        return inf_weight;
+        }
+
+        ConstArray lower_bound_weight;
+        unsigned percent;
+};
+
+// The weights that a reader of a QueryWeightStore uses during one query. It
+// can be used in place of QueryWeight.
+struct PinnedQueryWeight{
+        const unsigned*weight;
+
+        PinnedQueryWeight():weight(nullptr){}
+
+        unsigned eval(unsigned arc)const{
+                return weight[arc];
+        }
+};
+
+// Query weights that can be replaced while queries run, e.g., every minute
+// from a traffic feed. Every reader has an id in [0, reader_count) and pins
+// the current weights before a query and unpins them afterwards. A writer
+// builds the next weights on its own thread and publishes them. Readers never
+// wait for writers.
+//
+// Publication is epoch based. Publishing makes the new weights current and
+// then advances the epoch. A pinning reader first announces the epoch it saw
+// and then loads the current weights, so a reader that announced an epoch
+// after a publication can not see the replaced weights. Replaced weights are
+// freed by later publications or by reclaim once no reader has announced an
+// epoch from before their replacement.
+//
+// Published weights are raised to lower_bound_weight where they are below it.
+// Potentials computed on a CH of lower_bound_weight thus stay feasible and
+// the CH does not need to be rebuilt.
+class QueryWeightStore{
+public:
+        QueryWeightStore(ConstArray lower_bound_weight, unsigned percent_extra, unsigned reader_count):
+                lower_bound_weight(lower_bound_weight),
+                reader(new Reader[reader_count]),
+                reader_count(reader_count),
+                epoch(1){
+                for(unsigned i=0; i<reader_count; ++i)
+                        reader[i].pinned_epoch.store(not_pinned);
+
+                QueryWeight initial_weight(lower_bound_weight, percent_extra);
+                std::vector<unsigned>weight(lower_bound_weight.size());
+                for(unsigned xy=0; xy<weight.size(); ++xy)
+                        weight[xy] = initial_weight.eval(xy);
+                current.store(new std::vector<unsigned>(std::move(weight)));
+        }
+
+        QueryWeightStore(const QueryWeightStore&) = delete;
+        QueryWeightStore&operator=(const QueryWeightStore&) = delete;
+
+        ~QueryWeightStore(){
+                delete current.load();
+                for(auto&r:retired)
+                        delete r.weight;
+        }
+
+        void pin(unsigned reader_id, PinnedQueryWeight&w){
+                assert(reader_id < reader_count);
+                assert(reader[reader_id].pinned_epoch.load() == not_pinned);
+                reader[reader_id].pinned_epoch.store(epoch.load());
+                w.weight = current.load()->data();
+        }
+
+        void unpin(unsigned reader_id){
+                assert(reader_id < reader_count);
+                reader[reader_id].pinned_epoch.store(not_pinned);
+        }
+
+        // Replaces the current weights. weight must have one entry per arc.
+        // Returns the epoch from which on readers see the new weights.
+        uint64_t publish(std::vector<unsigned>weight){
+                if(weight.size() != lower_bound_weight.size())
+                        throw std::runtime_error("the weights must have one entry per arc");
+                for(unsigned xy=0; xy<weight.size(); ++xy)
+                        if(weight[xy] < lower_bound_weight[xy])
+                                weight[xy] = lower_bound_weight[xy];
+
+                std::vector<unsigned>*next = new std::vector<unsigned>(std::move(weight));
+
+                std::lock_guard<std::mutex>guard(writer_lock);
+                std::vector<unsigned>*prev = current.exchange(next);
+                uint64_t next_epoch = epoch.fetch_add(1) + 1;
+                retired.push_back({next_epoch, prev});
+                reclaim_retired_weights();
+                return next_epoch;
+        }
+
+        // Frees the replaced weights that no reader can use anymore. Returns
+        // the number of replaced weights that are still kept.
+        unsigned reclaim(){
+                std::lock_guard<std::mutex>guard(writer_lock);
+                reclaim_retired_weights();
+                return retired.size();
+        }
+
+        uint64_t get_epoch()const{
+                return epoch.load();
+        }
+
+private:
+        static const uint64_t not_pinned = std::numeric_limits<uint64_t>::max();
+
+        // Each reader has its own cache line so that pinning does not cause
+        // false sharing between the readers.
+        struct alignas(64) Reader{
+                std::atomic<uint64_t>pinned_epoch;
+        };
+
+        struct RetiredWeight{
+                // Readers that announced this epoch or a later one can not use weight.
+                uint64_t replaced_in_epoch;
+                std::vector<unsigned>*weight;
+        };
+
+        void reclaim_retired_weights(){
+                uint64_t min_pinned_epoch = not_pinned;
+                for(unsigned i=0; i<reader_count; ++i)
+                        min_pinned_epoch = std::min(min_pinned_epoch, reader[i].pinned_epoch.load());
+
+                unsigned out = 0;
+                for(auto&r:retired){
+                        if(r.replaced_in_epoch <= min_pinned_epoch)
+                                delete r.weight;
+                        else
+                                retired[out++] = r;
+                }
+                retired.resize(out);
+        }
+
+        ConstArray lower_bound_weight;
+        std::unique_ptr<Reader[]>reader;
+        unsigned reader_count;
+
+        std::atomic<uint64_t>epoch;
+        std::atomic<std::vector<unsigned>*>current;
+
+        std::mutex writer_lock;
+        std::vector<RetiredWeight>retired;
+};
+
+// Pins the weights of a QueryWeightStore for the lifetime of the object.
+struct QueryWeightPin{
+        QueryWeightStore&store;
+        unsigned reader_id;
+
+        QueryWeightPin(QueryWeightStore&store, unsigned reader_id, PinnedQueryWeight&w):
+                store(store), reader_id(reader_id){
+                store.pin(reader_id, w);
+        }
+
+        QueryWeightPin(const QueryWeightPin&) = delete;
+        QueryWeightPin&operator=(const QueryWeightPin&) = delete;
+
+        ~QueryWeightPin(){
+                store.unpin(reader_id);
+        }
+};
+
+// A CH layout determines how BasicCHPot stores the CH. It identifies every node by
+// an internal id and gives access to the upward arcs of both sides by id. This
+// layout uses the CH as given, the internal id of a node is its rank.
+struct RankOrderedCHLayout{
+        ContractionHierarchyView ch;
+
+        void build(const ContractionHierarchyView&ch){
+                this->ch = ch;
+        }
+
+        unsigned to_id(unsigned node)const{ return ch.rank[node]; }
+        unsigned to_node(unsigned x)const{ return ch.order[x]; }
+
+        unsigned forward_first_out(unsigned x)const{ return ch.forward.first_out[x]; }
+        unsigned forward_head(unsigned xy)const{ return ch.forward.head[xy]; }
+        unsigned forward_weight(unsigned xy)const{ return ch.forward.weight[xy]; }
+
+        unsigned backward_first_out(unsigned x)const{ return ch.backward.first_out[x]; }
+        unsigned backward_head(unsigned xy)const{ return ch.backward.head[xy]; }
+        unsigned backward_weight(unsigned xy)const{ return ch.backward.weight[xy]; }
+};
+
+// A cache-friendlier copy of the CH. The nodes are renumbered in pseudo-DFS order
+// over the upward arcs, so that nodes on common upward paths are close in memory.
+// Head and weight of every arc are stored next to each other.
+struct DFSOrderedCHLayout{
+        struct Arc{
+                unsigned head;
+                unsigned weight;
+        };
+
+        struct Side{
+                std::vector<unsigned>first_out;
+                std::vector<Arc>arc;
+        };
+
+        std::vector<unsigned>node_to_slot, slot_to_node;
+        Side forward, backward;
+
+        void build(const ContractionHierarchyView&ch){
+                unsigned node_count = ch.node_count();
+                std::vector<unsigned>slot_of_rank(node_count, invalid_id);
+                std::vector<unsigned>rank_of_slot(node_count);
+                {
+                        unsigned next_slot = 0;
+                        std::vector<unsigned>stack;
+                        auto assign_slot = [&](unsigned r){
+                                slot_of_rank[r] = next_slot;
+                                rank_of_slot[next_slot] = r;
+                                ++next_slot;
+                                stack.push_back(r);
+                        };
+                        for(unsigned r=0; r<node_count; ++r){
+                                if(slot_of_rank[r] == invalid_id){
+                                        assign_slot(r);
+                                        while(!stack.empty()){
+                                                unsigned x = stack.back();
+                                                stack.pop_back();
+                                                for(unsigned xy=ch.forward.first_out[x]; xy<ch.forward.first_out[x+1]; ++xy)
+                                                        if(slot_of_rank[ch.forward.head[xy]] == invalid_id)
+                                                                assign_slot(ch.forward.head[xy]);
+                                        }
+                                }
+                        }
+                }
+
+                auto build_side = [&](const ContractionHierarchyView::Side&side, Side&out){
+                        out.first_out.resize(node_count+1);
+                        out.arc.clear();
+                        out.arc.reserve(side.head.size());
+                        for(unsigned x=0; x<node_count; ++x){
+                                out.first_out[x] = out.arc.size();
+                                unsigned r = rank_of_slot[x];
+                                for(unsigned xy=side.first_out[r]; xy<side.first_out[r+1]; ++xy)
+                                        out.arc.push_back({slot_of_rank[side.head[xy]], side.weight[xy]});
+                        }
+                        out.first_out[node_count] = out.arc.size();
+                };
+                build_side(ch.forward, forward);
+                build_side(ch.backward, backward);
+
+                node_to_slot.resize(node_count);
+                slot_to_node.resize(node_count);
+                for(unsigned x=0; x<node_count; ++x){
+                        node_to_slot[x] = slot_of_rank[ch.rank[x]];
+                        slot_to_node[node_to_slot[x]] = x;
+                }
+        }
+
+        unsigned to_id(unsigned node)const{ return node_to_slot[node]; }
+        unsigned to_node(unsigned x)const{ return slot_to_node[x]; }
+
+        unsigned forward_first_out(unsigned x)const{ return forward.first_out[x]; }
+        unsigned forward_head(unsigned xy)const{ return forward.arc[xy].head; }
+        unsigned forward_weight(unsigned xy)const{ return forward.arc[xy].weight; }
+
+        unsigned backward_first_out(unsigned x)const{ return backward.first_out[x]; }
+        unsigned backward_head(unsigned xy)const{ return backward.arc[xy].head; }
+        unsigned backward_weight(unsigned xy)const{ return backward.arc[xy].weight; }
+};
+
+template<class IDQueue, class CHLayout = RankOrderedCHLayout>
+struct BasicCHPot{
+        CHLayout ch;
+        std::vector<unsigned>tentative_distance;
+        TimestampFlags was_pot_computed, was_pushed;
+        IDQueue queue;
+
+        struct EvalFrame{
+                unsigned node;
+                unsigned next_arc;
+                unsigned dist;
+        };
+        std::vector<EvalFrame>eval_stack;
+        #ifndef NDEBUG
+        // The results are only checked if a ContractionHierarchy is available
+        bool has_ch_query;
+        ContractionHierarchyQuery ch_query;
+        unsigned target_node;
+        #endif        
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                preprocess(node_count, tail, head, lower_bound_weight, ContractionHierarchyView(ch));
+                #ifndef NDEBUG
+                ch_query.reset(ch);
+                has_ch_query = true;
+                #endif
+        }
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchyView&ch){
+                tentative_distance.resize(node_count);
+                was_pushed = TimestampFlags(node_count);
+                was_pot_computed = TimestampFlags(node_count);
+                queue = IDQueue(node_count);
+                eval_stack.clear();
+                this->ch.build(ch);
+                #ifndef NDEBUG
+                has_ch_query = false;
+                #endif
+        }
+
+        void set_target(unsigned target_node){
+                #ifndef NDEBUG
+                this->target_node = target_node;
+                #endif
+
+                unsigned t = ch.to_id(target_node);
+
+                was_pushed.reset_all();
+                queue.clear();
+                queue.push({t, 0});
+                was_pushed.set(t);
+                tentative_distance[t] = 0;
+                
+                #ifndef NDEBUG
+                unsigned last_key = 0;
+                #endif
+
+                while(!queue.empty()){
+                        auto e = queue.pop();
+                        unsigned x = e.id;
+                        unsigned x_dist = e.key;
+                        #ifndef NDEBUG
+                        assert(e.key >= last_key);
+                        last_key = e.key;
+                        assert(was_pushed.is_set(x));
+                        if(has_ch_query){
+                                unsigned correct_dist = ch_query.reset().add_source(ch.to_node(x)).add_target(target_node).run().get_distance();
+                                assert(correct_dist <= x_dist);
+                        }
+                        #endif
+                        for(unsigned xy = ch.backward_first_out(x); xy < ch.backward_first_out(x+1); ++xy){
+                                unsigned xy_dist = ch.backward_weight(xy);
+                                if(xy_dist < inf_weight){
+                                        unsigned y = ch.backward_head(xy);
+                                        unsigned y_dist = x_dist + xy_dist;
+
+                                        #ifndef NDEBUG
+                                        if(has_ch_query){
+                                                unsigned correct_y_dist = ch_query.reset().add_source(ch.to_node(y)).add_target(target_node).run().get_distance();
+                                                assert(correct_y_dist <= y_dist);
+                                        }
+                                        #endif
+
+                                        if(!was_pushed.is_set(y)){
+                                                tentative_distance[y] = y_dist;
+                                                was_pushed.set(y);
+                                                queue.push({y, y_dist});
+                                        }else if(tentative_distance[y] > y_dist){
+                                                tentative_distance[y] = y_dist;
+                                                if(queue.contains_id(y)){
+                                                        queue.decrease_key({y, y_dist});
+                                                }
+                                        }
+                                }
+                        }
+                }
+
+                was_pot_computed.reset_all();
+        }
+
+protected:
+        // Recursive formulation: The recursion depth is the length of the longest
+        // upward path in the CH, which can overflow the thread stack on large graphs.
+        unsigned eval_using_ch_node_order_recursively(unsigned x){
+                if(!was_pot_computed.is_set(x)){
+                        unsigned x_dist;
+                        if(was_pushed.is_set(x))
+                                x_dist = tentative_distance[x];
+                        else
+                                x_dist = inf_weight;
+
+                        for(unsigned xy = ch.forward_first_out(x); xy < ch.forward_first_out(x+1); ++xy){
+                                unsigned xy_dist = ch.forward_weight(xy);
+                                unsigned y = ch.forward_head(xy);
+                                unsigned y_dist = eval_using_ch_node_order_recursively(y);
+                                unsigned d = xy_dist + y_dist;
+                                if(d < x_dist)
+                                        x_dist = d; 
+                        }
+                        tentative_distance[x] = x_dist;
+                        was_pot_computed.set(x);
+                }
+                return tentative_distance[x];
+        }
+
+        // Same as above but the recursion is replaced by an explicit stack of frames.
+        // The stack is a member and thus its memory is reused across queries. Its size
+        // is bounded by the length of the longest upward path in the CH.
+        unsigned eval_using_ch_node_order_iteratively(unsigned s){
+                if(was_pot_computed.is_set(s))
+                        return tentative_distance[s];
+
+                auto push_frame = [&](unsigned x){
+                        unsigned x_dist;
+                        if(was_pushed.is_set(x))
+                                x_dist = tentative_distance[x];
+                        else
+                                x_dist = inf_weight;
+                        eval_stack.push_back({x, ch.forward_first_out(x), x_dist});
+                };
+
+                eval_stack.clear();
+                push_frame(s);
+
+                while(!eval_stack.empty()){
+                        EvalFrame&f = eval_stack.back();
+                        unsigned x = f.node;
+                        unsigned xy = f.next_arc;
+                        unsigned xy_end = ch.forward_first_out(x+1);
+                        bool is_finished = true;
+
+                        for(; xy < xy_end; ++xy){
+                                unsigned y = ch.forward_head(xy);
+                                if(!was_pot_computed.is_set(y)){
+                                        // Descend into y. Once y is finished, arc xy is
+                                        // looked at again and y's distance is then known.
+                                        f.next_arc = xy;
+                                        push_frame(y); // invalidates f
+                                        is_finished = false;
+                                        break;
+                                }
+                                unsigned d = ch.forward_weight(xy) + tentative_distance[y];
+                                if(d < f.dist)
+                                        f.dist = d;
+                        }
+
+                        if(is_finished){
+                                tentative_distance[x] = f.dist;
+                                was_pot_computed.set(x);
+                                eval_stack.pop_back();
+                        }
+                }
+                return tentative_distance[s];
+        }
+public:
+
+        unsigned eval(unsigned source_node){
+                unsigned x_pot = eval_using_ch_node_order_iteratively(ch.to_id(source_node));
+                #ifndef NDEBUG
+                if(has_ch_query){
+                        unsigned correct_dist = ch_query.reset().add_source(source_node).add_target(target_node).run().get_distance();
+                        assert(correct_dist == x_pot);
+                }
+                #endif
+
+                return x_pot;
+        }
+
+
+};
+
+typedef BasicCHPot<MinIDQueue> CHPot;
+
+// Uses the original recursive evaluation. Only kept to compare against CHPot.
+struct RecursiveCHPot : CHPot{
+        unsigned eval(unsigned source_node){
+                unsigned x_pot = eval_using_ch_node_order_recursively(ch.to_id(source_node));
+                #ifndef NDEBUG
+                if(has_ch_query){
+                        unsigned correct_dist = ch_query.reset().add_source(source_node).add_target(target_node).run().get_distance();
+                        assert(correct_dist == x_pot);
+                }
+                #endif
+
+                return x_pot;
+        }
+};
+
+// Same potential as CHPot but the CH is stored in DFSOrderedCHLayout.
+typedef BasicCHPot<MinIDQueue, DFSOrderedCHLayout> ReorderedCHPot;
+
+template<class QueryWeight, class Potential, class IDQueue = MinIDQueue>
+struct AStar{
+        ConstArray first_out;
+        ConstArray head;
+        const QueryWeight&query_weight;
+        Potential&pot;
+        IDQueue queue;
+        std::vector<unsigned>tentative_distance;
+        std::vector<unsigned>predecessor;
+        TimestampFlags was_pushed;
+        unsigned source_node;
+
+        AStar(ConstArray first_out, ConstArray head, const QueryWeight&query_weight, Potential&pot):
+                first_out(first_out), head(head), 
+                query_weight(query_weight), pot(pot),
+                queue(first_out.size()-1),
+                tentative_distance(first_out.size()-1, inf_weight),
+                predecessor(first_out.size()-1),
+                was_pushed(first_out.size()-1){}
+
+        unsigned run(unsigned source_node, unsigned target_node){
+                this->source_node = source_node;
+                was_pushed.reset_all();
+                queue.clear();
+                tentative_distance[source_node] = 0;
+                queue.push({source_node, pot.eval(source_node)});
+                was_pushed.set(source_node);
+                
+                #ifndef NDEBUG
+                unsigned last_key = 0;
+                #endif
+
+                while(!queue.empty()){
+                        auto e = queue.pop();
+                        #ifndef NDEBUG
+                        assert(e.key >= last_key);
+                        last_key = e.key;
+                        assert(was_pushed.is_set(e.id));
+                        assert(e.key == pot.eval(e.id) + tentative_distance[e.id]);
+                        #endif
+                        unsigned x = e.id;
+                        unsigned x_dist = tentative_distance[x];
+                        if(x == target_node)
+                                break;
+                        for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
+                                unsigned y = head[xy];
+                                unsigned xy_dist = query_weight.eval(xy);
+                                if(xy_dist < inf_weight){
+                                        unsigned y_pot = pot.eval(y);
+                                        unsigned y_dist = x_dist + xy_dist;
+
+                                        if(was_pushed.is_set(y)){
+                                                if(tentative_distance[y] > y_dist){
+                                                        queue.decrease_key({y, y_dist+y_pot});
+                                                        tentative_distance[y] = y_dist;
+                                                        predecessor[y] = x;
+                                                }
+                                        }else{
+                                                was_pushed.set(y);
+                                                tentative_distance[y] = y_dist;
+                                                predecessor[y] = x;
+                                                queue.push({y, y_dist+y_pot});
+                                        }
+                                }
+                        }
+                }
+
+                if(was_pushed.is_set(target_node))
+                        return tentative_distance[target_node] ;
+                else
+                        return inf_weight;
+        }
+
+        // The nodes of the shortest path to target_node found by the last run,
+        // starting with its source. Empty if target_node was not reached.
+        std::vector<unsigned>get_node_path(unsigned target_node)const{
+                std::vector<unsigned>path;
+                if(!was_pushed.is_set(target_node))
+                        return path;
+                unsigned x = target_node;
+                path.push_back(x);
+                while(x != source_node){
+                        x = predecessor[x];
+                        path.push_back(x);
+                }
+                std::reverse(path.begin(), path.end());
+                return path;
+        }
+};
+
+// Same search as AStar but all per-node state is stored in one struct, i.e., the
+// timestamp that replaces was_pushed, the tentative distance, the potential and
+// the position in the heap. Relaxing an arc thus touches a single cache line of the
+// node state array. The potential of a node is evaluated once per query when the
+// node is first reached. The queue is a binary heap that stores the key next to the
+// id.
+template<class QueryWeight, class Potential>
+struct FusedAStar{
+        struct NodeState{
+                unsigned timestamp;
+                unsigned tentative_distance;
+                unsigned pot;
+                unsigned heap_pos;
+        };
+
+        ConstArray first_out;
+        ConstArray head;
+        const QueryWeight&query_weight;
+        Potential&pot;
+        std::vector<NodeState>node_state;
+        std::vector<IDKeyPair>heap;
+        unsigned current_timestamp;
+
+        FusedAStar(ConstArray first_out, ConstArray head, const QueryWeight&query_weight, Potential&pot):
+                first_out(first_out), head(head),
+                query_weight(query_weight), pot(pot),
+                node_state(first_out.size()-1, NodeState{0, inf_weight, 0, invalid_id}),
+                current_timestamp(0){
+                heap.reserve(first_out.size()-1);
+        }
+
+        unsigned run(unsigned source_node, unsigned target_node){
+                start_new_query();
+
+                NodeState&s = node_state[source_node];
+                s.timestamp = current_timestamp;
+                s.tentative_distance = 0;
+                s.pot = pot.eval(source_node);
+                heap_push(source_node, s.pot);
+
+                #ifndef NDEBUG
+                unsigned last_key = 0;
+                #endif
+
+                while(!heap.empty()){
+                        auto e = heap_pop();
+                        #ifndef NDEBUG
+                        assert(e.key >= last_key);
+                        last_key = e.key;
+                        assert(node_state[e.id].timestamp == current_timestamp);
+                        assert(e.key == node_state[e.id].pot + node_state[e.id].tentative_distance);
+                        #endif
+                        unsigned x = e.id;
+                        unsigned x_dist = node_state[x].tentative_distance;
+                        if(x == target_node)
+                                break;
+                        for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
+                                unsigned xy_dist = query_weight.eval(xy);
+                                if(xy_dist < inf_weight){
+                                        unsigned y = head[xy];
+                                        NodeState&y_state = node_state[y];
+                                        unsigned y_dist = x_dist + xy_dist;
+
+                                        if(y_state.timestamp == current_timestamp){
+                                                if(y_state.tentative_distance > y_dist){
+                                                        y_state.tentative_distance = y_dist;
+                                                        heap_decrease_key(y, y_dist+y_state.pot);
+                                                }
+                                        }else{
+                                                y_state.timestamp = current_timestamp;
+                                                y_state.tentative_distance = y_dist;
+                                                y_state.pot = pot.eval(y);
+                                                heap_push(y, y_dist+y_state.pot);
+                                        }
+                                }
+                        }
+                }
+
+                if(node_state[target_node].timestamp == current_timestamp)
+                        return node_state[target_node].tentative_distance;
+                else
+                        return inf_weight;
+        }
+
+private:
+        void start_new_query(){
+                for(auto&e:heap)
+                        node_state[e.id].heap_pos = invalid_id;
+                heap.clear();
+                ++current_timestamp;
+                if(current_timestamp == 0){
+                        for(auto&x:node_state)
+                                x.timestamp = 0;
+                        current_timestamp = 1;
+                }
+        }
+
+        void heap_move_to(unsigned pos, IDKeyPair e){
+                heap[pos] = e;
+                node_state[e.id].heap_pos = pos;
+        }
+
+        void heap_sift_up(unsigned pos, IDKeyPair e){
+                while(pos != 0){
+                        unsigned parent = (pos-1)/2;
+                        if(heap[parent].key <= e.key)
+                                break;
+                        heap_move_to(pos, heap[parent]);
+                        pos = parent;
+                }
+                heap_move_to(pos, e);
+        }
+
+        void heap_push(unsigned id, unsigned key){
+                heap.push_back({id, key});
+                heap_sift_up(heap.size()-1, {id, key});
+        }
+
+        void heap_decrease_key(unsigned id, unsigned key){
+                unsigned pos = node_state[id].heap_pos;
+                assert(pos != invalid_id);
+                assert(heap[pos].key >= key);
+                heap_sift_up(pos, {id, key});
+        }
+
+        IDKeyPair heap_pop(){
+                IDKeyPair top = heap.front();
+                node_state[top.id].heap_pos = invalid_id;
+                IDKeyPair e = heap.back();
+                heap.pop_back();
+                unsigned n = heap.size();
+                if(n != 0){
+                        unsigned pos = 0;
+                        for(;;){
+                                unsigned child = 2*pos+1;
+                                if(child >= n)
+                                        break;
+                                if(child+1 < n && heap[child+1].key < heap[child].key)
+                                        ++child;
+                                if(e.key <= heap[child].key)
+                                        break;
+                                heap_move_to(pos, heap[child]);
+                                pos = child;
+                        }
+                        heap_move_to(pos, e);
+                }
+                return top;
+        }
+};
+
+// Combines a potential towards the target with a potential from the source. The
+// latter is a Potential of the same type that works on the reversed graph. Its CH
+// is a view of the given CH with forward and backward swapped, so nothing is
+// copied. Both potentials refer to the arrays of the CH, which must thus outlive
+// the BidirectionalPot.
+template<class Potential>
+struct BidirectionalPot{
+        Potential to_target;
+        Potential from_source;
+
+        BidirectionalPot(){}
+        BidirectionalPot(const BidirectionalPot&) = delete;
+        BidirectionalPot&operator=(const BidirectionalPot&) = delete;
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                to_target.preprocess(node_count, tail, head, lower_bound_weight, ch);
+                preprocess_from_source(node_count, tail, head, lower_bound_weight, ContractionHierarchyView(ch));
+        }
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchyView&ch){
+                to_target.preprocess(node_count, tail, head, lower_bound_weight, ch);
+                preprocess_from_source(node_count, tail, head, lower_bound_weight, ch);
+        }
+
+        void set_target(unsigned target_node){
+                to_target.set_target(target_node);
+        }
+
+        void set_source(unsigned source_node){
+                from_source.set_target(source_node);
+        }
+
+        unsigned eval_to_target(unsigned node){
+                return to_target.eval(node);
+        }
+
+        unsigned eval_from_source(unsigned node){
+                return from_source.eval(node);
+        }
+
+private:
+        void preprocess_from_source(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchyView&ch){
+                ContractionHierarchyView reversed_ch = ch;
+                std::swap(reversed_ch.forward, reversed_ch.backward);
+                from_source.preprocess(node_count, head, tail, lower_bound_weight, reversed_ch);
+        }
+};
+
+// Bidirectional A* using the average potential p(v) = (pot_t(v) - pot_s(v))/2 for
+// the forward search and -p(v) for the backward search. Both searches are then
+// Dijkstra's algorithm on the same graph with reduced arc weights and the usual
+// stopping criterion of bidirectional Dijkstra applies. To avoid fractions and
+// negative queue keys, the keys are doubled and shifted such that the source and
+// the target have key 0.
+//
+// The Potential must be a BidirectionalPot. run() sets the source of the potential,
+// the time needed for this is thus part of the search time.
+template<class QueryWeight, class Potential>
+struct BidirectionalAStar{
+        ConstArray first_out;
+        ConstArray head;
+        std::vector<unsigned>backward_first_out;
+        std::vector<unsigned>backward_tail;
+        std::vector<unsigned>backward_arc;
+        const QueryWeight&query_weight;
+        Potential&pot;
+        MinIDQueue forward_queue, backward_queue;
+        std::vector<unsigned>forward_tentative_distance, backward_tentative_distance;
+        TimestampFlags forward_was_pushed, backward_was_pushed;
+
+        BidirectionalAStar(ConstArray first_out, ConstArray head, const QueryWeight&query_weight, Potential&pot):
+                first_out(first_out), head(head),
+                backward_first_out(first_out.size(), 0),
+                backward_tail(head.size()),
+                backward_arc(head.size()),
+                query_weight(query_weight), pot(pot),
+                forward_queue(first_out.size()-1),
+                backward_queue(first_out.size()-1),
+                forward_tentative_distance(first_out.size()-1, inf_weight),
+                backward_tentative_distance(first_out.size()-1, inf_weight),
+                forward_was_pushed(first_out.size()-1),
+                backward_was_pushed(first_out.size()-1){
+
+                unsigned node_count = first_out.size()-1;
+                unsigned arc_count = head.size();
+
+                for(unsigned xy=0; xy<arc_count; ++xy)
+                        ++backward_first_out[head[xy]+1];
+                for(unsigned x=0; x<node_count; ++x)
+                        backward_first_out[x+1] += backward_first_out[x];
+
+                std::vector<unsigned>next_out(backward_first_out.begin(), backward_first_out.end()-1);
+                for(unsigned x=0; x<node_count; ++x){
+                        for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
+                                unsigned i = next_out[head[xy]]++;
+                                backward_tail[i] = x;
+                                backward_arc[i] = xy;
+                        }
+                }
+        }
+
+        unsigned run(unsigned source_node, unsigned target_node){
+                if(source_node == target_node)
+                        return 0;
+
+                pot.set_source(source_node);
+
+                unsigned lower_bound = pot.eval_to_target(source_node);
+                if(lower_bound == inf_weight)
+                        return inf_weight;
+
+                auto forward_key = [&](unsigned x, unsigned x_dist, unsigned x_pot_to_target){
+                        long long key = 2*static_cast<long long>(x_dist) + x_pot_to_target - pot.eval_from_source(x) - lower_bound;
+                        assert(key >= 0 && key < inf_weight);
+                        return static_cast<unsigned>(key);
+                };
+
+                auto backward_key = [&](unsigned x, unsigned x_dist, unsigned x_pot_from_source){
+                        long long key = 2*static_cast<long long>(x_dist) + x_pot_from_source - pot.eval_to_target(x) - lower_bound;
+                        assert(key >= 0 && key < inf_weight);
+                        return static_cast<unsigned>(key);
+                };
+
+                forward_was_pushed.reset_all();
+                backward_was_pushed.reset_all();
+                forward_queue.clear();
+                backward_queue.clear();
+
+                forward_tentative_distance[source_node] = 0;
+                forward_queue.push({source_node, 0});
+                forward_was_pushed.set(source_node);
+
+                backward_tentative_distance[target_node] = 0;
+                backward_queue.push({target_node, 0});
+                backward_was_pushed.set(target_node);
+
+                unsigned shortest_path_length = inf_weight;
+
+                while(!forward_queue.empty() && !backward_queue.empty()){
+                        unsigned forward_min_key = forward_queue.peek().key;
+                        unsigned backward_min_key = backward_queue.peek().key;
+
+                        if(shortest_path_length != inf_weight){
+                                uint64_t reduced_shortest_path_length = 2*static_cast<uint64_t>(shortest_path_length - lower_bound);
+                                if(static_cast<uint64_t>(forward_min_key) + backward_min_key >= reduced_shortest_path_length)
+                                        break;
+                        }
+
+                        if(forward_min_key <= backward_min_key){
+                                unsigned x = forward_queue.pop().id;
+                                unsigned x_dist = forward_tentative_distance[x];
+                                for(unsigned xy=first_out[x]; xy<first_out[x+1]; ++xy){
+                                        unsigned xy_dist = query_weight.eval(xy);
+                                        if(xy_dist < inf_weight){
+                                                unsigned y = head[xy];
+                                                unsigned y_pot = pot.eval_to_target(y);
+                                                if(y_pot == inf_weight)
+                                                        continue;
+                                                unsigned y_dist = x_dist + xy_dist;
+
+                                                if(forward_was_pushed.is_set(y)){
+                                                        if(forward_tentative_distance[y] > y_dist){
+                                                                forward_tentative_distance[y] = y_dist;
+                                                                if(forward_queue.contains_id(y))
+                                                                        forward_queue.decrease_key({y, forward_key(y, y_dist, y_pot)});
+                                                        }
+                                                }else{
+                                                        forward_was_pushed.set(y);
+                                                        forward_tentative_distance[y] = y_dist;
+                                                        forward_queue.push({y, forward_key(y, y_dist, y_pot)});
+                                                }
+
+                                                if(backward_was_pushed.is_set(y) && y_dist + backward_tentative_distance[y] < shortest_path_length)
+                                                        shortest_path_length = y_dist + backward_tentative_distance[y];
+                                        }
+                                }
+                        }else{
+                                unsigned x = backward_queue.pop().id;
+                                unsigned x_dist = backward_tentative_distance[x];
+                                for(unsigned i=backward_first_out[x]; i<backward_first_out[x+1]; ++i){
+                                        unsigned yx_dist = query_weight.eval(backward_arc[i]);
+                                        if(yx_dist < inf_weight){
+                                                unsigned y = backward_tail[i];
+                                                unsigned y_pot = pot.eval_from_source(y);
+                                                if(y_pot == inf_weight)
+                                                        continue;
+                                                unsigned y_dist = x_dist + yx_dist;
+
+                                                if(backward_was_pushed.is_set(y)){
+                                                        if(backward_tentative_distance[y] > y_dist){
+                                                                backward_tentative_distance[y] = y_dist;
+                                                                if(backward_queue.contains_id(y))
+                                                                        backward_queue.decrease_key({y, backward_key(y, y_dist, y_pot)});
+                                                        }
+                                                }else{
+                                                        backward_was_pushed.set(y);
+                                                        backward_tentative_distance[y] = y_dist;
+                                                        backward_queue.push({y, backward_key(y, y_dist, y_pot)});
+                                                }
+
+                                                if(forward_was_pushed.is_set(y) && y_dist + forward_tentative_distance[y] < shortest_path_length)
+                                                        shortest_path_length = y_dist + forward_tentative_distance[y];
+                                        }
+                                }
+                        }
+                }
+
+                return shortest_path_length;
+        }
+};
+
+// Dijkstra search on one side of a CH that only goes to higher ranked nodes.
+// Node ids are ranks.
+struct CHUpwardSearch{
+        std::vector<unsigned>tentative_distance;
+        TimestampFlags was_pushed;
+        MinIDQueue queue;
+
+        CHUpwardSearch(){}
+
+        explicit CHUpwardSearch(unsigned node_count):
+                tentative_distance(node_count), was_pushed(node_count), queue(node_count){}
+
+        // Calls on_settle(x, dist) for every node x that is settled and not
+        // stalled. A node is stalled if the stall_side arcs to higher nodes
+        // reach it on a shorter path.
+        template<class OnSettle>
+        void run(const ContractionHierarchyView::Side&side, const ContractionHierarchyView::Side&stall_side, unsigned s, const OnSettle&on_settle){
+                was_pushed.reset_all();
+                queue.clear();
+                tentative_distance[s] = 0;
+                was_pushed.set(s);
+                queue.push({s, 0});
+
+                while(!queue.empty()){
+                        auto e = queue.pop();
+                        unsigned x = e.id;
+                        unsigned x_dist = e.key;
+
+                        bool is_stalled = false;
+                        for(unsigned xy = stall_side.first_out[x]; xy < stall_side.first_out[x+1]; ++xy){
+                                unsigned y = stall_side.head[xy];
+                                if(was_pushed.is_set(y) && stall_side.weight[xy] < inf_weight && tentative_distance[y] + stall_side.weight[xy] < x_dist){
+                                        is_stalled = true;
+                                        break;
+                                }
+                        }
+                        if(is_stalled)
+                                continue;
+
+                        on_settle(x, x_dist);
+
+                        for(unsigned xy = side.first_out[x]; xy < side.first_out[x+1]; ++xy){
+                                unsigned xy_dist = side.weight[xy];
+                                if(xy_dist < inf_weight){
+                                        unsigned y = side.head[xy];
+                                        unsigned y_dist = x_dist + xy_dist;
+                                        if(!was_pushed.is_set(y)){
+                                                tentative_distance[y] = y_dist;
+                                                was_pushed.set(y);
+                                                queue.push({y, y_dist});
+                                        }else if(tentative_distance[y] > y_dist){
+                                                tentative_distance[y] = y_dist;
+                                                if(queue.contains_id(y))
+                                                        queue.decrease_key({y, y_dist});
+                                        }
+                                }
+                        }
+                }
+        }
+};
+
+// Computes distance matrices with the bucket-based many-to-many algorithm. An
+// upward search in the backward CH is run from every target. Every node it
+// settles gets a bucket entry with the target and the distance. Then an upward
+// search in the forward CH is run from every source and every node it settles
+// is combined with the entries in its bucket. Both phases use stall-on-demand
+// and are distributed over thread_count threads, each of which owns its own
+// search state. A thread_count of 0 means std::thread::hardware_concurrency().
+//
+// The query object can be reused for several matrices but not by several
+// threads at the same time.
+struct ManyToManyCHQuery{
+        struct BucketEntry{
+                unsigned target_index;
+                unsigned dist;
+        };
+
+        // Sources and targets are claimed in chunks of this size.
+        static const unsigned chunk_size = 16;
+
+        ContractionHierarchyView ch;
+        unsigned thread_count;
+        std::vector<CHUpwardSearch>search;
+
+        // Bucket of rank x is first_bucket_entry[x]..first_bucket_entry[x+1]
+        std::vector<unsigned>first_bucket_entry;
+        std::vector<BucketEntry>bucket_entry;
+        std::vector<std::vector<std::pair<unsigned, BucketEntry>>>thread_bucket_entry;
+
+        ManyToManyCHQuery():thread_count(0){}
+
+        explicit ManyToManyCHQuery(const ContractionHierarchyView&ch, unsigned thread_count = 0):
+                ch(ch), thread_count(RoutingKit2::resolve_thread_count(thread_count)),
+                first_bucket_entry(ch.node_count()+1),
+                thread_bucket_entry(this->thread_count){
+                search.reserve(this->thread_count);
+                for(unsigned i=0; i<this->thread_count; ++i)
+                        search.emplace_back(ch.node_count());
+        }
+
+        // distance[i*target.size()+j] is set to the distance from source[i] to
+        // target[j] or to inf_weight if there is no path. distance must have
+        // source.size()*target.size() elements.
+        void run_and_copy_into(ConstArray source, ConstArray target, RoutingKit2::Span<unsigned>distance){
+                if(distance.size() != static_cast<uint64_t>(source.size())*target.size())
+                        throw std::runtime_error("the distance matrix has the wrong size");
+                if(source.empty() || target.empty())
+                        return;
+
+                unsigned node_count = ch.node_count();
+                for(unsigned x:source)
+                        if(x >= node_count)
+                                throw std::runtime_error("source node out of range");
+                for(unsigned x:target)
+                        if(x >= node_count)
+                                throw std::runtime_error("target node out of range");
+
+                fill_buckets(target);
+                scan_buckets(source, target.size(), distance);
+        }
+
+        std::vector<unsigned>run(ConstArray source, ConstArray target){
+                std::vector<unsigned>distance(static_cast<uint64_t>(source.size())*target.size());
+                run_and_copy_into(source, target, distance);
+                return distance;
+        }
+
+private:
+        template<class F>
+        void run_on_chunks(unsigned element_count, const F&f){
+                std::atomic<unsigned>next_chunk_begin(0);
+                unsigned used_thread_count = RoutingKit2::limit_thread_count(thread_count, element_count, chunk_size);
+                RoutingKit2::run_on_threads(
+                        used_thread_count,
+                        [&](unsigned thread_id){
+                                for(;;){
+                                        unsigned begin = next_chunk_begin.fetch_add(chunk_size);
+                                        if(begin >= element_count)
+                                                break;
+                                        unsigned end = std::min(begin+chunk_size, element_count);
+                                        for(unsigned i=begin; i<end; ++i)
+                                                f(thread_id, i);
+                                }
+                        }
+                );
+        }
+
+        void fill_buckets(ConstArray target){
+                for(auto&e:thread_bucket_entry)
+                        e.clear();
+
+                run_on_chunks(
+                        target.size(),
+                        [&](unsigned thread_id, unsigned j){
+                                auto&out = thread_bucket_entry[thread_id];
+                                search[thread_id].run(
+                                        ch.backward, ch.forward, ch.rank[target[j]],
+                                        [&](unsigned x, unsigned dist){
+                                                out.push_back({x, {j, dist}});
+                                        }
+                                );
+                        }
+                );
+
+                // Group the entries of all threads by node. first_bucket_entry[x]
+                // first counts the entries of x, then holds the end of the bucket
+                // of x and after the entries are placed backwards its begin.
+                unsigned node_count = ch.node_count();
+                std::fill(first_bucket_entry.begin(), first_bucket_entry.end(), 0);
+                for(auto&entries:thread_bucket_entry)
+                        for(auto&e:entries)
+                                ++first_bucket_entry[e.first];
+                for(unsigned x=1; x<=node_count; ++x)
+                        first_bucket_entry[x] += first_bucket_entry[x-1];
+
+                bucket_entry.resize(first_bucket_entry[node_count]);
+                for(auto&entries:thread_bucket_entry)
+                        for(auto&e:entries)
+                                bucket_entry[--first_bucket_entry[e.first]] = e.second;
+        }
+
+        void scan_buckets(ConstArray source, unsigned target_count, RoutingKit2::Span<unsigned>distance){
+                run_on_chunks(
+                        source.size(),
+                        [&](unsigned thread_id, unsigned i){
+                                unsigned*row = distance.begin() + static_cast<uint64_t>(i)*target_count;
+                                std::fill(row, row+target_count, inf_weight);
+                                search[thread_id].run(
+                                        ch.forward, ch.backward, ch.rank[source[i]],
+                                        [&](unsigned x, unsigned dist){
+                                                for(unsigned k=first_bucket_entry[x]; k<first_bucket_entry[x+1]; ++k){
+                                                        unsigned d = dist + bucket_entry[k].dist;
+                                                        unsigned&out = row[bucket_entry[k].target_index];
+                                                        if(d < out)
+                                                                out = d;
+                                                }
+                                        }
+                                );
+                        }
+                );
+        }
+};
+
+// Computes the same potentials as PotUsingCHManyToOneQuery but for up to
+// lane_count targets at once. set_targets runs an upward search in the backward
+// CH from every target and then a single PHAST sweep over all nodes in
+// decreasing rank. Every node stores one distance per target next to each
+// other, so relaxing a CH arc updates all targets with lane_count/8 AVX2
+// instructions if available. select_target chooses the target that eval
+// refers to, which allows running A* for all targets of a batch after one sweep.
+template<unsigned lane_count>
+struct MultiTargetPot{
+        ContractionHierarchyView ch;
+        CHUpwardSearch search;
+        // The distance from the node with rank x to target i is dist[x*lane_count+i].
+        std::vector<unsigned>dist;
+        unsigned target_count;
+        unsigned selected_target;
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                preprocess(node_count, tail, head, lower_bound_weight, ContractionHierarchyView(ch));
+        }
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchyView&ch){
+                this->ch = ch;
+                search = CHUpwardSearch(node_count);
+                dist.resize(static_cast<uint64_t>(node_count)*lane_count);
+                target_count = 0;
+                selected_target = 0;
+        }
+
+        // At most lane_count targets. Selects the first target.
+        void set_targets(ConstArray target_node){
+                if(target_node.size() > lane_count)
+                        throw std::runtime_error("too many targets for one sweep");
+
+                unsigned node_count = ch.node_count();
+                target_count = target_node.size();
+                selected_target = 0;
+
+                std::fill(dist.begin(), dist.end(), inf_weight);
+                for(unsigned i=0; i<target_count; ++i)
+                        search.run(
+                                ch.backward, ch.forward, ch.rank[target_node[i]],
+                                [&](unsigned x, unsigned x_dist){
+                                        dist[static_cast<uint64_t>(x)*lane_count+i] = x_dist;
+                                }
+                        );
+
+                // All distances stay at most inf_weight < 2^31, so the sums
+                // below can not overflow.
+                for(unsigned x=node_count; x-- > 0;){
+                        unsigned*x_dist = dist.data() + static_cast<uint64_t>(x)*lane_count;
+                        unsigned xy_end = ch.forward.first_out[x+1];
+                        #ifdef __AVX2__
+                        if(lane_count % 8 == 0){
+                                const unsigned vector_count = (lane_count+7)/8;
+                                __m256i acc[vector_count];
+                                for(unsigned v=0; v<vector_count; ++v)
+                                        acc[v] = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(x_dist+8*v));
+                                for(unsigned xy = ch.forward.first_out[x]; xy < xy_end; ++xy){
+                                        unsigned xy_weight = ch.forward.weight[xy];
+                                        if(xy_weight >= inf_weight)
+                                                continue;
+                                        const unsigned*y_dist = dist.data() + static_cast<uint64_t>(ch.forward.head[xy])*lane_count;
+                                        __m256i w = _mm256_set1_epi32(xy_weight);
+                                        for(unsigned v=0; v<vector_count; ++v)
+                                                acc[v] = _mm256_min_epu32(acc[v], _mm256_add_epi32(w, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(y_dist+8*v))));
+                                }
+                                for(unsigned v=0; v<vector_count; ++v)
+                                        _mm256_storeu_si256(reinterpret_cast<__m256i*>(x_dist+8*v), acc[v]);
+                                continue;
+                        }
+                        #endif
+                        for(unsigned xy = ch.forward.first_out[x]; xy < xy_end; ++xy){
+                                unsigned xy_weight = ch.forward.weight[xy];
+                                if(xy_weight >= inf_weight)
+                                        continue;
+                                const unsigned*y_dist = dist.data() + static_cast<uint64_t>(ch.forward.head[xy])*lane_count;
+                                for(unsigned i=0; i<lane_count; ++i)
+                                        x_dist[i] = std::min(x_dist[i], xy_weight + y_dist[i]);
+                        }
+                }
+        }
+
+        void select_target(unsigned i){
+                selected_target = i;
+        }
+
+        void set_target(unsigned target_node){
+                set_targets({&target_node, &target_node+1});
+        }
+
+        unsigned eval(unsigned source_node){
+                return dist[static_cast<uint64_t>(ch.rank[source_node])*lane_count+selected_target];
+        }
+};
+
+// Potential for queries that stay in a region, using RPHAST. select_nodes takes
+// the nodes of the region, e.g., the nodes found by GeoIndexFindWithinRadiusQuery,
+// and extracts the part of the forward CH reachable from them by upward arcs.
+// Its nodes get local ids ordered by rank, and its arcs are stored with local
+// heads. set_target then runs an upward search in the backward CH from the
+// target and a PHAST sweep over the extracted nodes only. Its cost depends on
+// the size of the region and not on the size of the graph.
+//
+// eval is exact for every extracted node, which includes the selected ones,
+// and inf_weight for all other nodes. A* with this potential thus only finds
+// shortest paths that do not leave the extracted nodes.
+struct RPHASTPot{
+        ContractionHierarchyView ch;
+        CHUpwardSearch search;
+
+        // The extracted CH. Local ids are ordered by rank.
+        std::vector<unsigned>rank_to_local;
+        std::vector<unsigned>local_to_rank;
+        std::vector<unsigned>local_first_out;
+        std::vector<unsigned>local_head;
+        std::vector<unsigned>local_weight;
+
+        std::vector<unsigned>dist;
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchy&ch){
+                preprocess(node_count, tail, head, lower_bound_weight, ContractionHierarchyView(ch));
+        }
+
+        void preprocess(unsigned node_count, ConstArray tail, ConstArray head, ConstArray lower_bound_weight, const ContractionHierarchyView&ch){
+                this->ch = ch;
+                search = CHUpwardSearch(node_count);
+                rank_to_local.assign(node_count, invalid_id);
+                local_to_rank.clear();
+                local_first_out.assign(1, 0);
+                local_head.clear();
+                local_weight.clear();
+                dist.clear();
+        }
+
+        // Must be called before set_target. Calling it again replaces the region.
+        void select_nodes(ConstArray node){
+                for(unsigned x:local_to_rank)
+                        rank_to_local[x] = invalid_id;
+                local_to_rank.clear();
+
+                // rank_to_local only marks the visited nodes until the local ids
+                // are assigned.
+                const unsigned is_visited = 0;
+                for(unsigned x:node){
+                        unsigned r = ch.rank[x];
+                        if(rank_to_local[r] == invalid_id){
+                                rank_to_local[r] = is_visited;
+                                local_to_rank.push_back(r);
+                        }
+                }
+                for(unsigned i=0; i<local_to_rank.size(); ++i){
+                        unsigned x = local_to_rank[i];
+                        for(unsigned xy = ch.forward.first_out[x]; xy < ch.forward.first_out[x+1]; ++xy){
+                                unsigned y = ch.forward.head[xy];
+                                if(rank_to_local[y] == invalid_id){
+                                        rank_to_local[y] = is_visited;
+                                        local_to_rank.push_back(y);
+                                }
+                        }
+                }
+
+                std::sort(local_to_rank.begin(), local_to_rank.end());
+                unsigned local_node_count = local_to_rank.size();
+                for(unsigned i=0; i<local_node_count; ++i)
+                        rank_to_local[local_to_rank[i]] = i;
+
+                local_first_out.resize(local_node_count+1);
+                local_head.clear();
+                local_weight.clear();
+                local_first_out[0] = 0;
+                for(unsigned i=0; i<local_node_count; ++i){
+                        unsigned x = local_to_rank[i];
+                        for(unsigned xy = ch.forward.first_out[x]; xy < ch.forward.first_out[x+1]; ++xy){
+                                if(ch.forward.weight[xy] < inf_weight){
+                                        local_head.push_back(rank_to_local[ch.forward.head[xy]]);
+                                        local_weight.push_back(ch.forward.weight[xy]);
+                                }
+                        }
+                        local_first_out[i+1] = local_head.size();
+                }
+
+                dist.assign(local_node_count, inf_weight);
+        }
+
+        unsigned get_local_node_count()const{
+                return local_to_rank.size();
+        }
+
+        void set_target(unsigned target_node){
+                unsigned local_node_count = local_to_rank.size();
+
+                std::fill(dist.begin(), dist.end(), inf_weight);
+                search.run(
+                        ch.backward, ch.forward, ch.rank[target_node],
+                        [&](unsigned x, unsigned x_dist){
+                                unsigned local_x = rank_to_local[x];
+                                if(local_x != invalid_id)
+                                        dist[local_x] = x_dist;
+                        }
+                );
+
+                for(unsigned x=local_node_count; x-- > 0;){
+                        unsigned x_dist = dist[x];
+                        for(unsigned xy = local_first_out[x]; xy < local_first_out[x+1]; ++xy){
+                                unsigned d = local_weight[xy] + dist[local_head[xy]];
+                                if(d < x_dist)
+                                        x_dist = d;
+                        }
+                        dist[x] = x_dist;
+                }
+        }
+
+        unsigned eval(unsigned source_node){
+                unsigned local_x = rank_to_local[ch.rank[source_node]];
+                if(local_x == invalid_id)
+                        return inf_weight;
+                return dist[local_x];
+        }
+};
+
+#endif
@@ -0,0 +1,568 @@
+// HTTP service that answers shortest path queries using A* with CH-Potentials.
+//
+// usage: route_server port graph_dir ch_dir [worker_count [admin_port]]
+//
+// graph_dir contains first_out, tail, head, travel_time, latitude and longitude
+// in the RoutingKit format. ch_dir contains the CH of travel_time as written by
+// compute_ch. All of these are mapped into memory and shared read-only by all
+// workers, and by all processes on the host that map the same files.
+//
+// Requests:
+//
+//   POST /route with body "from_lat from_lon to_lat to_lon" (degrees). Both
+//   coordinates are snapped to the closest arc within snap_radius_in_m. The
+//   answer is
+//
+//     travel_time_in_ms <time along the arcs between the snapped points>
+//     path <gpoly of the snapped source, the nodes of the path and the snapped target>
+//     latency_in_us <time needed to answer the request>
+//
+//   POST /matrix with body "source_count target_count" followed by the
+//   coordinates of the sources and then of the targets, each as "lat lon".
+//   The coordinates are snapped as for /route. The answer has the MIME type
+//   application/octet-stream and consists of source_count*target_count
+//   little-endian uint32 travel times in ms ordered by source and then by
+//   target. 4294967295 means that there is no path. Each of source_count and
+//   target_count must be at most max_matrix_side_count and the matrix must
+//   have at most max_matrix_cell_count cells. The matrix uses the travel
+//   times of the CH, i.e., it ignores traffic. A matrix with fewer than
+//   min_parallel_matrix_cell_count cells is computed with the single-threaded
+//   ManyToManyCHQuery of the worker that received the request. Larger
+//   matrices are computed with a ManyToManyCHQuery that is shared by all
+//   workers and that parallelizes over the sources and over the targets using
+//   all cores. Only one large matrix is computed at a time.
+//
+//   POST /traffic with a body of one little-endian uint32 travel time in ms
+//   per arc replaces the travel times used by /route. Travel times below the
+//   ones in graph_dir are raised to them, so the CH stays valid. Routes that
+//   are being computed finish with the travel times they started with. The
+//   answer is "epoch N", where N is the first epoch that uses the new times.
+//   /traffic is not served on port but only on admin_port, which only accepts
+//   connections from 127.0.0.1. Only the admin port accepts request bodies
+//   that are large enough for /traffic; port keeps the default limit. Without
+//   admin_port, the travel times cannot be replaced.
+//
+//   GET /stats returns the number of route and matrix requests, including the
+//   failed ones, and their latency distributions.
+//
+// Worker sizing: A request is answered to completion on the thread of the
+// worker that received it. Until it is answered, all other connections of
+// that worker wait. A route needs milliseconds, but a large matrix needs up to
+// seconds and a worker that waits for the shared matrix query of another
+// worker is blocked as well. Matrix requests thus stall the workers that
+// receive them. Use more workers than matrix requests that are expected to run
+// concurrently, so that the remaining workers keep answering routes. Every
+// worker owns a CHPot, an AStar, a link query and a
+// single-threaded ManyToManyCHQuery. Their state needs about 72 bytes per node
+// and 4 bytes per arc, e.g., about 1.6 GB per worker for a graph with 20M nodes
+// and 40M arcs. The graph, the CH, the geo index and the shared matrix query
+// exist only once. The shared matrix query needs about 18 bytes per node and
+// core. Each set of traffic travel times needs 4 bytes per arc and is shared by
+// all workers. The geo index is built on all cores during startup.
+
+#include "ch_pot.h"
+
+#include <routingkit/timer.h>
+
+#include "../routingkit2/src/http_server.h"
+#include "../routingkit2/src/geo_index.h"
+#include "../routingkit2/src/geo_pos.h"
+#include "../routingkit2/src/gpoly.h"
+#include "../routingkit2/src/map.h"
+
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <iostream>
+#include <limits>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+const unsigned snap_radius_in_m = 200;
+const uint64_t max_matrix_side_count = 10000;
+// The answer needs 4 bytes per cell, i.e., at most 100 MB.
+const uint64_t max_matrix_cell_count = 25000000;
+const uint64_t min_parallel_matrix_cell_count = 1 << 16;
+const uint32_t unreachable_matrix_travel_time = std::numeric_limits<uint32_t>::max();
+
+// Latency histogram shared by all workers. Bucket i counts the requests that
+// needed less than 2^i microseconds.
+struct LatencyStatistic{
+        static const unsigned bucket_count = 40;
+        std::atomic<unsigned long long>request_count;
+        std::atomic<unsigned long long>total_latency_in_us;
+        std::atomic<unsigned long long>bucket[bucket_count];
+
+        LatencyStatistic():request_count(0), total_latency_in_us(0){
+                for(auto&b:bucket)
+                        b.store(0);
+        }
+
+        void add(long long latency_in_us){
+                unsigned i = 0;
+                while(i+1 < bucket_count && (1ull << i) <= static_cast<unsigned long long>(latency_in_us))
+                        ++i;
+                bucket[i].fetch_add(1, std::memory_order_relaxed);
+                request_count.fetch_add(1, std::memory_order_relaxed);
+                total_latency_in_us.fetch_add(latency_in_us, std::memory_order_relaxed);
+        }
+
+        // An upper bound on the latency of the given fraction of requests.
+        unsigned long long get_percentile_bound_in_us(double fraction)const{
+                unsigned long long total = 0;
+                for(auto&b:bucket)
+                        total += b.load();
+                unsigned long long seen = 0;
+                for(unsigned i=0; i<bucket_count; ++i){
+                        seen += bucket[i].load();
+                        if(seen > 0 && seen >= fraction*total)
+                                return 1ull << i;
+                }
+                return 0;
+        }
+};
+
+// Measures the time from its construction to its destruction and adds it to a
+// LatencyStatistic. Requests are thus also counted if they fail.
+class LatencyTimer{
+public:
+        explicit LatencyTimer(LatencyStatistic&latency):latency(latency), start_time(get_micro_time()){}
+
+        long long get_elapsed_time_in_us()const{
+                return get_micro_time() - start_time;
+        }
+
+        ~LatencyTimer(){
+                latency.add(get_elapsed_time_in_us());
+        }
+
+private:
+        LatencyStatistic&latency;
+        long long start_time;
+};
+
+// The ManyToManyCHQuery for large matrices. It uses all cores and is shared by
+// all workers.
+struct SharedManyToManyCHQuery{
+        std::mutex lock;
+        ManyToManyCHQuery query;
+
+        explicit SharedManyToManyCHQuery(const ContractionHierarchyView&ch):
+                query(ch, 0){}
+};
+
+struct ServerData{
+        unsigned node_count;
+        ConstArray first_out, tail, head, travel_time;
+        ContractionHierarchyView ch;
+        // The CH is built for free_flow_weight. route uses traffic_weight.
+        const QueryWeight*free_flow_weight;
+        QueryWeightStore*traffic_weight;
+
+        RoutingKit2::ConstRefLinkShapes link_shapes;
+        RoutingKit2::ConstRefGeoIndex link_geo_index;
+
+        SharedManyToManyCHQuery*large_matrix_query;
+
+        LatencyStatistic*route_latency;
+        LatencyStatistic*matrix_latency;
+};
+
+struct WorkerData{
+        CHPot pot;
+        PinnedQueryWeight traffic_weight;
+        AStar<PinnedQueryWeight, CHPot> a_star;
+        RoutingKit2::LinkGeoIndexFindWithinRadiusQuery link_query;
+        ManyToManyCHQuery many_to_many;
+
+        explicit WorkerData(const ServerData&server_data):
+                a_star(server_data.first_out, server_data.head, traffic_weight, pot),
+                link_query(server_data.link_shapes, server_data.link_geo_index),
+                many_to_many(server_data.ch, 1){
+                pot.preprocess(server_data.node_count, server_data.tail, server_data.head, server_data.travel_time, server_data.ch);
+        }
+};
+
+// The arcs are the links of the geo index. They have no shape points.
+RoutingKit2::VecLinkShapes build_arc_shapes(ConstArray tail, ConstArray head, const RoutingKit2::FileArray<float>&latitude, const RoutingKit2::FileArray<float>&longitude){
+        unsigned node_count = latitude.size();
+        unsigned arc_count = head.size();
+
+        RoutingKit2::VecLinkShapes shapes(node_count, arc_count, 0);
+        for(unsigned x=0; x<node_count; ++x)
+                shapes.node_pos[x] = RoutingKit2::LatLon::from_lat_lon(latitude[x], longitude[x]);
+        for(unsigned xy=0; xy<arc_count; ++xy){
+                shapes.link_tail[xy] = tail[xy];
+                shapes.link_head[xy] = head[xy];
+                shapes.link_length_in_cm[xy] = RoutingKit2::compute_distance_in_cm(
+                        RoutingKit2::GeoPos(shapes.node_pos[tail[xy]]),
+                        RoutingKit2::GeoPos(shapes.node_pos[head[xy]])
+                );
+        }
+        std::fill(shapes.first_shape_pos_of_link.begin(), shapes.first_shape_pos_of_link.end(), 0);
+        return shapes;
+}
+
+struct SnappedPos{
+        unsigned arc;
+        RoutingKit2::GeoPos pos;
+        unsigned offset_in_cm;
+};
+
+SnappedPos snap(const ServerData&server_data, WorkerData&worker_data, RoutingKit2::LatLon p){
+        RoutingKit2::GeoPos center(p);
+
+        SnappedPos best;
+        best.arc = invalid_id;
+        uint64_t best_distance_in_sqr_cm = std::numeric_limits<uint64_t>::max();
+
+        worker_data.link_query.start(center, snap_radius_in_m*100);
+        while(auto arc = worker_data.link_query.next()){
+                auto q = find_closest_point_offset_and_distance_on_dlink(server_data.link_shapes, RoutingKit2::link_to_forward_dlink(*arc), center);
+                if(q.distance_in_sqr_cm < best_distance_in_sqr_cm || (q.distance_in_sqr_cm == best_distance_in_sqr_cm && *arc < best.arc)){
+                        best_distance_in_sqr_cm = q.distance_in_sqr_cm;
+                        best.arc = *arc;
+                        best.pos = q.pos;
+                        best.offset_in_cm = std::min(q.offset_in_cm, server_data.link_shapes.link_length_in_cm[*arc]);
+                }
+        }
+
+        if(best.arc == invalid_id){
+                std::ostringstream msg;
+                msg << "no road within " << snap_radius_in_m << "m of " << p.lat() << ' ' << p.lon();
+                throw std::runtime_error(msg.str());
+        }
+        return best;
+}
+
+// The travel time along the first offset_in_cm of the arc.
+template<class Weight>
+unsigned long long get_partial_travel_time(const ServerData&server_data, const Weight&weight, unsigned arc, unsigned offset_in_cm){
+        unsigned long long length_in_cm = server_data.link_shapes.link_length_in_cm[arc];
+        if(length_in_cm == 0)
+                return 0;
+        return static_cast<unsigned long long>(weight.eval(arc)) * offset_in_cm / length_in_cm;
+}
+
+// Whether to is reached by following the arc of from without passing a node.
+bool is_on_same_arc_behind(const SnappedPos&from, const SnappedPos&to){
+        return from.arc == to.arc && from.offset_in_cm <= to.offset_in_cm;
+}
+
+template<class Weight>
+unsigned long long get_travel_time_on_same_arc(const ServerData&server_data, const Weight&weight, const SnappedPos&from, const SnappedPos&to){
+        return
+                get_partial_travel_time(server_data, weight, to.arc, to.offset_in_cm) -
+                get_partial_travel_time(server_data, weight, from.arc, from.offset_in_cm);
+}
+
+// node_dist is the travel time from the head of the arc of from to the tail of
+// the arc of to.
+template<class Weight>
+unsigned long long get_travel_time_via_nodes(const ServerData&server_data, const Weight&weight, const SnappedPos&from, const SnappedPos&to, unsigned node_dist){
+        return
+                weight.eval(from.arc) - get_partial_travel_time(server_data, weight, from.arc, from.offset_in_cm) +
+                node_dist +
+                get_partial_travel_time(server_data, weight, to.arc, to.offset_in_cm);
+}
+
+void serve_route(int worker_id, const ServerData&server_data, WorkerData&worker_data, const std::string&body, RoutingKit2::http::Response&res){
+        LatencyTimer timer(*server_data.route_latency);
+
+        double from_lat, from_lon, to_lat, to_lon;
+        {
+                std::istringstream in(body);
+                if(!(in >> from_lat >> from_lon >> to_lat >> to_lon))
+                        throw std::runtime_error("expected \"from_lat from_lon to_lat to_lon\" as body");
+        }
+
+        SnappedPos from = snap(server_data, worker_data, RoutingKit2::LatLon::from_lat_lon(from_lat, from_lon));
+        SnappedPos to = snap(server_data, worker_data, RoutingKit2::LatLon::from_lat_lon(to_lat, to_lon));
+
+        QueryWeightPin pin(*server_data.traffic_weight, worker_id, worker_data.traffic_weight);
+        const PinnedQueryWeight&weight = worker_data.traffic_weight;
+
+        unsigned long long travel_time;
+        std::vector<RoutingKit2::LatLon>path;
+        path.push_back(RoutingKit2::LatLon(from.pos));
+
+        if(is_on_same_arc_behind(from, to)){
+                travel_time = get_travel_time_on_same_arc(server_data, weight, from, to);
+        }else{
+                // Leave the source arc at its head and enter the target arc at its tail.
+                unsigned source_node = server_data.head[from.arc];
+                unsigned target_node = server_data.tail[to.arc];
+
+                worker_data.pot.set_target(target_node);
+                unsigned dist = worker_data.a_star.run(source_node, target_node);
+                if(dist == inf_weight){
+                        res.status = 404;
+                        res.body = "no path\n";
+                        res.mime_type = "text/plain";
+                        return;
+                }
+
+                travel_time = get_travel_time_via_nodes(server_data, weight, from, to, dist);
+
+                for(unsigned x:worker_data.a_star.get_node_path(target_node))
+                        path.push_back(server_data.link_shapes.node_pos[x]);
+        }
+
+        path.push_back(RoutingKit2::LatLon(to.pos));
+
+        std::ostringstream out;
+        out
+                << "travel_time_in_ms " << travel_time << '\n'
+                << "path " << RoutingKit2::encode_gpoly_from_span(path) << '\n'
+                << "latency_in_us " << timer.get_elapsed_time_in_us() << '\n';
+        res.body = out.str();
+        res.mime_type = "text/plain";
+}
+
+void serve_matrix(const ServerData&server_data, WorkerData&worker_data, const std::string&body, RoutingKit2::http::Response&res){
+        LatencyTimer timer(*server_data.matrix_latency);
+
+        std::istringstream in(body);
+        uint64_t source_count, target_count;
+        if(!(in >> source_count >> target_count))
+                throw std::runtime_error("expected \"source_count target_count\" at the begin of the body");
+        // The counts are checked before anything of their size is allocated.
+        // Every coordinate "lat lon" needs at least four characters including
+        // the whitespace in front of it.
+        if(source_count > max_matrix_side_count || target_count > max_matrix_side_count)
+                throw std::runtime_error("there are more than " + std::to_string(max_matrix_side_count) + " sources or targets");
+        if(source_count + target_count > body.size()/4)
+                throw std::runtime_error("the body is too short for source_count + target_count coordinates");
+        if(source_count*target_count > max_matrix_cell_count)
+                throw std::runtime_error("the matrix has more than " + std::to_string(max_matrix_cell_count) + " cells");
+
+        auto read_and_snap = [&](uint64_t count){
+                std::vector<SnappedPos>pos(count);
+                for(auto&p:pos){
+                        double lat, lon;
+                        if(!(in >> lat >> lon))
+                                throw std::runtime_error("expected source_count + target_count coordinates \"lat lon\"");
+                        p = snap(server_data, worker_data, RoutingKit2::LatLon::from_lat_lon(lat, lon));
+                }
+                return pos;
+        };
+        std::vector<SnappedPos>from = read_and_snap(source_count);
+        std::vector<SnappedPos>to = read_and_snap(target_count);
+
+        std::vector<unsigned>source_node(source_count), target_node(target_count);
+        for(uint64_t i=0; i<source_count; ++i)
+                source_node[i] = server_data.head[from[i].arc];
+        for(uint64_t j=0; j<target_count; ++j)
+                target_node[j] = server_data.tail[to[j].arc];
+
+        std::vector<unsigned>node_dist(source_count*target_count);
+        if(source_count*target_count < min_parallel_matrix_cell_count){
+                worker_data.many_to_many.run_and_copy_into(source_node, target_node, node_dist);
+        }else{
+                std::lock_guard<std::mutex>guard(server_data.large_matrix_query->lock);
+                server_data.large_matrix_query->query.run_and_copy_into(source_node, target_node, node_dist);
+        }
+
+        res.body.resize(4*source_count*target_count);
+        char*out = &res.body[0];
+        for(uint64_t i=0; i<source_count; ++i){
+                for(uint64_t j=0; j<target_count; ++j){
+                        unsigned long long travel_time;
+                        unsigned d = node_dist[i*target_count+j];
+                        if(is_on_same_arc_behind(from[i], to[j]))
+                                travel_time = get_travel_time_on_same_arc(server_data, *server_data.free_flow_weight, from[i], to[j]);
+                        else if(d == inf_weight)
+                                travel_time = unreachable_matrix_travel_time;
+                        else
+                                travel_time = std::min<unsigned long long>(get_travel_time_via_nodes(server_data, *server_data.free_flow_weight, from[i], to[j], d), unreachable_matrix_travel_time-1);
+
+                        for(unsigned b=0; b<4; ++b)
+                                *out++ = static_cast<char>((travel_time >> (8*b)) & 0xFF);
+                }
+        }
+        res.mime_type = "application/octet-stream";
+}
+
+void serve_traffic(const ServerData&server_data, const std::string&body, RoutingKit2::http::Response&res){
+        unsigned arc_count = server_data.head.size();
+        if(body.size() != 4ull*arc_count)
+                throw std::runtime_error("expected " + std::to_string(arc_count) + " little-endian uint32 travel times as body");
+
+        std::vector<unsigned>weight(arc_count);
+        const unsigned char*in = reinterpret_cast<const unsigned char*>(body.data());
+        for(unsigned xy=0; xy<arc_count; ++xy, in += 4)
+                weight[xy] = in[0] | (in[1] << 8) | (in[2] << 16) | (static_cast<unsigned>(in[3]) << 24);
+
+        uint64_t epoch = server_data.traffic_weight->publish(std::move(weight));
+        res.body = "epoch " + std::to_string(epoch) + "\n";
+        res.mime_type = "text/plain";
+}
+
+void write_latency_statistic(std::ostream&out, const std::string&prefix, const LatencyStatistic&latency){
+        unsigned long long request_count = latency.request_count.load();
+        out << prefix << "request_count " << request_count << '\n';
+        if(request_count != 0){
+                out
+                        << prefix << "mean_latency_in_us " << latency.total_latency_in_us.load() / request_count << '\n'
+                        << prefix << "p50_latency_bound_in_us " << latency.get_percentile_bound_in_us(0.5) << '\n'
+                        << prefix << "p99_latency_bound_in_us " << latency.get_percentile_bound_in_us(0.99) << '\n'
+                        << prefix << "p999_latency_bound_in_us " << latency.get_percentile_bound_in_us(0.999) << '\n';
+        }
+}
+
+void serve_stats(const ServerData&server_data, RoutingKit2::http::Response&res){
+        std::ostringstream out;
+        write_latency_statistic(out, "route_", *server_data.route_latency);
+        write_latency_statistic(out, "matrix_", *server_data.matrix_latency);
+        res.body = out.str();
+        res.mime_type = "text/plain";
+}
+
+int main(int argc, char*argv[]){
+        try{
+                if(argc < 4 || argc > 6){
+                        cout << "usage: " << argv[0] << " port graph_dir ch_dir [worker_count [admin_port]]" << endl;
+                        return 1;
+                }
+
+                RoutingKit2::http::Config config;
+                config.port = std::stoi(argv[1]);
+                if(argc >= 5)
+                        config.worker_count = std::stoi(argv[4]);
+
+                std::string graph_dir = std::string(argv[2]) + "/";
+                std::string ch_dir = std::string(argv[3]) + "/";
+
+                cout << "Map graph and CH" << endl;
+                RoutingKit2::FileArray<unsigned>mapped_first_out(graph_dir+"first_out");
+                RoutingKit2::FileArray<unsigned>mapped_tail(graph_dir+"tail");
+                RoutingKit2::FileArray<unsigned>mapped_head(graph_dir+"head");
+                RoutingKit2::FileArray<unsigned>mapped_travel_time(graph_dir+"travel_time");
+                RoutingKit2::FileArray<float>latitude(graph_dir+"latitude");
+                RoutingKit2::FileArray<float>longitude(graph_dir+"longitude");
+                MappedContractionHierarchy mapped_ch(ch_dir);
+
+                ServerData server_data;
+                server_data.first_out = as_const_array(mapped_first_out);
+                server_data.tail = as_const_array(mapped_tail);
+                server_data.head = as_const_array(mapped_head);
+                server_data.travel_time = as_const_array(mapped_travel_time);
+                server_data.ch = mapped_ch.as_view();
+                server_data.node_count = server_data.first_out.size()-1;
+
+                if(server_data.ch.node_count() != server_data.node_count)
+                        throw std::runtime_error("The CH in " + ch_dir + " does not match the graph");
+                if(latitude.size() != server_data.node_count || longitude.size() != server_data.node_count)
+                        throw std::runtime_error("latitude and longitude must have one entry per node");
+
+                // A /traffic body has 4 bytes per arc and is usually larger than
+                // the default body size limit. Only the admin server accepts it,
+                // so that public clients cannot make the server buffer bodies of
+                // this size.
+                RoutingKit2::http::Config admin_config;
+                bool has_admin_server = argc == 6;
+                if(has_admin_server){
+                        uint64_t traffic_body_size = 4ull*server_data.head.size();
+                        if(traffic_body_size > static_cast<uint64_t>(std::numeric_limits<int>::max()))
+                                throw std::runtime_error("The graph has too many arcs for a /traffic request body");
+
+                        admin_config.port = std::stoi(argv[5]);
+                        admin_config.bind_address = "127.0.0.1";
+                        admin_config.worker_count = 1;
+                        admin_config.max_connection_count_per_worker = 4;
+                        admin_config.install_int_signal_handler = false;
+                        admin_config.max_request_body_size = std::max<int>(admin_config.max_request_body_size, traffic_body_size);
+                }
+
+                QueryWeight free_flow_weight(server_data.travel_time, 0);
+                server_data.free_flow_weight = &free_flow_weight;
+                QueryWeightStore traffic_weight(server_data.travel_time, 0, config.worker_count);
+                server_data.traffic_weight = &traffic_weight;
+
+                cout << "Build geo index" << endl;
+                long long timer = -get_micro_time();
+                RoutingKit2::VecLinkShapes arc_shapes = build_arc_shapes(server_data.tail, server_data.head, latitude, longitude);
+                RoutingKit2::VecGeoIndex arc_geo_index = RoutingKit2::build_link_geo_index(arc_shapes.as_cref(), 0);
+                timer += get_micro_time();
+                cout << "Geo index time : " << timer << " musec" << endl;
+
+                server_data.link_shapes = arc_shapes.as_cref();
+                server_data.link_geo_index = arc_geo_index.as_cref();
+
+                SharedManyToManyCHQuery large_matrix_query(server_data.ch);
+                server_data.large_matrix_query = &large_matrix_query;
+
+                LatencyStatistic route_latency, matrix_latency;
+                server_data.route_latency = &route_latency;
+                server_data.matrix_latency = &matrix_latency;
+
+                auto answer = [](
+                        int worker_id, int,
+                        const ServerData&server_data, WorkerData&worker_data,
+                        const RoutingKit2::http::Request&req, RoutingKit2::http::Response&res
+                ){
+                        if(req.resource == "/route"){
+                                serve_route(worker_id, server_data, worker_data, req.body, res);
+                        }else if(req.resource == "/matrix"){
+                                serve_matrix(server_data, worker_data, req.body, res);
+                        }else if(req.resource == "/stats"){
+                                serve_stats(server_data, res);
+                        }else if(req.resource == "/traffic"){
+                                throw std::runtime_error("/traffic is only served on the admin port");
+                        }else{
+                                throw std::runtime_error("Unknown resource");
+                        }
+                };
+
+                auto answer_admin = [&](int, int, const RoutingKit2::http::Request&req, RoutingKit2::http::Response&res){
+                        if(req.resource == "/traffic"){
+                                serve_traffic(server_data, req.body, res);
+                        }else{
+                                throw std::runtime_error("Unknown resource");
+                        }
+                };
+
+                // If the admin server fails, for example because admin_port is in
+                // use, then the public server is stopped as well.
+                std::atomic<bool>stop_servers(false);
+                config.stop_flag = &stop_servers;
+                admin_config.stop_flag = &stop_servers;
+                std::exception_ptr admin_error;
+                std::thread admin_server;
+                if(has_admin_server){
+                        cout << "Start admin server on 127.0.0.1:" << admin_config.port << endl;
+                        admin_server = std::thread([&]{
+                                try{
+                                        RoutingKit2::http::run(admin_config, answer_admin);
+                                }catch(...){
+                                        admin_error = std::current_exception();
+                                        stop_servers.store(true);
+                                }
+                        });
+                }
+
+                cout << "Start " << config.worker_count << " workers" << endl;
+                try{
+                        RoutingKit2::http::run_with_worker_data<WorkerData>(config, server_data, answer, []{cout << "Server is running." << endl;});
+                }catch(...){
+                        stop_servers.store(true);
+                        if(admin_server.joinable())
+                                admin_server.join();
+                        throw;
+                }
+                stop_servers.store(true);
+                if(admin_server.joinable())
+                        admin_server.join();
+                if(admin_error)
+                        std::rethrow_exception(admin_error);
+        }catch(std::exception&err){
+                cerr << "Exception: " << err.what() << endl;
+                return 1;
+        }
+}